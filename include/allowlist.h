@@ -0,0 +1,16 @@
+// Allowlist header for MakerPass firmware
+// Offline member list synchronised from the server
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Function declarations
+void initAllowlist();
+bool allowlistContains(uint8_t resource, uint32_t code);
+uint32_t allowlistVersion(uint8_t resource);
+uint32_t allowlistCount(uint8_t resource);
+void requestAllowlistSync();
+void handleAllowlistFull(JsonDocument &doc);
+void handleAllowlistDelta(JsonDocument &doc);
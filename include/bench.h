@@ -0,0 +1,25 @@
+// Benchmark header for MakerPass firmware
+// Timing of the hot paths: on the device from the serial console, and
+// on the host by the bench program (src/host/bench), which compares
+// the results with bench/baseline.json
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// One measurement: nanoseconds per sample (one call, or the batch of
+// calls the name ends in), or a count per call such as pixels or SPI
+// bytes reaching the panel
+struct BenchResult {
+  const char *name;
+  uint32_t value;
+  const char *unit;
+};
+
+static const size_t BENCH_COUNT = 10;
+
+// Function declarations
+void runBenchmarks(BenchResult results[BENCH_COUNT]);
+void benchResultsJson(const BenchResult *results, size_t count, JsonObject out);
+void printBenchmarks();
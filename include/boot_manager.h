@@ -0,0 +1,22 @@
+// Boot management header for MakerPass firmware
+// Non-blocking start-up sequence and time-to-ready logging
+
+#pragma once
+
+#include <Arduino.h>
+
+// Points on the way to ready, each logged once with its time since
+// power-on
+enum BootMilestone : uint8_t {
+  BOOT_ACCESS_LIVE,        // cards and master key work
+  BOOT_STORAGE_READY,      // allowlist and journal loaded
+  BOOT_WIFI_UP,
+  BOOT_CLOCK_SET,
+  BOOT_SERVER_CONNECTED,
+  BOOT_AUTHENTICATED,
+  BOOT_MILESTONE_COUNT
+};
+
+// Function declarations
+void markBootMilestone(BootMilestone milestone);
+void handleBoot();
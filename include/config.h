@@ -12,6 +12,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include "pins.h"
 
 // WiFi credentials.  Replace these with the SSID and
 // password for the local network. Note: ESP32 does not
@@ -19,6 +20,20 @@
 static const char* WIFI_SSID     = "your-ssid";
 static const char* WIFI_PASSWORD = "your-password";
 
+// Networks the device may join, most preferred first.  Access points
+// sharing an SSID need only one entry; the device roams between them
+// on signal strength.  Add further SSIDs (e.g. a fallback network)
+// below the first entry.
+struct WiFiNetwork {
+  const char* ssid;
+  const char* password;
+};
+static const WiFiNetwork WIFI_NETWORKS[] = {
+  {WIFI_SSID, WIFI_PASSWORD},
+  // {"fallback-ssid", "fallback-password"},
+};
+static const uint8_t WIFI_NETWORK_COUNT = sizeof(WIFI_NETWORKS) / sizeof(WIFI_NETWORKS[0]);
+
 // WebSocket server details. If using the makerpass dashboard,
 // just use the URL that points to the home page. Do not include
 // the "wss://" prefix and does not work with unsecure connections.
@@ -27,6 +42,16 @@ static const char* WS_HOST = "yourdomain.com";
 static const uint16_t WS_PORT = 443;
 static const char* WS_PATH = "/ws";
 
+// Optional server key pin: the base64 SHA-256 of the server
+// certificate's SubjectPublicKeyInfo, as printed by
+//   openssl s_client -connect yourdomain.com:443 </dev/null |
+//   openssl x509 -pubkey -noout | openssl pkey -pubin -outform der |
+//   openssl dgst -sha256 -binary | base64
+// Only a server holding that key is accepted; the certificate chain
+// is not walked.  The pin survives certificate renewals that keep the
+// key.  Leave empty to connect without verifying the server.
+static const char* WS_PIN_SPKI = "";
+
 // API key used for authenticating this device. The makerpass
 // dashboard generates this keys; Never commit real keys to a
 // public repository, the below key is just an example.
@@ -44,6 +69,33 @@ static const char* RESOURCE_ID = "ABCD1234";
 // installation.
 static const char* DEVICE_TYPE = "machine";
 
+// Resources served by this controller.  Each is a Wiegand reader and
+// relay pair with its own dashboard id and device type, and each keeps
+// its own session; a door and two machines on the same wall can share
+// one board and one server connection.  The first entry is the
+// controller's own identity towards the server.  Pins are from pins.h;
+// use PIN_NONE for a reader LED or beeper that is not wired.  At most
+// MAX_RESOURCES entries.
+struct ResourceConfig {
+  const char* id;
+  const char* type;        // "door" or "machine"
+  uint8_t pinD0;
+  uint8_t pinD1;
+  uint8_t pinRelay;
+  uint8_t pinReaderLed;
+  uint8_t pinReaderBeep;
+};
+static const ResourceConfig RESOURCES[] = {
+  {RESOURCE_ID, DEVICE_TYPE, PIN_RFID_D0, PIN_RFID_D1, PIN_RELAY, PIN_RFID_LED, PIN_RFID_BEEP},
+#ifdef MAKERPASS_SIM_DOOR
+  // The host simulator ([env:native]) runs a machine and a door
+  {"EFGH5678", "door", PIN_RFID2_D0, PIN_RFID2_D1, PIN_RELAY2, PIN_RFID2_LED, PIN_NONE},
+#else
+  // {"EFGH5678", "door", PIN_RFID2_D0, PIN_RFID2_D1, PIN_RELAY2, PIN_RFID2_LED, PIN_NONE},
+#endif
+};
+static const uint8_t RESOURCE_COUNT = sizeof(RESOURCES) / sizeof(RESOURCES[0]);
+
 // Duration (in milliseconds) to energise the relay when
 // granting door access. This is ignored for machine
 // devices where the relay remains on for the duration of
@@ -20,6 +20,15 @@ static const uint16_t BOTTOM_STATUS_BAR_H = 20;  // Bottom bar for connection st
 static const uint16_t MESSAGE_AREA_Y      = TOP_STATUS_BAR_H;
 static const uint16_t MESSAGE_AREA_H      = SCREEN_HEIGHT - TOP_STATUS_BAR_H - BOTTOM_STATUS_BAR_H;
 
+// Text placement.  Positions are derived from the font metrics in
+// text_layout.cpp; text wider than the screen less both margins is
+// ellipsized.
+static const uint16_t TEXT_MARGIN_X    = 10;
+static const uint16_t TEXT_MAX_WIDTH   = SCREEN_WIDTH - 2 * TEXT_MARGIN_X;
+static const uint16_t MESSAGE_LINE_GAP = 9;   // between the two message lines
+static const uint16_t STATUS_DOT_R     = 4;   // connection indicator radius
+static const uint8_t  TEXT_LAYOUT_CACHE_SIZE = 4;
+
 // Colours used by the UI (16‑bit 565 format).  The TFT_eSPI library
 // defines a palette of colours such as TFT_BLACK and TFT_WHITE.  We
 // create a few more for convenience.
@@ -38,5 +47,235 @@ static const uint16_t COLOR_MSG_ERR   = TFT_RED;
 static const unsigned long PING_INTERVAL_MS = 300000; // 5 minutes (but server initiates pings)
 static const unsigned long PONG_TIMEOUT_MS  = 960000; // 16 minutes (slightly longer than server's 15-min timeout)
 
-// Card presence tracking for require_card_present
-static const unsigned long CARD_PRESENT_TIMEOUT_MS = 2000; // treat card as removed after 2 s
+// WebSocket reconnects.  Each attempt waits a uniformly random time up
+// to min(WS_BACKOFF_MAX_MS, WS_BACKOFF_BASE_MS * 2^failures), so a
+// fleet that lost the server together comes back spread out.  A
+// connection that stays authenticated for WS_BACKOFF_RESET_MS clears
+// the failure count.  An attempt fails as soon as its TCP/TLS connect
+// does, or when it has not upgraded within WS_CONNECT_TIMEOUT_MS.
+static const unsigned long WS_BACKOFF_BASE_MS    = 1000;
+static const unsigned long WS_BACKOFF_MAX_MS     = 120000;  // 2 minutes
+static const unsigned long WS_BACKOFF_RESET_MS   = 60000;
+static const unsigned long WS_CONNECT_TIMEOUT_MS = 15000;
+// Ceiling on a server retry_after hint
+static const unsigned long WS_RETRY_AFTER_MAX_MS = 3600000; // 1 hour
+
+// Temporary messages stay up for TEMP_MESSAGE_DURATION_MS, or for at
+// least TEMP_MESSAGE_MIN_MS when others are waiting.  Queued messages
+// older than TEMP_MESSAGE_MAX_AGE_MS are stale and dropped unseen.
+static const unsigned long TEMP_MESSAGE_DURATION_MS = 3000;
+static const unsigned long TEMP_MESSAGE_MIN_MS      = 1000;
+static const unsigned long TEMP_MESSAGE_MAX_AGE_MS  = 6000;
+static const uint8_t       UI_MESSAGE_QUEUE_SIZE    = 4;
+
+// Priorities for temporary messages.  A higher priority message
+// replaces a lower priority one immediately instead of queueing.
+static const uint8_t UI_PRIORITY_LOW    = 0;
+static const uint8_t UI_PRIORITY_NORMAL = 1;
+static const uint8_t UI_PRIORITY_HIGH   = 2;
+
+// WiFi reconnects.  The first attempt after a drop goes straight to
+// the last access point (BSSID and channel kept in NVS) and is given
+// WIFI_FAST_ATTEMPT_MS; later attempts scan and pick the best
+// configured network, each given WIFI_ATTEMPT_TIMEOUT_MS.  An attempt
+// is never interrupted while it is still running.
+static const unsigned long WIFI_FAST_ATTEMPT_MS    = 3000;
+static const unsigned long WIFI_ATTEMPT_TIMEOUT_MS = 10000;
+
+// Roaming: while the signal is below WIFI_ROAM_RSSI_DBM the device
+// scans every WIFI_ROAM_CHECK_MS and moves to an access point at least
+// WIFI_ROAM_HYSTERESIS_DB stronger, before the link actually drops
+static const unsigned long WIFI_ROAM_CHECK_MS   = 15000;
+static const int8_t        WIFI_ROAM_RSSI_DBM   = -72;
+static const uint8_t       WIFI_ROAM_HYSTERESIS_DB = 8;
+
+// Card presence tracking for require_card_present.  A card resting on
+// the reader is read continuously; repeat reads of the session's card
+// only refresh its presence.  A gap in reads longer than
+// CARD_DROPOUT_MS pauses the heartbeat, and the session ends only once
+// the gap exceeds CARD_PRESENT_TIMEOUT_MS.
+static const unsigned long CARD_PRESENT_TIMEOUT_MS = 2000;  // treat card as removed after 2 s
+static const unsigned long CARD_DROPOUT_MS         = 500;
+static const unsigned long CARD_PRESENCE_HEARTBEAT_MS = 60000; // card_present to the server
+
+// Boot: time allowed for the first WiFi association before the offline
+// screen is shown (association continues in the background), and the
+// WiFi LED blink period while waiting
+static const unsigned long BOOT_WIFI_TIMEOUT_MS = 20000;
+static const unsigned long BOOT_LED_BLINK_MS    = 500;
+
+// ---------------------------------------------------------------------------
+// Resources
+// ---------------------------------------------------------------------------
+
+// Reader/relay pairs one controller can serve (RESOURCES in config.h).
+// Each has its own Wiegand decoder, session, timers and allowlist.
+static const uint8_t MAX_RESOURCES = 4;
+
+// ---------------------------------------------------------------------------
+// Grant cache
+// ---------------------------------------------------------------------------
+
+// Number of recent grants kept in RAM.  The least recently used entry
+// is evicted when the cache is full.
+static const uint8_t GRANT_CACHE_SIZE = 32;
+
+// Upper bound on the server-supplied cache_ttl (seconds) so that a bad
+// value cannot keep a revoked card working indefinitely.
+static const uint32_t GRANT_CACHE_MAX_TTL_S = 86400; // 24 hours
+
+// ---------------------------------------------------------------------------
+// Offline allowlist
+// ---------------------------------------------------------------------------
+
+// Maximum number of member cards held for offline decisions.  The
+// sorted hash index and Bloom filter live in PSRAM when available.
+static const uint32_t ALLOWLIST_MAX_ENTRIES = 16384;
+
+// Bloom filter size (bits, power of two) and probe count.  At 10k
+// members this gives a false positive rate of roughly 0.05 %, and a
+// positive is always confirmed against the sorted index.
+static const uint32_t ALLOWLIST_BLOOM_BITS   = 262144; // 32 KB
+static const uint8_t  ALLOWLIST_BLOOM_PROBES = 4;
+
+// Codes per allowlist_full frame requested from the server.  A JSON
+// chunk must parse within JSON_ARENA_SIZE; see there.
+static const uint16_t ALLOWLIST_SYNC_CHUNK = 128;
+
+// LittleFS file holding the persisted allowlist of the first resource;
+// further resources use ALLOWLIST_FILE_FORMAT with their index
+static const char* ALLOWLIST_FILE        = "/allowlist.bin";
+static const char* ALLOWLIST_FILE_FORMAT = "/allowlist%u.bin";
+static const char* ALLOWLIST_TMP_FILE    = "/allowlist.tmp";
+
+// ---------------------------------------------------------------------------
+// Tasks
+// ---------------------------------------------------------------------------
+
+// The access task (Arduino loop()) sleeps until its next timer, a
+// Wiegand edge or a command from the network task, all of which wake
+// it directly.  This only caps the sleep.
+static const uint32_t ACCESS_IDLE_MAX_MS = 1000;
+static const uint32_t NETWORK_TASK_PERIOD_MS = 2;
+static const uint32_t UI_TASK_PERIOD_MS      = 20;
+
+// Priorities: relay control outranks everything, drawing runs last
+static const UBaseType_t ACCESS_TASK_PRIORITY  = 3;
+static const UBaseType_t NETWORK_TASK_PRIORITY = 2;
+static const UBaseType_t UI_TASK_PRIORITY      = 1;
+static const UBaseType_t LOG_TASK_PRIORITY     = 0;  // shares time with idle
+
+// Stack sizes in bytes; TLS needs a generous network stack
+static const uint32_t NETWORK_TASK_STACK = 12288;
+static const uint32_t UI_TASK_STACK      = 4096;
+static const uint32_t LOG_TASK_STACK     = 3072;
+
+// Queue depths (powers of two)
+static const uint16_t ACCESS_QUEUE_DEPTH = 16;
+static const uint16_t NET_QUEUE_DEPTH    = 16;
+static const uint16_t UI_QUEUE_DEPTH     = 16;
+static const uint16_t LOG_QUEUE_DEPTH    = 32;   // records per producing task
+
+// A full UI queue is logged at most this often per producing task
+static const uint32_t UI_DROP_LOG_INTERVAL_MS = 1000;
+
+// ---------------------------------------------------------------------------
+// Inbound messages
+// ---------------------------------------------------------------------------
+
+// Static arena backing the reusable inbound JsonDocument.  ArduinoJson 7
+// copies every string it parses, so the arena holds the parsed tree and
+// a copy of each string.  The largest message is a JSON allowlist_full
+// chunk of ALLOWLIST_SYNC_CHUNK hex codes.  On the ESP32 each code takes
+// a 16-byte slot, from pools of 128 slots (2 KB), and a 17-byte string
+// node that with the arena's block header takes 32 bytes.  128 codes
+// come to about 10.5 KB; the rest is headroom for other library
+// versions and for 64-bit host builds.
+static const size_t JSON_ARENA_SIZE = 16384;
+
+// ---------------------------------------------------------------------------
+// Display rendering
+// ---------------------------------------------------------------------------
+
+// The UI draws into an off-screen framebuffer.  Dirty rows are compared
+// with what the panel shows in bands of this many rows, and only the
+// changed rectangle of each band is pushed with DMA.  Two band-sized
+// bounce buffers are taken from DMA-capable internal RAM.
+static const uint16_t DISPLAY_BAND_ROWS  = 16;
+static const uint8_t  DISPLAY_BAND_COUNT = (SCREEN_HEIGHT + DISPLAY_BAND_ROWS - 1) / DISPLAY_BAND_ROWS;
+
+// ---------------------------------------------------------------------------
+// Telemetry
+// ---------------------------------------------------------------------------
+
+// Latency histograms use log2 buckets in microseconds: bucket i counts
+// samples in [2^i, 2^(i+1)), the last one everything from ~8.4 s up.
+static const uint8_t LATENCY_BUCKETS = 24;
+
+// How often the histograms are reported to the server
+static const unsigned long TELEMETRY_INTERVAL_MS = 300000; // 5 minutes
+
+// A largest free internal block below this is logged as a warning at
+// each report: a TLS handshake needs about this much in one piece
+static const uint32_t HEAP_LOW_BLOCK_BYTES = 16384;
+
+// Typing this character on the serial console dumps the histograms
+static const char TELEMETRY_CONSOLE_KEY = 't';
+
+// Console key for the benchmarks (bench.cpp), which print their
+// results as JSON
+static const char BENCH_CONSOLE_KEY = 'b';
+
+// Samples per timed round and rounds per benchmark; the fastest round
+// counts
+static const uint32_t BENCH_ITERATIONS = 1000;
+static const uint8_t BENCH_ROUNDS = 5;
+
+// ---------------------------------------------------------------------------
+// Event journal
+// ---------------------------------------------------------------------------
+
+// Locally decided events (master key, offline grants and denials,
+// sessions ended without the server) are appended to segment files of
+// fixed-size records on LittleFS until the server acknowledges them.
+// A segment is only ever appended to, and is deleted whole once all of
+// it is acknowledged or when the oldest must make room.
+static const uint16_t JOURNAL_SEGMENT_RECORDS = 256;  // 16 KB per segment
+static const uint8_t  JOURNAL_SEGMENTS        = 8;    // 2048 records, 128 KB
+static const uint16_t JOURNAL_QUEUE_DEPTH     = 64;   // records awaiting flash (power of two)
+
+// Queued records are written together at most this often, unless the
+// queue is half full, so that a burst costs one append and not one per
+// event
+static const uint32_t JOURNAL_FLUSH_MS = 1000;
+
+// Events per event_batch frame, and how long to wait for its event_ack,
+// or after a failed send, before sending it again
+static const uint8_t JOURNAL_BATCH_SIZE = 64;
+static const unsigned long JOURNAL_ACK_TIMEOUT_MS = 10000;
+
+// LittleFS directory of segments (named by a rising number) and files
+// holding the acknowledged position
+static const char* JOURNAL_DIR        = "/journal";
+static const char* JOURNAL_STATE_FILE = "/journal.ack";
+static const char* JOURNAL_STATE_TMP  = "/journal.tmp";
+
+// ---------------------------------------------------------------------------
+// Wiegand input
+// ---------------------------------------------------------------------------
+
+// D0/D1 falling edges are timestamped in the interrupt handler and
+// queued for the access task (power of two; a 37-bit read is 37 edges)
+static const uint16_t WIEGAND_EDGE_QUEUE_DEPTH = 128;
+
+// Edges closer than this to the previous one are ringing on the line
+static const uint32_t WIEGAND_GLITCH_US = 150;
+
+// A read ends after a silence of four bit intervals once it has a
+// valid length and parity (never less than WIEGAND_MIN_GAP_US), and
+// unconditionally after WIEGAND_MAX_GAP_US
+static const uint32_t WIEGAND_MIN_GAP_US = 3000;
+static const uint32_t WIEGAND_MAX_GAP_US = 25000;
+
+// Longest frame collected; anything longer is discarded
+static const uint8_t WIEGAND_MAX_BITS = 64;
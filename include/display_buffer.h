@@ -0,0 +1,25 @@
+// Display buffer header for MakerPass firmware
+// Off-screen framebuffer with dirty-band tracking and DMA pushes
+
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// Per-frame rendering figures, for checking how much reaches the panel
+struct DisplayStats {
+  uint32_t frames;        // flushes that pushed at least one rectangle
+  uint32_t lastBytes;     // pixel bytes pushed by the last such flush
+  uint16_t lastRects;
+  uint32_t lastRenderUs;  // drawing into the framebuffer
+  uint32_t lastPushUs;    // diffing and DMA transfer
+  uint32_t peakBytes;
+  uint64_t totalBytes;
+};
+
+// Function declarations
+bool initDisplayBuffer();
+TFT_eSPI &displayCanvas();
+void displayMarkDirty(int32_t x, int32_t y, int32_t w, int32_t h);
+void displayFlush();
+DisplayStats getDisplayStats();
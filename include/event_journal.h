@@ -0,0 +1,41 @@
+// Event journal header for MakerPass firmware
+// Flash-backed audit trail of events decided without the server
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+enum JournalEventType : uint8_t {
+  JOURNAL_MASTER_UNLOCK = 1,   // master key used
+  JOURNAL_OFFLINE_GRANT,       // admitted from the offline allowlist
+  JOURNAL_CACHE_GRANT,         // admitted from the grant cache while offline
+  JOURNAL_OFFLINE_DENY,        // refused while offline
+  JOURNAL_SESSION_END          // session ended without telling the server; data = seconds
+};
+
+// One 64-byte record, stored as-is on flash
+struct JournalRecord {
+  uint32_t seq;          // 1-based, never reused for a given journal
+  uint32_t time;         // Unix time, 0 if the clock was not set
+  uint32_t code;         // card code
+  uint32_t data;         // type-specific value
+  uint8_t  type;         // JournalEventType
+  uint8_t  resource;     // index into RESOURCES; 0 in records from before
+  uint8_t  reserved[2];
+  char     sessionId[40];
+  uint32_t crc;          // over everything above
+};
+
+static_assert(sizeof(JournalRecord) == 64, "JournalRecord must stay 64 bytes");
+
+// Function declarations
+void initJournal();
+void journalEvent(JournalEventType type, uint8_t resource, uint32_t code, uint32_t data = 0,
+                  const char* sessionId = "");
+void journalUnsentEvent(JournalEventType type, uint8_t resource, uint32_t code, uint32_t data = 0,
+                        const char* sessionId = "");
+const char* journalEventName(uint8_t type);
+void handleJournal();
+void resetJournalUpload();
+void handleEventAck(JsonDocument &doc);
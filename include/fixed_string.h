@@ -0,0 +1,50 @@
+// Fixed-capacity string header for MakerPass firmware
+// Bounded inline strings for names, session ids and display text
+//
+// State that lives for the life of the device (session state, cached
+// grants, the resource name) is held inline instead of in Arduino
+// String, so weeks of sessions do not fragment the heap the TLS stack
+// allocates from.  Text longer than the capacity is cut at the last
+// whole UTF-8 character that fits, and is always terminated.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Copy src into dst[size], truncating at a character boundary.  A null
+// src copies as empty.
+inline void copyBoundedText(char *dst, size_t size, const char *src) {
+  if (!src) src = "";
+  size_t len = 0;
+  while (len < size - 1 && src[len] != '\0') len++;
+  // Cut before a character the buffer cannot hold in full
+  if (src[len] != '\0') {
+    while (len > 0 && ((uint8_t)src[len] & 0xC0) == 0x80) len--;
+  }
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+}
+
+// N is the buffer size, terminator included
+template <size_t N>
+class FixedString {
+ public:
+  FixedString() { text_[0] = '\0'; }
+  FixedString(const char *text) { copyBoundedText(text_, N, text); }
+
+  FixedString &operator=(const char *text) {
+    if (text != text_) copyBoundedText(text_, N, text);
+    return *this;
+  }
+
+  void clear() { text_[0] = '\0'; }
+  const char *c_str() const { return text_; }
+  size_t length() const { return strlen(text_); }
+  bool empty() const { return text_[0] == '\0'; }
+
+  bool operator==(const char *other) const { return strcmp(text_, other ? other : "") == 0; }
+  bool operator!=(const char *other) const { return !(*this == other); }
+
+ private:
+  char text_[N];
+};
@@ -0,0 +1,31 @@
+// Outbound frame builder header for MakerPass firmware
+// Allocation-free JSON frames for the frequent device messages
+
+#pragma once
+
+#include <Arduino.h>
+#include <WebSocketsClient.h>
+
+// Largest JSON payload built by the frame builders
+static const size_t FRAME_MAX_PAYLOAD = 256;
+
+// A frame with room for the WebSocket header in front of the payload,
+// so the library can frame and mask it in place instead of allocating
+// a combined buffer.  Lives on the caller's stack.
+struct OutboundFrame {
+  uint8_t data[WEBSOCKETS_MAX_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+  size_t length;   // payload bytes
+  bool binary;     // MessagePack rather than JSON text
+
+  char *payload() { return (char *)data + WEBSOCKETS_MAX_HEADER_SIZE; }
+};
+
+// Function declarations
+void initFrameTemplates();
+void setFrameEncoding(bool binary);
+void encodeHex32(uint32_t value, char *out);
+bool buildRFIDScanFrame(OutboundFrame &frame, uint8_t resource, uint32_t code);
+bool buildSessionEndFrame(OutboundFrame &frame, uint8_t resource, const char *sessionId);
+bool buildCardPresentFrame(OutboundFrame &frame, uint8_t resource, const char *sessionId);
+bool buildDeviceAuthFrame(OutboundFrame &frame);
+bool buildPongFrame(OutboundFrame &frame);
@@ -0,0 +1,24 @@
+// Grant cache header for MakerPass firmware
+// Keeps recent server grants so repeat scans unlock locally
+
+#pragma once
+
+#include <Arduino.h>
+#include "task_manager.h"
+
+// Counters describing cache effectiveness
+struct GrantCacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;    // live entries displaced to make room
+  uint32_t expirations;  // entries dropped because their TTL ran out
+  uint32_t revocations;  // entries removed at the server's request
+};
+
+// Function declarations
+bool grantCacheLookup(uint8_t resource, uint32_t code, UserName &userName);
+void grantCacheStore(uint8_t resource, uint32_t code, const char *userName, uint32_t ttlSeconds);
+bool grantCacheRevoke(uint8_t resource, uint32_t code);
+void grantCacheClear();
+uint8_t grantCacheCount();
+const GrantCacheStats &getGrantCacheStats();
@@ -0,0 +1,104 @@
+// Hardware abstraction header for MakerPass firmware
+// Time, randomness, GPIO and Wiegand edges as used by the firmware.
+// No module reads millis(), micros(), esp_random() or time() or drives
+// a pin other than through here.
+//
+// On the ESP32 every call is an always-inlined forward to Arduino or
+// esp_timer, so the access path costs the same as calling them
+// directly and stays safe in interrupt handlers.  A host build defines
+// MAKERPASS_HOST and links hal_host.cpp instead: time is a virtual
+// clock, pins are plain state, and edges are injected at virtual times
+// and delivered to the attached handler as the interrupt would be.
+// Starting the virtual clock just short of 2^32 ms runs the code
+// across a millis() rollover.
+//
+// The display and the server transport are abstracted one level up,
+// at the TFT_eSPI and WebSocketsClient interfaces.  The host build
+// replaces those libraries (and Arduino, FreeRTOS, WiFi, LittleFS and
+// Preferences) with the doubles in lib/host_sim, which run setup() and
+// loop() and the tasks on this virtual clock.
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// GPIO numbers on the ESP32
+static const uint8_t HAL_PIN_COUNT = 40;
+
+typedef void (*HalEdgeHandler)(void *arg);
+
+#ifndef MAKERPASS_HOST
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define HAL_INLINE static inline __attribute__((always_inline))
+
+// Milliseconds and microseconds since boot, wrapping at 32 bits
+HAL_INLINE uint32_t halMillis() { return millis(); }
+HAL_INLINE uint32_t halMicros() { return micros(); }
+
+// Microseconds since boot on the 64-bit clock, which never wraps
+HAL_INLINE int64_t halUptimeUs() { return esp_timer_get_time(); }
+
+// Real elapsed nanoseconds, for benchmarks only
+HAL_INLINE int64_t halBenchNs() { return esp_timer_get_time() * 1000; }
+
+// 32 random bits from the hardware RNG
+HAL_INLINE uint32_t halRandom() { return esp_random(); }
+
+// Seconds since 1970 once SNTP has set the clock; until then the
+// seconds since boot
+HAL_INLINE time_t halTime() { return time(nullptr); }
+
+HAL_INLINE void halPinMode(uint8_t pin, uint8_t mode) { pinMode(pin, mode); }
+HAL_INLINE void halDigitalWrite(uint8_t pin, uint8_t level) { digitalWrite(pin, level); }
+
+// Call handler(arg) on every falling edge of pin, in interrupt context
+HAL_INLINE void halAttachFallingEdge(uint8_t pin, HalEdgeHandler handler, void *arg) {
+  attachInterruptArg(digitalPinToInterrupt(pin), handler, arg, FALLING);
+}
+
+#else
+
+uint32_t halMillis();
+uint32_t halMicros();
+int64_t halUptimeUs();
+int64_t halBenchNs();       // the machine's monotonic clock, not the virtual one
+uint32_t halRandom();
+time_t halTime();
+void halPinMode(uint8_t pin, uint8_t mode);
+void halDigitalWrite(uint8_t pin, uint8_t level);
+void halAttachFallingEdge(uint8_t pin, HalEdgeHandler handler, void *arg);
+
+// Host only: the virtual clock.  Moving it forward runs every event
+// due on the way, each at its own time.
+static const int64_t HAL_NO_EVENT = INT64_MAX;
+void halSetUptimeUs(int64_t us);
+void halAdvanceUs(int64_t us);
+int64_t halNextEventUs();
+
+// Host only: call handler(arg) at a virtual time, as an interrupt or a
+// driver callback would run.  Events due at the same time run in the
+// order they were scheduled.
+void halScheduleAt(int64_t us, HalEdgeHandler handler, void *arg);
+
+// Host only: the RNG sequence, and the wall clock SNTP would set
+void halSeedRandom(uint64_t seed);
+void halSetWallClock(time_t now);
+
+// Host only: observe or stimulate pins
+uint8_t halPinLevel(uint8_t pin);
+uint32_t halPinWrites(uint8_t pin);
+uint32_t halPinRises(uint8_t pin);
+void halFallingEdge(uint8_t pin);
+void halScheduleFallingEdge(uint8_t pin, int64_t us);
+
+// Host only: a Wiegand frame as a reader sends it, MSB first: one
+// pulse on DATA0 for every 0 bit and on DATA1 for every 1 bit, the
+// first at startUs and then one every intervalUs
+void halWiegandFrame(uint8_t pinData0, uint8_t pinData1, uint64_t bits, uint8_t count,
+                     int64_t startUs, uint32_t intervalUs);
+
+#endif
@@ -0,0 +1,29 @@
+// JSON arena header for MakerPass firmware
+// Fixed-buffer allocator for reusable ArduinoJson documents
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "constants.h"
+
+// Bump allocator over a static buffer.  A document using it is cleared
+// and the arena reset before each message, so parsing never touches the
+// heap.  When the buffer is exhausted allocation fails and ArduinoJson
+// reports NoMemory.
+class JsonArena : public ArduinoJson::Allocator {
+ public:
+  void reset();
+  size_t used() const { return used_; }
+  size_t peak() const { return peak_; }
+
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t newSize) override;
+
+ private:
+  alignas(8) uint8_t buffer_[JSON_ARENA_SIZE];
+  size_t used_ = 0;
+  size_t peak_ = 0;
+  uint8_t* last_ = nullptr;   // most recent block, which may grow in place
+};
@@ -0,0 +1,120 @@
+// Logger header for MakerPass firmware
+// Leveled log records queued per task and written to the serial port by
+// a low-priority task
+//
+// Log with the macros, naming the module and a printf format:
+//
+//   LOG_I(WIFI, "Connected, %d dBm", rssi);
+//
+// Each module has a compile-time level, LOG_LEVEL_<module>, defaulting
+// to LOG_LEVEL.  A call above its module's level compiles to nothing,
+// format string included.  Release builds set -DLOG_LEVEL=LOG_WARN (see
+// platformio.ini); a single module can be opened up with e.g.
+// -DLOG_LEVEL_WS=LOG_DEBUG.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define LOG_NONE  0
+#define LOG_ERROR 1
+#define LOG_WARN  2
+#define LOG_INFO  3
+#define LOG_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+// Modules, in the order of LOG_MODULE_NAMES in logger.cpp
+enum LogModule : uint8_t {
+  LOG_MODULE_BOOT,
+  LOG_MODULE_TASK,
+  LOG_MODULE_WIFI,
+  LOG_MODULE_WS,
+  LOG_MODULE_WIRE,
+  LOG_MODULE_RFID,
+  LOG_MODULE_ACCESS,
+  LOG_MODULE_SESSION,
+  LOG_MODULE_CACHE,
+  LOG_MODULE_ALLOW,
+  LOG_MODULE_JOURNAL,
+  LOG_MODULE_TELEM,
+  LOG_MODULE_UI,
+  LOG_MODULE_LOG,
+  LOG_MODULE_BENCH,
+  LOG_MODULE_COUNT
+};
+
+#ifndef LOG_LEVEL_BOOT
+#define LOG_LEVEL_BOOT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_TASK
+#define LOG_LEVEL_TASK LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_WS
+#define LOG_LEVEL_WS LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_WIRE
+#define LOG_LEVEL_WIRE LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_RFID
+#define LOG_LEVEL_RFID LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ACCESS
+#define LOG_LEVEL_ACCESS LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_SESSION
+#define LOG_LEVEL_SESSION LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_CACHE
+#define LOG_LEVEL_CACHE LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ALLOW
+#define LOG_LEVEL_ALLOW LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_JOURNAL
+#define LOG_LEVEL_JOURNAL LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_TELEM
+#define LOG_LEVEL_TELEM LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_UI
+#define LOG_LEVEL_UI LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_LOG
+#define LOG_LEVEL_LOG LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_BENCH
+#define LOG_LEVEL_BENCH LOG_LEVEL
+#endif
+
+#define LOG_AT(module, level, ...)                                        \
+  do {                                                                    \
+    if ((level) <= LOG_LEVEL_##module) {                                  \
+      logWrite(LOG_MODULE_##module, (level), __VA_ARGS__);                \
+    }                                                                     \
+  } while (0)
+
+#define LOG_E(module, ...) LOG_AT(module, LOG_ERROR, __VA_ARGS__)
+#define LOG_W(module, ...) LOG_AT(module, LOG_WARN, __VA_ARGS__)
+#define LOG_I(module, ...) LOG_AT(module, LOG_INFO, __VA_ARGS__)
+#define LOG_D(module, ...) LOG_AT(module, LOG_DEBUG, __VA_ARGS__)
+
+// Text kept per record; longer lines are truncated
+static const size_t LOG_TEXT_LEN = 88;
+
+struct LogStats {
+  uint32_t written;        // records printed
+  uint32_t dropped;        // records lost to a full ring or an unknown task
+  uint32_t truncated;      // records cut at LOG_TEXT_LEN
+};
+
+// Function declarations
+void logWrite(LogModule module, uint8_t level, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void logTask(void *);
+LogStats getLogStats();
@@ -0,0 +1,97 @@
+// Message type table for MakerPass firmware
+// Compile-time table of server message types with a perfect hash
+
+#pragma once
+
+#include <Arduino.h>
+
+// Server -> device message types
+enum MessageType : uint8_t {
+  MSG_UNKNOWN = 0,
+  MSG_AUTH_SUCCESS,
+  MSG_AUTH_ERROR,
+  MSG_ERROR,
+  MSG_PING,
+  MSG_PONG,
+  MSG_ACCESS_GRANTED,
+  MSG_ACCESS_DENIED,
+  MSG_SESSION_STARTED,
+  MSG_SESSION_ENDED,
+  MSG_CACHE_REVOKE,
+  MSG_CACHE_STATS,
+  MSG_ALLOWLIST_FULL,
+  MSG_ALLOWLIST_DELTA,
+  MSG_EVENT_ACK
+};
+
+struct MessageTypeEntry {
+  const char* name;
+  MessageType type;
+};
+
+static constexpr MessageTypeEntry MESSAGE_TYPES[] = {
+  {"auth_success",    MSG_AUTH_SUCCESS},
+  {"auth_error",      MSG_AUTH_ERROR},
+  {"error",           MSG_ERROR},
+  {"ping",            MSG_PING},
+  {"pong",            MSG_PONG},
+  {"access_granted",  MSG_ACCESS_GRANTED},
+  {"access_denied",   MSG_ACCESS_DENIED},
+  {"session_started", MSG_SESSION_STARTED},
+  {"session_ended",   MSG_SESSION_ENDED},
+  {"cache_revoke",    MSG_CACHE_REVOKE},
+  {"cache_stats",     MSG_CACHE_STATS},
+  {"allowlist_full",  MSG_ALLOWLIST_FULL},
+  {"allowlist_delta", MSG_ALLOWLIST_DELTA},
+  {"event_ack",       MSG_EVENT_ACK},
+};
+
+static constexpr size_t MESSAGE_TYPE_COUNT = sizeof(MESSAGE_TYPES) / sizeof(MESSAGE_TYPES[0]);
+
+// FNV-1a with a seed chosen so that every name above lands in its own
+// slot.  When adding a type, the static_assert below fails if the seed
+// no longer separates them; pick a new seed that does.
+static constexpr uint32_t MESSAGE_HASH_SEED  = 5;
+static constexpr uint8_t  MESSAGE_HASH_BITS  = 6;
+static constexpr uint8_t  MESSAGE_HASH_SLOTS = 1 << MESSAGE_HASH_BITS;
+static constexpr uint8_t  MESSAGE_SLOT_EMPTY = 0xFF;
+
+constexpr uint8_t messageTypeSlot(const char* name) {
+  uint32_t h = MESSAGE_HASH_SEED;
+  while (*name) {
+    h = (h ^ (uint8_t)*name++) * 16777619u;
+  }
+  return h >> (32 - MESSAGE_HASH_BITS);
+}
+
+struct MessageSlotTable {
+  uint8_t entry[MESSAGE_HASH_SLOTS];  // index into MESSAGE_TYPES
+  bool collisionFree;
+};
+
+constexpr MessageSlotTable buildMessageSlotTable() {
+  MessageSlotTable table = {};
+  table.collisionFree = true;
+  for (uint8_t i = 0; i < MESSAGE_HASH_SLOTS; i++) {
+    table.entry[i] = MESSAGE_SLOT_EMPTY;
+  }
+  for (uint8_t i = 0; i < MESSAGE_TYPE_COUNT; i++) {
+    uint8_t slot = messageTypeSlot(MESSAGE_TYPES[i].name);
+    if (table.entry[slot] != MESSAGE_SLOT_EMPTY) table.collisionFree = false;
+    table.entry[slot] = i;
+  }
+  return table;
+}
+
+static constexpr MessageSlotTable MESSAGE_SLOT_TABLE = buildMessageSlotTable();
+static_assert(MESSAGE_SLOT_TABLE.collisionFree,
+              "message type hash collision: choose another MESSAGE_HASH_SEED");
+
+// Map a type string to its enum with one hash and one strcmp
+inline MessageType lookupMessageType(const char* name) {
+  uint8_t index = MESSAGE_SLOT_TABLE.entry[messageTypeSlot(name)];
+  if (index == MESSAGE_SLOT_EMPTY || strcmp(MESSAGE_TYPES[index].name, name) != 0) {
+    return MSG_UNKNOWN;
+  }
+  return MESSAGE_TYPES[index].type;
+}
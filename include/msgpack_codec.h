@@ -0,0 +1,42 @@
+// MessagePack codec header for MakerPass firmware
+// Binary encoding of protocol messages using the codes in wire_schema.h
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Minimal MessagePack writer over a caller-supplied buffer.  Writing
+// past the end sets ok() to false instead of overflowing.
+class MsgPackWriter {
+ public:
+  MsgPackWriter(uint8_t *buffer, size_t size);
+
+  void mapHeader(uint32_t count);
+  void arrayHeader(uint32_t count);
+  void unsignedInt(uint64_t value);
+  void signedInt(int64_t value);
+  void uint32Fixed(uint32_t value);   // always 5 bytes
+  void string(const char* text, size_t length);
+  void string(const char* text) { string(text, strlen(text)); }
+  void boolean(bool value);
+  void nil();
+  void float64(double value);
+
+  size_t length() const { return pos_ - start_; }
+  bool ok() const { return ok_; }
+
+ private:
+  void put(uint8_t byte);
+  void putBigEndian(uint64_t value, uint8_t bytes);
+  void header(uint8_t fixBase, uint8_t fixMax, uint8_t code16, uint32_t count);
+
+  uint8_t *start_;
+  uint8_t *pos_;
+  uint8_t *end_;
+  bool ok_;
+};
+
+// Function declarations
+size_t encodeWireMessage(JsonVariantConst message, uint8_t *out, size_t size);
+bool decodeWireMessage(uint8_t *data, size_t length, JsonDocument &doc);
@@ -16,6 +16,17 @@ static const uint8_t PIN_RFID_BEEP = 19;
 // Relay output controlling the door or machine
 static const uint8_t PIN_RELAY     = 23;
 
+// Further reader/relay pairs, for a controller serving more than one
+// resource (see RESOURCES in config.h).  GPIO 16 and 17 are taken by
+// the WROVER's PSRAM.
+static const uint8_t PIN_RFID2_D0  = 32;
+static const uint8_t PIN_RFID2_D1  = 33;
+static const uint8_t PIN_RELAY2    = 15;
+static const uint8_t PIN_RFID2_LED = 2;
+
+// A reader line that is not wired
+static const uint8_t PIN_NONE      = 0xFF;
+
 // Status LEDs: WiFi, relay active and RFID activity
 static const uint8_t PIN_LED_WIFI  = 27;
 static const uint8_t PIN_LED_RELAY = 26;
@@ -3,10 +3,57 @@
 #pragma once
 
 #include <Arduino.h>
+#include "config.h"
+#include "task_manager.h"
+
+// Card presence coalescing counters (access task)
+struct PresenceStats {
+  uint32_t suppressed;   // repeat reads of the session's card absorbed
+  uint32_t dropouts;     // read gaps that recovered before the timeout
+  uint32_t heartbeats;   // card_present frames queued
+};
+
+// Access-side state of one resource, owned by the access task.  Its
+// fixed configuration is the matching entry of RESOURCES.
+struct ResourceState {
+  uint8_t index;                   // into RESOURCES
+  const ResourceConfig *config;
+  bool door;                       // door rather than machine
+  bool presenceRequired;           // require_card_present
+
+  // Session
+  SessionId currentSessionId;      // non-empty when a session is active
+  UserName activeUser;             // user currently granted access
+  unsigned long sessionStartTime;  // for machines: when the session started
+  bool runtimeDisplayReset;        // trigger a full timer display redraw
+  bool relayActive;                // true while the relay is energised
+  uint32_t grantedCode;            // card whose grant holds the relay
+
+  // Card presence tracking for require_card_present
+  uint32_t lastCardCode;           // 0 when no card is held
+  unsigned long lastCardTime;
+  bool cardDropout;
+
+  // Deadlines on accessTimers, with this resource as context
+  Timer indicatorTimer;
+  Timer doorTimer;
+  Timer displayTimer;
+  Timer presenceTimer;
+  Timer heartbeatTimer;
+};
+
+extern ResourceState resources[RESOURCE_COUNT];
 
 // Function declarations
-void flashRFIDIndicator(uint16_t durationMs = 100);
-void unlockRelay(const String &userName);
-void lockRelay();
-void startSession(const String &sessionId, const String &userName);
-void endSession(const String &userName);
+void initResources();
+void flashRFIDIndicator(ResourceState &res, uint16_t durationMs = 100);
+void unlockRelay(ResourceState &res, uint32_t code, const char *userName);
+void lockRelay(ResourceState &res);
+void grantAccess(ResourceState &res, uint32_t code, const char *userName);
+void startSession(ResourceState &res, uint32_t code, const char *sessionId, const char *userName);
+void endSession(ResourceState &res, const char *userName);
+void showResource(ResourceState &res);
+void processAccessCommand(const AccessCommand &cmd);
+bool coalescePresenceRead(ResourceState &res, uint32_t code);
+void watchCardPresence(ResourceState &res);
+const PresenceStats &getPresenceStats();
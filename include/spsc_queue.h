@@ -0,0 +1,65 @@
+// Single-producer/single-consumer queue for MakerPass firmware
+// Lock-free ring buffer used to pass messages between tasks
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Fixed-capacity ring buffer.  Exactly one task may push and exactly
+// one task may pop; under that rule no locks are needed.  Capacity must
+// be a power of two.  Items are copied in and out, so T should be a
+// plain struct without heap-owning members.
+template <typename T, uint16_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+ public:
+  // Producer side.  Returns false (and counts a drop) when full.
+  bool push(const T &item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      dropped_++;
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.  Returns false when empty.
+  bool pop(T &item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    item = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.  The oldest item, left in place until pop(), or
+  // nullptr when empty.
+  const T *front() const {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return nullptr;
+    }
+    return &items_[tail & (N - 1)];
+  }
+
+  uint32_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  // Number of pushes rejected because the queue was full
+  uint32_t dropped() const {
+    return dropped_;
+  }
+
+ private:
+  T items_[N];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  uint32_t dropped_ = 0;
+};
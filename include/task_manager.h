@@ -0,0 +1,140 @@
+// Task management header for MakerPass firmware
+// Task layout and the messages passed between tasks
+//
+//  - access task (Arduino loop(), core 1, high priority): Wiegand,
+//    relay, card presence and indicator LEDs
+//  - network task (core 0): WiFi, TLS/WebSocket I/O and JSON protocol
+//  - UI task (core 1, low priority): all TFT drawing
+//  - log task (core 0, lowest priority): serial output (logger.h)
+//
+// Each direction between two tasks has its own lock-free SPSC queue;
+// the tasks do not share mutable globals.
+
+#pragma once
+
+#include <Arduino.h>
+#include "fixed_string.h"
+#include "timer_wheel.h"
+
+// Bounded text sizes used in queued messages.  Longer strings are
+// truncated when copied into a message.
+static const size_t QUEUE_TEXT_LEN    = 48;
+static const size_t QUEUE_USER_LEN    = 32;
+static const size_t QUEUE_SESSION_LEN = 40;
+
+// Inline strings of the same sizes, for state kept between messages,
+// so a value passes through the queues unchanged
+typedef FixedString<QUEUE_USER_LEN> UserName;
+typedef FixedString<QUEUE_SESSION_LEN> SessionId;
+typedef FixedString<QUEUE_TEXT_LEN> DisplayText;
+
+// ---------------------------------------------------------------------------
+// Network task -> access task
+// ---------------------------------------------------------------------------
+
+enum AccessCommandType : uint8_t {
+  ACCESS_LINK_STATE,       // online, presenceRequired
+  ACCESS_GRANT,            // userName, code, ttlSeconds
+  ACCESS_SESSION_STARTED,  // sessionId, userName, code, ttlSeconds
+  ACCESS_SESSION_ENDED,    // sessionId, userName
+  ACCESS_DENIED,           // text (reason), code
+  ACCESS_CACHE_REVOKE,     // code
+  ACCESS_CACHE_CLEAR
+};
+
+// Every command but ACCESS_CACHE_CLEAR concerns one resource
+struct AccessCommand {
+  AccessCommandType type;
+  uint8_t resource;        // index into RESOURCES
+  bool online;             // WiFi up and device authenticated
+  bool presenceRequired;   // require_card_present from auth_success
+  bool codeKnown;          // false: the command refers to the last scan
+  uint32_t code;
+  uint32_t ttlSeconds;     // grant cache lifetime, 0 = do not cache
+  char userName[QUEUE_USER_LEN];
+  char sessionId[QUEUE_SESSION_LEN];
+  char text[QUEUE_TEXT_LEN];
+};
+
+// ---------------------------------------------------------------------------
+// Access task -> network task
+// ---------------------------------------------------------------------------
+
+enum NetRequestType : uint8_t {
+  NET_RFID_SCAN,           // code, cacheGrant
+  NET_SESSION_END,         // sessionId, code, data = seconds
+  NET_CARD_PRESENT         // sessionId
+};
+
+// The link may fall between posting and sending; the network task then
+// journals the scan or session end from these fields instead
+struct NetRequest {
+  NetRequestType type;
+  uint8_t resource;        // index into RESOURCES
+  bool cacheGrant;         // scan already admitted from the grant cache
+  uint32_t code;
+  uint32_t data;
+  uint32_t postedUs;       // halMicros() when queued, for telemetry
+  char sessionId[QUEUE_SESSION_LEN];
+};
+
+// ---------------------------------------------------------------------------
+// Any task -> UI task
+// ---------------------------------------------------------------------------
+
+enum UiCommandType : uint8_t {
+  UI_BOOT,                 // text1, text2, textColor
+  UI_MESSAGE,              // text1, text2, textColor, bgColor
+  UI_IDLE,
+  UI_DOOR_COUNTDOWN,       // text1 (header), text2 (seconds), initialDraw
+  UI_RUNTIME,              // text1 (user), text2 (runtime), initialDraw
+  UI_STATUS_BAR,
+  UI_LINK_STATE,           // wifiConnected, authenticated, text1 (resource name)
+  UI_TEMP_MESSAGE,         // text1, text2, textColor, bgColor, priority
+  UI_CLEAR_TEMP
+};
+
+struct UiCommand {
+  UiCommandType type;
+  uint8_t priority;
+  bool initialDraw;
+  bool wifiConnected;
+  bool authenticated;
+  uint16_t textColor;
+  uint16_t bgColor;
+  char text1[QUEUE_TEXT_LEN];
+  char text2[QUEUE_TEXT_LEN];
+};
+
+// Tasks that produce queued messages; each has its own queues
+enum TaskRole : uint8_t {
+  TASK_ACCESS,
+  TASK_NETWORK,
+  TASK_UI,
+  TASK_ROLE_COUNT
+};
+
+// Deadlines of the access and network tasks.  Each wheel and its
+// timers are touched only by the task that owns it.
+extern TimerWheel accessTimers;
+extern TimerWheel networkTimers;
+
+// Copy a string into a fixed queue field, truncating at a character
+// boundary if needed
+inline void copyQueueText(char *dst, size_t size, const char *src) {
+  copyBoundedText(dst, size, src);
+}
+
+// Function declarations
+void startTasks();
+bool tasksRunning();
+TaskRole currentTaskRole();
+bool postAccessCommand(const AccessCommand &cmd);
+bool pollAccessCommand(AccessCommand &cmd);
+void waitForAccessEvent(uint32_t timeoutMs);
+void wakeAccessTaskFromISR();
+bool requestRFIDScan(uint8_t resource, uint32_t code, bool cacheGrant = false);
+bool requestSessionEnd(uint8_t resource, const char *sessionId, uint32_t code, uint32_t seconds);
+bool requestCardPresent(uint8_t resource, const char *sessionId);
+void postUiCommand(const UiCommand &cmd);
+uint32_t uiCommandsDropped();
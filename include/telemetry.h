@@ -0,0 +1,64 @@
+// Telemetry header for MakerPass firmware
+// Latency histograms for the scan-to-relay path
+
+#pragma once
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Measured stages.  Each is recorded by exactly one task.
+enum LatencyStage : uint8_t {
+  LAT_LOOP,            // access: one loop() iteration, excluding the wait
+  LAT_DECODE,          // access: last Wiegand bit to code decoded, incl. end-of-frame gap
+  LAT_QUEUE,           // access -> network queue hand-off
+  LAT_BUILD,           // network: rfid_scan frame build
+  LAT_SEND,            // network: sendTXT
+  LAT_RTT,             // network: scan sent to server answer received
+  LAT_PARSE,           // network: inbound frame parse and dispatch
+  LAT_UI,              // UI: one render pass including the flush
+  LAT_SCAN_TO_RELAY,   // access: last Wiegand bit to relay energised
+  LAT_CONNECT,         // network: connect attempt to WebSocket upgraded
+  LAT_NET_LOOP,        // network: one task iteration, excluding the wait
+  LAT_WIFI_RECONNECT,  // network: WiFi link lost (or roam started) to IP
+  LAT_TLS_FULL,        // network: TLS handshake with the server's certificate
+  LAT_TLS_RESUMED,     // network: TLS handshake resuming the last session
+  LAT_STAGE_COUNT
+};
+
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t buckets[LATENCY_BUCKETS];
+};
+
+// Internal heap, which the TLS stack allocates from
+struct HeapStats {
+  uint32_t freeBytes;
+  uint32_t largestBlock;   // largest single allocation that would succeed
+  uint32_t minFreeBytes;   // low-water mark since boot
+};
+
+// WebSocket frames and payload bytes since boot (network task)
+struct TrafficStats {
+  uint32_t framesOut;
+  uint32_t bytesOut;
+  uint32_t framesIn;
+  uint32_t bytesIn;
+};
+
+// Function declarations
+void recordLatency(LatencyStage stage, uint32_t us);
+const LatencyHistogram &getLatencyHistogram(LatencyStage stage);
+const char* latencyStageName(LatencyStage stage);
+void latencyScanStarted(uint32_t startUs);
+void latencyScanDenied();
+void latencyRelayOn();
+void latencyScanSent();
+void latencyScanAnswered(uint32_t receivedUs);
+void recordFrameSent(size_t bytes);
+void recordFrameReceived(size_t bytes);
+const TrafficStats &getTrafficStats();
+HeapStats getHeapStats();
+void dumpTelemetry();
+void handleTelemetry();
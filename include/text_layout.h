@@ -0,0 +1,27 @@
+// Text layout header for MakerPass firmware
+// Glyph metrics for the fonts the UI draws with, and a cache of fitted
+// (measured and ellipsized) strings
+
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "task_manager.h"
+
+// Fonts with metrics: TFT_eSPI fonts 2 (16 px) and 4 (26 px).  Other
+// fonts measure as zero.
+static const uint8_t FONT_SMALL = 2;
+static const uint8_t FONT_LARGE = 4;
+
+// A string cut to a maximum width, with "..." appended when cut
+struct FittedText {
+  char text[QUEUE_TEXT_LEN + 3];
+  uint16_t width;          // pixels, as drawn
+  uint16_t height;         // font height
+};
+
+// Function declarations
+void initTextMetrics(TFT_eSPI &gfx);
+uint16_t textPixelWidth(const char *text, uint8_t font);
+uint16_t fontPixelHeight(uint8_t font);
+const FittedText &fitText(const char *text, uint8_t font, uint16_t maxWidth);
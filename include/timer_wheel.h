@@ -0,0 +1,58 @@
+// Timer wheel header for MakerPass firmware
+// Hierarchical timing wheel holding one task's deadlines
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef void (*TimerCallback)(void *context);
+
+// A deadline owned by the module that uses it, normally a static
+// initialised with just its callback.  Timers that belong to one of
+// several objects carry a pointer to it in context.  It is linked into
+// the wheel while armed, so arming and cancelling never allocate.
+struct Timer {
+  TimerCallback callback;
+  void *context;
+  Timer *next;
+  Timer *prev;
+  int64_t expiresMs;
+  uint8_t level;
+  uint8_t slot;
+  bool armed;
+};
+
+// Four levels of 64 slots at 1 ms resolution, covering about 4.6 hours
+// directly; longer delays are parked and re-filed as they come round.
+// Time comes from the 64-bit esp_timer, so deadlines never wrap.
+// schedule() and cancel() are O(1).  A wheel is not thread-safe: each
+// task has its own and only that task may touch it or its timers.
+class TimerWheel {
+ public:
+  TimerWheel();
+
+  void schedule(Timer &timer, uint32_t delayMs);
+  void cancel(Timer &timer);
+  bool armed(const Timer &timer) const { return timer.armed; }
+  uint32_t remainingMs(const Timer &timer) const;
+
+  void run();
+  uint32_t msUntilNext(uint32_t limitMs);
+
+ private:
+  static const uint8_t LEVELS    = 4;
+  static const uint8_t SLOT_BITS = 6;
+  static const uint8_t SLOTS     = 1 << SLOT_BITS;
+  static const uint8_t FIRING    = 0xFF;   // level of timers being fired
+
+  void sync();
+  void insert(Timer &timer);
+  void cascade(uint8_t level, uint8_t slot);
+
+  Timer *slots_[LEVELS][SLOTS];
+  uint64_t occupied_[LEVELS];
+  Timer *firing_;
+  int64_t nextTick_;    // first millisecond not yet processed, -1 until used
+};
+
+int64_t timerNowMs();
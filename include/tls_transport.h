@@ -0,0 +1,55 @@
+// TLS transport header for MakerPass firmware
+// The server connection's TLS layer: mbedTLS over a WiFiClient socket,
+// resuming the previous session when the server still holds it
+
+#pragma once
+
+#include <Arduino.h>
+
+// The most recent successful TLS handshake
+struct TlsHandshake {
+  bool resumed;   // the server accepted the cached session
+  uint32_t us;    // the handshake alone, after the TCP connect
+};
+
+#ifndef MAKERPASS_HOST
+
+#include <WiFi.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+
+// Handed to the WebSockets library as its connection by
+// ServerSocket::open().  The library reads and writes it as a plain
+// client and deletes it once the connection is closed.
+class TlsTransport : public WiFiClient {
+ public:
+  TlsTransport();
+  ~TlsTransport() override;
+
+  // TCP connect, then the TLS handshake: resumed when a session is
+  // cached, otherwise full and checked against WS_PIN_SPKI
+  int connect(const char *host, uint16_t port, int32_t timeoutMs) override;
+
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+
+ private:
+  void close();
+
+  mbedtls_ssl_context ssl_;
+  mbedtls_net_context net_;
+  bool open_;     // handshake done and not closed
+  int peeked_;    // byte taken by peek(), or -1
+};
+
+#endif
+
+// Function declarations
+const TlsHandshake &lastTlsHandshake();
@@ -5,16 +5,21 @@
 #include <Arduino.h>
 #include <TFT_eSPI.h>
 #include "constants.h"
+#include "task_manager.h"
 
 // Function declarations
-void getTextDimensions(const String &text, uint8_t font, uint16_t &width, uint16_t &height);
+void getTextDimensions(const char *text, uint8_t font, uint16_t &width, uint16_t &height);
+void setUiLinkState(bool wifiConnected, bool authenticated, const char *resourceName);
 void showStatusBar();
-void showTopStatusBar();
-void showBottomStatusBar();
-void showMessage(const String &line1, const String &line2 = "", uint16_t textColor = COLOR_STATUS_TX, uint16_t bgColor = COLOR_BG);
-void showTempMessage(const String &line1, const String &line2 = "", uint16_t textColor = COLOR_STATUS_TX, uint16_t bgColor = COLOR_BG);
-void showBootMessage(const String &message, const String &detail = "", uint16_t textColor = TFT_WHITE);
+void showMessage(const char *line1, const char *line2 = "", uint16_t textColor = COLOR_STATUS_TX, uint16_t bgColor = COLOR_BG);
+void showTempMessage(const char *line1, const char *line2 = "", uint16_t textColor = COLOR_STATUS_TX, uint16_t bgColor = COLOR_BG, uint8_t priority = UI_PRIORITY_NORMAL);
+void clearTempMessages();
+void showBootMessage(const char *message, const char *detail = "", uint16_t textColor = TFT_WHITE);
 void showIdleScreen();
-void showRuntimeDisplay(const String &userName, const String &runtime, bool initialDraw = false);
-void showDoorCountdown(const String &header, const String &seconds, bool initialDraw = false);
+void showRuntimeDisplay(const char *userName, const char *runtime, bool initialDraw = false);
+void showDoorCountdown(const char *header, const char *seconds, bool initialDraw = false);
 void resetRuntimeDisplay();
+
+// UI task only
+void renderUiCommand(const UiCommand &cmd);
+void updateUI();
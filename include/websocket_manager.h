@@ -5,12 +5,37 @@
 #include <Arduino.h>
 #include <WebSocketsClient.h>
 #include <ArduinoJson.h>
+#include "task_manager.h"
+#include "frame_builder.h"
+#include "event_journal.h"
+
+// The WebSocket client, on its own TLS transport
+class ServerSocket : public WebSocketsClient {
+ public:
+  // Connect over a TlsTransport (TCP and TLS handshake, synchronously)
+  // and send the upgrade request.  False when either fails.
+  bool open();
+};
 
 // Function declarations
 void initWebSocket();
+void pollWebSocket();
 void sendDeviceAuth();
-void handleIncomingMessage(const String &message);
+bool sendFrame(OutboundFrame &frame);
+bool sendDocument(JsonDocument &doc);
+void handleIncomingMessage(uint8_t *payload, size_t length);
+void handleIncomingBinary(uint8_t *payload, size_t length);
+size_t inboundArenaPeak();
 void processJsonMessage(JsonDocument &doc);
-void handleWebSocketKeepAlive();
-void sendRFIDScan(const String &codeStr);
-void sendSessionEnd(const String &sessionId);
+void publishLinkState();
+unsigned long reconnectBackoffMs(uint8_t failures, unsigned long hintMs, uint32_t draw);
+bool resourceIndexFor(JsonDocument &doc, uint8_t &index);
+void processNetRequest(const NetRequest &req);
+void sendRFIDScan(uint8_t resource, uint32_t code);
+void sendSessionEnd(uint8_t resource, const char* sessionId);
+void sendCardPresent(uint8_t resource, const char* sessionId);
+void sendCacheStats();
+void sendTelemetry();
+void sendAllowlistSync(uint8_t resource, uint32_t sinceVersion);
+void sendAllowlistAck(uint8_t resource, uint32_t version);
+bool sendEventBatch(uint32_t journalId, const JournalRecord *records, uint8_t count);
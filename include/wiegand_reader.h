@@ -0,0 +1,40 @@
+// Wiegand reader header for MakerPass firmware
+// Interrupt-driven decoder for 26-, 34- and 37-bit card readers
+
+#pragma once
+
+#include <Arduino.h>
+
+// Card formats recognised by length and parity layout
+enum WiegandFormat : uint8_t {
+  WIEGAND_H10301,    // 26-bit: 8-bit facility, 16-bit card
+  WIEGAND_H10306,    // 34-bit: 16-bit facility, 16-bit card
+  WIEGAND_H10304,    // 37-bit: 16-bit facility, 19-bit card
+};
+
+// One validated read.  code holds the data bits with the parity bits
+// removed, most significant first.
+struct WiegandRead {
+  WiegandFormat format;
+  uint8_t bits;           // frame length including parity
+  uint64_t code;
+  uint32_t lastEdgeUs;    // halMicros() of the final bit
+};
+
+// Rejected frames, for diagnosing wiring and reader problems
+struct WiegandStats {
+  uint32_t reads;         // frames accepted
+  uint32_t parityErrors;  // known length, parity mismatch
+  uint32_t badLength;     // length of no known format
+  uint32_t tooWide;       // valid, but the code needs more than 32 bits
+  uint32_t glitches;      // edges dropped as ringing
+  uint32_t overruns;      // edges lost to a full queue
+};
+
+// Function declarations
+void initWiegandReader(uint8_t index, uint8_t pinD0, uint8_t pinD1);
+bool pollWiegand(uint8_t index, WiegandRead &read);
+uint32_t wiegandMsUntilFrameEnd(uint32_t limitMs);
+uint32_t wiegandCardNumber(const WiegandRead &read);
+const char* wiegandFormatName(WiegandFormat format);
+WiegandStats getWiegandStats(uint8_t index);
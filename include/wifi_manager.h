@@ -6,5 +6,5 @@
 #include <WiFi.h>
 
 // Function declarations
-void connectToWiFi();
+void startWiFi();
 void handleWiFiStatus();
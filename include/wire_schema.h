@@ -0,0 +1,105 @@
+// Wire schema for MakerPass firmware
+// Integer codes for the binary (MessagePack) encoding of the protocol
+//
+// The binary encoding carries exactly the JSON messages, with two
+// substitutions: object keys listed below become their integer code,
+// and the value of "type" becomes its message code.  rfid_code is sent
+// as the raw 32-bit card number instead of an 8-digit hex string.  Keys
+// not listed (e.g. telemetry stage names) stay strings.  Codes are part
+// of the protocol: append new ones, never renumber.
+
+#pragma once
+
+#include <Arduino.h>
+
+static const char* const WIRE_ENCODING_MSGPACK = "msgpack";
+
+// Object keys
+static const char* const WIRE_KEYS[] = {
+  "type",                  // 0
+  "resource_id",           // 1
+  "api_key",               // 2
+  "rfid_code",             // 3
+  "user_name",             // 4
+  "user",                  // 5
+  "session_id",            // 6
+  "cache_ttl",             // 7
+  "reason",                // 8
+  "message",               // 9
+  "enabled",               // 10
+  "require_card_present",  // 11
+  "resource_name",         // 12
+  "version",               // 13
+  "base_version",          // 14
+  "offset",                // 15
+  "more",                  // 16
+  "codes",                 // 17
+  "add",                   // 18
+  "remove",                // 19
+  "chunk",                 // 20
+  "all",                   // 21
+  "entries",               // 22
+  "hits",                  // 23
+  "misses",                // 24
+  "evictions",             // 25
+  "expirations",           // 26
+  "revocations",           // 27
+  "journal",               // 28
+  "events",                // 29
+  "seq",                   // 30
+  "uptime_s",              // 31
+  "stages",                // 32
+  "encodings",             // 33
+  "encoding",              // 34
+  "presence",              // 35
+  "retry_after",           // 36
+  "log",                   // 37
+  "resources",             // 38
+};
+
+static const uint8_t WIRE_KEY_COUNT = sizeof(WIRE_KEYS) / sizeof(WIRE_KEYS[0]);
+static const uint8_t WIRE_KEY_TYPE        = 0;
+static const uint8_t WIRE_KEY_RESOURCE_ID = 1;
+static const uint8_t WIRE_KEY_RFID_CODE   = 3;
+static const uint8_t WIRE_KEY_SESSION_ID  = 6;
+
+// Message types, both directions
+static const char* const WIRE_TYPES[] = {
+  "",                      // 0, unused
+  "auth_success",          // 1
+  "auth_error",            // 2
+  "error",                 // 3
+  "ping",                  // 4
+  "pong",                  // 5
+  "access_granted",        // 6
+  "access_denied",         // 7
+  "session_started",       // 8
+  "session_ended",         // 9
+  "cache_revoke",          // 10
+  "cache_stats",           // 11
+  "allowlist_full",        // 12
+  "allowlist_delta",       // 13
+  "event_ack",             // 14
+  "device_auth",           // 15
+  "rfid_scan",             // 16
+  "session_end",           // 17
+  "allowlist_sync",        // 18
+  "allowlist_ack",         // 19
+  "telemetry",             // 20
+  "event_batch",           // 21
+  "card_present",          // 22
+};
+
+static const uint8_t WIRE_TYPE_COUNT = sizeof(WIRE_TYPES) / sizeof(WIRE_TYPES[0]);
+static const uint8_t WIRE_TYPE_PONG        = 5;
+static const uint8_t WIRE_TYPE_RFID_SCAN   = 16;
+static const uint8_t WIRE_TYPE_SESSION_END = 17;
+static const uint8_t WIRE_TYPE_CARD_PRESENT = 22;
+
+// Code for a key or type name, or -1 when it has none
+inline int16_t wireCodeFor(const char* const* table, uint8_t count, const char* name) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(table[i], name) == 0) return i;
+  }
+  return -1;
+}
@@ -0,0 +1,75 @@
+// Arduino core double for host builds of MakerPass firmware
+// Only what the firmware uses.  Deliberately missing are millis(),
+// micros(), delay(), pinMode(), digitalWrite() and esp_random(): the
+// firmware reaches time, pins and randomness through hal.h, and a
+// direct call fails to compile here.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define FALLING 0x02
+
+#define IRAM_ATTR
+
+class String {
+ public:
+  String(const char *text = "") : text_(text ? text : "") {}
+  const char *c_str() const { return text_.c_str(); }
+  unsigned int length() const { return text_.length(); }
+  bool operator==(const char *other) const { return text_ == (other ? other : ""); }
+  bool operator==(const String &other) const { return text_ == other.text_; }
+  bool operator!=(const char *other) const { return !(*this == other); }
+
+ private:
+  std::string text_;
+};
+
+// Stored as the ESP32 core does: the first octet in the low byte
+class IPAddress {
+ public:
+  IPAddress() : address_(0) {}
+  IPAddress(uint32_t address) : address_(address) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : address_(a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) {}
+  operator uint32_t() const { return address_; }
+  uint8_t operator[](int index) const { return (address_ >> (8 * index)) & 0xFF; }
+
+ private:
+  uint32_t address_;
+};
+
+// Output goes to stdout unless muted with hostSerialEcho(false); input
+// is queued with hostSerialInput()
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud);
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t *data, size_t length);
+  size_t print(const char *text);
+  size_t println(const char *text = "");
+  int available();
+  int read();
+};
+
+extern HardwareSerial Serial;
+
+bool psramFound();
+void *ps_malloc(size_t size);
+
+// Starts SNTP; the wall clock is set a little later (see host_sim.h)
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
@@ -0,0 +1,48 @@
+// File system double for host builds of MakerPass firmware
+// An in-memory flash: files are byte vectors keyed by path, directories
+// are implied by mkdir().  Writes land at once, as if every write were
+// followed by a sync.
+
+#pragma once
+
+#include "Arduino.h"
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct HostFile;
+
+class File {
+ public:
+  File() {}
+  explicit File(std::shared_ptr<HostFile> file) : file_(file) {}
+  explicit operator bool() const;
+  size_t read(uint8_t *buf, size_t size);
+  size_t write(const uint8_t *buf, size_t size);
+  bool seek(uint32_t pos);
+  size_t size() const;
+  void close();
+  const char *name() const;
+  const char *path() const;
+  bool isDirectory() const;
+  File openNextFile();
+
+ private:
+  std::shared_ptr<HostFile> file_;
+};
+
+namespace fs {
+
+class FS {
+ public:
+  bool begin(bool formatOnFail = false);
+  File open(const char *path, const char *mode = FILE_READ);
+  bool exists(const char *path);
+  bool mkdir(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *from, const char *to);
+};
+
+}  // namespace fs
@@ -0,0 +1,7 @@
+// LittleFS double for host builds of MakerPass firmware
+
+#pragma once
+
+#include "FS.h"
+
+extern fs::FS LittleFS;
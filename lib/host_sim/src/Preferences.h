@@ -0,0 +1,22 @@
+// NVS Preferences double for host builds of MakerPass firmware
+// Namespaces of typed values in memory, kept for the life of the
+// process as NVS keeps them across reboots.
+
+#pragma once
+
+#include "Arduino.h"
+
+class Preferences {
+ public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t putBytes(const char *key, const void *value, size_t len);
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+  size_t putUInt(const char *key, uint32_t value);
+
+ private:
+  std::string namespace_;
+  bool open_ = false;
+  bool readOnly_ = false;
+};
@@ -0,0 +1,115 @@
+// TFT_eSPI double for host builds of MakerPass firmware
+// The drawing calls the firmware makes, reduced to two primitives:
+// fill a window with one colour, or push a window of pixels.  On the
+// panel each primitive is one SPI window and is counted in
+// hostPanelStats(); a sprite writes into its own framebuffer instead.
+// Text uses fixed-width cells per font (6x8, 8x16, 14x26 for fonts 1,
+// 2 and 4) with a pattern standing in for the glyph, so widths and
+// pixel counts are stable from run to run.
+
+#pragma once
+
+#include "Arduino.h"
+
+#ifndef TFT_WIDTH
+#define TFT_WIDTH 170
+#endif
+#ifndef TFT_HEIGHT
+#define TFT_HEIGHT 320
+#endif
+
+#define TFT_BLACK 0x0000
+#define TFT_NAVY 0x000F
+#define TFT_DARKGREEN 0x03E0
+#define TFT_DARKGREY 0x7BEF
+#define TFT_LIGHTGREY 0xD69A
+#define TFT_BLUE 0x001F
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_RED 0xF800
+#define TFT_MAGENTA 0xF81F
+#define TFT_YELLOW 0xFFE0
+#define TFT_ORANGE 0xFDA0
+#define TFT_WHITE 0xFFFF
+
+// Sprite attribute: allocate the framebuffer in PSRAM
+#define PSRAM_ENABLE 3
+
+class TFT_eSPI {
+ public:
+  TFT_eSPI(int16_t width = TFT_WIDTH, int16_t height = TFT_HEIGHT);
+  virtual ~TFT_eSPI() {}
+
+  void init();
+  void setRotation(uint8_t rotation);
+  int16_t width() const { return width_; }
+  int16_t height() const { return height_; }
+
+  void fillScreen(uint32_t color);
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  void fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color);
+  void drawPixel(int32_t x, int32_t y, uint32_t color);
+
+  void setTextFont(uint8_t font) { font_ = font; }
+  void setTextColor(uint16_t color) { textColor_ = textBgColor_ = color; }
+  void setTextColor(uint16_t color, uint16_t bgColor) {
+    textColor_ = color;
+    textBgColor_ = bgColor;
+  }
+  void setCursor(int16_t x, int16_t y) {
+    cursorX_ = x;
+    cursorY_ = y;
+  }
+  size_t print(const char *text);
+  size_t println(const char *text = "");
+  int16_t textWidth(const char *text, uint8_t font);
+  int16_t textWidth(const char *text) { return textWidth(text, font_); }
+  int16_t fontHeight(uint8_t font);
+  int16_t fontHeight() { return fontHeight(font_); }
+
+  bool initDMA(bool ctrlCs = false);
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data,
+                    uint16_t *buffer = nullptr);
+  void dmaWait() {}
+  void startWrite() {}
+  void endWrite() {}
+  bool getSwapBytes() const { return swapBytes_; }
+  void setSwapBytes(bool swap) { swapBytes_ = swap; }
+
+ protected:
+  // The primitives, on a window already clipped to the screen
+  virtual void fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+  virtual void pushWindow(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels);
+
+  int16_t width_;
+  int16_t height_;
+
+ private:
+  bool clip(int32_t &x, int32_t &y, int32_t &w, int32_t &h) const;
+  void drawGlyph(uint32_t codepoint);
+
+  uint8_t font_ = 1;
+  uint16_t textColor_ = TFT_WHITE;
+  uint16_t textBgColor_ = TFT_WHITE;
+  int16_t cursorX_ = 0;
+  int16_t cursorY_ = 0;
+  bool swapBytes_ = false;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+ public:
+  explicit TFT_eSprite(TFT_eSPI *tft);
+  ~TFT_eSprite() override { deleteSprite(); }
+
+  void setColorDepth(int8_t) {}
+  void setAttribute(uint8_t, uint8_t) {}
+  void *createSprite(int16_t width, int16_t height, uint8_t frames = 1);
+  void deleteSprite();
+
+ protected:
+  void fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) override;
+  void pushWindow(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels) override;
+
+ private:
+  uint16_t *buffer_;
+};
@@ -0,0 +1,102 @@
+// WebSockets client double for host builds of MakerPass firmware
+// The subset of links2004/WebSockets that the firmware uses, with the
+// same connection states and callback order.  The far end is the
+// HostServer registered with hostSetServer(); the link (reachable,
+// full and resumed TLS handshake times, one-way latency) is set with
+// hostSetLink().
+
+#pragma once
+
+#include "Arduino.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+#define WEBSOCKETS_MAX_HEADER_SIZE (14)
+
+typedef enum {
+  WSC_NOT_CONNECTED,
+  WSC_HEADER,
+  WSC_BODY,
+  WSC_CONNECTED
+} WSclientsStatus_t;
+
+typedef enum {
+  WStype_ERROR,
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_TEXT,
+  WStype_BIN,
+  WStype_FRAGMENT_TEXT_START,
+  WStype_FRAGMENT_BIN_START,
+  WStype_FRAGMENT,
+  WStype_FRAGMENT_FIN,
+  WStype_PING,
+  WStype_PONG
+} WStype_t;
+
+struct WSclient_t {
+  WSclientsStatus_t status;
+};
+
+class WebSocketsClient {
+ public:
+  typedef std::function<void(WStype_t type, uint8_t *payload, size_t length)> WebSocketClientEvent;
+
+  WebSocketsClient();
+  virtual ~WebSocketsClient() {}
+
+  void begin(const char *host, uint16_t port, const char *url = "/",
+             const char *protocol = "arduino");
+  void beginSSL(const char *host, uint16_t port, const char *url = "/",
+                const char *fingerprint = "", const char *protocol = "arduino");
+  void beginSslWithCA(const char *host, uint16_t port, const char *url = "/",
+                      const char *caCert = nullptr, const char *protocol = "arduino");
+  void onEvent(WebSocketClientEvent event);
+  void setReconnectInterval(unsigned long time);
+  void loop();
+  void disconnect();
+
+  // With headerToPayload the first WEBSOCKETS_MAX_HEADER_SIZE bytes of
+  // payload are header space and length counts the bytes after them
+  bool sendTXT(uint8_t *payload, size_t length = 0, bool headerToPayload = false);
+  bool sendTXT(const char *payload, size_t length = 0);
+  bool sendBIN(uint8_t *payload, size_t length, bool headerToPayload = false);
+
+  // Host only: frames from the server, delivered by loop()
+  struct HostFrame {
+    int64_t atUs;
+    bool binary;
+    std::vector<uint8_t> data;
+  };
+  void hostQueueFrame(const uint8_t *payload, size_t length, bool binary, int64_t atUs);
+  void hostServerClosed() { serverClosed_ = true; }
+  bool hostConnected() const { return _client.status == WSC_CONNECTED; }
+  void hostAttach() { _client.status = WSC_CONNECTED; }
+  // What ServerSocket::open() does on the ESP32: connect now, whatever
+  // the reconnect interval
+  bool hostOpen() {
+    connect();
+    return _client.status != WSC_NOT_CONNECTED;
+  }
+  bool hostTlsResumed() const { return tlsResumed_; }
+
+ protected:
+  WSclient_t _client;
+
+ private:
+  bool send(uint8_t *payload, size_t length, bool headerToPayload, bool binary);
+  void connect();
+  void closeConnection();
+
+  const char *url_;
+  bool started_;
+  WebSocketClientEvent event_;
+  unsigned long reconnectIntervalMs_;
+  uint32_t lastConnectionFailMs_;
+  int64_t upgradeAtUs_;
+  bool serverClosed_;
+  bool tlsSessionCached_;   // a connect succeeded; the next may resume
+  bool tlsResumed_;
+  std::deque<HostFrame> inbound_;
+};
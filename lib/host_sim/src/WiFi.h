@@ -0,0 +1,57 @@
+// WiFi double for host builds of MakerPass firmware
+// Station mode against the access points registered with
+// hostWiFiAddAccessPoint().  Association and scans finish in the
+// background after a realistic delay, as on the ESP32.
+
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class WiFiClass {
+ public:
+  bool persistent(bool) { return true; }
+  bool mode(wifi_mode_t) { return true; }
+  bool setAutoReconnect(bool) { return true; }
+  wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t *bssid = nullptr, bool connect = true);
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+              IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status();
+
+  int16_t scanNetworks(bool async = false);
+  int16_t scanComplete();
+  void scanDelete();
+  String SSID(uint8_t index);
+  int32_t RSSI(uint8_t index);
+  uint8_t *BSSID(uint8_t index);
+  int32_t channel(uint8_t index);
+
+  // The access point in use
+  String SSID();
+  int32_t RSSI();
+  uint8_t *BSSID();
+  int32_t channel();
+
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+};
+
+extern WiFiClass WiFi;
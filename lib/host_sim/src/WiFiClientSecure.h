@@ -0,0 +1,9 @@
+// WiFiClientSecure double for host builds of MakerPass firmware
+// TLS is modelled by the WebSockets client double (HostLink), so the
+// class only has to exist.
+
+#pragma once
+
+#include "WiFi.h"
+
+class WiFiClientSecure {};
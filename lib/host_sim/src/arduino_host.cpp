@@ -0,0 +1,80 @@
+// Arduino core double for host builds of MakerPass firmware
+// Serial console, PSRAM allocation and SNTP.
+
+#include "Arduino.h"
+#include "host_sim.h"
+#include "host_internal.h"
+#include "hal.h"
+#include <deque>
+
+// SNTP answers this long after configTime()
+static const int64_t SNTP_DELAY_US = 400000;
+
+HardwareSerial Serial;
+
+static bool consoleEcho = true;
+static std::deque<uint8_t> consoleInput;
+static time_t sntpTime = 1767225600;   // 2026-01-01 00:00:00 UTC
+
+void hostConsoleWrite(const char *text, size_t length) {
+  if (consoleEcho) fwrite(text, 1, length, stdout);
+}
+
+void hostSerialEcho(bool on) {
+  consoleEcho = on;
+}
+
+void hostSerialInput(const char *text) {
+  while (*text) consoleInput.push_back((uint8_t)*text++);
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+size_t HardwareSerial::write(uint8_t byte) {
+  hostConsoleWrite((const char *)&byte, 1);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+  hostConsoleWrite((const char *)data, length);
+  return length;
+}
+
+size_t HardwareSerial::print(const char *text) {
+  return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HardwareSerial::println(const char *text) {
+  return print(text) + write((const uint8_t *)"\r\n", 2);
+}
+
+int HardwareSerial::available() {
+  return (int)consoleInput.size();
+}
+
+int HardwareSerial::read() {
+  if (consoleInput.empty()) return -1;
+  int byte = consoleInput.front();
+  consoleInput.pop_front();
+  return byte;
+}
+
+bool psramFound() {
+  return true;
+}
+
+void *ps_malloc(size_t size) {
+  return malloc(size);
+}
+
+void hostSetSntpTime(time_t now) {
+  sntpTime = now;
+}
+
+static void sntpAnswered(void *) {
+  halSetWallClock(sntpTime + (time_t)(halUptimeUs() / 1000000));
+}
+
+void configTime(long, int, const char *, const char *, const char *) {
+  halScheduleAt(halUptimeUs() + SNTP_DELAY_US, sntpAnswered, nullptr);
+}
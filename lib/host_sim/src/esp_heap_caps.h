@@ -0,0 +1,20 @@
+// ESP-IDF heap capabilities double for host builds of MakerPass firmware
+// Allocation comes from the host heap.  The statistics are fixed
+// figures typical of the firmware at run time, so that reports and
+// benchmarks have stable numbers.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+inline void *heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline size_t heap_caps_get_free_size(uint32_t) { return 151552; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return 110592; }
+inline size_t heap_caps_get_minimum_free_size(uint32_t) { return 139264; }
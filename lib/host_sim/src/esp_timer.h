@@ -0,0 +1,11 @@
+// ESP-IDF timer double for host builds of MakerPass firmware
+// The firmware reads the clock through hal.h; this is the same
+// virtual clock for code that asks esp_timer directly.
+
+#pragma once
+
+#include <stdint.h>
+
+int64_t halUptimeUs();
+
+inline int64_t esp_timer_get_time() { return halUptimeUs(); }
@@ -0,0 +1,29 @@
+// FreeRTOS double for host builds of MakerPass firmware
+// The types, constants and asserts the firmware uses.  One tick is one
+// millisecond, as configured for the ESP32 Arduino core.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Yielding from an interrupt is implicit: the scheduler picks the
+// highest-priority ready task whenever the running one blocks
+#define portYIELD_FROM_ISR()
+
+[[noreturn]] void hostAssertFailed(const char *file, int line, const char *expr);
+
+#define configASSERT(x) \
+  do { \
+    if (!(x)) hostAssertFailed(__FILE__, __LINE__, #x); \
+  } while (0)
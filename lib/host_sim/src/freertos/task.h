@@ -0,0 +1,25 @@
+// FreeRTOS task double for host builds of MakerPass firmware
+// Tasks are coroutines on the virtual clock (see host_scheduler.cpp).
+// A task runs until it blocks; then the highest-priority ready task
+// runs, and when none is ready the clock jumps to the next deadline.
+// Code takes no virtual time to run, so the order of events is exact
+// and repeatable; the real CPU time of each task is measured
+// separately.
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+struct HostTask;
+typedef HostTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *created,
+                                   BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+void vTaskDelay(TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken);
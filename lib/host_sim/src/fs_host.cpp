@@ -0,0 +1,146 @@
+// File system double for host builds of MakerPass firmware
+
+#include "FS.h"
+#include "LittleFS.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+static std::map<std::string, std::vector<uint8_t>> files;
+static std::set<std::string> directories = {"/"};
+
+struct HostFile {
+  std::string path;
+  std::string name;        // after the last '/'
+  bool directory;
+  bool writable;
+  bool open;
+  size_t position;
+  std::string nextEntry;   // directory listing: entries after this one
+};
+
+static std::shared_ptr<HostFile> makeFile(const std::string &path, bool directory, bool writable) {
+  auto file = std::make_shared<HostFile>();
+  file->path = path;
+  file->name = path.substr(path.rfind('/') + 1);
+  file->directory = directory;
+  file->writable = writable;
+  file->open = true;
+  file->position = 0;
+  return file;
+}
+
+File::operator bool() const {
+  return file_ && file_->open;
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+  if (!*this || file_->directory) return 0;
+  const std::vector<uint8_t> &data = files[file_->path];
+  size_t n = file_->position < data.size() ? std::min(size, data.size() - file_->position) : 0;
+  memcpy(buf, data.data() + file_->position, n);
+  file_->position += n;
+  return n;
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+  if (!*this || file_->directory || !file_->writable) return 0;
+  std::vector<uint8_t> &data = files[file_->path];
+  if (data.size() < file_->position + size) data.resize(file_->position + size);
+  memcpy(data.data() + file_->position, buf, size);
+  file_->position += size;
+  return size;
+}
+
+bool File::seek(uint32_t pos) {
+  if (!*this || pos > size()) return false;
+  file_->position = pos;
+  return true;
+}
+
+size_t File::size() const {
+  if (!*this || file_->directory) return 0;
+  auto it = files.find(file_->path);
+  return it == files.end() ? 0 : it->second.size();
+}
+
+void File::close() {
+  if (file_) file_->open = false;
+}
+
+const char *File::name() const {
+  return file_ ? file_->name.c_str() : "";
+}
+
+const char *File::path() const {
+  return file_ ? file_->path.c_str() : "";
+}
+
+bool File::isDirectory() const {
+  return *this && file_->directory;
+}
+
+// The next file directly inside this directory, in name order
+File File::openNextFile() {
+  if (!isDirectory()) return File();
+  std::string prefix = file_->path == "/" ? "/" : file_->path + "/";
+  for (auto it = files.upper_bound(file_->nextEntry.empty() ? prefix : file_->nextEntry);
+       it != files.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+    if (it->first.find('/', prefix.size()) != std::string::npos) continue;
+    file_->nextEntry = it->first;
+    return File(makeFile(it->first, false, false));
+  }
+  return File();
+}
+
+namespace fs {
+
+bool FS::begin(bool) {
+  return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+  std::string name = path;
+  if (directories.count(name)) return File(makeFile(name, true, false));
+  if (mode[0] == 'r') {
+    if (!files.count(name)) return File();
+    return File(makeFile(name, false, false));
+  }
+  std::string parent = name.substr(0, name.rfind('/'));
+  if (!parent.empty() && !directories.count(parent)) return File();
+  std::vector<uint8_t> &data = files[name];
+  auto file = makeFile(name, false, true);
+  if (mode[0] == 'w') {
+    data.clear();
+  } else {
+    file->position = data.size();
+  }
+  return File(file);
+}
+
+bool FS::exists(const char *path) {
+  return files.count(path) || directories.count(path);
+}
+
+bool FS::mkdir(const char *path) {
+  directories.insert(path);
+  return true;
+}
+
+bool FS::remove(const char *path) {
+  return files.erase(path) > 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  auto it = files.find(from);
+  if (it == files.end()) return false;
+  files[to] = std::move(it->second);
+  files.erase(from);
+  return true;
+}
+
+}  // namespace fs
+
+fs::FS LittleFS;
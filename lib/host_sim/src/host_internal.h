@@ -0,0 +1,13 @@
+// Shared between the host doubles; not for firmware or host programs
+
+#pragma once
+
+#include <stdint.h>
+
+// Block the calling task for us of virtual time, e.g. inside a driver
+// call that would busy the CPU (a TLS handshake).  Other tasks run
+// meanwhile.  Outside a task the clock simply moves on.
+void hostSleepUs(int64_t us);
+
+// Write text to the console unless it is muted
+void hostConsoleWrite(const char *text, size_t length);
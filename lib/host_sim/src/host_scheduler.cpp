@@ -0,0 +1,259 @@
+// FreeRTOS scheduler double for host builds of MakerPass firmware
+// Each task is a ucontext coroutine with its own stack.  The scheduler
+// runs the highest-priority ready task until it blocks; when no task
+// is ready it moves the virtual clock to the earliest task deadline or
+// HAL event (a Wiegand edge, a driver callback), runs the events due
+// and wakes the tasks whose deadline has come.  A task that blocks
+// while every other task sleeps past its own deadline moves the clock
+// itself and carries on without a switch, which keeps the network
+// task's 2 ms poll cheap enough for a day to run in about a minute.
+//
+// There is no preemption and code takes no virtual time, so a run is
+// deterministic: the same scenario and seed give the same trace.  The
+// real CPU time each task spends is measured for the loop cost report.
+
+#include "Arduino.h"
+#include "host_sim.h"
+#include "host_internal.h"
+#include "hal.h"
+#include <ucontext.h>
+#include <chrono>
+#include <vector>
+
+struct HostTask {
+  const char *name;
+  TaskFunction_t code;
+  void *arg;
+  UBaseType_t priority;
+  ucontext_t context;
+  void *stack;
+  bool ready;
+  bool takesNotify;        // blocked in ulTaskNotifyTake()
+  int64_t wakeUs;          // deadline while blocked
+  uint32_t notify;
+  uint64_t lastRun;        // round robin among equal priorities
+  uint64_t wakeups;
+  uint64_t cpuNs;
+};
+
+// Host code needs far more stack than the firmware budgets on target
+static const size_t HOST_STACK_BYTES = 1024 * 1024;
+
+// Task switches at one virtual instant before the run is declared
+// stuck, e.g. two tasks notifying each other forever
+static const uint32_t HOST_SPIN_LIMIT = 1000000;
+
+static const int64_t FOREVER = INT64_MAX;
+
+static std::vector<HostTask *> tasks;
+static HostTask *current = nullptr;
+static bool inInterrupt = false;
+static ucontext_t schedulerContext;
+static int64_t runLimitUs = 0;
+static uint64_t runCount = 0;
+static uint32_t spins = 0;
+static void (*probe)() = nullptr;
+
+void setup();
+void loop();
+
+[[noreturn]] void hostAssertFailed(const char *file, int line, const char *expr) {
+  fflush(stdout);
+  fprintf(stderr, "\nassert failed at %.3f s in %s: %s (%s:%d)\n", halUptimeUs() / 1e6,
+          current ? current->name : "scheduler", expr, file, line);
+  abort();
+}
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Move the clock, running the events due on the way in interrupt
+// context
+static void advanceClock(int64_t us) {
+  inInterrupt = true;
+  halSetUptimeUs(us);
+  inInterrupt = false;
+}
+
+static void taskEntry() {
+  current->code(current->arg);
+  hostAssertFailed(__FILE__, __LINE__, "task function returned");
+}
+
+static HostTask *nextReady() {
+  HostTask *best = nullptr;
+  for (HostTask *task : tasks) {
+    if (!task->ready) continue;
+    if (!best || task->priority > best->priority ||
+        (task->priority == best->priority && task->lastRun < best->lastRun)) {
+      best = task;
+    }
+  }
+  return best;
+}
+
+// Earliest moment anything other than `self` needs the CPU
+static int64_t nextDeadlineExcept(const HostTask *self) {
+  int64_t due = halNextEventUs();
+  for (HostTask *task : tasks) {
+    if (task == self) continue;
+    if (task->ready) return halUptimeUs();
+    if (task->wakeUs < due) due = task->wakeUs;
+  }
+  return due;
+}
+
+static void block(HostTask *self, int64_t wakeUs, bool takesNotify) {
+  if (!self) {
+    if (wakeUs != FOREVER) advanceClock(wakeUs);
+    return;
+  }
+  configASSERT(!inInterrupt);
+  self->wakeups++;
+  // Nothing else to run before our own deadline: skip the switch
+  if (wakeUs < runLimitUs && wakeUs < nextDeadlineExcept(self)) {
+    halSetUptimeUs(wakeUs);
+    spins = 0;
+    if (probe) probe();
+    return;
+  }
+  self->ready = false;
+  self->takesNotify = takesNotify;
+  self->wakeUs = wakeUs;
+  swapcontext(&self->context, &schedulerContext);
+}
+
+static void makeReady(HostTask *task) {
+  task->ready = true;
+  task->takesNotify = false;
+  task->wakeUs = FOREVER;
+}
+
+static void runTask(HostTask *task) {
+  current = task;
+  task->lastRun = ++runCount;
+  uint64_t startNs = nowNs();
+  swapcontext(&schedulerContext, &task->context);
+  task->cpuNs += nowNs() - startNs;
+  current = nullptr;
+}
+
+void hostRunUntil(int64_t uptimeUs) {
+  configASSERT(!current);
+  runLimitUs = uptimeUs;
+  for (;;) {
+    HostTask *task = nextReady();
+    if (task) {
+      if (++spins > HOST_SPIN_LIMIT) {
+        hostAssertFailed(__FILE__, __LINE__, "tasks keep running without the clock moving");
+      }
+      runTask(task);
+      if (probe) probe();
+      continue;
+    }
+    int64_t due = halNextEventUs();
+    for (HostTask *blocked : tasks) {
+      if (blocked->wakeUs < due) due = blocked->wakeUs;
+    }
+    if (due > uptimeUs) {
+      advanceClock(uptimeUs);
+      return;
+    }
+    advanceClock(due);
+    spins = 0;
+    for (HostTask *blocked : tasks) {
+      if (!blocked->ready && blocked->wakeUs <= halUptimeUs()) makeReady(blocked);
+    }
+  }
+}
+
+static void loopTask(void *) {
+  setup();
+  for (;;) {
+    loop();
+  }
+}
+
+void hostStart() {
+  xTaskCreatePinnedToCore(loopTask, "loopTask", 8192, nullptr, 1, nullptr, 1);
+}
+
+void hostSetProbe(void (*callback)()) {
+  probe = callback;
+}
+
+size_t hostTaskStats(HostTaskStats *out, size_t max) {
+  size_t n = 0;
+  for (HostTask *task : tasks) {
+    if (n == max) break;
+    out[n++] = {task->name, (uint8_t)task->priority, task->wakeups, task->cpuNs};
+  }
+  return n;
+}
+
+void hostSleepUs(int64_t us) {
+  block(inInterrupt ? nullptr : current, halUptimeUs() + us, false);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t) {
+  HostTask *task = new HostTask();
+  task->name = name;
+  task->code = code;
+  task->arg = arg;
+  task->priority = priority;
+  task->stack = malloc(HOST_STACK_BYTES);
+  getcontext(&task->context);
+  task->context.uc_stack.ss_sp = task->stack;
+  task->context.uc_stack.ss_size = HOST_STACK_BYTES;
+  task->context.uc_link = nullptr;
+  makecontext(&task->context, taskEntry, 0);
+  makeReady(task);
+  tasks.push_back(task);
+  if (created) *created = task;
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return inInterrupt ? nullptr : current;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+  if (!task) task = current;
+  if (task) task->priority = priority;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  block(current, halUptimeUs() + (int64_t)ticks * 1000, false);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  configASSERT(!inInterrupt);
+  HostTask *self = current;
+  if (!self) {
+    // Outside the tasks (a unit test) nothing can notify; just wait
+    if (ticks != portMAX_DELAY) advanceClock(halUptimeUs() + (int64_t)ticks * 1000);
+    return 0;
+  }
+  if (self->notify == 0 && ticks > 0) {
+    block(self, ticks == portMAX_DELAY ? FOREVER : halUptimeUs() + (int64_t)ticks * 1000, true);
+  }
+  uint32_t value = self->notify;
+  if (value) self->notify = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  task->notify++;
+  if (!task->ready && task->takesNotify) makeReady(task);
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken) {
+  bool wasBlocked = !task->ready;
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken && wasBlocked && task->ready) *higherPriorityTaskWoken = pdTRUE;
+}
@@ -0,0 +1,108 @@
+// Host simulation control surface for MakerPass firmware
+// The firmware sees the ESP32 through hal.h and the library interfaces
+// doubled in this directory.  A host program (the scenario runner, the
+// benchmarks, the unit tests) drives them through these calls: run
+// setup() and loop() and the tasks on the virtual clock, stand in for
+// the server at the far end of the WebSocket, switch access points and
+// the server link up and down, and read back what reached the panel.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ---------------------------------------------------------------------------
+// Scheduler
+// ---------------------------------------------------------------------------
+
+// Create the Arduino loop task, which runs setup() and then loop()
+// forever, as the ESP32 core does at boot
+void hostStart();
+
+// Run the tasks until the virtual clock reaches uptimeUs.  Aborts with
+// a diagnostic if the tasks keep running without the clock moving.
+void hostRunUntil(int64_t uptimeUs);
+
+// Called after every task switch, e.g. to check invariants
+void hostSetProbe(void (*probe)());
+
+struct HostTaskStats {
+  const char *name;
+  uint8_t priority;
+  uint64_t wakeups;        // returns from a blocking call
+  uint64_t cpuNs;          // real time spent running
+};
+
+size_t hostTaskStats(HostTaskStats *out, size_t max);
+
+// ---------------------------------------------------------------------------
+// Serial console
+// ---------------------------------------------------------------------------
+
+void hostSerialEcho(bool on);
+void hostSerialInput(const char *text);
+
+// ---------------------------------------------------------------------------
+// WiFi: access points within reach
+// ---------------------------------------------------------------------------
+
+// Returns the access point's index.  Associating takes longer when
+// the driver has to scan for the network than with a known BSSID.
+uint8_t hostWiFiAddAccessPoint(const char *ssid, const uint8_t bssid[6], int32_t channel,
+                               int32_t rssi);
+void hostWiFiSetAccessPoint(uint8_t index, bool up, int32_t rssi);
+
+// The wall-clock time at boot; SNTP sets the clock a moment after
+// configTime()
+void hostSetSntpTime(time_t now);
+
+// ---------------------------------------------------------------------------
+// Server link: the far end of the WebSocket
+// ---------------------------------------------------------------------------
+
+// Frames reach the server as the device sends them; it answers with
+// hostServerSend(), from its callbacks or at any other time
+class HostServer {
+ public:
+  virtual ~HostServer() {}
+  // The device asks to upgrade; false answers 503
+  virtual bool accept() = 0;
+  virtual void receive(const uint8_t *payload, size_t length, bool binary) = 0;
+  virtual void closed() = 0;
+};
+
+struct HostLink {
+  bool reachable;          // false: TCP connects are refused
+  uint32_t handshakeMs;    // TCP + full TLS handshake, blocking the caller
+  uint32_t latencyUs;      // one way, each frame and the upgrade
+  uint32_t resumedHandshakeMs;  // TCP + TLS resuming the last session; 0: never resumed
+};
+
+void hostSetServer(HostServer *server);
+void hostSetLink(const HostLink &link);
+void hostServerSend(const uint8_t *payload, size_t length, bool binary);
+void hostServerClose();
+bool hostServerConnected();
+
+// Open the connection at once, without WiFi or a handshake.  For a
+// program that carries the frames itself (the load generator): with
+// no latency every frame the firmware sends reaches receive() before
+// the send returns.
+void hostServerAttach();
+
+// ---------------------------------------------------------------------------
+// Panel
+// ---------------------------------------------------------------------------
+
+// Traffic to the display controller.  A window costs 11 bytes of
+// commands (CASET, RASET, RAMWR) before its pixels, two bytes each.
+struct HostPanelStats {
+  uint32_t windows;
+  uint64_t pixels;
+  uint64_t spiBytes;
+};
+
+const HostPanelStats &hostPanelStats();
+void hostPanelResetStats();
+uint16_t hostPanelPixel(int16_t x, int16_t y);
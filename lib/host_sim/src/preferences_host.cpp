@@ -0,0 +1,46 @@
+// NVS Preferences double for host builds of MakerPass firmware
+
+#include "Preferences.h"
+#include <map>
+#include <vector>
+
+static std::map<std::string, std::vector<uint8_t>> store;   // "namespace/key"
+
+static std::string storeKey(const std::string &space, const char *key) {
+  return space + "/" + key;
+}
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  namespace_ = name;
+  open_ = true;
+  readOnly_ = readOnly;
+  return true;
+}
+
+void Preferences::end() {
+  open_ = false;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  if (!open_) return 0;
+  auto it = store.find(storeKey(namespace_, key));
+  if (it == store.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (!open_ || readOnly_) return 0;
+  const uint8_t *bytes = (const uint8_t *)value;
+  store[storeKey(namespace_, key)].assign(bytes, bytes + len);
+  return len;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) {
+  uint32_t value;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
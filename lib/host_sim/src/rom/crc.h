@@ -0,0 +1,9 @@
+// ESP32 ROM CRC double for host builds of MakerPass firmware
+
+#pragma once
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3), the ROM's crc32_le: crc32_le(0, buf, len) is
+// the usual CRC of buf, and a previous result continues it
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,226 @@
+// TFT_eSPI double for host builds of MakerPass firmware
+
+#include "TFT_eSPI.h"
+#include "host_sim.h"
+#include <algorithm>
+#include <vector>
+
+// Address window set-up before each run of pixels: CASET and RASET
+// with four bytes each, then RAMWR
+static const uint32_t WINDOW_COMMAND_BYTES = 11;
+
+// What the panel shows, large enough for either orientation
+static const int32_t PANEL_STRIDE = TFT_WIDTH > TFT_HEIGHT ? TFT_WIDTH : TFT_HEIGHT;
+static std::vector<uint16_t> panel(PANEL_STRIDE * PANEL_STRIDE);
+static HostPanelStats panelStats = {};
+
+const HostPanelStats &hostPanelStats() {
+  return panelStats;
+}
+
+void hostPanelResetStats() {
+  panelStats = {};
+}
+
+uint16_t hostPanelPixel(int16_t x, int16_t y) {
+  if (x < 0 || y < 0 || x >= PANEL_STRIDE || y >= PANEL_STRIDE) return 0;
+  return panel[y * PANEL_STRIDE + x];
+}
+
+static void countWindow(int32_t w, int32_t h) {
+  panelStats.windows++;
+  panelStats.pixels += (uint64_t)w * h;
+  panelStats.spiBytes += WINDOW_COMMAND_BYTES + (uint64_t)w * h * 2;
+}
+
+struct FontCell {
+  uint8_t width;
+  uint8_t height;
+};
+
+static FontCell fontCell(uint8_t font) {
+  switch (font) {
+    case 2: return {8, 16};
+    case 4: return {14, 26};
+    case 6: return {24, 48};
+    case 7: return {32, 48};
+    case 8: return {55, 75};
+    default: return {6, 8};
+  }
+}
+
+// Next code point of UTF-8 text; malformed bytes count as one each
+static uint32_t nextCodepoint(const char *&text) {
+  uint8_t lead = (uint8_t)*text++;
+  int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+  uint32_t codepoint = extra ? lead & (0x3F >> extra) : lead;
+  while (extra-- > 0 && ((uint8_t)*text & 0xC0) == 0x80) {
+    codepoint = (codepoint << 6) | ((uint8_t)*text++ & 0x3F);
+  }
+  return codepoint;
+}
+
+TFT_eSPI::TFT_eSPI(int16_t width, int16_t height) : width_(width), height_(height) {}
+
+void TFT_eSPI::init() {}
+
+void TFT_eSPI::setRotation(uint8_t rotation) {
+  bool landscape = rotation & 1;
+  width_ = landscape ? TFT_HEIGHT : TFT_WIDTH;
+  height_ = landscape ? TFT_WIDTH : TFT_HEIGHT;
+}
+
+bool TFT_eSPI::clip(int32_t &x, int32_t &y, int32_t &w, int32_t &h) const {
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > width_) w = width_ - x;
+  if (y + h > height_) h = height_ - y;
+  return w > 0 && h > 0;
+}
+
+void TFT_eSPI::fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+  countWindow(w, h);
+  for (int32_t row = y; row < y + h; row++) {
+    std::fill_n(&panel[row * PANEL_STRIDE + x], w, color);
+  }
+}
+
+void TFT_eSPI::pushWindow(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels) {
+  countWindow(w, h);
+  for (int32_t row = 0; row < h; row++) {
+    std::copy_n(pixels + row * w, w, &panel[(y + row) * PANEL_STRIDE + x]);
+  }
+}
+
+void TFT_eSPI::fillScreen(uint32_t color) {
+  fillRect(0, 0, width_, height_, color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  if (clip(x, y, w, h)) fillWindow(x, y, w, h, (uint16_t)color);
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color) {
+  fillRect(x, y, 1, 1, color);
+}
+
+// One horizontal span per row, as the library draws it
+void TFT_eSPI::fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color) {
+  for (int32_t dy = -r; dy <= r; dy++) {
+    int32_t dx = 0;
+    while ((dx + 1) * (dx + 1) + dy * dy <= r * r) dx++;
+    fillRect(x - dx, y + dy, 2 * dx + 1, 1, color);
+  }
+}
+
+// One cell at the cursor.  With a background colour the whole cell is
+// one window, as the library sends built-in fonts; without one (text
+// colour equal to background) only the glyph pixels are drawn.
+void TFT_eSPI::drawGlyph(uint32_t codepoint) {
+  FontCell cell = fontCell(font_);
+  uint16_t pixels[75 * 55];
+  for (int32_t row = 0; row < cell.height; row++) {
+    for (int32_t col = 0; col < cell.width; col++) {
+      bool inked = codepoint != ' ' && row > 1 && row < cell.height - 2 && col > 0 &&
+                   col < cell.width - 1 && ((codepoint * 7 + row * 3 + col * 5) % 4) == 0;
+      pixels[row * cell.width + col] = inked ? textColor_ : textBgColor_;
+      if (inked && textColor_ == textBgColor_) drawPixel(cursorX_ + col, cursorY_ + row, textColor_);
+    }
+  }
+  if (textColor_ != textBgColor_) {
+    int32_t x = cursorX_, y = cursorY_, w = cell.width, h = cell.height;
+    if (x >= 0 && y >= 0 && clip(x, y, w, h) && w == cell.width && h == cell.height) {
+      pushWindow(x, y, w, h, pixels);
+    } else {
+      for (int32_t row = 0; row < cell.height; row++) {
+        for (int32_t col = 0; col < cell.width; col++) {
+          drawPixel(cursorX_ + col, cursorY_ + row, pixels[row * cell.width + col]);
+        }
+      }
+    }
+  }
+  cursorX_ += cell.width;
+}
+
+size_t TFT_eSPI::print(const char *text) {
+  size_t length = strlen(text);
+  while (*text) {
+    uint32_t codepoint = nextCodepoint(text);
+    if (codepoint == '\n') {
+      cursorX_ = 0;
+      cursorY_ += fontHeight(font_);
+    } else {
+      drawGlyph(codepoint);
+    }
+  }
+  return length;
+}
+
+size_t TFT_eSPI::println(const char *text) {
+  size_t length = print(text);
+  cursorX_ = 0;
+  cursorY_ += fontHeight(font_);
+  return length + 1;
+}
+
+int16_t TFT_eSPI::textWidth(const char *text, uint8_t font) {
+  int16_t glyphs = 0;
+  while (*text) {
+    nextCodepoint(text);
+    glyphs++;
+  }
+  return glyphs * fontCell(font).width;
+}
+
+int16_t TFT_eSPI::fontHeight(uint8_t font) {
+  return fontCell(font).height;
+}
+
+bool TFT_eSPI::initDMA(bool) {
+  return true;
+}
+
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data,
+                            uint16_t *) {
+  int32_t cx = x, cy = y, cw = w, ch = h;
+  if (!clip(cx, cy, cw, ch)) return;
+  if (cw == w && ch == h) {
+    pushWindow(x, y, w, h, data);
+    return;
+  }
+  std::vector<uint16_t> part(cw * ch);
+  for (int32_t row = 0; row < ch; row++) {
+    std::copy_n(data + (cy - y + row) * w + (cx - x), cw, &part[row * cw]);
+  }
+  pushWindow(cx, cy, cw, ch, part.data());
+}
+
+TFT_eSprite::TFT_eSprite(TFT_eSPI *) : TFT_eSPI(0, 0), buffer_(nullptr) {}
+
+void *TFT_eSprite::createSprite(int16_t width, int16_t height, uint8_t) {
+  deleteSprite();
+  buffer_ = (uint16_t *)calloc((size_t)width * height, sizeof(uint16_t));
+  if (buffer_) {
+    width_ = width;
+    height_ = height;
+  }
+  return buffer_;
+}
+
+void TFT_eSprite::deleteSprite() {
+  free(buffer_);
+  buffer_ = nullptr;
+  width_ = height_ = 0;
+}
+
+void TFT_eSprite::fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+  for (int32_t row = y; row < y + h; row++) {
+    std::fill_n(buffer_ + row * width_ + x, w, color);
+  }
+}
+
+void TFT_eSprite::pushWindow(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels) {
+  for (int32_t row = 0; row < h; row++) {
+    std::copy_n(pixels + row * w, w, buffer_ + (y + row) * width_ + x);
+  }
+}
@@ -0,0 +1,197 @@
+// WebSockets client double for host builds of MakerPass firmware
+// loop() connects when the reconnect interval allows, as the library
+// does: the TCP and TLS handshake blocks the calling task for
+// HostLink::handshakeMs, or resumedHandshakeMs when an earlier connect
+// left a session to resume, then the upgrade answer arrives a round trip
+// later on a following loop().  Frames travel one way in
+// HostLink::latencyUs; with no latency they are handed over inside the
+// send call.  A disconnect reports WStype_DISCONNECTED only for a
+// connection that had been upgraded, and a dropped WiFi link is
+// noticed on the next loop().
+
+#include "WebSocketsClient.h"
+#include "WiFi.h"
+#include "host_sim.h"
+#include "host_internal.h"
+#include "hal.h"
+
+static WebSocketsClient *activeClient = nullptr;
+static HostServer *server = nullptr;
+static HostLink link = {true, 600, 20000, 150};
+
+// A frame on its way to the server
+struct ServerBound {
+  bool binary;
+  std::vector<uint8_t> data;
+};
+
+void hostSetServer(HostServer *farEnd) {
+  server = farEnd;
+}
+
+void hostSetLink(const HostLink &settings) {
+  link = settings;
+}
+
+bool hostServerConnected() {
+  return activeClient && activeClient->hostConnected();
+}
+
+void hostServerSend(const uint8_t *payload, size_t length, bool binary) {
+  if (!hostServerConnected()) return;
+  activeClient->hostQueueFrame(payload, length, binary, halUptimeUs() + link.latencyUs);
+}
+
+void hostServerAttach() {
+  if (activeClient) activeClient->hostAttach();
+}
+
+void hostServerClose() {
+  if (hostServerConnected()) activeClient->hostServerClosed();
+}
+
+static void arriveAtServer(void *arg) {
+  ServerBound *frame = (ServerBound *)arg;
+  if (server && hostServerConnected()) {
+    server->receive(frame->data.data(), frame->data.size(), frame->binary);
+  }
+  delete frame;
+}
+
+WebSocketsClient::WebSocketsClient()
+    : url_("/"), started_(false), reconnectIntervalMs_(500), lastConnectionFailMs_(0),
+      upgradeAtUs_(0), serverClosed_(false), tlsSessionCached_(false), tlsResumed_(false) {
+  _client.status = WSC_NOT_CONNECTED;
+}
+
+void WebSocketsClient::begin(const char *, uint16_t, const char *url, const char *) {
+  url_ = url;
+  started_ = true;
+  activeClient = this;
+}
+
+void WebSocketsClient::beginSSL(const char *host, uint16_t port, const char *url, const char *,
+                                const char *protocol) {
+  begin(host, port, url, protocol);
+}
+
+void WebSocketsClient::beginSslWithCA(const char *host, uint16_t port, const char *url,
+                                      const char *, const char *protocol) {
+  begin(host, port, url, protocol);
+}
+
+void WebSocketsClient::onEvent(WebSocketClientEvent event) {
+  event_ = event;
+}
+
+void WebSocketsClient::setReconnectInterval(unsigned long time) {
+  reconnectIntervalMs_ = time;
+}
+
+void WebSocketsClient::hostQueueFrame(const uint8_t *payload, size_t length, bool binary,
+                                      int64_t atUs) {
+  HostFrame frame;
+  frame.atUs = atUs;
+  frame.binary = binary;
+  frame.data.assign(payload, payload + length);
+  inbound_.push_back(frame);
+}
+
+// TCP connect and TLS handshake, then send the upgrade request
+void WebSocketsClient::connect() {
+  bool resume = tlsSessionCached_ && link.resumedHandshakeMs != 0;
+  hostSleepUs((int64_t)(resume ? link.resumedHandshakeMs : link.handshakeMs) * 1000);
+  if (!link.reachable || !server || WiFi.status() != WL_CONNECTED) {
+    lastConnectionFailMs_ = halMillis();
+    return;
+  }
+  tlsSessionCached_ = true;
+  tlsResumed_ = resume;
+  lastConnectionFailMs_ = 0;
+  serverClosed_ = false;
+  inbound_.clear();
+  _client.status = WSC_HEADER;
+  upgradeAtUs_ = halUptimeUs() + 2 * (int64_t)link.latencyUs;
+}
+
+void WebSocketsClient::closeConnection() {
+  bool upgraded = _client.status == WSC_CONNECTED;
+  _client.status = WSC_NOT_CONNECTED;
+  inbound_.clear();
+  if (!upgraded) return;
+  if (server) server->closed();
+  if (event_) event_(WStype_DISCONNECTED, nullptr, 0);
+}
+
+void WebSocketsClient::loop() {
+  if (!started_) return;
+  switch (_client.status) {
+    case WSC_NOT_CONNECTED:
+      if (halMillis() - lastConnectionFailMs_ < reconnectIntervalMs_) return;
+      connect();
+      return;
+    case WSC_HEADER:
+    case WSC_BODY:
+      if (WiFi.status() != WL_CONNECTED) {
+        closeConnection();
+        return;
+      }
+      if (halUptimeUs() < upgradeAtUs_) return;
+      if (!server->accept()) {
+        closeConnection();
+        return;
+      }
+      _client.status = WSC_CONNECTED;
+      if (event_) event_(WStype_CONNECTED, (uint8_t *)url_, strlen(url_));
+      return;
+    case WSC_CONNECTED:
+      break;
+  }
+  if (serverClosed_ || WiFi.status() != WL_CONNECTED) {
+    closeConnection();
+    return;
+  }
+  while (!inbound_.empty() && inbound_.front().atUs <= halUptimeUs() &&
+         _client.status == WSC_CONNECTED) {
+    HostFrame frame = inbound_.front();
+    inbound_.pop_front();
+    // The library hands over its receive buffer, terminated
+    frame.data.push_back(0);
+    if (event_) {
+      event_(frame.binary ? WStype_BIN : WStype_TEXT, frame.data.data(), frame.data.size() - 1);
+    }
+  }
+}
+
+void WebSocketsClient::disconnect() {
+  closeConnection();
+}
+
+bool WebSocketsClient::send(uint8_t *payload, size_t length, bool headerToPayload, bool binary) {
+  if (_client.status != WSC_CONNECTED) return false;
+  if (headerToPayload) payload += WEBSOCKETS_MAX_HEADER_SIZE;
+  if (link.latencyUs == 0) {
+    if (server) server->receive(payload, length, binary);
+    return true;
+  }
+  ServerBound *frame = new ServerBound();
+  frame->binary = binary;
+  frame->data.assign(payload, payload + length);
+  halScheduleAt(halUptimeUs() + link.latencyUs, arriveAtServer, frame);
+  return true;
+}
+
+bool WebSocketsClient::sendTXT(uint8_t *payload, size_t length, bool headerToPayload) {
+  if (length == 0) {
+    length = strlen((const char *)payload + (headerToPayload ? WEBSOCKETS_MAX_HEADER_SIZE : 0));
+  }
+  return send(payload, length, headerToPayload, false);
+}
+
+bool WebSocketsClient::sendTXT(const char *payload, size_t length) {
+  return sendTXT((uint8_t *)payload, length, false);
+}
+
+bool WebSocketsClient::sendBIN(uint8_t *payload, size_t length, bool headerToPayload) {
+  return send(payload, length, headerToPayload, true);
+}
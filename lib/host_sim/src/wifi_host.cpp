@@ -0,0 +1,183 @@
+// WiFi double for host builds of MakerPass firmware
+// Association completes WIFI_JOIN_DIRECT_US after begin() with a BSSID
+// and channel, WIFI_JOIN_SCAN_US without (the driver scans first), and
+// fails with WL_NO_SSID_AVAIL when no matching access point is up.  An
+// access point going down drops the station on it.  Every change is a
+// HAL event, so it happens at an exact virtual time.
+
+#include "WiFi.h"
+#include "host_sim.h"
+#include "hal.h"
+#include <string>
+#include <vector>
+
+static const int64_t WIFI_JOIN_DIRECT_US = 250000;
+static const int64_t WIFI_JOIN_SCAN_US   = 2200000;
+static const int64_t WIFI_SCAN_US        = 1800000;
+
+struct HostAccessPoint {
+  std::string ssid;
+  uint8_t bssid[6];
+  int32_t channel;
+  int32_t rssi;
+  bool up;
+};
+
+WiFiClass WiFi;
+
+static std::vector<HostAccessPoint> accessPoints;
+static std::vector<HostAccessPoint> scanResults;
+static wl_status_t stationStatus = WL_IDLE_STATUS;
+static int joined = -1;                 // index into accessPoints
+static uint32_t joinGeneration = 0;     // outdated completions are ignored
+static std::string joinSsid;
+static bool joinBssidSet = false;
+static uint8_t joinBssid[6];
+static bool scanRunning = false;
+static bool scanDone = false;
+static uint32_t scanGeneration = 0;
+static uint8_t noBssid[6];
+
+uint8_t hostWiFiAddAccessPoint(const char *ssid, const uint8_t bssid[6], int32_t channel,
+                               int32_t rssi) {
+  HostAccessPoint ap;
+  ap.ssid = ssid;
+  memcpy(ap.bssid, bssid, 6);
+  ap.channel = channel;
+  ap.rssi = rssi;
+  ap.up = true;
+  accessPoints.push_back(ap);
+  return (uint8_t)(accessPoints.size() - 1);
+}
+
+void hostWiFiSetAccessPoint(uint8_t index, bool up, int32_t rssi) {
+  if (index >= accessPoints.size()) return;
+  accessPoints[index].up = up;
+  accessPoints[index].rssi = rssi;
+  if (!up && joined == index) {
+    joined = -1;
+    stationStatus = WL_CONNECTION_LOST;
+  }
+}
+
+// The strongest access point that is up and matches the attempt
+static int findAccessPoint() {
+  int best = -1;
+  for (size_t i = 0; i < accessPoints.size(); i++) {
+    const HostAccessPoint &ap = accessPoints[i];
+    if (!ap.up || ap.ssid != joinSsid) continue;
+    if (joinBssidSet && memcmp(ap.bssid, joinBssid, 6) != 0) continue;
+    if (best < 0 || ap.rssi > accessPoints[best].rssi) best = (int)i;
+  }
+  return best;
+}
+
+static void joinFinished(void *arg) {
+  if ((uint32_t)(uintptr_t)arg != joinGeneration) return;
+  joined = findAccessPoint();
+  stationStatus = joined >= 0 ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *, int32_t channel,
+                             const uint8_t *bssid, bool) {
+  joined = -1;
+  joinSsid = ssid;
+  joinBssidSet = bssid != nullptr && channel > 0;
+  if (joinBssidSet) memcpy(joinBssid, bssid, 6);
+  stationStatus = WL_DISCONNECTED;
+  int64_t delayUs = joinBssidSet ? WIFI_JOIN_DIRECT_US : WIFI_JOIN_SCAN_US;
+  halScheduleAt(halUptimeUs() + delayUs, joinFinished, (void *)(uintptr_t)++joinGeneration);
+  return stationStatus;
+}
+
+bool WiFiClass::config(IPAddress, IPAddress, IPAddress, IPAddress, IPAddress) {
+  return true;
+}
+
+bool WiFiClass::disconnect(bool, bool) {
+  joinGeneration++;
+  joined = -1;
+  stationStatus = WL_DISCONNECTED;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  return stationStatus;
+}
+
+static void scanFinished(void *arg) {
+  if ((uint32_t)(uintptr_t)arg != scanGeneration) return;
+  scanResults.clear();
+  for (const HostAccessPoint &ap : accessPoints) {
+    if (ap.up) scanResults.push_back(ap);
+  }
+  scanRunning = false;
+  scanDone = true;
+}
+
+int16_t WiFiClass::scanNetworks(bool) {
+  scanRunning = true;
+  scanDone = false;
+  halScheduleAt(halUptimeUs() + WIFI_SCAN_US, scanFinished, (void *)(uintptr_t)++scanGeneration);
+  return WIFI_SCAN_RUNNING;
+}
+
+int16_t WiFiClass::scanComplete() {
+  if (scanRunning) return WIFI_SCAN_RUNNING;
+  return scanDone ? (int16_t)scanResults.size() : WIFI_SCAN_FAILED;
+}
+
+void WiFiClass::scanDelete() {
+  scanGeneration++;
+  scanRunning = false;
+  scanDone = false;
+  scanResults.clear();
+}
+
+String WiFiClass::SSID(uint8_t index) {
+  return index < scanResults.size() ? String(scanResults[index].ssid.c_str()) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t index) {
+  return index < scanResults.size() ? scanResults[index].rssi : 0;
+}
+
+uint8_t *WiFiClass::BSSID(uint8_t index) {
+  return index < scanResults.size() ? scanResults[index].bssid : nullptr;
+}
+
+int32_t WiFiClass::channel(uint8_t index) {
+  return index < scanResults.size() ? scanResults[index].channel : 0;
+}
+
+String WiFiClass::SSID() {
+  return joined >= 0 ? String(accessPoints[joined].ssid.c_str()) : String();
+}
+
+int32_t WiFiClass::RSSI() {
+  return joined >= 0 ? accessPoints[joined].rssi : 0;
+}
+
+uint8_t *WiFiClass::BSSID() {
+  return joined >= 0 ? accessPoints[joined].bssid : noBssid;
+}
+
+int32_t WiFiClass::channel() {
+  return joined >= 0 ? accessPoints[joined].channel : 0;
+}
+
+IPAddress WiFiClass::localIP() {
+  return joined >= 0 ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  return joined >= 0 ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask() {
+  return joined >= 0 ? IPAddress(255, 255, 255, 0) : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t) {
+  return joined >= 0 ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
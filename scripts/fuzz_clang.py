@@ -0,0 +1,6 @@
+# PlatformIO extra script for [env:fuzz]: libFuzzer comes with clang,
+# and the sanitizers have to be linked in as well as compiled in.
+Import("env")
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(LINKFLAGS=["-fsanitize=fuzzer,address,undefined"])
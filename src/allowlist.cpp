@@ -0,0 +1,348 @@
+// Allowlist functions for MakerPass firmware
+// This module keeps each resource's member list for offline decisions.
+// After auth_success the device asks, per resource, for every change
+// since the last version it acknowledged; the server answers with
+// either a chunked allowlist_full or an allowlist_delta.  Cards are
+// stored as a packed, sorted array of 32-bit hashes with a Bloom filter
+// in front of it, both in PSRAM, and the list is persisted to LittleFS.
+// Updates come from the network task; lookups from the access task.
+
+#include "allowlist.h"
+#include "config.h"
+#include "constants.h"
+#include "websocket_manager.h"
+#include "logger.h"
+#include <LittleFS.h>
+#include <rom/crc.h>
+#include <algorithm>
+#include <atomic>
+
+static const uint32_t ALLOWLIST_MAGIC  = 0x4C41504D; // "MPAL"
+static const uint16_t ALLOWLIST_FORMAT = 1;
+
+// On-flash header, followed by `count` sorted hashes
+struct AllowlistHeader {
+  uint32_t magic;
+  uint16_t format;
+  uint16_t reserved;
+  uint32_t version;
+  uint32_t count;
+  uint32_t crc;
+};
+
+// The index is double-buffered: the access task reads the active copy
+// while the network task rebuilds the other one, then the two swap.
+struct AllowlistBuffer {
+  uint32_t *entries;     // sorted hashes of member codes
+  uint8_t  *bloom;
+  uint32_t  count;
+  uint32_t  version;     // last version acknowledged
+};
+
+struct Allowlist {
+  AllowlistBuffer buffers[2];
+  std::atomic<uint8_t> activeIndex;
+  std::atomic<uint8_t> activeReaders;
+  std::atomic<bool> ready;      // set by the network task at boot
+  uint32_t stagingCount;        // codes staged during a full sync
+};
+
+// One list per resource, as members may be trained on one machine and
+// not on the one next to it
+static Allowlist lists[MAX_RESOURCES];
+
+static bool fsReady = false;
+
+// Prefer PSRAM for the large tables, fall back to internal RAM
+static void *allocLarge(size_t bytes) {
+  if (psramFound()) {
+    void *p = ps_malloc(bytes);
+    if (p) return p;
+  }
+  return malloc(bytes);
+}
+
+// Murmur3 finaliser.  It is a bijection on 32-bit values, so equal
+// hashes imply equal codes and the sorted index gives exact answers
+// without storing raw card numbers.
+static uint32_t codeHash(uint32_t code) {
+  uint32_t h = code ^ 0x9E3779B9;
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35;
+  h ^= h >> 16;
+  return h;
+}
+
+// Bloom probes use double hashing derived from the code hash
+static inline uint32_t bloomIndex(uint32_t h, uint8_t probe) {
+  uint32_t h2 = ((h >> 17) | (h << 15)) | 1;
+  return (h + probe * h2) & (ALLOWLIST_BLOOM_BITS - 1);
+}
+
+static void rebuildBloom(AllowlistBuffer &buf) {
+  memset(buf.bloom, 0, ALLOWLIST_BLOOM_BITS / 8);
+  for (uint32_t i = 0; i < buf.count; i++) {
+    for (uint8_t p = 0; p < ALLOWLIST_BLOOM_PROBES; p++) {
+      uint32_t bit = bloomIndex(buf.entries[i], p);
+      buf.bloom[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+    }
+  }
+}
+
+static AllowlistBuffer &activeBuffer(Allowlist &list) {
+  return list.buffers[list.activeIndex.load()];
+}
+
+// Claim the inactive buffer for writing.  Lookups that started before
+// the last swap may still be reading it, so wait for them to finish;
+// a lookup takes microseconds.
+static AllowlistBuffer &beginUpdate(Allowlist &list) {
+  while (list.activeReaders.load() != 0) {
+    vTaskDelay(1);
+  }
+  return list.buffers[list.activeIndex.load() ^ 1];
+}
+
+// Make a rebuilt buffer the one lookups use
+static void publish(Allowlist &list, AllowlistBuffer &buf) {
+  list.activeIndex.store(&buf == &list.buffers[0] ? 0 : 1);
+}
+
+// The list of the resource a message names, or nullptr if it names
+// none of ours or the list is not loaded
+static Allowlist *listFor(JsonDocument &doc, uint8_t &resource) {
+  if (!resourceIndexFor(doc, resource) || !lists[resource].ready) return nullptr;
+  return &lists[resource];
+}
+
+static void allowlistPath(uint8_t resource, char *path, size_t size) {
+  if (resource == 0) {
+    snprintf(path, size, "%s", ALLOWLIST_FILE);
+  } else {
+    snprintf(path, size, ALLOWLIST_FILE_FORMAT, resource);
+  }
+}
+
+// Sort and drop duplicates, returning the new length
+static uint32_t sortUnique(uint32_t *data, uint32_t count) {
+  std::sort(data, data + count);
+  return std::unique(data, data + count) - data;
+}
+
+// Accept codes as the 8-character hex strings used by rfid_scan or as
+// plain integers
+static bool parseCode(JsonVariant value, uint32_t &code) {
+  if (value.is<const char*>()) {
+    const char* text = value.as<const char*>();
+    char *end = nullptr;
+    code = strtoul(text, &end, 16);
+    return end != text && *end == '\0';
+  }
+  if (value.is<uint32_t>()) {
+    code = value.as<uint32_t>();
+    return true;
+  }
+  return false;
+}
+
+// Write the list to a temporary file and rename it over the old one so
+// that a power cut leaves either the old or the new list intact
+static void persistAllowlist(uint8_t resource, const AllowlistBuffer &buf) {
+  if (!fsReady) return;
+  char path[24];
+  allowlistPath(resource, path, sizeof(path));
+  size_t dataBytes = buf.count * sizeof(uint32_t);
+  AllowlistHeader header = {ALLOWLIST_MAGIC, ALLOWLIST_FORMAT, 0, buf.version, buf.count,
+                            crc32_le(0, (const uint8_t *)buf.entries, dataBytes)};
+  File file = LittleFS.open(ALLOWLIST_TMP_FILE, FILE_WRITE);
+  if (!file) {
+    LOG_E(ALLOW, "Could not open file for writing");
+    return;
+  }
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            file.write((const uint8_t *)buf.entries, dataBytes) == dataBytes;
+  file.close();
+  if (!ok) {
+    LOG_E(ALLOW, "Write failed, keeping previous file");
+    LittleFS.remove(ALLOWLIST_TMP_FILE);
+    return;
+  }
+  LittleFS.remove(path);
+  LittleFS.rename(ALLOWLIST_TMP_FILE, path);
+}
+
+static void loadAllowlist(uint8_t resource, AllowlistBuffer &buf) {
+  char path[24];
+  allowlistPath(resource, path, sizeof(path));
+  if (!fsReady || !LittleFS.exists(path)) return;
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) return;
+  AllowlistHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == ALLOWLIST_MAGIC && header.format == ALLOWLIST_FORMAT &&
+            header.count <= ALLOWLIST_MAX_ENTRIES;
+  size_t dataBytes = ok ? header.count * sizeof(uint32_t) : 0;
+  ok = ok && file.read((uint8_t *)buf.entries, dataBytes) == dataBytes &&
+       crc32_le(0, (const uint8_t *)buf.entries, dataBytes) == header.crc;
+  file.close();
+  if (!ok) {
+    LOG_W(ALLOW, "Stored list %u is corrupt, waiting for full sync", resource);
+    return;
+  }
+  buf.count   = header.count;
+  buf.version = header.version;
+}
+
+// Mount LittleFS, then allocate both copies of each resource's tables
+// and load its persisted list
+void initAllowlist() {
+  fsReady = LittleFS.begin(true);
+  if (!fsReady) {
+    LOG_E(ALLOW, "LittleFS mount failed, list will not persist");
+  }
+  for (uint8_t r = 0; r < RESOURCE_COUNT; r++) {
+    Allowlist &list = lists[r];
+    bool allocated = true;
+    for (AllowlistBuffer &buf : list.buffers) {
+      buf.entries = (uint32_t *)allocLarge(ALLOWLIST_MAX_ENTRIES * sizeof(uint32_t));
+      buf.bloom   = (uint8_t *)allocLarge(ALLOWLIST_BLOOM_BITS / 8);
+      buf.count   = 0;
+      buf.version = 0;
+      allocated = allocated && buf.entries && buf.bloom;
+    }
+    if (!allocated) {
+      LOG_E(ALLOW, "Out of memory, offline allowlist disabled for %s", RESOURCES[r].id);
+      continue;
+    }
+    AllowlistBuffer &buf = activeBuffer(list);
+    loadAllowlist(r, buf);
+    rebuildBloom(buf);
+    list.ready = true;
+    LOG_I(ALLOW, "%s: loaded version %u with %u cards", RESOURCES[r].id,
+          (unsigned)buf.version, (unsigned)buf.count);
+  }
+}
+
+// Offline membership test: Bloom filter first, then binary search.
+// Called from the access task.
+bool allowlistContains(uint8_t resource, uint32_t code) {
+  if (resource >= MAX_RESOURCES || !lists[resource].ready) return false;
+  Allowlist &list = lists[resource];
+  uint32_t h = codeHash(code);
+  bool found = true;
+
+  list.activeReaders++;
+  const AllowlistBuffer &buf = activeBuffer(list);
+  for (uint8_t p = 0; p < ALLOWLIST_BLOOM_PROBES && found; p++) {
+    uint32_t bit = bloomIndex(h, p);
+    found = (buf.bloom[bit >> 3] & (1 << (bit & 7))) != 0;
+  }
+  found = found && std::binary_search(buf.entries, buf.entries + buf.count, h);
+  list.activeReaders--;
+  return found;
+}
+
+uint32_t allowlistVersion(uint8_t resource) {
+  return activeBuffer(lists[resource]).version;
+}
+
+uint32_t allowlistCount(uint8_t resource) {
+  return activeBuffer(lists[resource]).count;
+}
+
+// Ask the server for everything since the last acknowledged version,
+// for every resource
+void requestAllowlistSync() {
+  for (uint8_t r = 0; r < RESOURCE_COUNT; r++) {
+    if (lists[r].ready) sendAllowlistSync(r, allowlistVersion(r));
+  }
+}
+
+// Handle one chunk of a full list.  Chunks carry the index of their
+// first code in `offset`; `more` is false on the last one.  A gap means
+// a chunk was lost, in which case the sync is restarted.
+void handleAllowlistFull(JsonDocument &doc) {
+  uint8_t resource;
+  Allowlist *list = listFor(doc, resource);
+  if (!list) return;
+  uint32_t offset = doc["offset"] | 0U;
+  if (offset == 0) {
+    list->stagingCount = 0;
+  } else if (offset != list->stagingCount) {
+    LOG_W(ALLOW, "Missing chunk, restarting full sync");
+    list->stagingCount = 0;
+    sendAllowlistSync(resource, 0);
+    return;
+  }
+  AllowlistBuffer &staging = beginUpdate(*list);
+
+  for (JsonVariant value : doc["codes"].as<JsonArray>()) {
+    uint32_t code;
+    if (list->stagingCount < ALLOWLIST_MAX_ENTRIES && parseCode(value, code)) {
+      staging.entries[list->stagingCount++] = codeHash(code);
+    }
+  }
+  if (doc["more"] | false) return;
+
+  // Last chunk: swap the staged list in
+  staging.count   = sortUnique(staging.entries, list->stagingCount);
+  staging.version = doc["version"] | 0U;
+  list->stagingCount = 0;
+  rebuildBloom(staging);
+  publish(*list, staging);
+
+  persistAllowlist(resource, staging);
+  sendAllowlistAck(resource, staging.version);
+  LOG_I(ALLOW, "%s: full sync to version %u, %u cards", RESOURCES[resource].id,
+        (unsigned)staging.version, (unsigned)staging.count);
+}
+
+// Apply an incremental change set to a copy of the active list.  A
+// delta that does not start from our version cannot be applied, so
+// ask again from where we are.
+void handleAllowlistDelta(JsonDocument &doc) {
+  uint8_t resource;
+  Allowlist *list = listFor(doc, resource);
+  if (!list) return;
+  const AllowlistBuffer &current = activeBuffer(*list);
+  uint32_t baseVersion = doc["base_version"] | 0U;
+  if (baseVersion != current.version) {
+    LOG_W(ALLOW, "Delta base mismatch, resyncing");
+    sendAllowlistSync(resource, current.version);
+    return;
+  }
+
+  AllowlistBuffer &next = beginUpdate(*list);
+  memcpy(next.entries, current.entries, current.count * sizeof(uint32_t));
+  next.count = current.count;
+
+  for (JsonVariant value : doc["remove"].as<JsonArray>()) {
+    uint32_t code;
+    if (!parseCode(value, code)) continue;
+    uint32_t h = codeHash(code);
+    uint32_t *end = next.entries + next.count;
+    uint32_t *pos = std::lower_bound(next.entries, end, h);
+    if (pos != end && *pos == h) {
+      memmove(pos, pos + 1, (end - pos - 1) * sizeof(uint32_t));
+      next.count--;
+    }
+  }
+  bool added = false;
+  for (JsonVariant value : doc["add"].as<JsonArray>()) {
+    uint32_t code;
+    if (next.count < ALLOWLIST_MAX_ENTRIES && parseCode(value, code)) {
+      next.entries[next.count++] = codeHash(code);
+      added = true;
+    }
+  }
+  if (added) next.count = sortUnique(next.entries, next.count);
+  next.version = doc["version"] | current.version;
+  rebuildBloom(next);
+  publish(*list, next);
+
+  persistAllowlist(resource, next);
+  sendAllowlistAck(resource, next.version);
+  LOG_I(ALLOW, "%s: delta applied, version %u", RESOURCES[resource].id, (unsigned)next.version);
+}
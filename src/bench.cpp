@@ -0,0 +1,188 @@
+// Benchmark functions for MakerPass firmware
+// This module times the hot paths of the network and access tasks:
+// inbound parse and type lookup, outbound frame building, the
+// MessagePack codec, card code formatting with the master key
+// comparison, and timer rescheduling.  Each benchmark takes
+// BENCH_ITERATIONS samples BENCH_ROUNDS times and the fastest round
+// counts, so being preempted only slows the rounds that are discarded.
+// A sample is one call, or for the paths that take a few nanoseconds
+// on the host a batch of calls named in the result (timer_update_x32),
+// so that no sample is much under 100 ns and timer resolution and
+// loop overhead stay small beside it.
+// Parsed messages are not dispatched, since that would act on the
+// relays.
+//
+// The host bench program runs them (with the display benchmarks only
+// the host can count) and compares the results with
+// bench/baseline.json.  On the device, typing BENCH_CONSOLE_KEY runs
+// them on the network task, which is blocked for well under a second,
+// and prints the results as one line of JSON in the same format, for
+// the bench program to check against a device baseline.
+
+#include "bench.h"
+#include "config.h"
+#include "constants.h"
+#include "frame_builder.h"
+#include "hal.h"
+#include "json_arena.h"
+#include "logger.h"
+#include "message_types.h"
+#include "msgpack_codec.h"
+#include "timer_wheel.h"
+
+// Inbound samples, one per message shape the server sends often
+static const char SAMPLE_GRANTED[] =
+  "{\"type\":\"access_granted\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\","
+  "\"user_name\":\"Ada Lovelace\",\"cache_ttl\":3600}";
+static const char SAMPLE_SESSION[] =
+  "{\"type\":\"session_started\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\","
+  "\"session_id\":\"5f1c2a7e-9b0d-4e11-a3c2-7d41f0e8b6a9\",\"user_name\":\"Ada Lovelace\"}";
+static const char SAMPLE_PING[] = "{\"type\":\"ping\"}";
+static const char SAMPLE_DELTA[] =
+  "{\"type\":\"allowlist_delta\",\"resource_id\":\"ABCD1234\",\"base_version\":41,"
+  "\"version\":42,\"add\":[\"00C0FFEE\",\"0012AB34\",\"00FACADE\"],\"remove\":[\"0000BEEF\"]}";
+
+// State the benchmarks share; allocated for the run only
+struct BenchContext {
+  JsonArena arena;
+  JsonDocument doc;
+  char text[FRAME_MAX_PAYLOAD];
+  uint8_t wire[FRAME_MAX_PAYLOAD];
+  size_t wireLength;
+  TimerWheel wheel;
+  Timer timer;
+
+  BenchContext() : doc(&arena), wireLength(0), timer{} {}
+};
+
+typedef void (*BenchBody)(BenchContext &ctx, uint32_t i);
+
+static void benchNoop(void *) {}
+
+// Copy a sample into the receive buffer and parse it in place, as
+// handleIncomingMessage() does
+static void parseSample(BenchContext &ctx, const char *sample, size_t length) {
+  memcpy(ctx.text, sample, length);
+  ctx.doc.clear();
+  ctx.arena.reset();
+  deserializeJson(ctx.doc, ctx.text, length);
+  volatile MessageType type = lookupMessageType(ctx.doc["type"] | "");
+  (void)type;
+}
+
+static void parseGranted(BenchContext &ctx, uint32_t) {
+  parseSample(ctx, SAMPLE_GRANTED, sizeof(SAMPLE_GRANTED) - 1);
+}
+
+static void parseSession(BenchContext &ctx, uint32_t) {
+  parseSample(ctx, SAMPLE_SESSION, sizeof(SAMPLE_SESSION) - 1);
+}
+
+static void parsePing(BenchContext &ctx, uint32_t) {
+  parseSample(ctx, SAMPLE_PING, sizeof(SAMPLE_PING) - 1);
+}
+
+static void parseDelta(BenchContext &ctx, uint32_t) {
+  parseSample(ctx, SAMPLE_DELTA, sizeof(SAMPLE_DELTA) - 1);
+}
+
+static void buildScan(BenchContext &, uint32_t i) {
+  OutboundFrame frame;
+  buildRFIDScanFrame(frame, 0, i);
+}
+
+static void buildSessionEnd(BenchContext &, uint32_t) {
+  OutboundFrame frame;
+  buildSessionEndFrame(frame, 0, "5f1c2a7e-9b0d-4e11-a3c2-7d41f0e8b6a9");
+}
+
+// Encodes the document left by the benchmark's setup, the parsed
+// access_granted sample; decoding reads the bytes this produced
+static void wireEncode(BenchContext &ctx, uint32_t) {
+  ctx.wireLength = encodeWireMessage(ctx.doc, ctx.wire, sizeof(ctx.wire));
+}
+
+static void wireDecode(BenchContext &ctx, uint32_t) {
+  uint8_t copy[FRAME_MAX_PAYLOAD];
+  memcpy(copy, ctx.wire, ctx.wireLength);
+  ctx.doc.clear();
+  ctx.arena.reset();
+  decodeWireMessage(copy, ctx.wireLength, ctx.doc);
+}
+
+// What handleRFIDScan() does with every code before the grant cache
+static void cardCheck(BenchContext &, uint32_t i) {
+  char codeStr[9];
+  encodeHex32(i * 2654435761UL, codeStr);
+  codeStr[8] = '\0';
+  volatile bool master = strcasecmp(codeStr, MASTER_KEY) == 0;
+  (void)master;
+}
+
+// Rescheduling an armed timer, as every card read does for presence
+static void timerUpdate(BenchContext &ctx, uint32_t i) {
+  ctx.wheel.schedule(ctx.timer, 1 + i % CARD_PRESENT_TIMEOUT_MS);
+}
+
+// Nanoseconds per sample of `batch` calls
+static uint32_t timeBody(BenchContext &ctx, BenchBody body, uint16_t batch) {
+  int64_t best = INT64_MAX;
+  for (uint8_t round = 0; round < BENCH_ROUNDS; round++) {
+    int64_t start = halBenchNs();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS * batch; i++) body(ctx, i);
+    int64_t elapsed = halBenchNs() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  return (uint32_t)(best / BENCH_ITERATIONS);
+}
+
+// Time every benchmark, in nanoseconds per sample
+void runBenchmarks(BenchResult results[BENCH_COUNT]) {
+  static const struct {
+    const char *name;
+    BenchBody body;
+    BenchBody setup;   // run once before timing, or nullptr
+    uint16_t batch;    // calls per sample
+  } BENCHMARKS[BENCH_COUNT] = {
+    {"parse_granted", parseGranted, nullptr, 1},
+    {"parse_session", parseSession, nullptr, 1},
+    {"parse_ping", parsePing, nullptr, 1},
+    {"parse_delta", parseDelta, nullptr, 1},
+    {"build_scan_x16", buildScan, nullptr, 16},
+    {"build_end_x4", buildSessionEnd, nullptr, 4},
+    {"wire_encode", wireEncode, parseGranted, 1},
+    {"wire_decode", wireDecode, nullptr, 1},
+    {"card_check_x8", cardCheck, nullptr, 8},
+    {"timer_update_x32", timerUpdate, nullptr, 32},
+  };
+
+  BenchContext *ctx = new BenchContext();
+  ctx->timer.callback = benchNoop;
+  for (size_t i = 0; i < BENCH_COUNT; i++) {
+    if (BENCHMARKS[i].setup) BENCHMARKS[i].setup(*ctx, 0);
+    results[i] = {BENCHMARKS[i].name, timeBody(*ctx, BENCHMARKS[i].body, BENCHMARKS[i].batch), "ns"};
+  }
+  ctx->wheel.cancel(ctx->timer);
+  delete ctx;
+}
+
+// {"<name>": {"value": <n>, "unit": "<unit>"}, ...}
+void benchResultsJson(const BenchResult *results, size_t count, JsonObject out) {
+  for (size_t i = 0; i < count; i++) {
+    JsonObject entry = out[results[i].name].to<JsonObject>();
+    entry["value"] = results[i].value;
+    entry["unit"]  = results[i].unit;
+  }
+}
+
+// Console: run the benchmarks and print {"results": {...}} on one line
+void printBenchmarks() {
+  BenchResult results[BENCH_COUNT];
+  runBenchmarks(results);
+  JsonDocument doc;
+  benchResultsJson(results, BENCH_COUNT, doc["results"].to<JsonObject>());
+  char line[1024];
+  serializeJson(doc, line, sizeof(line));
+  Serial.println(line);
+  LOG_I(BENCH, "%u benchmarks done", (unsigned)BENCH_COUNT);
+}
@@ -0,0 +1,114 @@
+// Boot management functions for MakerPass firmware
+// This module runs everything in start-up that can wait on the radio or
+// on flash.  setup() only brings up the pins, reader and display and
+// starts the tasks, so cards and the master key work within a few
+// hundred milliseconds of power-on.  The network task then steps
+// through handleBoot(): flash is read while the WiFi driver associates,
+// and once an address is assigned SNTP and the TLS connection start
+// together.
+
+#include "boot_manager.h"
+#include "constants.h"
+#include "pins.h"
+#include "ui_manager.h"
+#include "wifi_manager.h"
+#include "websocket_manager.h"
+#include "allowlist.h"
+#include "event_journal.h"
+#include "task_manager.h"
+#include "hal.h"
+#include "logger.h"
+#include <time.h>
+
+extern bool authenticated;
+
+enum BootState : uint8_t {
+  BOOT_STATE_STORAGE,      // start WiFi, load flash
+  BOOT_STATE_WIFI,         // waiting for association
+  BOOT_STATE_SERVER,       // SNTP and TLS/auth in progress
+  BOOT_STATE_DONE
+};
+
+static const char* const MILESTONE_NAMES[BOOT_MILESTONE_COUNT] = {
+  "Access live", "Storage ready", "WiFi up", "Clock set", "Server connected", "Authenticated"
+};
+
+static BootState bootState = BOOT_STATE_STORAGE;
+static bool milestoneSeen[BOOT_MILESTONE_COUNT];
+
+// While associating: blink the WiFi LED, and give up waiting at
+// BOOT_WIFI_TIMEOUT_MS after power-on
+static void blinkWiFiLed(void *);
+static void wifiWaitExpired(void *);
+static Timer blinkTimer    = {blinkWiFiLed};
+static Timer wifiWaitTimer = {wifiWaitExpired};
+static bool blinkOn = false;
+
+static void blinkWiFiLed(void *) {
+  blinkOn = !blinkOn;
+  halDigitalWrite(PIN_LED_WIFI, blinkOn);
+  networkTimers.schedule(blinkTimer, BOOT_LED_BLINK_MS);
+}
+
+static void wifiWaitExpired(void *) {
+  networkTimers.cancel(blinkTimer);
+  halDigitalWrite(PIN_LED_WIFI, LOW);
+  LOG_W(BOOT, "No WiFi yet, running offline");
+  showIdleScreen();
+}
+
+void markBootMilestone(BootMilestone milestone) {
+  if (milestoneSeen[milestone]) return;
+  milestoneSeen[milestone] = true;
+  LOG_I(BOOT, "%s at %lu ms", MILESTONE_NAMES[milestone], (unsigned long)halMillis());
+}
+
+// Advance the start-up sequence.  Called every network task iteration;
+// only the storage step blocks, and only this task.
+void handleBoot() {
+  unsigned long now = halMillis();
+  if (bootState >= BOOT_STATE_SERVER && !milestoneSeen[BOOT_CLOCK_SET] &&
+      halTime() > 1600000000) {
+    markBootMilestone(BOOT_CLOCK_SET);
+  }
+
+  switch (bootState) {
+    case BOOT_STATE_STORAGE:
+      // The WiFi driver associates in the background while flash is read
+      startWiFi();
+      showBootMessage("Connecting WiFi");
+      initAllowlist();
+      initJournal();
+      markBootMilestone(BOOT_STORAGE_READY);
+      bootState = BOOT_STATE_WIFI;
+      networkTimers.schedule(blinkTimer, BOOT_LED_BLINK_MS);
+      networkTimers.schedule(wifiWaitTimer, now < BOOT_WIFI_TIMEOUT_MS ? BOOT_WIFI_TIMEOUT_MS - now : 0);
+      break;
+
+    case BOOT_STATE_WIFI:
+      if (WiFi.status() == WL_CONNECTED) {
+        networkTimers.cancel(blinkTimer);
+        networkTimers.cancel(wifiWaitTimer);
+        markBootMilestone(BOOT_WIFI_UP);
+        IPAddress ip = WiFi.localIP();
+        char ipText[16];
+        snprintf(ipText, sizeof(ipText), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        showBootMessage("WiFi Connected", ipText);
+        // SNTP and the TLS handshake proceed in parallel
+        configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+        initWebSocket();
+        bootState = BOOT_STATE_SERVER;
+      }
+      break;
+
+    case BOOT_STATE_SERVER:
+      if (authenticated) {
+        LOG_I(BOOT, "Ready in %lu ms", now);
+        bootState = BOOT_STATE_DONE;
+      }
+      break;
+
+    case BOOT_STATE_DONE:
+      break;
+  }
+}
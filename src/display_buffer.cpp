@@ -0,0 +1,199 @@
+// Display buffer functions for MakerPass firmware
+// This module gives the UI an off-screen framebuffer (a full-screen
+// TFT_eSprite, in PSRAM when available) to draw into.  Drawing code
+// marks the areas it touches; displayFlush() compares those rows with
+// a copy of what the panel currently shows and pushes only the
+// rectangles that actually changed, using DMA so the next band is
+// prepared while the previous one is on the bus.  Everything here runs
+// in the UI task.
+
+#include "display_buffer.h"
+#include "constants.h"
+#include "hal.h"
+#include "logger.h"
+#include <esp_heap_caps.h>
+
+extern TFT_eSPI tft;
+
+static TFT_eSprite backBuffer(&tft);
+static uint16_t *back  = nullptr;          // sprite pixels, panel byte order
+static uint16_t *front = nullptr;          // what the panel currently shows
+static uint16_t *bounce[2] = {nullptr, nullptr};
+static bool bufferReady = false;
+
+// Columns touched in each band since the last flush; x0 > x1 when clean
+struct DirtySpan {
+  int16_t x0;
+  int16_t x1;
+};
+
+static DirtySpan dirty[DISPLAY_BAND_COUNT];
+static bool anyDirty = false;
+static uint32_t renderStartUs = 0;
+
+static DisplayStats stats = {};
+
+// Prefer PSRAM for the frame copy, fall back to internal RAM
+static void *allocLarge(size_t bytes) {
+  if (psramFound()) {
+    void *p = ps_malloc(bytes);
+    if (p) return p;
+  }
+  return malloc(bytes);
+}
+
+static void clearDirty() {
+  for (uint8_t i = 0; i < DISPLAY_BAND_COUNT; i++) {
+    dirty[i].x0 = SCREEN_WIDTH;
+    dirty[i].x1 = -1;
+  }
+  anyDirty = false;
+}
+
+static void releaseBuffers() {
+  if (back) backBuffer.deleteSprite();
+  free(front);
+  free(bounce[0]);
+  free(bounce[1]);
+  back = front = bounce[0] = bounce[1] = nullptr;
+}
+
+// Allocate the framebuffer, the panel copy and the DMA bounce buffers.
+// Call after tft.init() and the initial fillScreen(COLOR_BG).  Without
+// the memory the UI keeps drawing straight to the panel.
+bool initDisplayBuffer() {
+  size_t frameBytes = SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t);
+  size_t bandBytes  = SCREEN_WIDTH * DISPLAY_BAND_ROWS * sizeof(uint16_t);
+
+  backBuffer.setColorDepth(16);
+  backBuffer.setAttribute(PSRAM_ENABLE, true);
+  back      = (uint16_t *)backBuffer.createSprite(SCREEN_WIDTH, SCREEN_HEIGHT);
+  front     = (uint16_t *)allocLarge(frameBytes);
+  bounce[0] = (uint16_t *)heap_caps_malloc(bandBytes, MALLOC_CAP_DMA);
+  bounce[1] = (uint16_t *)heap_caps_malloc(bandBytes, MALLOC_CAP_DMA);
+
+  if (!back || !front || !bounce[0] || !bounce[1] || !tft.initDMA()) {
+    releaseBuffers();
+    LOG_W(UI, "Framebuffer unavailable, drawing directly");
+    return false;
+  }
+
+  // The panel has just been cleared to COLOR_BG
+  backBuffer.fillScreen(COLOR_BG);
+  memcpy(front, back, frameBytes);
+  clearDirty();
+  bufferReady = true;
+  LOG_I(UI, "Off-screen framebuffer with DMA ready");
+  return true;
+}
+
+// Where the UI draws: the framebuffer, or the panel itself as fallback
+TFT_eSPI &displayCanvas() {
+  if (bufferReady) return backBuffer;
+  return tft;
+}
+
+// Record that an area of the framebuffer may have changed
+void displayMarkDirty(int32_t x, int32_t y, int32_t w, int32_t h) {
+  if (!bufferReady) return;
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > SCREEN_WIDTH)  w = SCREEN_WIDTH - x;
+  if (y + h > SCREEN_HEIGHT) h = SCREEN_HEIGHT - y;
+  if (w <= 0 || h <= 0) return;
+
+  if (!anyDirty) {
+    renderStartUs = halMicros();
+    anyDirty = true;
+  }
+  for (int32_t band = y / DISPLAY_BAND_ROWS; band <= (y + h - 1) / DISPLAY_BAND_ROWS; band++) {
+    if (x < dirty[band].x0) dirty[band].x0 = x;
+    if (x + w - 1 > dirty[band].x1) dirty[band].x1 = x + w - 1;
+  }
+}
+
+// Push one rectangle: copy it into a bounce buffer (DMA cannot read
+// PSRAM), bring the panel copy up to date and start the transfer.
+// pushImageDMA() waits for the transfer before it, so the bounce buffer
+// being filled is never the one on the bus.
+static void pushRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t slot) {
+  uint16_t *dst = bounce[slot];
+  for (int16_t row = y; row < y + h; row++) {
+    const uint16_t *src = back + row * SCREEN_WIDTH + x;
+    memcpy(dst, src, w * sizeof(uint16_t));
+    memcpy(front + row * SCREEN_WIDTH + x, src, w * sizeof(uint16_t));
+    dst += w;
+  }
+  tft.pushImageDMA(x, y, w, h, bounce[slot]);
+}
+
+// Send everything that changed since the last flush to the panel.
+// Called by the UI task after it has drawn the queued commands.
+void displayFlush() {
+  if (!bufferReady || !anyDirty) return;
+  uint32_t pushStartUs = halMicros();
+  uint32_t bytes = 0;
+  uint16_t rects = 0;
+  bool swapBytes = tft.getSwapBytes();
+
+  for (uint8_t band = 0; band < DISPLAY_BAND_COUNT; band++) {
+    const DirtySpan &span = dirty[band];
+    if (span.x0 > span.x1) continue;
+    int16_t y0 = band * DISPLAY_BAND_ROWS;
+    int16_t y1 = y0 + DISPLAY_BAND_ROWS - 1;
+    if (y1 >= SCREEN_HEIGHT) y1 = SCREEN_HEIGHT - 1;
+
+    // Narrow the band to the pixels that differ from the panel
+    int16_t minX = SCREEN_WIDTH, maxX = -1, minY = -1, maxY = -1;
+    for (int16_t y = y0; y <= y1; y++) {
+      const uint16_t *b = back + y * SCREEN_WIDTH;
+      const uint16_t *f = front + y * SCREEN_WIDTH;
+      int16_t left = span.x0;
+      while (left <= span.x1 && b[left] == f[left]) left++;
+      if (left > span.x1) continue;
+      int16_t right = span.x1;
+      while (b[right] == f[right]) right--;
+      if (left < minX) minX = left;
+      if (right > maxX) maxX = right;
+      if (minY < 0) minY = y;
+      maxY = y;
+    }
+    if (maxX < 0) continue;
+
+    if (rects == 0) {
+      // Sprite pixels are already in panel byte order
+      tft.setSwapBytes(false);
+      tft.startWrite();
+    }
+    int16_t w = maxX - minX + 1;
+    int16_t h = maxY - minY + 1;
+    pushRect(minX, minY, w, h, rects & 1);
+    bytes += w * h * sizeof(uint16_t);
+    rects++;
+  }
+
+  if (rects > 0) {
+    tft.dmaWait();
+    tft.endWrite();
+    tft.setSwapBytes(swapBytes);
+  }
+  clearDirty();
+  if (rects == 0) return;
+
+  stats.frames++;
+  stats.lastBytes    = bytes;
+  stats.lastRects    = rects;
+  stats.lastRenderUs = pushStartUs - renderStartUs;
+  stats.lastPushUs   = halMicros() - pushStartUs;
+  stats.totalBytes  += bytes;
+  if (bytes > stats.peakBytes) stats.peakBytes = bytes;
+
+  LOG_D(UI, "Frame: %u bytes in %u rects, render %u us, push %u us", (unsigned)bytes,
+        (unsigned)rects, (unsigned)stats.lastRenderUs, (unsigned)stats.lastPushUs);
+}
+
+// Snapshot of the counters; read from other tasks without locking, an
+// occasionally torn value is harmless
+DisplayStats getDisplayStats() {
+  return stats;
+}
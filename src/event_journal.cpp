@@ -0,0 +1,448 @@
+// Event journal functions for MakerPass firmware
+// This module keeps an audit trail of everything the device decides on
+// its own: master key unlocks, offline grants and denials, and sessions
+// ended without the server, including scans and session ends posted
+// just before the link fell.  The access task only queues a record in
+// RAM; the network task appends queued records to segment files on
+// LittleFS and, while authenticated, uploads unacknowledged records in
+// event_batch frames until the server confirms them with event_ack.
+//
+// Flash is never rewritten in place.  Records are only appended to the
+// newest segment, a few at a time (JOURNAL_FLUSH_MS), and a segment is
+// deleted whole once the server has all of it, or when the oldest must
+// make room.  An in-place write would make LittleFS copy the block and
+// rewrite the file's tail on every event.
+//
+// Every record carries its sequence number and a CRC, so after a power
+// cut the segments are rebuilt by reading them; a torn append loses
+// only that record, and the segment it hit takes no more.
+
+#include "event_journal.h"
+#include "constants.h"
+#include "spsc_queue.h"
+#include "task_manager.h"
+#include "websocket_manager.h"
+#include "hal.h"
+#include "logger.h"
+#include <LittleFS.h>
+#include <rom/crc.h>
+#include <time.h>
+
+extern bool wsConnected;
+extern bool authenticated;
+
+static const uint32_t JOURNAL_MAGIC = 0x4A4C504D; // "MPLJ"
+
+// Identity of the journal and how far the server has confirmed it
+struct JournalState {
+  uint32_t magic;
+  uint32_t journalId;   // random, new whenever the journal is started afresh
+  uint32_t ackedSeq;
+  uint32_t crc;
+};
+
+// One segment file, oldest first in segments[].  Its records have
+// consecutive sequence numbers.
+struct JournalSegment {
+  uint32_t number;      // file name in JOURNAL_DIR
+  uint32_t firstSeq;
+  uint16_t count;       // intact records
+  bool sealed;          // full, or its tail is torn; no more appends
+};
+
+// Access task -> network task
+static SpscQueue<JournalRecord, JOURNAL_QUEUE_DEPTH> queuedRecords;
+// Network task -> itself: requests it could no longer send
+static SpscQueue<JournalRecord, NET_QUEUE_DEPTH> unsentRecords;
+
+static JournalSegment segments[JOURNAL_SEGMENTS];
+static uint8_t segmentCount = 0;
+static uint32_t nextSegment = 0;  // number of the next segment created
+static bool journalReady = false;
+static uint32_t journalId = 0;
+static uint32_t headSeq  = 0;   // newest record on flash
+static uint32_t ackedSeq = 0;   // newest record the server has stored
+static unsigned long lastFlushAt = 0;
+
+// Upload state (network task)
+static bool batchInFlight = false;
+static uint32_t batchLastSeq = 0;
+static unsigned long batchSentAt = 0;
+
+// Scratch space for the boot scan and for building a batch
+static JournalRecord batch[JOURNAL_BATCH_SIZE];
+
+static uint32_t recordCrc(const JournalRecord &rec) {
+  return crc32_le(0, (const uint8_t *)&rec, offsetof(JournalRecord, crc));
+}
+
+static uint32_t stateCrc(const JournalState &state) {
+  return crc32_le(0, (const uint8_t *)&state, offsetof(JournalState, crc));
+}
+
+static void segmentPath(uint32_t number, char *path, size_t size) {
+  snprintf(path, size, "%s/%08lu", JOURNAL_DIR, (unsigned long)number);
+}
+
+static uint32_t segmentLastSeq(const JournalSegment &seg) {
+  return seg.firstSeq + seg.count - 1;
+}
+
+// Persist the acknowledged position via a temporary file so that a
+// power cut leaves the old or the new state intact
+static void saveState() {
+  JournalState state = {JOURNAL_MAGIC, journalId, ackedSeq, 0};
+  state.crc = stateCrc(state);
+  File file = LittleFS.open(JOURNAL_STATE_TMP, FILE_WRITE);
+  if (!file) return;
+  bool ok = file.write((const uint8_t *)&state, sizeof(state)) == sizeof(state);
+  file.close();
+  if (!ok) {
+    LittleFS.remove(JOURNAL_STATE_TMP);
+    return;
+  }
+  LittleFS.remove(JOURNAL_STATE_FILE);
+  LittleFS.rename(JOURNAL_STATE_TMP, JOURNAL_STATE_FILE);
+}
+
+static bool loadState() {
+  if (!LittleFS.exists(JOURNAL_STATE_FILE)) return false;
+  File file = LittleFS.open(JOURNAL_STATE_FILE, FILE_READ);
+  if (!file) return false;
+  JournalState state;
+  bool ok = file.read((uint8_t *)&state, sizeof(state)) == sizeof(state) &&
+            state.magic == JOURNAL_MAGIC && state.crc == stateCrc(state);
+  file.close();
+  if (!ok) return false;
+  journalId = state.journalId;
+  ackedSeq  = state.ackedSeq;
+  return true;
+}
+
+// Numbers of the segment files on flash, ascending; at most `max`,
+// more than the journal ever keeps
+static uint8_t listSegments(uint32_t *numbers, uint8_t max) {
+  uint8_t found = 0;
+  File dir = LittleFS.open(JOURNAL_DIR);
+  if (!dir || !dir.isDirectory()) return 0;
+  for (File entry = dir.openNextFile(); entry && found < max; entry = dir.openNextFile()) {
+    const char *name = entry.name();
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    char *end;
+    uint32_t number = strtoul(base, &end, 10);
+    entry.close();
+    if (end == base || *end != '\0') continue;
+    uint8_t i = found++;
+    while (i > 0 && numbers[i - 1] > number) {
+      numbers[i] = numbers[i - 1];
+      i--;
+    }
+    numbers[i] = number;
+  }
+  return found;
+}
+
+// Read one segment at boot.  Records count while their CRC matches and
+// their sequence numbers follow on; the first one that does not ends
+// the segment, which is then sealed.
+static void scanSegment(JournalSegment &seg) {
+  char path[32];
+  segmentPath(seg.number, path, sizeof(path));
+  seg.count = 0;
+  seg.sealed = false;
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) {
+    seg.sealed = true;
+    return;
+  }
+  uint32_t records = file.size() / sizeof(JournalRecord);
+  if (file.size() % sizeof(JournalRecord) != 0) seg.sealed = true;
+  while (seg.count < records && !seg.sealed) {
+    uint32_t n = records - seg.count;
+    if (n > JOURNAL_BATCH_SIZE) n = JOURNAL_BATCH_SIZE;
+    size_t bytes = n * sizeof(JournalRecord);
+    if (file.read((uint8_t *)batch, bytes) != bytes) {
+      seg.sealed = true;
+      break;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      const JournalRecord &rec = batch[i];
+      bool follows = seg.count == 0 ? rec.seq != 0 : rec.seq == seg.firstSeq + seg.count;
+      if (!follows || rec.crc != recordCrc(rec)) {
+        seg.sealed = true;
+        break;
+      }
+      if (seg.count == 0) seg.firstSeq = rec.seq;
+      seg.count++;
+    }
+  }
+  file.close();
+  if (seg.count >= JOURNAL_SEGMENT_RECORDS) seg.sealed = true;
+}
+
+// Delete the oldest segment
+static void dropOldestSegment() {
+  char path[32];
+  segmentPath(segments[0].number, path, sizeof(path));
+  LittleFS.remove(path);
+  segmentCount--;
+  memmove(segments, segments + 1, segmentCount * sizeof(JournalSegment));
+}
+
+// Delete segments the server has all of.  The one still being appended
+// to stays until it is full, so that acks do not churn files.
+static void dropAckedSegments() {
+  while (segmentCount > 0 && segments[0].sealed &&
+         (segments[0].count == 0 || segmentLastSeq(segments[0]) <= ackedSeq)) {
+    dropOldestSegment();
+  }
+}
+
+// The segment to append to, starting a new one when the newest is
+// sealed.  When all JOURNAL_SEGMENTS are in use the oldest is deleted,
+// giving up any of its records the server has not confirmed.
+static JournalSegment *appendSegment() {
+  if (segmentCount > 0) {
+    JournalSegment &last = segments[segmentCount - 1];
+    if (!last.sealed) return &last;
+    if (last.count == 0) {
+      // A failed first write left nothing usable; start the file again
+      char path[32];
+      segmentPath(last.number, path, sizeof(path));
+      LittleFS.remove(path);
+      last.firstSeq = headSeq + 1;
+      last.sealed = false;
+      return &last;
+    }
+  }
+  dropAckedSegments();
+  if (segmentCount == JOURNAL_SEGMENTS) {
+    uint32_t lastSeq = segmentLastSeq(segments[0]);
+    if (segments[0].count > 0 && lastSeq > ackedSeq) {
+      LOG_W(JOURNAL, "Journal full, %u unsent events dropped", (unsigned)(lastSeq - ackedSeq));
+      ackedSeq = lastSeq;
+      saveState();
+    }
+    dropOldestSegment();
+  }
+  JournalSegment &seg = segments[segmentCount++];
+  seg.number = nextSegment++;
+  seg.firstSeq = headSeq + 1;
+  seg.count = 0;
+  seg.sealed = false;
+  return &seg;
+}
+
+// Delete every segment, with the journal's identity lost
+static void removeSegments() {
+  uint32_t numbers[JOURNAL_SEGMENTS];
+  uint8_t found = listSegments(numbers, JOURNAL_SEGMENTS);
+  for (uint8_t i = 0; i < found; i++) {
+    char path[32];
+    segmentPath(numbers[i], path, sizeof(path));
+    LittleFS.remove(path);
+  }
+}
+
+// Read the segments and work out what is still to be uploaded.
+// LittleFS must already be mounted (initAllowlist() does this).
+void initJournal() {
+  if (!LittleFS.exists(JOURNAL_DIR) && !LittleFS.mkdir(JOURNAL_DIR)) {
+    LOG_E(JOURNAL, "Could not create journal, events will not be kept");
+    return;
+  }
+  if (!loadState()) {
+    // Records of a journal whose identity is lost cannot be attributed
+    removeSegments();
+    journalId = halRandom();
+    ackedSeq  = 0;
+    saveState();
+  }
+
+  uint32_t numbers[JOURNAL_SEGMENTS];
+  uint8_t found = listSegments(numbers, JOURNAL_SEGMENTS);
+  for (uint8_t i = 0; i < found; i++) {
+    JournalSegment &seg = segments[segmentCount];
+    seg.number = numbers[i];
+    scanSegment(seg);
+    nextSegment = seg.number + 1;
+    if (seg.count > 0 && segmentCount > 0 && seg.firstSeq <= headSeq) {
+      // Numbering went backwards; only the newer run can be trusted
+      seg.count = 0;
+    }
+    if (seg.count == 0) {
+      char path[32];
+      segmentPath(seg.number, path, sizeof(path));
+      LittleFS.remove(path);
+      continue;
+    }
+    headSeq = segmentLastSeq(seg);
+    segmentCount++;
+  }
+  // Numbering continues after the acknowledged position even if the
+  // segments themselves were lost
+  if (headSeq < ackedSeq) headSeq = ackedSeq;
+  dropAckedSegments();
+  journalReady = true;
+  LOG_I(JOURNAL, "%u events awaiting upload in %u segments", (unsigned)(headSeq - ackedSeq),
+        (unsigned)segmentCount);
+}
+
+const char* journalEventName(uint8_t type) {
+  switch (type) {
+    case JOURNAL_MASTER_UNLOCK: return "master_unlock";
+    case JOURNAL_OFFLINE_GRANT: return "offline_grant";
+    case JOURNAL_CACHE_GRANT:   return "cache_grant";
+    case JOURNAL_OFFLINE_DENY:  return "offline_deny";
+    case JOURNAL_SESSION_END:   return "session_end";
+    default:                    return "unknown";
+  }
+}
+
+static JournalRecord makeRecord(JournalEventType type, uint8_t resource, uint32_t code,
+                                uint32_t data, const char* sessionId) {
+  JournalRecord rec = {};
+  time_t now = halTime();
+  rec.time = now > 1600000000 ? (uint32_t)now : 0;
+  rec.code = code;
+  rec.data = data;
+  rec.type = type;
+  rec.resource = resource;
+  copyQueueText(rec.sessionId, sizeof(rec.sessionId), sessionId);
+  return rec;
+}
+
+// Record an event.  Called from the access task; never touches flash.
+void journalEvent(JournalEventType type, uint8_t resource, uint32_t code, uint32_t data,
+                  const char* sessionId) {
+  if (!queuedRecords.push(makeRecord(type, resource, code, data, sessionId))) {
+    LOG_W(JOURNAL, "Queue full, event dropped");
+  }
+}
+
+// Record a request the access task posted while the link was up but
+// that the network task found it could not send.  Called from the
+// network task; written with the access task's records.
+void journalUnsentEvent(JournalEventType type, uint8_t resource, uint32_t code, uint32_t data,
+                        const char* sessionId) {
+  if (!unsentRecords.push(makeRecord(type, resource, code, data, sessionId))) {
+    LOG_W(JOURNAL, "Queue full, event dropped");
+  }
+}
+
+// Append queued records to the newest segment, opening the file once
+// per segment touched.  Waits up to JOURNAL_FLUSH_MS to gather a burst
+// into one append unless the queue is half full.
+static void writeQueuedRecords() {
+  uint32_t queued = queuedRecords.size() + unsentRecords.size();
+  if (queued == 0) return;
+  unsigned long now = halMillis();
+  if (queued < JOURNAL_QUEUE_DEPTH / 2 && now - lastFlushAt < JOURNAL_FLUSH_MS) return;
+  lastFlushAt = now;
+
+  JournalSegment *seg = nullptr;
+  File file;
+  JournalRecord rec;
+  while (queuedRecords.pop(rec) || unsentRecords.pop(rec)) {
+    if (!seg || seg->sealed) {
+      if (file) file.close();
+      seg = appendSegment();
+      char path[32];
+      segmentPath(seg->number, path, sizeof(path));
+      file = LittleFS.open(path, FILE_APPEND);
+    }
+    rec.seq = headSeq + 1;
+    rec.crc = recordCrc(rec);
+    if (!file || file.write((const uint8_t *)&rec, sizeof(rec)) != sizeof(rec)) {
+      // The file may now end in part of this record; append no more to
+      // it, and leave the rest queued for the next flush
+      LOG_E(JOURNAL, "Write failed, event lost");
+      seg->sealed = true;
+      break;
+    }
+    headSeq = rec.seq;
+    if (++seg->count >= JOURNAL_SEGMENT_RECORDS) seg->sealed = true;
+  }
+  if (file) file.close();
+}
+
+// Read up to JOURNAL_BATCH_SIZE unacknowledged records into batch[].
+// A batch names one resource, so it ends before the first record of
+// another.  lastSeq is set to the last sequence number taken or
+// skipped because it could not be read.
+static uint8_t readBatch(uint32_t &lastSeq) {
+  uint8_t count = 0;
+  lastSeq = ackedSeq;
+  for (uint8_t s = 0; s < segmentCount && count < JOURNAL_BATCH_SIZE; s++) {
+    const JournalSegment &seg = segments[s];
+    if (seg.count == 0 || segmentLastSeq(seg) <= ackedSeq) continue;
+    uint32_t seq = seg.firstSeq > ackedSeq ? seg.firstSeq : ackedSeq + 1;
+    char path[32];
+    segmentPath(seg.number, path, sizeof(path));
+    File file = LittleFS.open(path, FILE_READ);
+    if (!file || !file.seek((seq - seg.firstSeq) * sizeof(JournalRecord))) {
+      if (count == 0) lastSeq = segmentLastSeq(seg);
+      return count;
+    }
+    for (; seq <= segmentLastSeq(seg) && count < JOURNAL_BATCH_SIZE; seq++) {
+      JournalRecord &rec = batch[count];
+      bool intact = file.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec) &&
+                    rec.seq == seq && rec.crc == recordCrc(rec);
+      if (!intact) {
+        // Only a flash fault gets here; the boot scan checked them all
+        if (count == 0) lastSeq = segmentLastSeq(seg);
+        return count;
+      }
+      if (count > 0 && rec.resource != batch[0].resource) return count;
+      lastSeq = seq;
+      count++;
+    }
+  }
+  return count;
+}
+
+// Called from the network task: store queued events and keep one
+// batch of the backlog in flight while the server is reachable
+void handleJournal() {
+  if (!journalReady) return;
+  writeQueuedRecords();
+
+  if (!wsConnected || !authenticated || headSeq == ackedSeq) return;
+  if (batchInFlight && halMillis() - batchSentAt < JOURNAL_ACK_TIMEOUT_MS) return;
+
+  uint32_t lastSeq;
+  uint8_t count = readBatch(lastSeq);
+  if (count == 0) {
+    // Nothing readable in this stretch of the journal; skip over it
+    ackedSeq = lastSeq;
+    saveState();
+    dropAckedSegments();
+    return;
+  }
+  // A batch that could not be sent waits out the ack timeout like one
+  // that was lost, rather than going again on the next pass
+  if (!sendEventBatch(journalId, batch, count)) {
+    LOG_W(JOURNAL, "Batch not sent, retrying in %lu ms", JOURNAL_ACK_TIMEOUT_MS);
+  }
+  batchInFlight = true;
+  batchLastSeq  = batch[count - 1].seq;
+  batchSentAt   = halMillis();
+}
+
+// Start uploading from the acknowledged position on a new connection
+void resetJournalUpload() {
+  batchInFlight = false;
+}
+
+// The server has stored everything up to and including `seq`
+void handleEventAck(JsonDocument &doc) {
+  if (!journalReady) return;
+  uint32_t seq = doc["seq"] | 0U;
+  if ((doc["journal"] | 0U) != journalId || seq <= ackedSeq || seq > headSeq) return;
+  ackedSeq = seq;
+  saveState();
+  dropAckedSegments();
+  if (seq >= batchLastSeq) batchInFlight = false;
+  LOG_I(JOURNAL, "Server stored events up to %u", (unsigned)seq);
+}
@@ -0,0 +1,263 @@
+// Outbound frame builder functions for MakerPass firmware
+// This module builds the rfid_scan, session_end, card_present,
+// device_auth and pong frames without JsonDocument or String.  The
+// parts that never change for this device (type, resource_id, api_key)
+// are rendered once by initFrameTemplates(), per resource where the
+// frame names one; each send copies the template into a stack frame
+// and appends the variable field.  device_auth lists every resource
+// the controller serves, so one connection authenticates them all.
+// Once the server has accepted the binary encoding, all but
+// device_auth are built as MessagePack instead (see wire_schema.h);
+// device_auth, which offers it, is always JSON.
+
+#include "frame_builder.h"
+#include "config.h"
+#include "constants.h"
+#include "msgpack_codec.h"
+#include "wire_schema.h"
+#include "logger.h"
+
+// Templates of the frames that name a resource, rendered once at boot
+struct ResourceTemplates {
+  char scanPrefix[96];
+  size_t scanPrefixLen;
+  char sessionEndPrefix[96];
+  size_t sessionEndPrefixLen;
+  char cardPresentPrefix[96];
+  size_t cardPresentPrefixLen;
+
+  // MessagePack
+  uint8_t scanPrefixBin[64];
+  size_t scanPrefixBinLen;
+  uint8_t sessionEndPrefixBin[64];
+  size_t sessionEndPrefixBinLen;
+  uint8_t cardPresentPrefixBin[64];
+  size_t cardPresentPrefixBinLen;
+};
+
+static ResourceTemplates templates[MAX_RESOURCES];
+static char authFrame[FRAME_MAX_PAYLOAD];
+static size_t authFrameLen = 0;
+static uint8_t pongFrameBin[4];
+static size_t pongFrameBinLen = 0;
+
+static bool binaryFrames = false;
+
+static const char PONG_FRAME[]   = "{\"type\":\"pong\"}";
+static const char FRAME_SUFFIX[] = "\"}";
+static const char AUTH_SUFFIX[]  = ",\"encodings\":[\"msgpack\"]}";
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// Append raw bytes at *pos, refusing to write past end
+static bool appendRaw(char *&pos, const char *end, const char *text, size_t len) {
+  if ((size_t)(end - pos) < len) return false;
+  memcpy(pos, text, len);
+  pos += len;
+  return true;
+}
+
+// Append a string with JSON escaping of quotes, backslashes and
+// control characters
+static bool appendEscaped(char *&pos, const char *end, const char *text) {
+  for (; *text; text++) {
+    uint8_t c = (uint8_t)*text;
+    if (c == '"' || c == '\\') {
+      char esc[2] = {'\\', (char)c};
+      if (!appendRaw(pos, end, esc, 2)) return false;
+    } else if (c < 0x20) {
+      char esc[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xF]};
+      if (!appendRaw(pos, end, esc, 6)) return false;
+    } else {
+      if (pos == end) return false;
+      *pos++ = (char)c;
+    }
+  }
+  return true;
+}
+
+// Render `"{\"type\":\"<type>\",\"resource_id\":\"<id>\",\"<field>\":\""`
+static size_t renderPrefix(char *buf, size_t size, const char *type, const char *resourceId,
+                           const char *field) {
+  char *pos = buf;
+  const char *end = buf + size;
+  bool ok = appendRaw(pos, end, "{\"type\":\"", 9) &&
+            appendEscaped(pos, end, type) &&
+            appendRaw(pos, end, "\",\"resource_id\":\"", 17) &&
+            appendEscaped(pos, end, resourceId) &&
+            appendRaw(pos, end, "\",\"", 3) &&
+            appendEscaped(pos, end, field) &&
+            appendRaw(pos, end, "\":\"", 3);
+  return ok ? pos - buf : 0;
+}
+
+// Render `{type: <type>, resource_id: "<id>", <field>: ` as MessagePack
+static size_t renderPrefixBin(uint8_t *buf, size_t size, uint8_t type, const char *resourceId,
+                              uint8_t field) {
+  MsgPackWriter out(buf, size);
+  out.mapHeader(3);
+  out.unsignedInt(WIRE_KEY_TYPE);
+  out.unsignedInt(type);
+  out.unsignedInt(WIRE_KEY_RESOURCE_ID);
+  out.string(resourceId);
+  out.unsignedInt(field);
+  return out.ok() ? out.length() : 0;
+}
+
+// Render the fixed parts of one resource's frames
+static bool renderResourceTemplates(ResourceTemplates &t, const char *id) {
+  t.scanPrefixLen        = renderPrefix(t.scanPrefix, sizeof(t.scanPrefix), "rfid_scan", id, "rfid_code");
+  t.sessionEndPrefixLen  = renderPrefix(t.sessionEndPrefix, sizeof(t.sessionEndPrefix),
+                                        "session_end", id, "session_id");
+  t.cardPresentPrefixLen = renderPrefix(t.cardPresentPrefix, sizeof(t.cardPresentPrefix),
+                                        "card_present", id, "session_id");
+  t.scanPrefixBinLen        = renderPrefixBin(t.scanPrefixBin, sizeof(t.scanPrefixBin),
+                                              WIRE_TYPE_RFID_SCAN, id, WIRE_KEY_RFID_CODE);
+  t.sessionEndPrefixBinLen  = renderPrefixBin(t.sessionEndPrefixBin, sizeof(t.sessionEndPrefixBin),
+                                              WIRE_TYPE_SESSION_END, id, WIRE_KEY_SESSION_ID);
+  t.cardPresentPrefixBinLen = renderPrefixBin(t.cardPresentPrefixBin, sizeof(t.cardPresentPrefixBin),
+                                              WIRE_TYPE_CARD_PRESENT, id, WIRE_KEY_SESSION_ID);
+  return t.scanPrefixLen && t.sessionEndPrefixLen && t.cardPresentPrefixLen &&
+         t.scanPrefixBinLen && t.sessionEndPrefixBinLen && t.cardPresentPrefixBinLen;
+}
+
+// device_auth names the first resource, as a single-resource device
+// always has, and lists all of them when there are more
+static size_t renderAuthFrame() {
+  char *pos = authFrame;
+  const char *end = authFrame + sizeof(authFrame);
+  size_t prefixLen = renderPrefix(authFrame, sizeof(authFrame), "device_auth", RESOURCES[0].id, "api_key");
+  pos += prefixLen;
+  bool ok = prefixLen > 0 &&
+            appendEscaped(pos, end, API_KEY) &&
+            appendRaw(pos, end, "\"", 1);
+  if (ok && RESOURCE_COUNT > 1) {
+    ok = appendRaw(pos, end, ",\"resources\":[", 14);
+    for (uint8_t i = 0; ok && i < RESOURCE_COUNT; i++) {
+      ok = (i == 0 || appendRaw(pos, end, ",", 1)) &&
+           appendRaw(pos, end, "\"", 1) &&
+           appendEscaped(pos, end, RESOURCES[i].id) &&
+           appendRaw(pos, end, "\"", 1);
+    }
+    ok = ok && appendRaw(pos, end, "]", 1);
+  }
+  ok = ok && appendRaw(pos, end, AUTH_SUFFIX, sizeof(AUTH_SUFFIX) - 1);
+  return ok ? pos - authFrame : 0;
+}
+
+// Render the fixed parts of every frame.  Call once before the
+// WebSocket connects.
+void initFrameTemplates() {
+  bool ok = true;
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    ok = renderResourceTemplates(templates[i], RESOURCES[i].id) && ok;
+  }
+  authFrameLen = renderAuthFrame();
+
+  MsgPackWriter pong(pongFrameBin, sizeof(pongFrameBin));
+  pong.mapHeader(1);
+  pong.unsignedInt(WIRE_KEY_TYPE);
+  pong.unsignedInt(WIRE_TYPE_PONG);
+  pongFrameBinLen = pong.length();
+
+  if (!ok || !authFrameLen) {
+    LOG_E(WIRE, "Resource id or API_KEY too long for frame templates");
+  }
+}
+
+// Select the encoding for rfid_scan, session_end and pong.  Called by
+// the network task when the server accepts or the connection drops.
+void setFrameEncoding(bool binary) {
+  binaryFrames = binary;
+}
+
+// Write a 32-bit value as exactly 8 upper-case hex digits (no NUL)
+void encodeHex32(uint32_t value, char *out) {
+  for (int8_t i = 7; i >= 0; i--) {
+    out[i] = HEX_DIGITS[value & 0xF];
+    value >>= 4;
+  }
+}
+
+bool buildRFIDScanFrame(OutboundFrame &frame, uint8_t resource, uint32_t code) {
+  if (resource >= MAX_RESOURCES) return false;
+  const ResourceTemplates &t = templates[resource];
+  frame.binary = binaryFrames;
+  if (binaryFrames) {
+    if (!t.scanPrefixBinLen) return false;
+    uint8_t *buf = (uint8_t *)frame.payload();
+    memcpy(buf, t.scanPrefixBin, t.scanPrefixBinLen);
+    MsgPackWriter out(buf + t.scanPrefixBinLen, FRAME_MAX_PAYLOAD - t.scanPrefixBinLen);
+    out.uint32Fixed(code);
+    frame.length = t.scanPrefixBinLen + out.length();
+    return out.ok();
+  }
+  if (!t.scanPrefixLen) return false;
+  char *buf = frame.payload();
+  memcpy(buf, t.scanPrefix, t.scanPrefixLen);
+  encodeHex32(code, buf + t.scanPrefixLen);
+  memcpy(buf + t.scanPrefixLen + 8, FRAME_SUFFIX, 2);
+  frame.length = t.scanPrefixLen + 8 + 2;
+  return true;
+}
+
+// Frames whose only variable field is the session id
+static bool buildSessionFrame(OutboundFrame &frame, const char *sessionId,
+                              const char *prefix, size_t prefixLen,
+                              const uint8_t *prefixBin, size_t prefixBinLen) {
+  frame.binary = binaryFrames;
+  if (binaryFrames) {
+    if (!prefixBinLen) return false;
+    uint8_t *buf = (uint8_t *)frame.payload();
+    memcpy(buf, prefixBin, prefixBinLen);
+    MsgPackWriter out(buf + prefixBinLen, FRAME_MAX_PAYLOAD - prefixBinLen);
+    out.string(sessionId);
+    frame.length = prefixBinLen + out.length();
+    return out.ok();
+  }
+  if (!prefixLen) return false;
+  char *buf = frame.payload();
+  char *pos = buf;
+  const char *end = buf + FRAME_MAX_PAYLOAD;
+  bool ok = appendRaw(pos, end, prefix, prefixLen) &&
+            appendEscaped(pos, end, sessionId) &&
+            appendRaw(pos, end, FRAME_SUFFIX, 2);
+  frame.length = pos - buf;
+  return ok;
+}
+
+bool buildSessionEndFrame(OutboundFrame &frame, uint8_t resource, const char *sessionId) {
+  if (resource >= MAX_RESOURCES) return false;
+  const ResourceTemplates &t = templates[resource];
+  return buildSessionFrame(frame, sessionId, t.sessionEndPrefix, t.sessionEndPrefixLen,
+                           t.sessionEndPrefixBin, t.sessionEndPrefixBinLen);
+}
+
+bool buildCardPresentFrame(OutboundFrame &frame, uint8_t resource, const char *sessionId) {
+  if (resource >= MAX_RESOURCES) return false;
+  const ResourceTemplates &t = templates[resource];
+  return buildSessionFrame(frame, sessionId, t.cardPresentPrefix, t.cardPresentPrefixLen,
+                           t.cardPresentPrefixBin, t.cardPresentPrefixBinLen);
+}
+
+// The templates are copied rather than sent directly because the
+// library masks the payload in place
+bool buildDeviceAuthFrame(OutboundFrame &frame) {
+  frame.binary = false;
+  if (!authFrameLen) return false;
+  memcpy(frame.payload(), authFrame, authFrameLen);
+  frame.length = authFrameLen;
+  return true;
+}
+
+bool buildPongFrame(OutboundFrame &frame) {
+  frame.binary = binaryFrames;
+  if (binaryFrames) {
+    memcpy(frame.payload(), pongFrameBin, pongFrameBinLen);
+    frame.length = pongFrameBinLen;
+    return true;
+  }
+  frame.length = sizeof(PONG_FRAME) - 1;
+  memcpy(frame.payload(), PONG_FRAME, frame.length);
+  return true;
+}
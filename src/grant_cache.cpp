@@ -0,0 +1,132 @@
+// Grant cache functions for MakerPass firmware
+// This module keeps a small LRU table of recent access grants keyed by
+// resource and 32-bit Wiegand code; a grant for one resource says
+// nothing about the others.  A hit lets handleRFIDScan() energise the
+// relay immediately; the scan is still sent to the server for audit and
+// the server may revoke an entry at any time.
+
+#include "grant_cache.h"
+#include "constants.h"
+#include "hal.h"
+
+struct GrantCacheEntry {
+  uint32_t code;
+  uint8_t  resource;   // index into RESOURCES
+  uint32_t storedAt;   // halMillis() when the grant was cached
+  uint32_t ttlMs;      // lifetime granted by the server
+  uint32_t lastUsed;   // LRU stamp, larger is more recent
+  bool     valid;
+  UserName userName;
+};
+
+static GrantCacheEntry cacheEntries[GRANT_CACHE_SIZE];
+static uint32_t useCounter = 0;
+static GrantCacheStats stats = {0, 0, 0, 0, 0};
+
+// Return true when the entry has outlived its TTL.  The subtraction is
+// rollover safe because both values are unsigned 32-bit halMillis().
+static bool entryExpired(const GrantCacheEntry &entry, uint32_t now) {
+  return (uint32_t)(now - entry.storedAt) >= entry.ttlMs;
+}
+
+static GrantCacheEntry *findEntry(uint8_t resource, uint32_t code) {
+  for (uint8_t i = 0; i < GRANT_CACHE_SIZE; i++) {
+    if (cacheEntries[i].valid && cacheEntries[i].code == code &&
+        cacheEntries[i].resource == resource) {
+      return &cacheEntries[i];
+    }
+  }
+  return nullptr;
+}
+
+// Look up a card.  On a hit the cached user name is returned and the
+// entry becomes the most recently used.
+bool grantCacheLookup(uint8_t resource, uint32_t code, UserName &userName) {
+  GrantCacheEntry *entry = findEntry(resource, code);
+  if (entry && entryExpired(*entry, halMillis())) {
+    entry->valid = false;
+    stats.expirations++;
+    entry = nullptr;
+  }
+  if (!entry) {
+    stats.misses++;
+    return false;
+  }
+  entry->lastUsed = ++useCounter;
+  userName = entry->userName;
+  stats.hits++;
+  return true;
+}
+
+// Remember a grant for ttlSeconds.  A TTL of zero means the server does
+// not want this grant cached, so any existing entry is dropped instead.
+void grantCacheStore(uint8_t resource, uint32_t code, const char *userName, uint32_t ttlSeconds) {
+  if (ttlSeconds == 0) {
+    GrantCacheEntry *existing = findEntry(resource, code);
+    if (existing) existing->valid = false;
+    return;
+  }
+  if (ttlSeconds > GRANT_CACHE_MAX_TTL_S) ttlSeconds = GRANT_CACHE_MAX_TTL_S;
+
+  uint32_t now = halMillis();
+  GrantCacheEntry *slot = findEntry(resource, code);
+  if (!slot) {
+    // Prefer a free or expired slot, otherwise evict the LRU entry
+    GrantCacheEntry *lru = nullptr;
+    for (uint8_t i = 0; i < GRANT_CACHE_SIZE && !slot; i++) {
+      GrantCacheEntry &entry = cacheEntries[i];
+      if (!entry.valid) {
+        slot = &entry;
+      } else if (entryExpired(entry, now)) {
+        stats.expirations++;
+        slot = &entry;
+      } else if (!lru || entry.lastUsed < lru->lastUsed) {
+        lru = &entry;
+      }
+    }
+    if (!slot) {
+      slot = lru;
+      stats.evictions++;
+    }
+  }
+
+  slot->code     = code;
+  slot->resource = resource;
+  slot->storedAt = now;
+  slot->ttlMs    = ttlSeconds * 1000UL;
+  slot->lastUsed = ++useCounter;
+  slot->valid    = true;
+  slot->userName = userName;
+}
+
+// Remove a single card.  Returns true if an entry was present.
+bool grantCacheRevoke(uint8_t resource, uint32_t code) {
+  GrantCacheEntry *entry = findEntry(resource, code);
+  if (!entry) return false;
+  entry->valid = false;
+  stats.revocations++;
+  return true;
+}
+
+// Drop every cached grant, e.g. when the server revokes all entries
+void grantCacheClear() {
+  for (uint8_t i = 0; i < GRANT_CACHE_SIZE; i++) {
+    if (cacheEntries[i].valid) {
+      cacheEntries[i].valid = false;
+      stats.revocations++;
+    }
+  }
+}
+
+// Number of live (possibly expired but not yet reclaimed) entries
+uint8_t grantCacheCount() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < GRANT_CACHE_SIZE; i++) {
+    if (cacheEntries[i].valid) count++;
+  }
+  return count;
+}
+
+const GrantCacheStats &getGrantCacheStats() {
+  return stats;
+}
@@ -0,0 +1,169 @@
+// Host hardware abstraction for MakerPass firmware
+// This module stands in for the ESP32 when the firmware is built for
+// the host (-DMAKERPASS_HOST).  Time only moves when the caller
+// advances it, so a day of door and machine traffic runs as fast as
+// the code itself: the scheduler in lib/host_sim runs whichever task
+// is ready, then jumps the clock to the next task deadline or event.
+// Events (Wiegand edges, driver callbacks) sit in a heap ordered by
+// virtual time and run as the clock passes them.  Pin writes are
+// recorded for inspection, and the RNG is a seeded xorshift so that a
+// run can be repeated exactly.
+
+#ifdef MAKERPASS_HOST
+
+#include "hal.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+struct HostPin {
+  uint8_t mode;
+  uint8_t level;
+  uint32_t writes;          // halDigitalWrite() calls
+  uint32_t rises;           // writes that took the pin from LOW to HIGH
+  HalEdgeHandler handler;
+  void *arg;
+};
+
+struct HostEvent {
+  int64_t us;
+  uint64_t seq;             // keeps events at the same time in order
+  HalEdgeHandler handler;
+  void *arg;
+};
+
+static int64_t uptimeUs = 0;
+static HostPin pins[HAL_PIN_COUNT];
+static std::vector<HostEvent> events;
+static uint64_t eventSeq = 0;
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+static bool wallClockSet = false;
+static time_t wallClockAtBoot = 0;
+
+// Heap order: the earliest event at the front
+static bool laterEvent(const HostEvent &a, const HostEvent &b) {
+  return a.us != b.us ? a.us > b.us : a.seq > b.seq;
+}
+
+uint32_t halMillis() {
+  return (uint32_t)(uptimeUs / 1000);
+}
+
+uint32_t halMicros() {
+  return (uint32_t)uptimeUs;
+}
+
+int64_t halUptimeUs() {
+  return uptimeUs;
+}
+
+int64_t halBenchNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint32_t halRandom() {
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return (uint32_t)((rngState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+time_t halTime() {
+  time_t sinceBoot = (time_t)(uptimeUs / 1000000);
+  return wallClockSet ? wallClockAtBoot + sinceBoot : sinceBoot;
+}
+
+void halPinMode(uint8_t pin, uint8_t mode) {
+  if (pin < HAL_PIN_COUNT) pins[pin].mode = mode;
+}
+
+void halDigitalWrite(uint8_t pin, uint8_t level) {
+  if (pin >= HAL_PIN_COUNT) return;
+  if (level && !pins[pin].level) pins[pin].rises++;
+  pins[pin].level = level;
+  pins[pin].writes++;
+}
+
+void halAttachFallingEdge(uint8_t pin, HalEdgeHandler handler, void *arg) {
+  if (pin >= HAL_PIN_COUNT) return;
+  pins[pin].handler = handler;
+  pins[pin].arg = arg;
+}
+
+// Move the clock to `us`, running due events on the way.  The clock
+// never goes backwards; setting it earlier only runs nothing.  Start
+// it at an arbitrary point, e.g. shortly before millis() wraps, before
+// anything has been scheduled.
+void halSetUptimeUs(int64_t us) {
+  while (!events.empty() && events.front().us <= us) {
+    std::pop_heap(events.begin(), events.end(), laterEvent);
+    HostEvent event = events.back();
+    events.pop_back();
+    if (event.us > uptimeUs) uptimeUs = event.us;
+    event.handler(event.arg);
+  }
+  if (us > uptimeUs) uptimeUs = us;
+}
+
+void halAdvanceUs(int64_t us) {
+  if (us > 0) halSetUptimeUs(uptimeUs + us);
+}
+
+int64_t halNextEventUs() {
+  return events.empty() ? HAL_NO_EVENT : events.front().us;
+}
+
+void halScheduleAt(int64_t us, HalEdgeHandler handler, void *arg) {
+  events.push_back({us, eventSeq++, handler, arg});
+  std::push_heap(events.begin(), events.end(), laterEvent);
+}
+
+void halSeedRandom(uint64_t seed) {
+  rngState = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+// What time(nullptr) returns from now on, as SNTP would set it
+void halSetWallClock(time_t now) {
+  wallClockAtBoot = now - (time_t)(uptimeUs / 1000000);
+  wallClockSet = true;
+}
+
+uint8_t halPinLevel(uint8_t pin) {
+  return pin < HAL_PIN_COUNT ? pins[pin].level : 0;
+}
+
+uint32_t halPinWrites(uint8_t pin) {
+  return pin < HAL_PIN_COUNT ? pins[pin].writes : 0;
+}
+
+uint32_t halPinRises(uint8_t pin) {
+  return pin < HAL_PIN_COUNT ? pins[pin].rises : 0;
+}
+
+// One Wiegand bit: a low pulse on the line, seen as a falling edge at
+// the current virtual time
+void halFallingEdge(uint8_t pin) {
+  if (pin < HAL_PIN_COUNT && pins[pin].handler) {
+    pins[pin].handler(pins[pin].arg);
+  }
+}
+
+static void fireEdge(void *arg) {
+  halFallingEdge((uint8_t)(uintptr_t)arg);
+}
+
+void halScheduleFallingEdge(uint8_t pin, int64_t us) {
+  halScheduleAt(us, fireEdge, (void *)(uintptr_t)pin);
+}
+
+void halWiegandFrame(uint8_t pinData0, uint8_t pinData1, uint64_t bits, uint8_t count,
+                     int64_t startUs, uint32_t intervalUs) {
+  for (uint8_t i = 0; i < count; i++) {
+    bool one = (bits >> (count - 1 - i)) & 1;
+    halScheduleFallingEdge(one ? pinData1 : pinData0, startUs + (int64_t)i * intervalUs);
+  }
+}
+
+#endif
@@ -0,0 +1,313 @@
+// Benchmark runner for MakerPass host builds
+// This program runs the firmware's benchmarks (bench.cpp) on the host,
+// adds the display benchmarks that need the counting TFT_eSPI double,
+// and compares everything with a stored baseline.  For showMessage()
+// and a showRuntimeDisplay() tick it reports the time per call and the
+// pixels and SPI bytes that reach the panel.
+//
+// Results go to stdout as JSON, in the format of bench/baseline.json;
+// a table with the change from the baseline goes to stderr.  A result
+// worse than its baseline by more than the baseline's threshold for
+// its unit fails the run (exit status 1).  Pixel and byte counts are
+// the same on every machine and are held to their baseline exactly;
+// they are all the committed baseline holds.  Timings belong to the
+// machine that made them: --save records the machine in the baseline,
+// and a timing is only held to a baseline saved on the same machine.
+// Against any other it is reported as advisory and does not fail the
+// run.  The suite runs --repeat times (default 5) and each timing
+// keeps its fastest run, so that a busy moment on the host does not
+// fail it.
+//
+// --results checks results printed by the device (console key `b`)
+// instead of running anything, against a baseline made the same way.
+//
+// Usage: program [--baseline bench/baseline.json] [--results file]
+//                [--repeat N] [--save]
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <TFT_eSPI.h>
+#include "bench.h"
+#include "constants.h"
+#include "display_buffer.h"
+#include "frame_builder.h"
+#include "text_layout.h"
+#include "ui_manager.h"
+#include "host_sim.h"
+#include "hal.h"
+#include <string>
+#include <vector>
+#include <sys/utsname.h>
+
+extern TFT_eSPI tft;
+
+// Thresholds for a baseline that does not set its own, in percent
+static const uint32_t DEFAULT_TIME_THRESHOLD = 25;
+
+// Redraws per timed round of a display benchmark
+static const uint32_t UI_ITERATIONS = 200;
+
+// Runs of the whole suite
+static const int DEFAULT_REPEAT = 5;
+
+// What results from --results were measured on
+static const char DEVICE_MACHINE[] = "device";
+
+struct Result {
+  std::string name;
+  uint32_t value;
+  std::string unit;
+};
+
+static void add(std::vector<Result> &results, const char *name, uint32_t value,
+                const char *unit) {
+  results.push_back({name, value, unit});
+}
+
+// ---------------------------------------------------------------------------
+// Display benchmarks
+// ---------------------------------------------------------------------------
+
+// Fastest of BENCH_ROUNDS rounds of draw(i), in ns per call
+template <typename Draw>
+static uint32_t timeDraw(Draw draw) {
+  int64_t best = INT64_MAX;
+  uint32_t i = 0;
+  for (uint8_t round = 0; round < BENCH_ROUNDS; round++) {
+    int64_t start = halBenchNs();
+    for (uint32_t n = 0; n < UI_ITERATIONS; n++) draw(i++);
+    int64_t elapsed = halBenchNs() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  return (uint32_t)(best / UI_ITERATIONS);
+}
+
+// Panel traffic of one draw
+template <typename Draw>
+static void countDraw(std::vector<Result> &results, const char *name, Draw draw) {
+  hostPanelResetStats();
+  draw();
+  const HostPanelStats &panel = hostPanelStats();
+  add(results, (std::string(name) + "_pixels").c_str(), (uint32_t)panel.pixels, "pixels");
+  add(results, (std::string(name) + "_spi").c_str(), (uint32_t)panel.spiBytes, "bytes");
+}
+
+static void runtimeText(uint32_t seconds, char *text, size_t size) {
+  snprintf(text, size, "%02u:%02u:%02u", (unsigned)(seconds / 3600),
+           (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60));
+}
+
+// Messages alternate so that every call changes what is on the panel
+static void runDisplayBenchmarks(std::vector<Result> &results) {
+  static const char *const USERS[] = {"Ada Lovelace", "Grace Hopper"};
+  showMessage(USERS[0], "Session Started", COLOR_MSG_OK);
+  add(results, "ui_message", timeDraw([](uint32_t i) {
+        showMessage(USERS[i % 2], "Session Started", COLOR_MSG_OK);
+      }), "ns");
+  showMessage(USERS[0], "Session Started", COLOR_MSG_OK);
+  countDraw(results, "ui_message", []() {
+    showMessage(USERS[1], "Session Started", COLOR_MSG_OK);
+  });
+
+  char text[16];
+  countDraw(results, "ui_runtime_first", [&text]() {
+    runtimeText(0, text, sizeof(text));
+    showRuntimeDisplay(USERS[0], text, true);
+  });
+  countDraw(results, "ui_runtime_tick", [&text]() {
+    runtimeText(1, text, sizeof(text));
+    showRuntimeDisplay(USERS[0], text, false);
+  });
+  add(results, "ui_runtime_tick", timeDraw([&text](uint32_t i) {
+        runtimeText(2 + i, text, sizeof(text));
+        showRuntimeDisplay(USERS[0], text, false);
+      }), "ns");
+}
+
+// ---------------------------------------------------------------------------
+// Baseline
+// ---------------------------------------------------------------------------
+
+// Host name and architecture; a CI runner is a different machine on
+// every run
+static std::string machineName() {
+  struct utsname name;
+  if (uname(&name) != 0) return "unknown";
+  return std::string(name.nodename) + "/" + name.machine;
+}
+
+static bool readFile(const char *path, std::string &text) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  char buffer[4096];
+  size_t n;
+  text.clear();
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, n);
+  fclose(file);
+  return true;
+}
+
+static std::string nameList(const std::vector<std::string> &names) {
+  std::string out = "[";
+  for (size_t i = 0; i < names.size(); i++) {
+    out += (i ? ", \"" : "\"") + names[i] + "\"";
+  }
+  return out + "]";
+}
+
+// {"results": {"<name>": {"value": n, "unit": "ns"}, ...}, "regressed": [...],
+//  "advisory": [...]}; a baseline (with thresholds) names its machine instead
+static std::string resultsJson(const std::vector<Result> &results,
+                               const std::vector<std::string> &regressed,
+                               const std::vector<std::string> &advisory,
+                               const std::string &thresholds, const std::string &machine) {
+  std::string out = "{\n";
+  if (!thresholds.empty()) {
+    out += "  \"machine\": \"" + machine + "\",\n";
+    out += "  \"threshold_percent\": " + thresholds + ",\n";
+  }
+  out += "  \"results\": {\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    char line[160];
+    snprintf(line, sizeof(line), "    \"%s\": {\"value\": %u, \"unit\": \"%s\"}%s\n",
+             results[i].name.c_str(), (unsigned)results[i].value, results[i].unit.c_str(),
+             i + 1 < results.size() ? "," : "");
+    out += line;
+  }
+  out += "  }";
+  if (thresholds.empty()) {
+    out += ",\n  \"regressed\": " + nameList(regressed);
+    out += ",\n  \"advisory\": " + nameList(advisory);
+  }
+  return out + "\n}\n";
+}
+
+// Results printed by the device: the line of JSON in a console log
+static bool loadResults(const char *path, std::vector<Result> &results) {
+  std::string text;
+  if (!readFile(path, text)) return false;
+  size_t at = text.find("{\"results\"");
+  if (at == std::string::npos) return false;
+  size_t end = text.find('\n', at);
+  std::string line = text.substr(at, end == std::string::npos ? std::string::npos : end - at);
+  JsonDocument doc;
+  if (deserializeJson(doc, line.c_str(), line.size())) return false;
+  for (JsonPair entry : doc["results"].as<JsonObject>()) {
+    results.push_back({entry.key().c_str(), entry.value()["value"] | 0u,
+                       entry.value()["unit"] | "ns"});
+  }
+  return !results.empty();
+}
+
+int main(int argc, char **argv) {
+  const char *baselinePath = "bench/baseline.json";
+  const char *resultsPath = nullptr;
+  bool save = false;
+  int repeat = DEFAULT_REPEAT;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--baseline" && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (arg == "--results" && i + 1 < argc) {
+      resultsPath = argv[++i];
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (arg == "--save") {
+      save = true;
+    } else {
+      fprintf(stderr, "usage: %s [--baseline file] [--results file] [--repeat n] [--save]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<Result> results;
+  std::string machine = resultsPath ? DEVICE_MACHINE : machineName();
+  if (resultsPath) {
+    if (!loadResults(resultsPath, results)) {
+      fprintf(stderr, "%s: no {\"results\": ...} line\n", resultsPath);
+      return 2;
+    }
+  } else {
+    hostSerialEcho(false);
+    tft.init();
+    tft.setRotation(3);
+    initDisplayBuffer();
+    initTextMetrics(displayCanvas());
+    initFrameTemplates();
+    for (int run = 0; run < repeat || run == 0; run++) {
+      std::vector<Result> current;
+      BenchResult firmware[BENCH_COUNT];
+      runBenchmarks(firmware);
+      for (const BenchResult &r : firmware) add(current, r.name, r.value, r.unit);
+      runDisplayBenchmarks(current);
+      if (run == 0) {
+        results = current;
+        continue;
+      }
+      for (size_t i = 0; i < results.size(); i++) {
+        if (current[i].value < results[i].value) results[i].value = current[i].value;
+      }
+    }
+  }
+
+  std::string baselineText;
+  JsonDocument baseline;
+  bool haveBaseline = readFile(baselinePath, baselineText) &&
+                      !deserializeJson(baseline, baselineText.c_str(), baselineText.size());
+  std::string thresholds = "{\"ns\": " + std::to_string(DEFAULT_TIME_THRESHOLD) +
+                           ", \"pixels\": 0, \"bytes\": 0}";
+  if (haveBaseline && baseline["threshold_percent"].is<JsonObject>()) {
+    char text[256];
+    serializeJson(baseline["threshold_percent"], text, sizeof(text));
+    thresholds = text;
+  }
+  if (save) {
+    FILE *file = fopen(baselinePath, "w");
+    if (!file) {
+      perror(baselinePath);
+      return 2;
+    }
+    fputs(resultsJson(results, {}, {}, thresholds, machine).c_str(), file);
+    fclose(file);
+    fprintf(stderr, "Baseline saved to %s\n", baselinePath);
+    return 0;
+  }
+  if (!haveBaseline) {
+    fprintf(stderr, "No baseline in %s; run with --save to make one\n", baselinePath);
+  }
+
+  JsonDocument limits;
+  deserializeJson(limits, thresholds.c_str(), thresholds.size());
+  const char *baselineMachine = baseline["machine"] | "";
+  bool sameMachine = machine == baselineMachine;
+  if (haveBaseline && baselineMachine[0] != '\0' && !sameMachine) {
+    fprintf(stderr, "Baseline timings are from %s, not %s: advisory only\n", baselineMachine,
+            machine.c_str());
+  }
+  std::vector<std::string> regressed, advisory;
+  fprintf(stderr, "%-22s %10s %-7s %10s %8s\n", "benchmark", "value", "unit", "baseline",
+          "change");
+  for (const Result &r : results) {
+    uint32_t base = baseline["results"][r.name.c_str()]["value"] | 0u;
+    uint32_t threshold = limits[r.unit.c_str()] | (r.unit == "ns" ? DEFAULT_TIME_THRESHOLD : 0u);
+    bool worse = base > 0 && r.value > base + (uint64_t)base * threshold / 100;
+    bool enforced = r.unit != "ns" || sameMachine;
+    if (worse) (enforced ? regressed : advisory).push_back(r.name);
+    char change[16] = "new";
+    if (base > 0) snprintf(change, sizeof(change), "%+.1f%%", (r.value - (double)base) * 100 / base);
+    fprintf(stderr, "%-22s %10u %-7s %10u %8s%s\n", r.name.c_str(), (unsigned)r.value,
+            r.unit.c_str(), (unsigned)base, change,
+            worse ? (enforced ? "  REGRESSED" : "  slower (advisory)") : "");
+  }
+  fputs(resultsJson(results, regressed, advisory, "", "").c_str(), stdout);
+  if (!regressed.empty()) {
+    fprintf(stderr, "FAIL: %zu regressed beyond the baseline's threshold\n", regressed.size());
+    return 1;
+  }
+  fprintf(stderr, "PASS\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,79 @@
+// Fuzz target for MakerPass host builds
+// libFuzzer mutates traces (see wire_trace.h) and this target replays
+// each one through handleIncomingMessage() and handleIncomingBinary(),
+// so both processJsonMessage() and the MessagePack decoder behind
+// decodeWireMessage() see whatever the mutations produce, in sequences
+// as well as one frame at a time.  The access invariants are checked
+// after every frame and a violation aborts, which libFuzzer reports
+// with the input that caused it.  Sessions and cached grants are
+// cleared between inputs.
+//
+// Built with clang by `pio run -e fuzz`; run it over a copy of the
+// seed corpus so that new inputs do not land in the tree:
+//
+//   cp -r scenarios/traces /tmp/corpus
+//   .pio/build/fuzz/program /tmp/corpus -dict=src/host/fuzz/protocol.dict
+//
+// Without -DMAKERPASS_LIBFUZZER (any compiler) the program instead
+// runs the files named on its command line once each, to reproduce a
+// crash or check the corpus.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include "../replay.h"
+#include "../wire_trace.h"
+#include "host_sim.h"
+#include <vector>
+
+// Longest gap between frames played; a mutated varint could otherwise
+// ask for centuries of virtual time
+static const uint32_t FUZZ_MAX_GAP_MS = 3600000;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static bool ready = false;
+  if (!ready) {
+    hostSerialEcho(false);
+    replayInit();
+    ready = true;
+  }
+  replayResetAccess();
+  std::vector<TraceFrame> frames;
+  parseTrace(data, size, frames);
+  uint32_t lastMs = frames.empty() ? 0 : frames[0].atMs;
+  for (const TraceFrame &frame : frames) {
+    uint32_t gapMs = frame.atMs - lastMs;
+    replayAdvanceMs(gapMs < FUZZ_MAX_GAP_MS ? gapMs : FUZZ_MAX_GAP_MS);
+    lastMs = frame.atMs;
+    replayFrame(frame.binary, frame.payload, frame.length);
+    const char *violation = accessStateViolation();
+    if (violation) {
+      fprintf(stderr, "access invariant violated: %s\n", violation);
+      abort();
+    }
+  }
+  return 0;
+}
+
+#ifndef MAKERPASS_LIBFUZZER
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s input...\n", argv[0]);
+    return 2;
+  }
+  for (int i = 1; i < argc; i++) {
+    std::vector<uint8_t> data;
+    if (!readTraceFile(argv[i], data)) {
+      perror(argv[i]);
+      return 2;
+    }
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    printf("%s: ok\n", argv[i]);
+  }
+  return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,596 @@
+// Fleet load generator for MakerPass host builds
+// This program opens thousands of device connections to a MakerPass
+// server (or the bundled mock, src/host/server) and plays a day of
+// door and machine traffic on each, compressed by --speed.  Every
+// controller serves a machine and a door, like the host simulator.
+//
+// The devices speak through the firmware's own protocol code: frames
+// are built by sendDeviceAuth(), sendRFIDScan() and sendSessionEnd(),
+// and answers go through handleIncomingMessage()/processJsonMessage(),
+// whose AccessCommands tell the generator what the server decided.
+// That code keeps one device's state, so the generator points it at
+// one connection at a time; a single thread and epoll carry them all.
+//
+// Scan to answer latency is measured on the real clock from the call
+// to sendRFIDScan() until processJsonMessage() has posted the answer,
+// and reported as p50/p99/p99.9 with the fleet's message throughput.
+//
+// With --trace the first device's inbound frames are recorded, on the
+// schedule's compressed clock, for the replay harness (wire_trace.h).
+//
+// Usage: program [--host 127.0.0.1] [--port 8080] [--devices 1000]
+//                [--duration 60] [--speed 60] [--ramp 5] [--members 1000]
+//                [--door-every 10m] [--machine-every 30m] [--hold 10m..90m]
+//                [--strangers 10] [--trace file] [-v]
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "config.h"
+#include "websocket_manager.h"
+#include "frame_builder.h"
+#include "display_buffer.h"
+#include "text_layout.h"
+#include "task_manager.h"
+#include "../mock_server.h"
+#include "../wire_trace.h"
+#include "../ws_wire.h"
+#include "host_sim.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <random>
+
+extern TFT_eSPI tft;
+extern ServerSocket webSocket;
+extern bool wifiConnected;
+
+// Resources of every simulated controller (see MAKERPASS_SIM_DOOR)
+static const uint8_t MACHINE = 0;
+static const uint8_t DOOR = 1;
+static_assert(RESOURCE_COUNT == 2, "the load generator needs MAKERPASS_SIM_DOOR");
+
+enum DeviceState { DEVICE_CONNECTING, DEVICE_UPGRADING, DEVICE_OPEN, DEVICE_CLOSED };
+
+struct Device {
+  int fd;
+  DeviceState state;
+  std::string key;
+  std::vector<uint8_t> in;
+  std::vector<uint8_t> out;
+  bool authenticated;
+  bool scanPending[RESOURCE_COUNT];
+  int64_t scanSentNs[RESOURCE_COUNT];
+  std::string sessionId;           // machine session in progress
+};
+
+enum TimerKind : uint8_t { CONNECT, DOOR_SCAN, MACHINE_START, MACHINE_END };
+
+struct TimerEntry {
+  int64_t atNs;
+  uint32_t device;
+  TimerKind kind;
+  bool operator>(const TimerEntry &other) const { return atNs > other.atNs; }
+};
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  uint32_t devices = 1000;
+  double durationS = 60;
+  double speed = 60;
+  double rampS = 5;
+  uint32_t members = 1000;
+  double doorEveryS = 600;
+  double machineEveryS = 1800;
+  double holdMinS = 600;
+  double holdMaxS = 5400;
+  uint32_t strangerPct = 10;
+  const char *tracePath = nullptr;
+  bool verbose = false;
+};
+
+struct Counters {
+  uint64_t framesOut;
+  uint64_t bytesOut;
+  uint64_t framesIn;
+  uint64_t bytesIn;
+  uint64_t scans;
+  uint64_t skipped;                // a scan was due while the last was unanswered
+  uint64_t sessionEnds;
+  uint64_t connectFailures;
+  uint64_t disconnects;
+};
+
+static Options options;
+static Counters counters;
+static std::vector<Device> devices;
+static std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<TimerEntry>> timers;
+static std::vector<uint32_t> grantLatencyUs;
+static std::vector<uint32_t> denialLatencyUs;
+static std::mt19937_64 rng(1);
+static int epollFd = -1;
+static Device *current = nullptr;
+static TraceWriter trace;
+static int64_t startNs;
+static volatile sig_atomic_t stopping = 0;
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// ---------------------------------------------------------------------------
+// The firmware's link: frames go to the device being served
+// ---------------------------------------------------------------------------
+
+class FleetLink : public HostServer {
+ public:
+  bool accept() override { return true; }
+  void receive(const uint8_t *payload, size_t length, bool binary) override {
+    if (!current || current->state != DEVICE_OPEN) return;
+    counters.framesOut++;
+    counters.bytesOut += length;
+    wsAppendFrame(current->out, binary ? WS_OP_BINARY : WS_OP_TEXT, payload, length, true,
+                  (uint32_t)rng());
+  }
+  void closed() override {}
+};
+
+static FleetLink fleetLink;
+
+// ---------------------------------------------------------------------------
+// Schedule
+// ---------------------------------------------------------------------------
+
+// A wait drawn from an exponential distribution with a mean of
+// meanS of simulated time, in real nanoseconds
+static int64_t waitNs(double meanS) {
+  std::exponential_distribution<double> gap(1.0);
+  return (int64_t)(gap(rng) * meanS / options.speed * 1e9);
+}
+
+static void schedule(uint32_t device, TimerKind kind, int64_t delayNs) {
+  timers.push({nowNs() + delayNs, device, kind});
+}
+
+static uint32_t drawCard() {
+  if (options.members == 0 || rng() % 100 < options.strangerPct) {
+    return 0xF0000000u | (uint32_t)(rng() & 0x0FFFFFFF);
+  }
+  return mockMemberCode(rng() % options.members);
+}
+
+// ---------------------------------------------------------------------------
+// Sockets
+// ---------------------------------------------------------------------------
+
+static void watch(Device &dev, uint32_t events, int op) {
+  epoll_event event = {};
+  event.events = events;
+  event.data.u32 = (uint32_t)(&dev - devices.data());
+  epoll_ctl(epollFd, op, dev.fd, &event);
+}
+
+static void dropDevice(Device &dev) {
+  if (dev.state == DEVICE_CLOSED) return;
+  if (dev.state == DEVICE_OPEN) {
+    counters.disconnects++;
+  } else {
+    counters.connectFailures++;
+  }
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, dev.fd, nullptr);
+  close(dev.fd);
+  dev.state = DEVICE_CLOSED;
+}
+
+static void flush(Device &dev) {
+  if (dev.state == DEVICE_CLOSED) return;
+  size_t sent = 0;
+  while (sent < dev.out.size()) {
+    ssize_t n = write(dev.fd, dev.out.data() + sent, dev.out.size() - sent);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+    if (n <= 0) {
+      dropDevice(dev);
+      return;
+    }
+    sent += n;
+  }
+  dev.out.erase(dev.out.begin(), dev.out.begin() + sent);
+  if (dev.state != DEVICE_CONNECTING) {
+    watch(dev, EPOLLIN | (dev.out.empty() ? 0 : EPOLLOUT), EPOLL_CTL_MOD);
+  }
+}
+
+static void startConnect(uint32_t index) {
+  Device &dev = devices[index];
+  dev.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(dev.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(options.port);
+  inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr);
+  dev.state = DEVICE_CONNECTING;
+  if (connect(dev.fd, (sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    close(dev.fd);
+    dev.state = DEVICE_CLOSED;
+    counters.connectFailures++;
+    return;
+  }
+  watch(dev, EPOLLOUT, EPOLL_CTL_ADD);
+}
+
+// TCP is up: send the upgrade request
+static void connected(Device &dev) {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  getsockopt(dev.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+  if (error != 0) {
+    dropDevice(dev);
+    return;
+  }
+  dev.key = wsClientKey((uint32_t)rng());
+  std::string request = "GET " + std::string(WS_PATH) + " HTTP/1.1\r\n"
+                        "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Key: " + dev.key + "\r\n"
+                        "Sec-WebSocket-Version: 13\r\n\r\n";
+  dev.out.assign(request.begin(), request.end());
+  dev.state = DEVICE_UPGRADING;
+  flush(dev);
+}
+
+// ---------------------------------------------------------------------------
+// Protocol, through the firmware
+// ---------------------------------------------------------------------------
+
+static void sendScan(Device &dev, uint8_t resource) {
+  if (dev.scanPending[resource]) {
+    counters.skipped++;
+    return;
+  }
+  current = &dev;
+  dev.scanPending[resource] = true;
+  dev.scanSentNs[resource] = nowNs();
+  counters.scans++;
+  sendRFIDScan(resource, drawCard());
+  flush(dev);
+}
+
+static void answered(Device &dev, uint8_t resource, std::vector<uint32_t> &samples) {
+  if (!dev.scanPending[resource]) return;
+  dev.scanPending[resource] = false;
+  samples.push_back((uint32_t)((nowNs() - dev.scanSentNs[resource]) / 1000));
+}
+
+// What processJsonMessage() decided for the device being served
+static void applyCommand(uint32_t index, const AccessCommand &cmd) {
+  Device &dev = devices[index];
+  switch (cmd.type) {
+    case ACCESS_LINK_STATE:
+      if (cmd.online && !dev.authenticated && cmd.resource == MACHINE) {
+        dev.authenticated = true;
+        schedule(index, DOOR_SCAN, waitNs(options.doorEveryS));
+        schedule(index, MACHINE_START, waitNs(options.machineEveryS));
+      }
+      break;
+    case ACCESS_GRANT:
+      answered(dev, cmd.resource, grantLatencyUs);
+      break;
+    case ACCESS_SESSION_STARTED: {
+      answered(dev, cmd.resource, grantLatencyUs);
+      dev.sessionId = cmd.sessionId;
+      double holdS = options.holdMinS;
+      if (options.holdMaxS > options.holdMinS) {
+        holdS += std::uniform_real_distribution<double>(0, options.holdMaxS - options.holdMinS)(rng);
+      }
+      schedule(index, MACHINE_END, (int64_t)(holdS / options.speed * 1e9));
+      break;
+    }
+    case ACCESS_DENIED:
+      answered(dev, cmd.resource, denialLatencyUs);
+      if (cmd.resource == MACHINE) schedule(index, MACHINE_START, waitNs(options.machineEveryS));
+      break;
+    case ACCESS_SESSION_ENDED:
+      dev.sessionId.clear();
+      schedule(index, MACHINE_START, waitNs(options.machineEveryS));
+      break;
+    default:
+      break;
+  }
+}
+
+static bool processFrames(uint32_t index) {
+  Device &dev = devices[index];
+  size_t used = 0;
+  for (;;) {
+    WsFrame frame;
+    long taken = wsParseFrame(dev.in.data() + used, dev.in.size() - used, frame);
+    if (taken < 0) return false;
+    if (taken == 0) break;
+    used += taken;
+    counters.framesIn++;
+    counters.bytesIn += frame.length;
+    if (index == 0 && (frame.opcode == WS_OP_TEXT || frame.opcode == WS_OP_BINARY)) {
+      uint64_t atMs = (uint64_t)((nowNs() - startNs) / 1e6 * options.speed);
+      trace.record(atMs, frame.opcode == WS_OP_BINARY, frame.payload, frame.length);
+    }
+    current = &dev;
+    if (frame.opcode == WS_OP_TEXT) {
+      handleIncomingMessage(frame.payload, frame.length);
+    } else if (frame.opcode == WS_OP_BINARY) {
+      handleIncomingBinary(frame.payload, frame.length);
+    } else if (frame.opcode == WS_OP_CLOSE) {
+      return false;
+    }
+    AccessCommand cmd;
+    while (pollAccessCommand(cmd)) {
+      applyCommand(index, cmd);
+    }
+  }
+  dev.in.erase(dev.in.begin(), dev.in.begin() + used);
+  return true;
+}
+
+// The server's 101 answer, then frames
+static void readable(uint32_t index) {
+  Device &dev = devices[index];
+  uint8_t buffer[16384];
+  for (;;) {
+    ssize_t n = read(dev.fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+    if (n <= 0) {
+      dropDevice(dev);
+      return;
+    }
+    dev.in.insert(dev.in.end(), buffer, buffer + n);
+  }
+  if (dev.state == DEVICE_UPGRADING) {
+    std::string response(dev.in.begin(), dev.in.end());
+    size_t end = response.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0 ||
+        response.find(wsAcceptKey(dev.key)) == std::string::npos) {
+      dropDevice(dev);
+      return;
+    }
+    dev.in.erase(dev.in.begin(), dev.in.begin() + end + 4);
+    dev.state = DEVICE_OPEN;
+    current = &dev;
+    sendDeviceAuth();
+  }
+  if (!processFrames(index)) {
+    dropDevice(dev);
+    return;
+  }
+  flush(dev);
+}
+
+static void fire(const TimerEntry &timer) {
+  Device &dev = devices[timer.device];
+  if (timer.kind == CONNECT) {
+    startConnect(timer.device);
+    return;
+  }
+  if (dev.state != DEVICE_OPEN) return;
+  switch (timer.kind) {
+    case DOOR_SCAN:
+      sendScan(dev, DOOR);
+      schedule(timer.device, DOOR_SCAN, waitNs(options.doorEveryS));
+      break;
+    case MACHINE_START:
+      sendScan(dev, MACHINE);
+      break;
+    case MACHINE_END:
+      // The card leaves the reader of a require_card_present machine
+      current = &dev;
+      counters.sessionEnds++;
+      sendSessionEnd(MACHINE, dev.sessionId.c_str());
+      flush(dev);
+      break;
+    default:
+      break;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+
+static double percentileMs(std::vector<uint32_t> &samples, double p) {
+  if (samples.empty()) return 0;
+  size_t rank = std::min(samples.size() - 1, (size_t)(p / 100 * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank] / 1000.0;
+}
+
+static void printLatency(const char *name, std::vector<uint32_t> &samples) {
+  printf("  %-13s %8zu  p50 %7.3f ms  p99 %7.3f ms  p99.9 %7.3f ms  max %7.3f ms\n", name,
+         samples.size(), percentileMs(samples, 50), percentileMs(samples, 99),
+         percentileMs(samples, 99.9), percentileMs(samples, 100));
+}
+
+static bool report(double seconds) {
+  uint32_t open = 0;
+  for (const Device &dev : devices) {
+    if (dev.state == DEVICE_OPEN && dev.authenticated) open++;
+  }
+  printf("\n%u of %u devices online, %.1f s at %gx (%.1f h of traffic)\n", open,
+         options.devices, seconds, options.speed, seconds * options.speed / 3600);
+  printf("  frames out   %10llu  %9.0f/s  %8.1f KB/s\n", (unsigned long long)counters.framesOut,
+         counters.framesOut / seconds, counters.bytesOut / seconds / 1024);
+  printf("  frames in    %10llu  %9.0f/s  %8.1f KB/s\n", (unsigned long long)counters.framesIn,
+         counters.framesIn / seconds, counters.bytesIn / seconds / 1024);
+  printf("  scans        %10llu  %9.0f/s  (%llu skipped while one was unanswered)\n",
+         (unsigned long long)counters.scans, counters.scans / seconds,
+         (unsigned long long)counters.skipped);
+  printf("  session ends %10llu\n", (unsigned long long)counters.sessionEnds);
+  printf("  connect failures %llu, disconnects %llu\n",
+         (unsigned long long)counters.connectFailures, (unsigned long long)counters.disconnects);
+  printf("  scan to answer:\n");
+  printLatency("grant/session", grantLatencyUs);
+  printLatency("denial", denialLatencyUs);
+  return open == options.devices && !grantLatencyUs.empty();
+}
+
+// ---------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------
+
+static bool parseSeconds(const char *text, double &seconds) {
+  char *unit;
+  seconds = strtod(text, &unit);
+  if (unit == text) return false;
+  if (*unit == 'm') seconds *= 60;
+  if (*unit == 'h') seconds *= 3600;
+  return *unit == '\0' || ((*unit == 's' || *unit == 'm' || *unit == 'h') && unit[1] == '\0');
+}
+
+static bool parseOptions(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool ok = value != nullptr;
+    if (arg == "-v") {
+      options.verbose = true;
+      continue;
+    } else if (arg == "--host" && ok) {
+      options.host = value;
+    } else if (arg == "--port" && ok) {
+      options.port = atoi(value);
+    } else if (arg == "--devices" && ok) {
+      options.devices = strtoul(value, nullptr, 0);
+    } else if (arg == "--duration" && ok) {
+      ok = parseSeconds(value, options.durationS);
+    } else if (arg == "--speed" && ok) {
+      options.speed = atof(value);
+      ok = options.speed > 0;
+    } else if (arg == "--ramp" && ok) {
+      ok = parseSeconds(value, options.rampS);
+    } else if (arg == "--members" && ok) {
+      options.members = strtoul(value, nullptr, 0);
+    } else if (arg == "--door-every" && ok) {
+      ok = parseSeconds(value, options.doorEveryS) && options.doorEveryS > 0;
+    } else if (arg == "--machine-every" && ok) {
+      ok = parseSeconds(value, options.machineEveryS) && options.machineEveryS > 0;
+    } else if (arg == "--hold" && ok) {
+      std::string range = value;
+      size_t dots = range.find("..");
+      ok = dots != std::string::npos &&
+           parseSeconds(range.substr(0, dots).c_str(), options.holdMinS) &&
+           parseSeconds(range.substr(dots + 2).c_str(), options.holdMaxS) &&
+           options.holdMinS <= options.holdMaxS;
+    } else if (arg == "--strangers" && ok) {
+      options.strangerPct = strtoul(value, nullptr, 0);
+    } else if (arg == "--trace" && ok) {
+      options.tracePath = value;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "%s: bad option %s; see the header of loadgen_main.cpp\n", argv[0],
+              arg.c_str());
+      return false;
+    }
+    i++;
+  }
+  return options.devices > 0;
+}
+
+static void stop(int) {
+  stopping = 1;
+}
+
+int main(int argc, char **argv) {
+  if (!parseOptions(argc, argv)) return 2;
+  hostSerialEcho(options.verbose);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < options.devices + 16) {
+      fprintf(stderr, "Only %lu file descriptors for %u devices\n",
+              (unsigned long)limit.rlim_cur, options.devices);
+      return 2;
+    }
+  }
+
+  // The parts of setup() the protocol code needs; the tasks are not
+  // started, so the display is drawn directly
+  tft.init();
+  tft.setRotation(3);
+  initDisplayBuffer();
+  initTextMetrics(displayCanvas());
+  initFrameTemplates();
+  webSocket.begin(options.host.c_str(), options.port, WS_PATH);
+  hostSetServer(&fleetLink);
+  hostSetLink({true, 0, 0});
+  hostServerAttach();
+  wifiConnected = true;
+
+  epollFd = epoll_create1(0);
+  devices.resize(options.devices);
+  for (uint32_t i = 0; i < options.devices; i++) {
+    devices[i] = {};
+    devices[i].fd = -1;
+    devices[i].state = DEVICE_CLOSED;
+    schedule(i, CONNECT, (int64_t)(options.rampS * 1e9 * i / options.devices));
+  }
+
+  if (options.tracePath && !trace.open(options.tracePath)) {
+    perror(options.tracePath);
+    return 2;
+  }
+  startNs = nowNs();
+  int64_t endNs = startNs + (int64_t)(options.durationS * 1e9);
+  std::vector<epoll_event> events(1024);
+  while (!stopping && nowNs() < endNs) {
+    int64_t waitMs = 100;
+    if (!timers.empty()) {
+      int64_t untilNs = timers.top().atNs - nowNs();
+      waitMs = std::max<int64_t>(0, std::min<int64_t>(waitMs, untilNs / 1000000));
+    }
+    int ready = epoll_wait(epollFd, events.data(), events.size(), (int)waitMs);
+    for (int i = 0; i < ready; i++) {
+      uint32_t index = events[i].data.u32;
+      Device &dev = devices[index];
+      if (dev.state == DEVICE_CLOSED) continue;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        dropDevice(dev);
+      } else if (dev.state == DEVICE_CONNECTING) {
+        connected(dev);
+      } else if (events[i].events & EPOLLIN) {
+        readable(index);
+      } else if (events[i].events & EPOLLOUT) {
+        flush(dev);
+      }
+    }
+    int64_t t = nowNs();
+    while (!timers.empty() && timers.top().atNs <= t) {
+      TimerEntry timer = timers.top();
+      timers.pop();
+      fire(timer);
+    }
+  }
+  return report((nowNs() - startNs) / 1e9) ? 0 : 1;
+}
+
+#endif
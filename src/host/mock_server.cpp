@@ -0,0 +1,260 @@
+// Mock server functions for MakerPass host builds
+// This module answers the device protocol the way the MakerPass server
+// does, with just enough state to keep the device's side consistent:
+// the member list and its version, the session running on each
+// machine, and the encoding negotiated on each connection.  Messages
+// are decoded and encoded with the firmware's own codec, so a JSON and
+// a MessagePack device exercise the same code on both ends.
+
+#include "mock_server.h"
+#include "msgpack_codec.h"
+#include "frame_builder.h"
+#include "wire_schema.h"
+
+// Largest frame the server sends; a full allowlist chunk fits
+static const size_t MOCK_MAX_FRAME = 16384;
+
+void MockConnection::reset() {
+  authenticated = false;
+  binary = false;
+  sessions.clear();
+}
+
+MockServer::MockServer()
+    : offerMsgpack_(true), requireCardPresent_(false), cacheTtl_(3600), allowlistVersion_(0),
+      nextSession_(1), stats_(), outbound_(MOCK_MAX_FRAME) {}
+
+void MockServer::addMember(uint32_t code, const char *name) {
+  if (members_.count(code) == 0) memberCodes_.push_back(code);
+  members_[code] = name;
+  allowlistVersion_++;
+}
+
+void MockServer::setResourceType(const char *resourceId, bool door) {
+  doors_[resourceId] = door;
+}
+
+// Encode in the connection's encoding and hand to the transport
+void MockServer::send(MockConnection &conn, JsonDocument &doc) {
+  size_t length = 0;
+  if (conn.binary) {
+    length = encodeWireMessage(doc, outbound_.data(), outbound_.size());
+  } else {
+    length = serializeJson(doc, (char *)outbound_.data(), outbound_.size());
+  }
+  if (length == 0) return;
+  stats_.framesOut++;
+  conn.sendFrame(outbound_.data(), length, conn.binary);
+}
+
+// rfid_code as the device expects it: a hex string in JSON, the number
+// in MessagePack
+void MockServer::setCode(MockConnection &conn, JsonDocument &reply, uint32_t code) {
+  if (conn.binary) {
+    reply["rfid_code"] = code;
+    return;
+  }
+  char hex[9];
+  encodeHex32(code, hex);
+  hex[8] = '\0';
+  reply["rfid_code"] = hex;
+}
+
+static uint32_t codeOf(JsonVariant value) {
+  if (value.is<uint32_t>()) return value.as<uint32_t>();
+  return strtoul(value | "", nullptr, 16);
+}
+
+void MockServer::receive(MockConnection &conn, const uint8_t *payload, size_t length,
+                         bool binary) {
+  stats_.framesIn++;
+  // Both decoders work in place
+  inbound_.assign(payload, payload + length);
+  inbound_.push_back(0);
+  JsonDocument doc;
+  bool ok = binary ? decodeWireMessage(inbound_.data(), length, doc)
+                   : !deserializeJson(doc, (char *)inbound_.data(), length);
+  if (!ok) {
+    stats_.malformed++;
+    return;
+  }
+  const char *type = doc["type"] | "";
+  if (strcmp(type, "device_auth") == 0) {
+    handleAuth(conn, doc);
+  } else if (!conn.authenticated) {
+    sendError(conn, "Not authenticated", 0);
+  } else if (strcmp(type, "rfid_scan") == 0) {
+    handleScan(conn, doc);
+  } else if (strcmp(type, "session_end") == 0) {
+    handleSessionEnd(conn, doc);
+  } else if (strcmp(type, "card_present") == 0) {
+    stats_.presence++;
+  } else if (strcmp(type, "allowlist_sync") == 0) {
+    handleAllowlistSync(conn, doc);
+  } else if (strcmp(type, "allowlist_ack") == 0) {
+    stats_.allowlistAcks++;
+  } else if (strcmp(type, "event_batch") == 0) {
+    handleEventBatch(conn, doc);
+  } else if (strcmp(type, "telemetry") == 0) {
+    stats_.telemetry++;
+  } else if (strcmp(type, "pong") == 0) {
+    stats_.pongs++;
+  } else if (strcmp(type, "cache_stats") != 0) {
+    stats_.malformed++;
+  }
+}
+
+// Accept any key; the device moves to MessagePack with this reply if
+// it offered it and we allow it
+void MockServer::handleAuth(MockConnection &conn, JsonDocument &doc) {
+  stats_.auths++;
+  stats_.connections++;
+  bool msgpack = false;
+  for (JsonVariant encoding : doc["encodings"].as<JsonArray>()) {
+    if (strcmp(encoding | "", WIRE_ENCODING_MSGPACK) == 0) msgpack = offerMsgpack_;
+  }
+  conn.reset();
+  conn.authenticated = true;
+  JsonDocument reply;
+  reply["type"] = "auth_success";
+  reply["enabled"] = true;
+  reply["require_card_present"] = requireCardPresent_;
+  reply["resource_name"] = "Simulated";
+  if (msgpack) reply["encoding"] = WIRE_ENCODING_MSGPACK;
+  send(conn, reply);
+  conn.binary = msgpack;
+}
+
+// Doors get a grant; a machine starts a session, or ends the running
+// one when its user scans again
+void MockServer::handleScan(MockConnection &conn, JsonDocument &doc) {
+  stats_.scans++;
+  std::string resourceId = doc["resource_id"] | "";
+  uint32_t code = codeOf(doc["rfid_code"]);
+  JsonDocument reply;
+  reply["resource_id"] = resourceId;
+  auto member = members_.find(code);
+  if (member == members_.end()) {
+    stats_.denials++;
+    reply["type"] = "access_denied";
+    setCode(conn, reply, code);
+    reply["reason"] = "Not a member";
+    send(conn, reply);
+    return;
+  }
+  auto door = doors_.find(resourceId);
+  if (door == doors_.end() || door->second) {
+    stats_.grants++;
+    reply["type"] = "access_granted";
+    setCode(conn, reply, code);
+    reply["user_name"] = member->second;
+    reply["cache_ttl"] = cacheTtl_;
+    send(conn, reply);
+    return;
+  }
+  auto running = conn.sessions.find(resourceId);
+  if (running != conn.sessions.end()) {
+    if (running->second.code != code) {
+      stats_.denials++;
+      reply["type"] = "access_denied";
+      setCode(conn, reply, code);
+      reply["reason"] = "In use";
+      send(conn, reply);
+      return;
+    }
+    stats_.sessionsEnded++;
+    reply["type"] = "session_ended";
+    reply["session_id"] = running->second.id;
+    reply["user_name"] = member->second;
+    conn.sessions.erase(running);
+    send(conn, reply);
+    return;
+  }
+  MockConnection::Session session = {"s" + std::to_string(nextSession_++), code};
+  conn.sessions[resourceId] = session;
+  stats_.sessionsStarted++;
+  reply["type"] = "session_started";
+  setCode(conn, reply, code);
+  reply["session_id"] = session.id;
+  reply["user_name"] = member->second;
+  reply["cache_ttl"] = cacheTtl_;
+  send(conn, reply);
+}
+
+// The card left the reader of a require_card_present machine
+void MockServer::handleSessionEnd(MockConnection &conn, JsonDocument &doc) {
+  stats_.sessionEnds++;
+  std::string resourceId = doc["resource_id"] | "";
+  const char *sessionId = doc["session_id"] | "";
+  auto running = conn.sessions.find(resourceId);
+  if (running == conn.sessions.end() || running->second.id != sessionId) return;
+  conn.sessions.erase(running);
+  stats_.sessionsEnded++;
+  JsonDocument reply;
+  reply["type"] = "session_ended";
+  reply["resource_id"] = resourceId;
+  reply["session_id"] = sessionId;
+  send(conn, reply);
+}
+
+// A device behind the current version gets the whole list, in chunks
+// of the size it asked for
+void MockServer::handleAllowlistSync(MockConnection &conn, JsonDocument &doc) {
+  stats_.allowlistSyncs++;
+  if ((doc["version"] | 0U) == allowlistVersion_) return;
+  std::string resourceId = doc["resource_id"] | "";
+  uint32_t chunk = doc["chunk"] | 512U;
+  if (chunk == 0) chunk = 512;
+  size_t offset = 0;
+  do {
+    size_t end = std::min(offset + chunk, memberCodes_.size());
+    JsonDocument reply;
+    reply["type"] = "allowlist_full";
+    reply["resource_id"] = resourceId;
+    reply["offset"] = offset;
+    JsonArray codes = reply["codes"].to<JsonArray>();
+    for (size_t i = offset; i < end; i++) {
+      if (conn.binary) {
+        codes.add(memberCodes_[i]);
+      } else {
+        char hex[9];
+        encodeHex32(memberCodes_[i], hex);
+        hex[8] = '\0';
+        codes.add(hex);
+      }
+    }
+    reply["more"] = end < memberCodes_.size();
+    reply["version"] = allowlistVersion_;
+    send(conn, reply);
+    offset = end;
+  } while (offset < memberCodes_.size());
+}
+
+// Store nothing, acknowledge everything
+void MockServer::handleEventBatch(MockConnection &conn, JsonDocument &doc) {
+  JsonArray events = doc["events"].as<JsonArray>();
+  if (events.size() == 0) return;
+  stats_.events += events.size();
+  JsonDocument reply;
+  reply["type"] = "event_ack";
+  reply["resource_id"] = doc["resource_id"] | "";
+  reply["journal"] = doc["journal"] | 0U;
+  reply["seq"] = events[events.size() - 1][0] | 0U;
+  send(conn, reply);
+}
+
+void MockServer::sendPing(MockConnection &conn) {
+  if (!conn.authenticated) return;
+  stats_.pings++;
+  JsonDocument ping;
+  ping["type"] = "ping";
+  send(conn, ping);
+}
+
+void MockServer::sendError(MockConnection &conn, const char *message, uint32_t retryAfterS) {
+  JsonDocument error;
+  error["type"] = "error";
+  error["message"] = message;
+  if (retryAfterS > 0) error["retry_after"] = retryAfterS;
+  send(conn, error);
+}
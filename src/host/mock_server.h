@@ -0,0 +1,111 @@
+// Mock server header for MakerPass host builds
+// The server side of the protocol, as far as the simulator, the fleet
+// load generator and the tests need it.  It knows a member list and
+// the type of each resource, and answers like the MakerPass server:
+// auth_success, a grant or session for a member's scan and a denial
+// for anyone else, session_ended, allowlist_full and event_ack.  It
+// negotiates MessagePack when the device offers it.
+//
+// The transport is not part of it: each device connection is a
+// MockConnection whose sendFrame() the caller implements, over the
+// simulated link or a real socket.
+
+#pragma once
+
+#include <ArduinoJson.h>
+#include <map>
+#include <string>
+#include <vector>
+
+struct MockServerStats {
+  uint32_t connections;
+  uint32_t framesIn;
+  uint32_t framesOut;
+  uint32_t malformed;
+  uint32_t auths;
+  uint32_t scans;
+  uint32_t grants;
+  uint32_t denials;
+  uint32_t sessionsStarted;
+  uint32_t sessionsEnded;
+  uint32_t sessionEnds;       // session_end from the device
+  uint32_t presence;          // card_present heartbeats
+  uint32_t allowlistSyncs;
+  uint32_t allowlistAcks;
+  uint32_t events;            // journal events received
+  uint32_t telemetry;
+  uint32_t pings;
+  uint32_t pongs;
+};
+
+// One device's connection and the protocol state the server keeps for
+// it
+class MockConnection {
+ public:
+  virtual ~MockConnection() {}
+  virtual void sendFrame(const uint8_t *payload, size_t length, bool binary) = 0;
+
+  // Reset when the connection closes
+  void reset();
+
+  bool authenticated = false;
+  bool binary = false;
+
+  // Machine sessions by resource id
+  struct Session {
+    std::string id;
+    uint32_t code;
+  };
+  std::map<std::string, Session> sessions;
+};
+
+// Card number of the index-th generated member.  The mock server and
+// the load generator derive the same list from a count alone.
+inline uint32_t mockMemberCode(uint32_t index) {
+  return ((index + 1) * 2654435761u) & 0xFFFFFF;
+}
+
+class MockServer {
+ public:
+  MockServer();
+
+  // Configuration
+  void addMember(uint32_t code, const char *name);
+  void setResourceType(const char *resourceId, bool door);
+  void setEncoding(bool offerMsgpack) { offerMsgpack_ = offerMsgpack; }
+  void setRequireCardPresent(bool required) { requireCardPresent_ = required; }
+  void setCacheTtl(uint32_t seconds) { cacheTtl_ = seconds; }
+  bool isMember(uint32_t code) const { return members_.count(code) != 0; }
+
+  // A frame from the device; the answer, if any, goes out through
+  // conn.sendFrame() before this returns
+  void receive(MockConnection &conn, const uint8_t *payload, size_t length, bool binary);
+
+  // Unprompted messages
+  void sendPing(MockConnection &conn);
+  void sendError(MockConnection &conn, const char *message, uint32_t retryAfterS);
+
+  const MockServerStats &stats() const { return stats_; }
+  void resetStats() { stats_ = {}; }
+
+ private:
+  void send(MockConnection &conn, JsonDocument &doc);
+  void handleAuth(MockConnection &conn, JsonDocument &doc);
+  void handleScan(MockConnection &conn, JsonDocument &doc);
+  void handleSessionEnd(MockConnection &conn, JsonDocument &doc);
+  void handleAllowlistSync(MockConnection &conn, JsonDocument &doc);
+  void handleEventBatch(MockConnection &conn, JsonDocument &doc);
+  void setCode(MockConnection &conn, JsonDocument &reply, uint32_t code);
+
+  std::map<uint32_t, std::string> members_;
+  std::vector<uint32_t> memberCodes_;       // in the order added
+  std::map<std::string, bool> doors_;
+  bool offerMsgpack_;
+  bool requireCardPresent_;
+  uint32_t cacheTtl_;
+  uint32_t allowlistVersion_;
+  uint32_t nextSession_;
+  MockServerStats stats_;
+  std::vector<uint8_t> inbound_;
+  std::vector<uint8_t> outbound_;
+};
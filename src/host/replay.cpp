@@ -0,0 +1,123 @@
+// Replay harness functions for MakerPass host builds
+// This module stands the firmware up without its tasks and feeds it
+// server frames; see replay.h.
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "replay.h"
+#include "allowlist.h"
+#include "config.h"
+#include "display_buffer.h"
+#include "event_journal.h"
+#include "frame_builder.h"
+#include "grant_cache.h"
+#include "session_manager.h"
+#include "task_manager.h"
+#include "text_layout.h"
+#include "websocket_manager.h"
+#include "host_sim.h"
+#include "hal.h"
+#include <chrono>
+#include <vector>
+
+extern TFT_eSPI tft;
+extern ServerSocket webSocket;
+extern bool wifiConnected;
+
+static ReplayStats stats;
+static std::vector<uint8_t> scratch;
+
+// The far end of the link: counts what the device sends
+class ReplaySink : public HostServer {
+ public:
+  bool accept() override { return true; }
+  void receive(const uint8_t *, size_t, bool) override { stats.framesSent++; }
+  void closed() override {}
+};
+
+static ReplaySink sink;
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void replayInit() {
+  initResources();
+  tft.init();
+  tft.setRotation(3);
+  initDisplayBuffer();
+  initTextMetrics(displayCanvas());
+  initFrameTemplates();
+  initAllowlist();
+  initJournal();
+  webSocket.begin(WS_HOST, WS_PORT, WS_PATH);
+  hostSetServer(&sink);
+  hostSetLink({true, 0, 0});
+  hostServerAttach();
+  wifiConnected = true;
+  scratch.resize(65536);
+}
+
+void replayResetAccess() {
+  // Drop what the previous input left queued
+  AccessCommand cmd;
+  while (pollAccessCommand(cmd)) continue;
+  for (ResourceState &res : resources) {
+    lockRelay(res);
+    res.currentSessionId.clear();
+    res.lastCardCode = 0;
+  }
+  grantCacheClear();
+}
+
+void replayAdvanceMs(uint32_t ms) {
+  if (ms > 0) halAdvanceUs((int64_t)ms * 1000);
+  accessTimers.run();
+}
+
+void replayFrame(bool binary, const uint8_t *payload, size_t length) {
+  // One spare byte: the JSON parser may look one past the end
+  if (scratch.size() < length + 1) scratch.resize(length + 1);
+  memcpy(scratch.data(), payload, length);
+  scratch[length] = 0;
+  stats.frames++;
+  stats.bytes += length;
+
+  int64_t startNs = nowNs();
+  if (binary) {
+    handleIncomingBinary(scratch.data(), length);
+  } else {
+    handleIncomingMessage(scratch.data(), length);
+  }
+  stats.dispatchNs += nowNs() - startNs;
+
+  AccessCommand cmd;
+  while (pollAccessCommand(cmd)) {
+    processAccessCommand(cmd);
+    stats.commands++;
+  }
+}
+
+const ReplayStats &replayStats() {
+  return stats;
+}
+
+const char *accessStateViolation() {
+  for (const ResourceState &res : resources) {
+    if (res.relayActive && res.activeUser.empty()) {
+      return "relay energised without a user";
+    }
+    if (halPinLevel(res.config->pinRelay) != (res.relayActive ? HIGH : LOW)) {
+      return "relay pin disagrees with the session state";
+    }
+    if (!res.currentSessionId.empty() && (res.door || !res.relayActive)) {
+      return "session id without a running machine session";
+    }
+    if (res.door && res.relayActive && !accessTimers.armed(res.doorTimer)) {
+      return "door held open with no door timer";
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,45 @@
+// Replay harness header for MakerPass host builds
+// Feeds recorded server frames to the firmware as fast as it takes
+// them, for the replay program and the fuzz target.  The firmware is
+// brought up without its tasks: the frames go through
+// handleIncomingMessage() or handleIncomingBinary() on this thread,
+// and the AccessCommands they post are applied at once, as the access
+// task would apply them.  The connection is held open throughout:
+// network timers (silence, reconnect) do not run, and what the device
+// sends goes to a sink that only counts it.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ReplayStats {
+  uint64_t frames;
+  uint64_t bytes;
+  uint64_t commands;       // AccessCommands applied
+  uint64_t framesSent;     // replies, acks and syncs from the device
+  uint64_t dispatchNs;     // inside handleIncomingMessage/Binary
+};
+
+// Bring up what the protocol and access code need; once per process
+void replayInit();
+
+// End every session and forget cached grants, so that one fuzz input
+// does not start where the previous one left off.  Protocol state
+// (the negotiated encoding, allowlist versions) carries over.
+void replayResetAccess();
+
+// Move the virtual clock forward and run the access timers due
+void replayAdvanceMs(uint32_t ms);
+
+// Deliver one frame.  The payload is copied first: the firmware
+// parses in place.
+void replayFrame(bool binary, const uint8_t *payload, size_t length);
+
+const ReplayStats &replayStats();
+
+// The access invariants: an energised relay has a user and agrees with
+// its pin, a session id means a machine with its relay energised, and
+// an open door has its door timer running.  Returns nullptr when they
+// hold, otherwise what is wrong.
+const char *accessStateViolation();
@@ -0,0 +1,102 @@
+// Trace replay for MakerPass host builds
+// This program feeds recorded traces (see wire_trace.h) through the
+// firmware's inbound path, handleIncomingMessage() for text frames and
+// handleIncomingBinary() for MessagePack, as fast as it will take them.
+// The virtual clock follows the trace, so door timers and session
+// displays run as they did when it was recorded, and every run of the
+// same trace is the same.  After every frame the access invariants
+// are checked; a violation names the frame and fails the run.
+//
+// It doubles as a parser benchmark: the report gives messages per
+// second through the dispatch alone and through the whole replay,
+// including the access task's work and the display.
+//
+// Usage: program [-v] [--repeat N] trace...
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include "../replay.h"
+#include "../wire_trace.h"
+#include "host_sim.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Returns false on an invariant violation
+static bool replayTrace(const char *path, const std::vector<TraceFrame> &frames) {
+  uint32_t lastMs = frames.empty() ? 0 : frames[0].atMs;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const TraceFrame &frame = frames[i];
+    replayAdvanceMs(frame.atMs - lastMs);
+    lastMs = frame.atMs;
+    replayFrame(frame.binary, frame.payload, frame.length);
+    const char *violation = accessStateViolation();
+    if (violation) {
+      fprintf(stderr, "%s: frame %zu at %u ms: %s\n", path, i, (unsigned)frame.atMs, violation);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::vector<const char *> paths;
+  uint32_t repeat = 1;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-v") {
+      verbose = true;
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = strtoul(argv[++i], nullptr, 0);
+    } else if (arg[0] != '-') {
+      paths.push_back(argv[i]);
+    } else {
+      paths.clear();
+      break;
+    }
+  }
+  if (paths.empty() || repeat == 0) {
+    fprintf(stderr, "usage: %s [-v] [--repeat N] trace...\n", argv[0]);
+    return 2;
+  }
+  hostSerialEcho(verbose);
+  replayInit();
+
+  // Load everything first: the frames point into these buffers
+  std::vector<std::vector<uint8_t>> data(paths.size());
+  std::vector<std::vector<TraceFrame>> traces(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (!readTraceFile(paths[i], data[i])) {
+      perror(paths[i]);
+      return 2;
+    }
+    if (!parseTrace(data[i].data(), data[i].size(), traces[i])) {
+      fprintf(stderr, "%s: not a trace or truncated after %zu frames\n", paths[i],
+              traces[i].size());
+      return 2;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t r = 0; r < repeat; r++) {
+    for (size_t i = 0; i < paths.size(); i++) {
+      if (!replayTrace(paths[i], traces[i])) return 1;
+    }
+  }
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const ReplayStats &s = replayStats();
+  double dispatchS = s.dispatchNs / 1e9;
+  printf("%llu frames, %.1f KB, replayed in %.3f s\n", (unsigned long long)s.frames,
+         s.bytes / 1024.0, wallS);
+  printf("  dispatch       %10.0f msgs/s  %7.1f MB/s\n", s.frames / dispatchS,
+         s.bytes / dispatchS / 1e6);
+  printf("  whole replay   %10.0f msgs/s\n", s.frames / wallS);
+  printf("  access commands %llu, frames sent %llu, invariants held\n",
+         (unsigned long long)s.commands, (unsigned long long)s.framesSent);
+  return 0;
+}
+
+#endif
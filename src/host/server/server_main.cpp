@@ -0,0 +1,310 @@
+// Mock WebSocket server for MakerPass host builds
+// This program serves the MakerPass device protocol over plain ws://
+// for the fleet load generator (or a device on the bench pointed at
+// it).  Every connection is upgraded and then handed to the mock
+// server in src/host/mock_server.cpp, which answers each message
+// before the next is read.  One thread and epoll carry thousands of
+// connections; every PING_INTERVAL the server pings them all, as the
+// real server does.  Counters are printed every few seconds and on
+// exit (Ctrl-C).
+//
+// Usage: program [--port 8080] [--members 1000] [--json] [--ping 300]
+//                [--door ID] [--machine ID]
+
+#ifndef PIO_UNIT_TESTING
+
+#include "../mock_server.h"
+#include "../ws_wire.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <unordered_map>
+
+// Counters are printed this often
+static const int REPORT_INTERVAL_S = 5;
+
+// Largest upgrade request accepted
+static const size_t MAX_REQUEST = 8192;
+
+struct ServerConnection : public MockConnection {
+  int fd;
+  bool upgraded = false;
+  bool closing = false;
+  std::vector<uint8_t> in;
+  std::vector<uint8_t> out;
+
+  void sendFrame(const uint8_t *payload, size_t length, bool binary) override {
+    wsAppendFrame(out, binary ? WS_OP_BINARY : WS_OP_TEXT, payload, length, false);
+  }
+};
+
+static MockServer brain;
+static std::unordered_map<int, ServerConnection *> connections;
+static int epollFd = -1;
+static volatile sig_atomic_t stopping = 0;
+
+static double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Thousands of sockets need more than the default 1024 descriptors
+static void raiseFileLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static void closeConnection(ServerConnection *conn) {
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+  close(conn->fd);
+  connections.erase(conn->fd);
+  delete conn;
+}
+
+// Write what is queued; wait for EPOLLOUT if the socket is full
+static bool flush(ServerConnection *conn) {
+  size_t sent = 0;
+  while (sent < conn->out.size()) {
+    ssize_t n = write(conn->fd, conn->out.data() + sent, conn->out.size() - sent);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+    if (n <= 0) return false;
+    sent += n;
+  }
+  conn->out.erase(conn->out.begin(), conn->out.begin() + sent);
+  epoll_event event = {};
+  event.events = EPOLLIN | (conn->out.empty() ? 0 : EPOLLOUT);
+  event.data.fd = conn->fd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+  return !(conn->closing && conn->out.empty());
+}
+
+// Answer the HTTP upgrade; false for anything that is not one
+static bool upgrade(ServerConnection *conn) {
+  std::string request(conn->in.begin(), conn->in.end());
+  size_t end = request.find("\r\n\r\n");
+  if (end == std::string::npos) return request.size() < MAX_REQUEST;
+  std::string key;
+  size_t at = 0;
+  while ((at = request.find("\r\n", at)) != std::string::npos && at < end) {
+    at += 2;
+    size_t colon = request.find(':', at);
+    if (colon == std::string::npos) break;
+    std::string name = request.substr(at, colon - at);
+    for (char &c : name) c = tolower(c);
+    if (name == "sec-websocket-key") {
+      size_t valueAt = request.find_first_not_of(' ', colon + 1);
+      key = request.substr(valueAt, request.find("\r\n", valueAt) - valueAt);
+    }
+  }
+  if (key.empty()) return false;
+  std::string response =
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: " + wsAcceptKey(key) + "\r\n\r\n";
+  conn->out.insert(conn->out.end(), response.begin(), response.end());
+  conn->in.erase(conn->in.begin(), conn->in.begin() + end + 4);
+  conn->upgraded = true;
+  return true;
+}
+
+// Hand every complete frame to the mock server
+static bool processFrames(ServerConnection *conn) {
+  size_t used = 0;
+  for (;;) {
+    WsFrame frame;
+    long taken = wsParseFrame(conn->in.data() + used, conn->in.size() - used, frame);
+    if (taken < 0) return false;
+    if (taken == 0) break;
+    used += taken;
+    switch (frame.opcode) {
+      case WS_OP_TEXT:
+      case WS_OP_BINARY:
+        brain.receive(*conn, frame.payload, frame.length, frame.opcode == WS_OP_BINARY);
+        break;
+      case WS_OP_PING:
+        wsAppendFrame(conn->out, WS_OP_PONG, frame.payload, frame.length, false);
+        break;
+      case WS_OP_CLOSE:
+        wsAppendFrame(conn->out, WS_OP_CLOSE, frame.payload, frame.length, false);
+        conn->closing = true;
+        break;
+    }
+  }
+  conn->in.erase(conn->in.begin(), conn->in.begin() + used);
+  return true;
+}
+
+static void readable(ServerConnection *conn) {
+  uint8_t buffer[16384];
+  for (;;) {
+    ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+    if (n <= 0) {
+      closeConnection(conn);
+      return;
+    }
+    conn->in.insert(conn->in.end(), buffer, buffer + n);
+  }
+  bool ok = conn->upgraded || upgrade(conn);
+  if (ok && conn->upgraded) ok = processFrames(conn);
+  if (!ok || !flush(conn)) closeConnection(conn);
+}
+
+static void acceptAll(int listenFd) {
+  for (;;) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+    setNonBlocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ServerConnection *conn = new ServerConnection();
+    conn->fd = fd;
+    connections[fd] = conn;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+static void pingAll() {
+  for (auto &entry : connections) {
+    brain.sendPing(*entry.second);
+  }
+  std::vector<ServerConnection *> all;
+  for (auto &entry : connections) all.push_back(entry.second);
+  for (ServerConnection *conn : all) {
+    if (!flush(conn)) closeConnection(conn);
+  }
+}
+
+static void report(double seconds, MockServerStats &last) {
+  const MockServerStats &s = brain.stats();
+  printf("%6zu conns  %8.0f in/s  %8.0f out/s  %7.0f scans/s  grants %u  denials %u  "
+         "sessions %u/%u  malformed %u\n",
+         connections.size(), (s.framesIn - last.framesIn) / seconds,
+         (s.framesOut - last.framesOut) / seconds, (s.scans - last.scans) / seconds, s.grants,
+         s.denials, s.sessionsStarted, s.sessionsEnded, s.malformed);
+  fflush(stdout);
+  last = s;
+}
+
+static void stop(int) {
+  stopping = 1;
+}
+
+int main(int argc, char **argv) {
+  int port = 8080;
+  uint32_t members = 1000;
+  double pingS = 300;
+  brain.setResourceType("ABCD1234", false);
+  brain.setResourceType("EFGH5678", true);
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--port" && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (arg == "--members" && hasValue) {
+      members = strtoul(argv[++i], nullptr, 0);
+    } else if (arg == "--ping" && hasValue) {
+      pingS = atof(argv[++i]);
+    } else if (arg == "--json") {
+      brain.setEncoding(false);
+    } else if (arg == "--door" && hasValue) {
+      brain.setResourceType(argv[++i], true);
+    } else if (arg == "--machine" && hasValue) {
+      brain.setResourceType(argv[++i], false);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--port N] [--members N] [--json] [--ping S] [--door ID] "
+              "[--machine ID]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  for (uint32_t i = 0; i < members; i++) {
+    brain.addMember(mockMemberCode(i), ("Member " + std::to_string(i + 1)).c_str());
+  }
+
+  raiseFileLimit();
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 4096) < 0) {
+    perror("listen");
+    return 1;
+  }
+  setNonBlocking(listenFd);
+  epollFd = epoll_create1(0);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = listenFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+  printf("Mock MakerPass server on ws://0.0.0.0:%d/ws, %u members, %s\n", port, members,
+         "msgpack offered unless --json");
+  fflush(stdout);
+
+  MockServerStats last = {};
+  double nextPing = now() + pingS;
+  double lastReport = now();
+  epoll_event events[256];
+  while (!stopping) {
+    int ready = epoll_wait(epollFd, events, 256, 100);
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listenFd) {
+        acceptAll(listenFd);
+        continue;
+      }
+      auto found = connections.find(fd);
+      if (found == connections.end()) continue;
+      ServerConnection *conn = found->second;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeConnection(conn);
+      } else if (events[i].events & EPOLLIN) {
+        readable(conn);
+      } else if (events[i].events & EPOLLOUT) {
+        if (!flush(conn)) closeConnection(conn);
+      }
+    }
+    double t = now();
+    if (t >= nextPing) {
+      pingAll();
+      nextPing = t + pingS;
+    }
+    if (t - lastReport >= REPORT_INTERVAL_S) {
+      report(t - lastReport, last);
+      lastReport = t;
+    }
+  }
+  report(now() - lastReport, last);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,523 @@
+// Scenario runner for MakerPass host builds
+// This program boots the firmware on the virtual clock (setup(), then
+// loop() and the tasks, as on the ESP32) against the mock server, and
+// plays a scenario at it: card scans as Wiegand pulse trains on the
+// reader pins, members arriving at random through the day, the server
+// or the access point going away and coming back.  Time only moves
+// when every task waits, so a day of traffic runs in well under a
+// minute.
+//
+// After every task switch the probe checks the access invariants
+// (accessStateViolation() in replay.h); a violation stops the run.  At
+// the end the runner reports the speed-up over real time, the CPU each
+// task used per wake-up, and the counters that `expect` lines can
+// check, and exits non-zero if any expectation failed.
+//
+// Usage: program [-v] [--trace file] scenario
+// -v echoes the serial log; --trace records every frame the device
+// receives for the replay harness (see wire_trace.h).  See scenarios/
+// for the scenario language.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include "config.h"
+#include "session_manager.h"
+#include "telemetry.h"
+#include "wiegand_reader.h"
+#include "../mock_server.h"
+#include "../replay.h"
+#include "../wire_trace.h"
+#include "host_sim.h"
+#include "hal.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+
+// Time between the bits of a simulated card read
+static const uint32_t SIM_BIT_INTERVAL_US = 2000;
+
+// The server pings every connected device this often
+static const int64_t SIM_PING_INTERVAL_US = 300000000LL;
+
+// ---------------------------------------------------------------------------
+// The simulated server at the far end of the link
+// ---------------------------------------------------------------------------
+
+enum ServerMode { SERVER_UP, SERVER_DOWN, SERVER_UNAVAILABLE };
+
+class SimServer : public HostServer, public MockConnection {
+ public:
+  MockServer brain;
+  ServerMode mode = SERVER_UP;
+  TraceWriter trace;
+
+  bool accept() override { return mode == SERVER_UP; }
+  void receive(const uint8_t *payload, size_t length, bool binary) override {
+    brain.receive(*this, payload, length, binary);
+  }
+  void closed() override { reset(); }
+  void sendFrame(const uint8_t *payload, size_t length, bool binary) override {
+    trace.record(halUptimeUs() / 1000, binary, payload, length);
+    hostServerSend(payload, length, binary);
+  }
+};
+
+static SimServer server;
+static HostLink link = {true, 600, 20000, 150};
+
+// ---------------------------------------------------------------------------
+// Timed actions
+// ---------------------------------------------------------------------------
+
+// Scenario actions run as HAL events at their virtual time
+static void runAction(void *arg) {
+  std::function<void()> *action = (std::function<void()> *)arg;
+  (*action)();
+  delete action;
+}
+
+static void at(int64_t us, std::function<void()> action) {
+  halScheduleAt(us, runAction, new std::function<void()>(action));
+}
+
+static void ping(void *) {
+  if (hostServerConnected()) server.brain.sendPing(server);
+  halScheduleAt(halUptimeUs() + SIM_PING_INTERVAL_US, ping, nullptr);
+}
+
+// A card presented at a resource's reader: 26-bit H10301 for codes that
+// fit in 24 bits, 34-bit H10306 otherwise.  Each half of the data bits
+// is covered by a parity bit, even in front and odd behind.
+static void presentCard(uint8_t resource, uint32_t code, int64_t us) {
+  uint8_t dataBits = code > 0xFFFFFF ? 32 : 24;
+  uint8_t half = dataBits / 2;
+  uint32_t high = code >> half;
+  uint32_t low = code & ((1U << half) - 1);
+  uint64_t even = __builtin_popcount(high) & 1;
+  uint64_t odd = (__builtin_popcount(low) & 1) ^ 1;
+  uint64_t frame = (even << (dataBits + 1)) | ((uint64_t)code << 1) | odd;
+  const ResourceConfig &config = RESOURCES[resource];
+  halWiegandFrame(config.pinD0, config.pinD1, frame, dataBits + 2, us, SIM_BIT_INTERVAL_US);
+}
+
+// ---------------------------------------------------------------------------
+// Invariants
+// ---------------------------------------------------------------------------
+
+static void checkInvariants() {
+  const char *violation = accessStateViolation();
+  if (violation) hostAssertFailed(__FILE__, __LINE__, violation);
+}
+
+// ---------------------------------------------------------------------------
+// Scenario language
+// ---------------------------------------------------------------------------
+//
+//   seed <n>                       RNG seed for the scenario and the firmware
+//   clock <ms>                     halMillis() at boot, e.g. 4294900000
+//   encoding json|msgpack          what the server agrees to
+//   link <handshake ms> <latency us>
+//   member <hex code> <name>       a card the server knows
+//   members <n>                    n random members
+//   at <time> scan <resource> <hex code> [hold <duration>]
+//   at <time> server up|down|503
+//   at <time> wifi up|down
+//   random <resource> <from>..<to> every <mean> [hold <min>..<max>] [strangers <pct>]
+//   run <duration>
+//   expect <counter> ==|>=|<= <n>
+//
+// Times are offsets from boot, as a duration (90s, 1h30m, 500ms) or a
+// time of day (07:30, 07:30:15).  A scan with `hold` at a machine
+// scans the same card again after the hold to end the session.
+// `random` presents members (or strangers) in a Poisson stream with
+// the given mean interval between `from` and `to` of every simulated
+// day.
+
+struct Expectation {
+  std::string counter;
+  std::string op;
+  uint64_t value;
+  int line;
+};
+
+struct RandomStream {
+  uint8_t resource;
+  int64_t fromUs;
+  int64_t toUs;
+  int64_t meanUs;
+  int64_t holdMinUs;
+  int64_t holdMaxUs;
+  uint32_t strangerPct;
+};
+
+struct Scenario {
+  std::string name;
+  uint64_t seed = 1;
+  int64_t bootUs = 0;
+  int64_t runUs = 0;
+  std::vector<std::pair<uint32_t, std::string>> members;
+  uint32_t randomMembers = 0;
+  std::vector<std::pair<int, std::function<void(int64_t)>>> actions;
+  std::vector<RandomStream> streams;
+  std::vector<Expectation> expectations;
+};
+
+static bool parseDuration(const std::string &text, int64_t &us) {
+  unsigned hours, minutes, seconds = 0;
+  if (text.find(':') != std::string::npos) {
+    if (sscanf(text.c_str(), "%u:%u:%u", &hours, &minutes, &seconds) < 2) return false;
+    us = ((int64_t)hours * 3600 + minutes * 60 + seconds) * 1000000;
+    return true;
+  }
+  us = 0;
+  const char *p = text.c_str();
+  while (*p) {
+    char *unit;
+    double value = strtod(p, &unit);
+    if (unit == p) return false;
+    int64_t scale;
+    if (strncmp(unit, "ms", 2) == 0) {
+      scale = 1000;
+      unit += 2;
+    } else if (strncmp(unit, "us", 2) == 0) {
+      scale = 1;
+      unit += 2;
+    } else if (*unit == 's') {
+      scale = 1000000;
+      unit++;
+    } else if (*unit == 'm') {
+      scale = 60000000;
+      unit++;
+    } else if (*unit == 'h') {
+      scale = 3600000000LL;
+      unit++;
+    } else if (*unit == 'd') {
+      scale = 86400000000LL;
+      unit++;
+    } else {
+      return false;
+    }
+    us += (int64_t)(value * scale);
+    p = unit;
+  }
+  return true;
+}
+
+static bool parseRange(const std::string &text, int64_t &from, int64_t &to) {
+  size_t dots = text.find("..");
+  return dots != std::string::npos && parseDuration(text.substr(0, dots), from) &&
+         parseDuration(text.substr(dots + 2), to) && from <= to;
+}
+
+static bool parseResource(const std::string &text, uint8_t &resource) {
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    if (text == RESOURCES[i].id || text == std::to_string(i)) {
+      resource = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// A scan at `us` after boot; at a machine with a hold, the same card
+// again to end the session
+static void scheduleScan(Scenario &scenario, int line, uint8_t resource, uint32_t code,
+                         int64_t us, int64_t holdUs) {
+  int64_t atUs = us;
+  scenario.actions.push_back({line, [resource, code, atUs](int64_t bootUs) {
+    presentCard(resource, code, bootUs + atUs);
+  }});
+  if (holdUs > 0 && strcmp(RESOURCES[resource].type, "door") != 0) {
+    int64_t endUs = us + holdUs;
+    scenario.actions.push_back({line, [resource, code, endUs](int64_t bootUs) {
+      presentCard(resource, code, bootUs + endUs);
+    }});
+  }
+}
+
+static bool fail(const std::string &file, int line, const std::string &message) {
+  fprintf(stderr, "%s:%d: %s\n", file.c_str(), line, message.c_str());
+  return false;
+}
+
+static bool parseScenario(const std::string &file, Scenario &scenario) {
+  std::ifstream in(file);
+  if (!in) return fail(file, 0, "cannot open");
+  scenario.name = file;
+  std::string text;
+  int line = 0;
+  while (std::getline(in, text)) {
+    line++;
+    size_t hash = text.find('#');
+    if (hash != std::string::npos) text.erase(hash);
+    std::istringstream words(text);
+    std::vector<std::string> w;
+    std::string word;
+    while (words >> word) w.push_back(word);
+    if (w.empty()) continue;
+
+    if (w[0] == "seed" && w.size() == 2) {
+      scenario.seed = strtoull(w[1].c_str(), nullptr, 0);
+    } else if (w[0] == "clock" && w.size() == 2) {
+      scenario.bootUs = (int64_t)strtoull(w[1].c_str(), nullptr, 0) * 1000;
+    } else if (w[0] == "encoding" && w.size() == 2 && (w[1] == "json" || w[1] == "msgpack")) {
+      server.brain.setEncoding(w[1] == "msgpack");
+    } else if (w[0] == "link" && w.size() == 3) {
+      link.handshakeMs = strtoul(w[1].c_str(), nullptr, 0);
+      link.latencyUs = strtoul(w[2].c_str(), nullptr, 0);
+    } else if (w[0] == "member" && w.size() >= 3) {
+      std::string name = w[2];
+      for (size_t i = 3; i < w.size(); i++) name += " " + w[i];
+      scenario.members.push_back({(uint32_t)strtoul(w[1].c_str(), nullptr, 16), name});
+    } else if (w[0] == "members" && w.size() == 2) {
+      scenario.randomMembers = strtoul(w[1].c_str(), nullptr, 0);
+    } else if (w[0] == "at" && w.size() >= 3) {
+      int64_t us;
+      if (!parseDuration(w[1], us)) return fail(file, line, "bad time " + w[1]);
+      if (w[2] == "scan" && (w.size() == 5 || (w.size() == 7 && w[5] == "hold"))) {
+        uint8_t resource;
+        int64_t holdUs = 0;
+        if (!parseResource(w[3], resource)) return fail(file, line, "no resource " + w[3]);
+        if (w.size() == 7 && !parseDuration(w[6], holdUs)) {
+          return fail(file, line, "bad hold " + w[6]);
+        }
+        scheduleScan(scenario, line, resource, strtoul(w[4].c_str(), nullptr, 16), us, holdUs);
+      } else if (w[2] == "server" && w.size() == 4) {
+        ServerMode mode;
+        if (w[3] == "up") {
+          mode = SERVER_UP;
+        } else if (w[3] == "down") {
+          mode = SERVER_DOWN;
+        } else if (w[3] == "503") {
+          mode = SERVER_UNAVAILABLE;
+        } else {
+          return fail(file, line, "server up, down or 503");
+        }
+        scenario.actions.push_back({line, [us, mode](int64_t bootUs) {
+          at(bootUs + us, [mode]() {
+            server.mode = mode;
+            link.reachable = mode != SERVER_DOWN;
+            hostSetLink(link);
+            if (mode != SERVER_UP) hostServerClose();
+          });
+        }});
+      } else if (w[2] == "wifi" && w.size() == 4 && (w[3] == "up" || w[3] == "down")) {
+        bool up = w[3] == "up";
+        scenario.actions.push_back({line, [us, up](int64_t bootUs) {
+          at(bootUs + us, [up]() { hostWiFiSetAccessPoint(0, up, -55); });
+        }});
+      } else {
+        return fail(file, line, "unknown action");
+      }
+    } else if (w[0] == "random" && w.size() >= 5 && w[3] == "every") {
+      RandomStream stream = {};
+      if (!parseResource(w[1], stream.resource)) return fail(file, line, "no resource " + w[1]);
+      if (!parseRange(w[2], stream.fromUs, stream.toUs)) return fail(file, line, "bad range");
+      if (!parseDuration(w[4], stream.meanUs) || stream.meanUs <= 0) {
+        return fail(file, line, "bad interval");
+      }
+      for (size_t i = 5; i + 1 < w.size(); i += 2) {
+        if (w[i] == "hold") {
+          if (!parseRange(w[i + 1], stream.holdMinUs, stream.holdMaxUs)) {
+            return fail(file, line, "bad hold range");
+          }
+        } else if (w[i] == "strangers") {
+          stream.strangerPct = strtoul(w[i + 1].c_str(), nullptr, 0);
+        } else {
+          return fail(file, line, "unknown option " + w[i]);
+        }
+      }
+      scenario.streams.push_back(stream);
+    } else if (w[0] == "run" && w.size() == 2) {
+      if (!parseDuration(w[1], scenario.runUs)) return fail(file, line, "bad duration");
+    } else if (w[0] == "expect" && w.size() == 4 && (w[2] == "==" || w[2] == ">=" || w[2] == "<=")) {
+      scenario.expectations.push_back({w[1], w[2], strtoull(w[3].c_str(), nullptr, 0), line});
+    } else {
+      return fail(file, line, "cannot parse: " + text);
+    }
+  }
+  if (scenario.runUs <= 0) return fail(file, line, "no run line");
+  return true;
+}
+
+// Members drawn from the server's list, strangers from outside it
+static void scheduleStreams(Scenario &scenario, std::mt19937_64 &rng,
+                            const std::vector<uint32_t> &codes) {
+  std::exponential_distribution<double> gap(1.0);
+  for (const RandomStream &stream : scenario.streams) {
+    for (int64_t day = 0; day < scenario.runUs; day += 86400000000LL) {
+      int64_t us = day + stream.fromUs;
+      for (;;) {
+        us += (int64_t)(gap(rng) * stream.meanUs);
+        if (us >= day + stream.toUs || us >= scenario.runUs) break;
+        uint32_t code;
+        if (codes.empty() || rng() % 100 < stream.strangerPct) {
+          do {
+            code = rng() & 0xFFFFFF;
+          } while (server.brain.isMember(code));
+        } else {
+          code = codes[rng() % codes.size()];
+        }
+        int64_t holdUs = stream.holdMinUs;
+        if (stream.holdMaxUs > stream.holdMinUs) {
+          holdUs += rng() % (stream.holdMaxUs - stream.holdMinUs);
+        }
+        scheduleScan(scenario, 0, stream.resource, code, us, holdUs);
+        // The machine is busy until the session ends
+        if (strcmp(RESOURCES[stream.resource].type, "door") != 0) us += holdUs;
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+
+static uint64_t counter(const std::string &name, bool &known) {
+  const MockServerStats &s = server.brain.stats();
+  known = true;
+  if (name == "connections") return s.connections;
+  if (name == "scans") return s.scans;
+  if (name == "grants") return s.grants;
+  if (name == "denials") return s.denials;
+  if (name == "sessions_started") return s.sessionsStarted;
+  if (name == "sessions_ended") return s.sessionsEnded;
+  if (name == "events") return s.events;
+  if (name == "malformed") return s.malformed;
+  if (name == "pongs") return s.pongs;
+  uint64_t total = 0;
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    WiegandStats wiegand = getWiegandStats(i);
+    if (name == "relay_rises") total += halPinRises(RESOURCES[i].pinRelay);
+    if (name == "reads") total += wiegand.reads;
+    if (name == "bad_reads") total += wiegand.parityErrors + wiegand.badLength + wiegand.tooWide;
+  }
+  known = name == "relay_rises" || name == "reads" || name == "bad_reads";
+  return total;
+}
+
+static const char *const REPORTED[] = {
+  "connections", "scans", "grants", "denials", "sessions_started", "sessions_ended",
+  "events", "pongs", "malformed", "relay_rises", "reads", "bad_reads",
+};
+
+static bool report(const Scenario &scenario, double wallS) {
+  double virtualS = scenario.runUs / 1e6;
+  printf("\n%s: %.0f s simulated in %.2f s, %.0fx real time\n", scenario.name.c_str(),
+         virtualS, wallS, virtualS / wallS);
+
+  HostTaskStats tasks[8];
+  size_t count = hostTaskStats(tasks, 8);
+  printf("  %-10s %4s %12s %10s %10s\n", "task", "prio", "wakeups", "cpu ms", "ns/wake");
+  for (size_t i = 0; i < count; i++) {
+    printf("  %-10s %4u %12llu %10.1f %10.0f\n", tasks[i].name, tasks[i].priority,
+           (unsigned long long)tasks[i].wakeups, tasks[i].cpuNs / 1e6,
+           tasks[i].wakeups ? (double)tasks[i].cpuNs / tasks[i].wakeups : 0.0);
+  }
+
+  const LatencyHistogram &relay = getLatencyHistogram(LAT_SCAN_TO_RELAY);
+  if (relay.count > 0) {
+    printf("  scan to relay: %u grants, mean %.1f ms, max %.1f ms\n", (unsigned)relay.count,
+           relay.sumUs / 1000.0 / relay.count, relay.maxUs / 1000.0);
+  }
+
+  bool known;
+  for (const char *name : REPORTED) {
+    printf("  %-18s %llu\n", name, (unsigned long long)counter(name, known));
+  }
+
+  bool passed = true;
+  for (const Expectation &e : scenario.expectations) {
+    uint64_t value = counter(e.counter, known);
+    bool ok = known && (e.op == "==" ? value == e.value
+                        : e.op == ">=" ? value >= e.value
+                                       : value <= e.value);
+    if (!ok) {
+      fprintf(stderr, "%s:%d: expected %s %s %llu, got %s\n", scenario.name.c_str(), e.line,
+              e.counter.c_str(), e.op.c_str(), (unsigned long long)e.value,
+              known ? std::to_string(value).c_str() : "no such counter");
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// ---------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------
+
+// One scenario per process: the firmware's state is global
+static int runScenario(const std::string &file, const char *tracePath) {
+  Scenario scenario;
+  if (!parseScenario(file, scenario)) return 2;
+  if (tracePath && !server.trace.open(tracePath)) {
+    perror(tracePath);
+    return 2;
+  }
+
+  halSeedRandom(scenario.seed);
+  std::mt19937_64 rng(scenario.seed);
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    server.brain.setResourceType(RESOURCES[i].id, strcmp(RESOURCES[i].type, "door") == 0);
+  }
+  std::vector<uint32_t> codes;
+  for (auto &member : scenario.members) {
+    server.brain.addMember(member.first, member.second.c_str());
+    codes.push_back(member.first);
+  }
+  for (uint32_t i = 0; i < scenario.randomMembers; i++) {
+    uint32_t code;
+    do {
+      code = rng() & 0xFFFFFF;
+    } while (server.brain.isMember(code));
+    server.brain.addMember(code, ("Member " + std::to_string(i + 1)).c_str());
+    codes.push_back(code);
+  }
+  scheduleStreams(scenario, rng, codes);
+
+  const uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  hostWiFiAddAccessPoint(WIFI_NETWORKS[0].ssid, bssid, 6, -55);
+  hostSetServer(&server);
+  hostSetLink(link);
+  hostSetProbe(checkInvariants);
+
+  halSetUptimeUs(scenario.bootUs);
+  for (auto &action : scenario.actions) {
+    action.second(scenario.bootUs);
+  }
+  halScheduleAt(scenario.bootUs + SIM_PING_INTERVAL_US, ping, nullptr);
+
+  auto start = std::chrono::steady_clock::now();
+  hostStart();
+  hostRunUntil(scenario.bootUs + scenario.runUs);
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  server.trace.close();
+  return report(scenario, wallS) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files;
+  bool verbose = false;
+  const char *tracePath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.size() != 1) {
+    fprintf(stderr, "usage: %s [-v] [--trace file] scenario\n", argv[0]);
+    return 2;
+  }
+  hostSerialEcho(verbose);
+  return runScenario(files[0], tracePath);
+}
+
+#endif
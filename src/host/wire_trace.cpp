@@ -0,0 +1,83 @@
+// Wire trace functions for MakerPass host builds
+// This module writes and parses the trace files described in
+// wire_trace.h.
+
+#include "wire_trace.h"
+#include <string.h>
+
+static void putVarint(FILE *file, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    fputc(value ? byte | 0x80 : byte, file);
+  } while (value);
+}
+
+static bool getVarint(const uint8_t *data, size_t length, size_t &at, uint64_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 64; shift += 7) {
+    if (at >= length) return false;
+    uint8_t byte = data[at++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+bool TraceWriter::open(const char *path) {
+  close();
+  file_ = fopen(path, "wb");
+  if (!file_) return false;
+  fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), file_);
+  started_ = false;
+  return true;
+}
+
+void TraceWriter::record(uint64_t atMs, bool binary, const uint8_t *payload, size_t length) {
+  if (!file_) return;
+  uint64_t gapMs = started_ && atMs > lastMs_ ? atMs - lastMs_ : 0;
+  started_ = true;
+  lastMs_ = atMs;
+  putVarint(file_, gapMs);
+  fputc(binary ? TRACE_FLAG_BINARY : 0, file_);
+  putVarint(file_, length);
+  fwrite(payload, 1, length, file_);
+}
+
+void TraceWriter::close() {
+  if (file_) fclose(file_);
+  file_ = nullptr;
+}
+
+bool parseTrace(const uint8_t *data, size_t length, std::vector<TraceFrame> &frames) {
+  frames.clear();
+  if (length < sizeof(TRACE_MAGIC) || memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+    return false;
+  }
+  size_t at = sizeof(TRACE_MAGIC);
+  uint64_t atMs = 0;
+  while (at < length) {
+    uint64_t gapMs, frameLength;
+    if (!getVarint(data, length, at, gapMs) || at >= length) return false;
+    uint8_t flags = data[at++];
+    if (!getVarint(data, length, at, frameLength) || frameLength > length - at) return false;
+    atMs += gapMs;
+    frames.push_back({(uint32_t)atMs, (flags & TRACE_FLAG_BINARY) != 0, data + at,
+                      (size_t)frameLength});
+    at += frameLength;
+  }
+  return true;
+}
+
+bool readTraceFile(const char *path, std::vector<uint8_t> &data) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  data.clear();
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
@@ -0,0 +1,49 @@
+// Wire trace header for MakerPass host builds
+// A trace is what one device received over its WebSocket: every frame,
+// text or binary, with the time it arrived.  The scenario runner and
+// the load generator capture traces (the latter against a real
+// server); the replay harness and the fuzz target feed them back
+// through handleIncomingMessage() and handleIncomingBinary().
+//
+// The file is "MPT1" followed by one record per frame: the time since
+// the previous frame in milliseconds and the payload length, both as
+// unsigned LEB128, a flags byte (TRACE_FLAG_BINARY) between them, and
+// the payload.  A day of one device's traffic is a few tens of KB.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+static const char TRACE_MAGIC[4] = {'M', 'P', 'T', '1'};
+static const uint8_t TRACE_FLAG_BINARY = 0x01;
+
+struct TraceFrame {
+  uint32_t atMs;           // since the first frame
+  bool binary;
+  const uint8_t *payload;  // into the parsed buffer
+  size_t length;
+};
+
+class TraceWriter {
+ public:
+  ~TraceWriter() { close(); }
+  bool open(const char *path);
+  bool isOpen() const { return file_ != nullptr; }
+  // atMs on any clock that does not go backwards
+  void record(uint64_t atMs, bool binary, const uint8_t *payload, size_t length);
+  void close();
+
+ private:
+  FILE *file_ = nullptr;
+  bool started_ = false;
+  uint64_t lastMs_ = 0;
+};
+
+// Parse a trace held in memory.  Returns false for a missing header or
+// a truncated record; frames up to that point are still returned.
+bool parseTrace(const uint8_t *data, size_t length, std::vector<TraceFrame> &frames);
+
+bool readTraceFile(const char *path, std::vector<uint8_t> &data);
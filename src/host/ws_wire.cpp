@@ -0,0 +1,146 @@
+// WebSocket wire functions for MakerPass host builds
+// This module frames and unframes WebSocket messages and computes the
+// handshake keys (SHA-1 and base64, as RFC 6455 asks) without pulling
+// in a TLS or crypto library: the mock server speaks plain ws:// on
+// localhost.
+
+#include "ws_wire.h"
+#include <string.h>
+
+static const char *const WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotl(uint32_t value, uint8_t bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1(const uint8_t *data, size_t length, uint8_t digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  std::vector<uint8_t> message(data, data + length);
+  message.push_back(0x80);
+  while (message.size() % 64 != 56) message.push_back(0);
+  uint64_t bits = (uint64_t)length * 8;
+  for (int i = 7; i >= 0; i--) message.push_back((uint8_t)(bits >> (i * 8)));
+
+  for (size_t block = 0; block < message.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const uint8_t *p = &message[block + i * 4];
+      w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    for (int i = 16; i < 80; i++) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 20; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+static std::string base64(const uint8_t *data, size_t length) {
+  static const char *const ALPHABET =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t chunk = (uint32_t)data[i] << 16;
+    if (i + 1 < length) chunk |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) chunk |= data[i + 2];
+    out += ALPHABET[(chunk >> 18) & 0x3F];
+    out += ALPHABET[(chunk >> 12) & 0x3F];
+    out += i + 1 < length ? ALPHABET[(chunk >> 6) & 0x3F] : '=';
+    out += i + 2 < length ? ALPHABET[chunk & 0x3F] : '=';
+  }
+  return out;
+}
+
+std::string wsAcceptKey(const std::string &key) {
+  std::string text = key + WS_GUID;
+  uint8_t digest[20];
+  sha1((const uint8_t *)text.data(), text.size(), digest);
+  return base64(digest, sizeof(digest));
+}
+
+std::string wsClientKey(uint32_t seed) {
+  uint8_t nonce[16];
+  for (int i = 0; i < 16; i++) {
+    seed = seed * 1664525 + 1013904223;
+    nonce[i] = (uint8_t)(seed >> 24);
+  }
+  return base64(nonce, sizeof(nonce));
+}
+
+void wsAppendFrame(std::vector<uint8_t> &out, uint8_t opcode, const uint8_t *payload,
+                   size_t length, bool mask, uint32_t maskKey) {
+  out.push_back(0x80 | opcode);
+  uint8_t maskBit = mask ? 0x80 : 0;
+  if (length < 126) {
+    out.push_back(maskBit | (uint8_t)length);
+  } else if (length <= 0xFFFF) {
+    out.push_back(maskBit | 126);
+    out.push_back((uint8_t)(length >> 8));
+    out.push_back((uint8_t)length);
+  } else {
+    out.push_back(maskBit | 127);
+    for (int i = 7; i >= 0; i--) out.push_back((uint8_t)((uint64_t)length >> (i * 8)));
+  }
+  if (!mask) {
+    out.insert(out.end(), payload, payload + length);
+    return;
+  }
+  uint8_t key[4] = {(uint8_t)(maskKey >> 24), (uint8_t)(maskKey >> 16), (uint8_t)(maskKey >> 8),
+                    (uint8_t)maskKey};
+  out.insert(out.end(), key, key + 4);
+  for (size_t i = 0; i < length; i++) out.push_back(payload[i] ^ key[i % 4]);
+}
+
+long wsParseFrame(uint8_t *data, size_t length, WsFrame &frame) {
+  if (length < 2) return 0;
+  bool fin = data[0] & 0x80;
+  frame.opcode = data[0] & 0x0F;
+  bool masked = data[1] & 0x80;
+  uint64_t payloadLength = data[1] & 0x7F;
+  size_t header = 2;
+  if (payloadLength == 126) {
+    if (length < 4) return 0;
+    payloadLength = (uint64_t)data[2] << 8 | data[3];
+    header = 4;
+  } else if (payloadLength == 127) {
+    if (length < 10) return 0;
+    payloadLength = 0;
+    for (int i = 0; i < 8; i++) payloadLength = payloadLength << 8 | data[2 + i];
+    header = 10;
+  }
+  if (!fin || frame.opcode == 0 || payloadLength > WS_MAX_FRAME) return -1;
+  size_t maskAt = header;
+  if (masked) header += 4;
+  if (length < header + payloadLength) return 0;
+  frame.payload = data + header;
+  frame.length = (size_t)payloadLength;
+  if (masked) {
+    for (size_t i = 0; i < frame.length; i++) frame.payload[i] ^= data[maskAt + i % 4];
+  }
+  return (long)(header + payloadLength);
+}
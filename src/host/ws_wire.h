@@ -0,0 +1,42 @@
+// WebSocket wire header for MakerPass host builds
+// The parts of RFC 6455 the mock server and the load generator need:
+// the upgrade handshake key and single-frame messages.  Fragmented
+// messages are not used by the protocol and are treated as an error.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static const uint8_t WS_OP_TEXT   = 0x1;
+static const uint8_t WS_OP_BINARY = 0x2;
+static const uint8_t WS_OP_CLOSE  = 0x8;
+static const uint8_t WS_OP_PING   = 0x9;
+static const uint8_t WS_OP_PONG   = 0xA;
+
+// Largest frame either side accepts
+static const size_t WS_MAX_FRAME = 65536;
+
+struct WsFrame {
+  uint8_t opcode;
+  uint8_t *payload;        // unmasked in place
+  size_t length;
+};
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key
+std::string wsAcceptKey(const std::string &key);
+
+// A random Sec-WebSocket-Key
+std::string wsClientKey(uint32_t seed);
+
+// Append one final frame.  Clients mask with maskKey, servers pass 0
+// and send unmasked.
+void wsAppendFrame(std::vector<uint8_t> &out, uint8_t opcode, const uint8_t *payload,
+                   size_t length, bool mask, uint32_t maskKey = 0);
+
+// Parse the frame at the start of data.  Returns the bytes it takes,
+// 0 if it is not complete yet, or -1 for a malformed, fragmented or
+// oversized frame.
+long wsParseFrame(uint8_t *data, size_t length, WsFrame &frame);
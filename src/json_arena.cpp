@@ -0,0 +1,69 @@
+// JSON arena functions for MakerPass firmware
+// Fixed-buffer allocator used for inbound message documents
+
+#include "json_arena.h"
+
+// Each block is preceded by its size so reallocate() can copy it
+static const size_t BLOCK_HEADER = 8;
+
+static size_t alignUp(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+// Forget every block.  Call only after the document using the arena
+// has been cleared.
+void JsonArena::reset() {
+  used_ = 0;
+  last_ = nullptr;
+}
+
+void* JsonArena::allocate(size_t size) {
+  size_t needed = BLOCK_HEADER + alignUp(size);
+  if (used_ + needed > sizeof(buffer_)) {
+    return nullptr;
+  }
+  uint8_t* block = buffer_ + used_;
+  *(size_t*)block = size;
+  used_ += needed;
+  if (used_ > peak_) peak_ = used_;
+  last_ = block + BLOCK_HEADER;
+  return last_;
+}
+
+// Only the most recent block can be given back; everything else is
+// reclaimed by reset()
+void JsonArena::deallocate(void* ptr) {
+  if (ptr && ptr == last_) {
+    used_ = (uint8_t*)ptr - BLOCK_HEADER - buffer_;
+    last_ = nullptr;
+  }
+}
+
+void* JsonArena::reallocate(void* ptr, size_t newSize) {
+  if (!ptr) return allocate(newSize);
+  uint8_t* block = (uint8_t*)ptr - BLOCK_HEADER;
+  size_t oldSize = *(size_t*)block;
+
+  // The newest block grows or shrinks in place
+  if (ptr == last_) {
+    size_t end = (block - buffer_) + BLOCK_HEADER + alignUp(newSize);
+    if (end > sizeof(buffer_)) return nullptr;
+    *(size_t*)block = newSize;
+    used_ = end;
+    if (used_ > peak_) peak_ = used_;
+    return ptr;
+  }
+
+  // ArduinoJson shrinks string nodes and slot pools to fit once they
+  // are filled; any block can shrink where it is
+  if (newSize <= oldSize) {
+    *(size_t*)block = newSize;
+    return ptr;
+  }
+
+  void* moved = allocate(newSize);
+  if (moved) {
+    memcpy(moved, ptr, oldSize < newSize ? oldSize : newSize);
+  }
+  return moved;
+}
@@ -0,0 +1,132 @@
+// Logger functions for MakerPass firmware
+// This module takes log output off the tasks that produce it.  A log
+// call formats its line into a fixed-size record and pushes it onto
+// the calling task's own lock-free ring, so the access, network and UI
+// tasks never wait for the UART.  The log task, which runs below
+// everything else, merges the rings by timestamp and writes them out.
+// When a ring is full the record is dropped and counted, and the count
+// is printed once the log task catches up.
+//
+// Before the tasks start there is only setup(), and lines are written
+// directly.
+
+#include "logger.h"
+#include "constants.h"
+#include "spsc_queue.h"
+#include "task_manager.h"
+#include "hal.h"
+#include <atomic>
+#include <stdarg.h>
+
+struct LogRecord {
+  uint32_t ms;
+  uint8_t module;
+  uint8_t level;
+  uint8_t length;
+  char text[LOG_TEXT_LEN];
+};
+
+static const char* const LOG_MODULE_NAMES[LOG_MODULE_COUNT] = {
+  "BOOT", "TASK", "WiFi", "WS", "WIRE", "RFID", "ACCESS", "SESSION",
+  "CACHE", "ALLOW", "JOURNAL", "TELEM", "UI", "LOG", "BENCH"
+};
+
+static const char LEVEL_LETTERS[] = "-EWID";
+
+// One ring per producing task, indexed by TaskRole
+static SpscQueue<LogRecord, LOG_QUEUE_DEPTH> rings[TASK_ROLE_COUNT];
+
+static TaskHandle_t logTaskHandle = nullptr;
+static uint32_t written = 0;               // log task only
+static std::atomic<uint32_t> truncated{0}; // any producer
+static std::atomic<uint32_t> stray{0};     // from tasks without a ring
+
+static void printRecord(const LogRecord &rec) {
+  char prefix[32];
+  int len = snprintf(prefix, sizeof(prefix), "%lu %c [%s] ", (unsigned long)rec.ms,
+                     LEVEL_LETTERS[rec.level], LOG_MODULE_NAMES[rec.module]);
+  Serial.write((const uint8_t *)prefix, len);
+  Serial.write((const uint8_t *)rec.text, rec.length);
+  Serial.println();
+}
+
+void logWrite(LogModule module, uint8_t level, const char *format, ...) {
+  LogRecord rec;
+  rec.ms = halMillis();
+  rec.module = module;
+  rec.level = level;
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(rec.text, sizeof(rec.text), format, args);
+  va_end(args);
+  if (len < 0) len = 0;
+  if ((size_t)len >= sizeof(rec.text)) {
+    len = sizeof(rec.text) - 1;
+    truncated.fetch_add(1, std::memory_order_relaxed);
+  }
+  rec.length = len;
+
+  if (!tasksRunning()) {
+    printRecord(rec);
+    return;
+  }
+  TaskRole role = currentTaskRole();
+  if (role >= TASK_ROLE_COUNT) {
+    stray.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  rings[role].push(rec);
+  if (logTaskHandle) xTaskNotifyGive(logTaskHandle);
+}
+
+static uint32_t droppedTotal() {
+  uint32_t total = stray.load(std::memory_order_relaxed);
+  for (const auto &ring : rings) total += ring.dropped();
+  return total;
+}
+
+// Log task: print queued records oldest first, then sleep until the
+// next one is pushed
+void logTask(void *) {
+  logTaskHandle = xTaskGetCurrentTaskHandle();
+  uint32_t reportedDropped = 0;
+  for (;;) {
+    for (;;) {
+      int8_t oldest = -1;
+      uint32_t oldestMs = 0;
+      for (uint8_t i = 0; i < TASK_ROLE_COUNT; i++) {
+        const LogRecord *rec = rings[i].front();
+        if (rec && (oldest < 0 || (int32_t)(rec->ms - oldestMs) < 0)) {
+          oldest = i;
+          oldestMs = rec->ms;
+        }
+      }
+      if (oldest < 0) break;
+      printRecord(*rings[oldest].front());
+      LogRecord done;
+      rings[oldest].pop(done);
+      written++;
+    }
+
+    uint32_t dropped = droppedTotal();
+    if (dropped != reportedDropped) {
+      LogRecord rec = {};
+      rec.ms = halMillis();
+      rec.module = LOG_MODULE_LOG;
+      rec.level = LOG_WARN;
+      rec.length = snprintf(rec.text, sizeof(rec.text), "%lu records dropped",
+                            (unsigned long)(dropped - reportedDropped));
+      printRecord(rec);
+      reportedDropped = dropped;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+LogStats getLogStats() {
+  LogStats stats;
+  stats.written = written;
+  stats.dropped = droppedTotal();
+  stats.truncated = truncated.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -6,8 +6,10 @@
  * connects to the MakerPass server over WiFi using a WebSocket to
  * authenticate itself and to relay RFID scans to the server. The
  * server authorizes access and instructs the device to power a relay
- * controlling a door or machine. A master RFID card can be used
- * to unlock the relay when the network is unavailable.
+ * controlling a door or machine. One board can serve several
+ * reader/relay pairs (RESOURCES in config.h) over the one connection.
+ * A master RFID card can be used to unlock the relay when the network
+ * is unavailable.
  */
 
 #include <Arduino.h>
@@ -15,7 +17,6 @@
 #include <WebSocketsClient.h>
 #include <ArduinoJson.h>
 #include <TFT_eSPI.h>
-#include "Wiegand.h"
 
 #include "config.h"
 #include "pins.h"
@@ -24,261 +25,201 @@
 #include "wifi_manager.h"
 #include "websocket_manager.h"
 #include "session_manager.h"
+#include "grant_cache.h"
+#include "allowlist.h"
+#include "task_manager.h"
+#include "frame_builder.h"
+#include "display_buffer.h"
+#include "text_layout.h"
+#include "telemetry.h"
+#include "event_journal.h"
+#include "boot_manager.h"
+#include "wiegand_reader.h"
+#include "hal.h"
+#include "logger.h"
 
 // ---------------------------------------------------------------------------
 // Global objects and state
 // ---------------------------------------------------------------------------
 
 TFT_eSPI tft = TFT_eSPI();          // Display driver instance
-WIEGAND wiegand;                    // RFID reader interface
-WebSocketsClient webSocket;         // WebSocket client
+ServerSocket webSocket;             // WebSocket client
 
-// Connection flags
+// The variables below are each owned by one task (see task_manager.h)
+// and are only read and written from that task.
+
+// Connection flags (network task)
 bool wifiConnected      = false;    // true when WiFi is associated
 bool wsConnected        = false;    // true when WebSocket is open
 bool authenticated      = false;    // true when auth_success has been received
-bool resourceEnabled    = false;    // value from auth_success
-bool requireCardPresent = false;    // value from auth_success
-
-// Resource name reported by the server
-String resourceName = "MakerPass";
-
-// Session management
-String currentSessionId = "";       // non‑empty when a session is active
-String activeUser       = "";       // user currently granted access
-unsigned long sessionStartTime = 0; // for machines: when the session started
-bool runtimeDisplayReset = true;    // flag to trigger full runtime display redraw
 
-// Relay timing for door mode
-unsigned long relayEndTime = 0;     // millis when the relay should be turned off
-bool relayActive = false;           // true while the relay is energised
+// Resource name reported by the server (network task)
+DisplayText resourceName = "MakerPass";
 
-// RFID indicator timing
-unsigned long rfidIndicatorEndTime = 0; // when to turn off the RFID LED/beep
-
-// Ping/pong keep‑alive
+// Ping/pong keep‑alive (network task)
 unsigned long lastPingTime = 0;
-unsigned long lastPongTime = 0;
 
-// Card presence tracking for require_card_present
-String lastCardCode = "";
-unsigned long lastCardTime = 0;
+// Link state as last reported by the network task (access task)
+bool linkUp = false;                // WiFi up and authenticated
+
+// Session, relay and card presence state of each resource (access
+// task); see session_manager.h
+static_assert(RESOURCE_COUNT >= 1 && RESOURCE_COUNT <= MAX_RESOURCES,
+              "RESOURCES in config.h must have 1 to MAX_RESOURCES entries");
+ResourceState resources[RESOURCE_COUNT];
 
 // Forward declarations for functions local to main.cpp
-void updateTimers();
-void checkCardPresence();
 void handleRFIDScan();
+void handleCardRead(ResourceState &res, const WiegandRead &read);
 
 // ---------------------------------------------------------------------------
-// Setup: configure hardware, connect to WiFi and initialise subsystems
+// Setup: configure hardware and start the tasks; see boot_manager.cpp
 // ---------------------------------------------------------------------------
 
 void setup() {
   // Start the serial port for debugging
   Serial.begin(115200);
-  delay(100);
-
-  // Configure GPIO pins
-  pinMode(PIN_RFID_D0, INPUT_PULLUP);
-  pinMode(PIN_RFID_D1, INPUT_PULLUP);
 
-  pinMode(PIN_RFID_LED, OUTPUT);
-  pinMode(PIN_RFID_BEEP, OUTPUT);
-  pinMode(PIN_RELAY, OUTPUT);
-  pinMode(PIN_LED_WIFI, OUTPUT);
-  pinMode(PIN_LED_RELAY, OUTPUT);
-  pinMode(PIN_LED_RFID, OUTPUT);
+  // Configure the board's status LEDs
+  halPinMode(PIN_LED_WIFI, OUTPUT);
+  halPinMode(PIN_LED_RELAY, OUTPUT);
+  halPinMode(PIN_LED_RFID, OUTPUT);
 
   // Initialise outputs to a safe state
-  digitalWrite(PIN_RFID_LED, LOW);
-  digitalWrite(PIN_RFID_BEEP, LOW);
-  digitalWrite(PIN_RELAY, LOW);
-  digitalWrite(PIN_LED_WIFI, LOW);
-  digitalWrite(PIN_LED_RELAY, LOW);
-  digitalWrite(PIN_LED_RFID, LOW);
-
-  // Brief LED test: turn on all status LEDs sequentially
-  digitalWrite(PIN_LED_WIFI, HIGH);
-  delay(100);
-  digitalWrite(PIN_LED_RELAY, HIGH);
-  delay(100);
-  digitalWrite(PIN_LED_RFID, HIGH);
-  delay(100);
-  digitalWrite(PIN_LED_WIFI, LOW);
-  digitalWrite(PIN_LED_RELAY, LOW);
-  digitalWrite(PIN_LED_RFID, LOW);
-
-   // Manual display reset sequence
-  pinMode(13, OUTPUT);  // Reset pin
-  pinMode(14, OUTPUT);  // DC pin
-  
-  digitalWrite(13, LOW);
-  delay(100);
-  digitalWrite(13, HIGH);
-  delay(100);
-
-  // Initialise the TFT display
+  halDigitalWrite(PIN_LED_WIFI, LOW);
+  halDigitalWrite(PIN_LED_RELAY, LOW);
+  halDigitalWrite(PIN_LED_RFID, LOW);
+
+  // Configure every reader and relay and start the Wiegand decoders
+  // first so that no card is missed while the rest starts
+  initResources();
+
+  // Initialise the TFT display.  init() pulses TFT_RST itself.
   tft.init();
   tft.setRotation(3); // landscape orientation
   tft.fillScreen(COLOR_BG);
+  initDisplayBuffer();
+  initTextMetrics(displayCanvas());
   showBootMessage("MakerPass Booting...");
 
-  // Initialise the Wiegand RFID reader.  The library uses
-  // interrupts internally; pinMode has already configured the
-  // inputs with pull‑ups.  Begin must be called after pinMode.
-  wiegand.begin(PIN_RFID_D0, PIN_RFID_D1);
-
-  // Flash the reader's LED and beeper briefly to indicate readiness
-  digitalWrite(PIN_RFID_LED, HIGH);
-  digitalWrite(PIN_RFID_BEEP, HIGH);
-  delay(100);
-  digitalWrite(PIN_RFID_LED, LOW);
-  digitalWrite(PIN_RFID_BEEP, LOW);
-
-  // Connect to WiFi.  This function blocks until either a
-  // connection is established or a timeout expires.
-  connectToWiFi();
-
-  // Initialise the WebSocket client
-  initWebSocket();
-  
-  // Prepare the status bars for subsequent screens
-  showStatusBar();
+  // Render the constant parts of outbound frames and start the access
+  // path offline; the network task connects in the background
+  initFrameTemplates();
+  publishLinkState();
+
+  // Move networking and drawing into their own tasks; from here on
+  // loop() only runs the access-control path.  Storage, WiFi, SNTP and
+  // the server connection are brought up by handleBoot().
+  startTasks();
+
+  // Flash the readers' LEDs and beepers to indicate readiness; the
+  // access task turns them off
+  for (ResourceState &res : resources) {
+    flashRFIDIndicator(res, 100);
+  }
+  markBootMilestone(BOOT_ACCESS_LIVE);
 }
 
 // ---------------------------------------------------------------------------
-// Main loop: handle events, scan cards and update timers
+// Main loop: the access task.  Applies decisions from the network task,
+// scans cards and fires due timers, then sleeps until the next
+// deadline, Wiegand edge or command.  Network and display work never
+// run here.
 // ---------------------------------------------------------------------------
 
 void loop() {
-  // Maintain the WebSocket connection and process incoming frames
-  webSocket.loop();
-
-  // Send periodic pings to keep the connection alive
-  handleWebSocketKeepAlive();
+  uint32_t iterationStartUs = halMicros();
 
-  // Check WiFi connection state and update the status bar if it changes
-  handleWiFiStatus();
+  // Apply grants, denials and link changes from the network task
+  AccessCommand cmd;
+  while (pollAccessCommand(cmd)) {
+    processAccessCommand(cmd);
+  }
 
-  // Check for new RFID cards
+  // Check every reader for new RFID cards
   handleRFIDScan();
 
-  // Update timers and UI (relay countdown or session runtime)
-  updateTimers();
+  // Indicator, relay, countdown/runtime display and card presence
+  accessTimers.run();
 
-  // Monitor card presence and end session if required
-  checkCardPresence();
+  recordLatency(LAT_LOOP, halMicros() - iterationStartUs);
+  uint32_t waitMs = accessTimers.msUntilNext(ACCESS_IDLE_MAX_MS);
+  waitForAccessEvent(wiegandMsUntilFrameEnd(waitMs));
 }
 
 // ---------------------------------------------------------------------------
 // RFID handling
 // ---------------------------------------------------------------------------
 
-// Handle RFID card scans
+// Handle RFID card scans on each reader.  Reads with a bad length or
+// parity have already been rejected by the decoder.
 void handleRFIDScan() {
-  if (wiegand.available()) {
-    uint32_t code = wiegand.getCode();
-    char buf[9];
-    snprintf(buf, sizeof(buf), "%08X", code);
-    String codeStr = String(buf);
-    Serial.print(F("[RFID] Scanned card: 0x"));
-    Serial.println(codeStr);
-    
-    // Record last card for presence detection
-    lastCardCode = codeStr;
-    lastCardTime = millis();
-    
-    // Flash activity indicator
-    flashRFIDIndicator(100);
-    
-    // Compare with master key (case insensitive)
-    String master = String(MASTER_KEY);
-    master.toUpperCase();
-    if (codeStr.equalsIgnoreCase(master)) {
-      // Immediately unlock regardless of network state
-      Serial.println(F("[RFID] Master key detected"));
-      unlockRelay("Master Key");
-    } else if (!wifiConnected || !authenticated) {
-      // Not connected or not authorised; deny access
-      Serial.println(F("[RFID] Offline: denying access"));
-      showTempMessage("Offline", "Access Denied", COLOR_MSG_ERR);
-      flashRFIDIndicator(200);
-    } else {
-      // Send scan to the server
-      sendRFIDScan(codeStr);
+  WiegandRead read;
+  for (ResourceState &res : resources) {
+    if (pollWiegand(res.index, read)) {
+      handleCardRead(res, read);
     }
   }
 }
 
-// ---------------------------------------------------------------------------
-// Timer and presence handling
-// ---------------------------------------------------------------------------
-
-// Update relay timers and session runtime counters.  Called each loop
-// iteration.  Updates the display once per second when a timer is
-// active.
-void updateTimers() {
-  unsigned long now = millis();
-  
-  // Turn off RFID indicator after the duration expires
-  if (rfidIndicatorEndTime != 0 && now > rfidIndicatorEndTime) {
-    digitalWrite(PIN_LED_RFID, LOW);
-    digitalWrite(PIN_RFID_LED, LOW);
-    digitalWrite(PIN_RFID_BEEP, LOW);
-    rfidIndicatorEndTime = 0;
-  }
-  
-  // Door mode: countdown until relay end
-  if (relayActive && strcmp(DEVICE_TYPE, "door") == 0) {
-    if (now >= relayEndTime) {
-      lockRelay();
-      showIdleScreen();
-      Serial.println(F("[RELAY] Door relay turned off"));
+// Decide on a card read at one resource
+void handleCardRead(ResourceState &res, const WiegandRead &read) {
+  // Latency is measured from the card's last bit on the wire
+  uint32_t scanUs = read.lastEdgeUs;
+  uint32_t code = wiegandCardNumber(read);
+  if (coalescePresenceRead(res, code)) return;
+
+  char codeStr[9];
+  encodeHex32(code, codeStr);
+  codeStr[8] = '\0';
+  recordLatency(LAT_DECODE, halMicros() - scanUs);
+  latencyScanStarted(scanUs);
+  LOG_I(RFID, "%s scanned card: 0x%s (%u-bit %s)", res.config->id, codeStr, read.bits,
+        wiegandFormatName(read.format));
+
+  // Record last card for presence detection
+  res.lastCardCode = code;
+  res.lastCardTime = halMillis();
+  watchCardPresence(res);
+
+  // Flash activity indicator and bring this resource to the display
+  flashRFIDIndicator(res, 100);
+  showResource(res);
+
+  // Compare with master key (case insensitive)
+  UserName cachedUser;
+  if (strcasecmp(codeStr, MASTER_KEY) == 0) {
+    // Immediately unlock regardless of network state
+    LOG_I(RFID, "Master key detected");
+    unlockRelay(res, code, "Master Key");
+    journalEvent(JOURNAL_MASTER_UNLOCK, res.index, code);
+  } else if (!res.relayActive && grantCacheLookup(res.index, code, cachedUser)) {
+    // Recently granted by the server: energise the relay now and
+    // still report the scan so the server can audit or revoke it
+    LOG_I(RFID, "Grant cache hit for: %s", cachedUser.c_str());
+    grantAccess(res, code, cachedUser.c_str());
+    if (linkUp) {
+      requestRFIDScan(res.index, code, true);
     } else {
-      static unsigned long lastUpdate = 0;
-      static bool firstDrawDoor = true;
-      if (now - lastUpdate >= 1000 || firstDrawDoor) {
-        uint32_t remaining = (relayEndTime - now + 999) / 1000;
-        showDoorCountdown("Access Granted", String(remaining) + " s", firstDrawDoor);
-        firstDrawDoor = false;
-        lastUpdate = now;
-      }
+      journalEvent(JOURNAL_CACHE_GRANT, res.index, code);
     }
-  }
-  
-  // Machine mode: show elapsed session time
-  if (relayActive && strcmp(DEVICE_TYPE, "machine") == 0) {
-    static unsigned long lastUpdate = 0;
-    if (now - lastUpdate >= 1000) {
-      uint32_t seconds = (now - sessionStartTime) / 1000;
-      uint32_t mins    = seconds / 60;
-      uint32_t hours   = mins / 60;
-      seconds %= 60;
-      mins    %= 60;
-      char timeBuf[16];
-      snprintf(timeBuf, sizeof(timeBuf), "%02lu:%02lu:%02lu", 
-               (unsigned long)hours, (unsigned long)mins, (unsigned long)seconds);
-      showRuntimeDisplay(activeUser, String(timeBuf), runtimeDisplayReset);
-      runtimeDisplayReset = false;
-      lastUpdate = now;
-    }
-  }
-}
-
-// Monitor card presence for require_card_present devices.  If the
-// last scanned card has not been seen recently, end the session.
-void checkCardPresence() {
-  if (requireCardPresent && relayActive && strcmp(DEVICE_TYPE, "machine") == 0) {
-    // If there is an active session and card not seen recently
-    if ((millis() - lastCardTime) > CARD_PRESENT_TIMEOUT_MS) {
-      // send session_end to server only if we have a session ID
-      Serial.println(F("[RFID] Card removed, ending session"));
-      if (wsConnected && authenticated && currentSessionId.length() > 0) {
-        sendSessionEnd(currentSessionId);
-        Serial.println(F("[SESSION] Sent end due to card removal"));
-      }
-      endSession(activeUser);
-      lastCardCode = "";
+  } else if (!linkUp && allowlistContains(res.index, code)) {
+    // Offline but the card is on the synchronised member list.
+    // Repeat reads during the granted session leave it running.
+    LOG_I(RFID, "Offline: allowlist match");
+    if (!res.relayActive) {
+      grantAccess(res, code, "Member");
+      journalEvent(JOURNAL_OFFLINE_GRANT, res.index, code);
     }
+  } else if (!linkUp) {
+    // Not connected or not authorised; deny access
+    LOG_I(RFID, "Offline: denying access");
+    latencyScanDenied();
+    journalEvent(JOURNAL_OFFLINE_DENY, res.index, code);
+    showTempMessage("Offline", "Access Denied", COLOR_MSG_ERR);
+    flashRFIDIndicator(res, 200);
+  } else {
+    // Send scan to the server
+    requestRFIDScan(res.index, code);
   }
 }
@@ -0,0 +1,365 @@
+// MessagePack codec functions for MakerPass firmware
+// This module converts between the JSON documents the rest of the
+// firmware works with and the binary form of the protocol.  Inbound
+// binary frames are decoded into the same JsonDocument, with integer
+// keys and type codes replaced by their names, so processJsonMessage()
+// handles both encodings.  Outbound documents are encoded by walking
+// the document.  See wire_schema.h for the codes.
+
+#include "msgpack_codec.h"
+#include "wire_schema.h"
+
+// Deepest nesting accepted in an inbound message
+static const uint8_t WIRE_MAX_DEPTH = 8;
+
+// ---------------------------------------------------------------------------
+// Writer
+// ---------------------------------------------------------------------------
+
+MsgPackWriter::MsgPackWriter(uint8_t *buffer, size_t size)
+    : start_(buffer), pos_(buffer), end_(buffer + size), ok_(true) {}
+
+void MsgPackWriter::put(uint8_t byte) {
+  if (pos_ == end_) {
+    ok_ = false;
+    return;
+  }
+  *pos_++ = byte;
+}
+
+void MsgPackWriter::putBigEndian(uint64_t value, uint8_t bytes) {
+  while (bytes-- > 0) {
+    put((uint8_t)(value >> (bytes * 8)));
+  }
+}
+
+void MsgPackWriter::header(uint8_t fixBase, uint8_t fixMax, uint8_t code16, uint32_t count) {
+  if (count <= fixMax) {
+    put(fixBase | count);
+  } else if (count <= 0xFFFF) {
+    put(code16);
+    putBigEndian(count, 2);
+  } else {
+    put(code16 + 1);
+    putBigEndian(count, 4);
+  }
+}
+
+void MsgPackWriter::mapHeader(uint32_t count) {
+  header(0x80, 15, 0xDE, count);
+}
+
+void MsgPackWriter::arrayHeader(uint32_t count) {
+  header(0x90, 15, 0xDC, count);
+}
+
+void MsgPackWriter::unsignedInt(uint64_t value) {
+  if (value < 0x80) {
+    put((uint8_t)value);
+  } else if (value <= 0xFF) {
+    put(0xCC);
+    put((uint8_t)value);
+  } else if (value <= 0xFFFF) {
+    put(0xCD);
+    putBigEndian(value, 2);
+  } else if (value <= 0xFFFFFFFF) {
+    put(0xCE);
+    putBigEndian(value, 4);
+  } else {
+    put(0xCF);
+    putBigEndian(value, 8);
+  }
+}
+
+void MsgPackWriter::signedInt(int64_t value) {
+  if (value >= 0) {
+    unsignedInt((uint64_t)value);
+  } else if (value >= -32) {
+    put((uint8_t)value);
+  } else if (value >= INT8_MIN) {
+    put(0xD0);
+    put((uint8_t)value);
+  } else if (value >= INT16_MIN) {
+    put(0xD1);
+    putBigEndian((uint64_t)value, 2);
+  } else if (value >= INT32_MIN) {
+    put(0xD2);
+    putBigEndian((uint64_t)value, 4);
+  } else {
+    put(0xD3);
+    putBigEndian((uint64_t)value, 8);
+  }
+}
+
+void MsgPackWriter::uint32Fixed(uint32_t value) {
+  put(0xCE);
+  putBigEndian(value, 4);
+}
+
+void MsgPackWriter::string(const char* text, size_t length) {
+  if (length <= 31) {
+    put(0xA0 | length);
+  } else if (length <= 0xFF) {
+    put(0xD9);
+    put((uint8_t)length);
+  } else if (length <= 0xFFFF) {
+    put(0xDA);
+    putBigEndian(length, 2);
+  } else {
+    put(0xDB);
+    putBigEndian(length, 4);
+  }
+  if ((size_t)(end_ - pos_) < length) {
+    ok_ = false;
+    pos_ = end_;
+    return;
+  }
+  memcpy(pos_, text, length);
+  pos_ += length;
+}
+
+void MsgPackWriter::boolean(bool value) {
+  put(value ? 0xC3 : 0xC2);
+}
+
+void MsgPackWriter::nil() {
+  put(0xC0);
+}
+
+void MsgPackWriter::float64(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put(0xCB);
+  putBigEndian(bits, 8);
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+// ---------------------------------------------------------------------------
+
+static void encodeValue(MsgPackWriter &out, JsonVariantConst value) {
+  if (value.is<JsonObjectConst>()) {
+    JsonObjectConst object = value.as<JsonObjectConst>();
+    out.mapHeader(object.size());
+    for (JsonPairConst pair : object) {
+      const char* key = pair.key().c_str();
+      int16_t keyCode = wireCodeFor(WIRE_KEYS, WIRE_KEY_COUNT, key);
+      int16_t typeCode = -1;
+      if (keyCode == WIRE_KEY_TYPE && pair.value().is<const char*>()) {
+        typeCode = wireCodeFor(WIRE_TYPES, WIRE_TYPE_COUNT, pair.value().as<const char*>());
+      }
+      if (keyCode >= 0) {
+        out.unsignedInt(keyCode);
+      } else {
+        out.string(key);
+      }
+      if (typeCode > 0) {
+        out.unsignedInt(typeCode);
+      } else {
+        encodeValue(out, pair.value());
+      }
+    }
+  } else if (value.is<JsonArrayConst>()) {
+    JsonArrayConst array = value.as<JsonArrayConst>();
+    out.arrayHeader(array.size());
+    for (JsonVariantConst item : array) {
+      encodeValue(out, item);
+    }
+  } else if (value.is<bool>()) {
+    out.boolean(value.as<bool>());
+  } else if (value.is<uint64_t>()) {
+    out.unsignedInt(value.as<uint64_t>());
+  } else if (value.is<int64_t>()) {
+    out.signedInt(value.as<int64_t>());
+  } else if (value.is<double>()) {
+    out.float64(value.as<double>());
+  } else if (value.is<const char*>()) {
+    out.string(value.as<const char*>());
+  } else {
+    out.nil();
+  }
+}
+
+// Encode a message document.  Returns the encoded length, or 0 if it
+// does not fit.
+size_t encodeWireMessage(JsonVariantConst message, uint8_t *out, size_t size) {
+  MsgPackWriter writer(out, size);
+  encodeValue(writer, message);
+  return writer.ok() ? writer.length() : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Decoding
+// ---------------------------------------------------------------------------
+
+struct WireReader {
+  uint8_t *pos;
+  uint8_t *end;
+  uint8_t depth;
+};
+
+static bool readBigEndian(WireReader &in, uint8_t bytes, uint64_t &value) {
+  if (in.end - in.pos < bytes) return false;
+  value = 0;
+  while (bytes-- > 0) {
+    value = (value << 8) | *in.pos++;
+  }
+  return true;
+}
+
+// Read a string and terminate it in place.  The text is moved back one
+// byte over its own header so the NUL lands on what was its last
+// character, leaving the following element untouched.
+static bool readString(WireReader &in, size_t length, const char* &text) {
+  if ((size_t)(in.end - in.pos) < length) return false;
+  char *dst = (char *)in.pos - 1;
+  memmove(dst, in.pos, length);
+  dst[length] = '\0';
+  in.pos += length;
+  text = dst;
+  return true;
+}
+
+// Length of a string, map or array from its header byte.  family is
+// set to 's', 'm', 'a', or 0 for anything else.
+static bool readLength(WireReader &in, uint8_t b, char &family, uint32_t &length) {
+  uint64_t value = 0;
+  family = 0;
+  if ((b & 0xE0) == 0xA0) { family = 's'; length = b & 0x1F; return true; }
+  if ((b & 0xF0) == 0x80) { family = 'm'; length = b & 0x0F; return true; }
+  if ((b & 0xF0) == 0x90) { family = 'a'; length = b & 0x0F; return true; }
+  switch (b) {
+    case 0xD9: family = 's'; break;
+    case 0xDA: family = 's'; break;
+    case 0xDB: family = 's'; break;
+    case 0xDC: case 0xDD: family = 'a'; break;
+    case 0xDE: case 0xDF: family = 'm'; break;
+    default: return true;
+  }
+  uint8_t bytes = (b == 0xD9) ? 1 : (b == 0xDA || b == 0xDC || b == 0xDE) ? 2 : 4;
+  if (!readBigEndian(in, bytes, value)) return false;
+  length = (uint32_t)value;
+  return true;
+}
+
+static bool decodeValue(WireReader &in, JsonVariant target, bool isType);
+
+static bool decodeMap(WireReader &in, JsonVariant target, uint32_t count) {
+  JsonObject object = target.to<JsonObject>();
+  for (uint32_t i = 0; i < count; i++) {
+    if (in.pos >= in.end) return false;
+    uint8_t b = *in.pos++;
+    const char* key = nullptr;
+    bool isType = false;
+    char family;
+    uint32_t length;
+    if (b < 0x80 || b == 0xCC) {
+      uint64_t code = b;
+      if (b == 0xCC && !readBigEndian(in, 1, code)) return false;
+      if (code < WIRE_KEY_COUNT) key = WIRE_KEYS[code];
+      isType = code == WIRE_KEY_TYPE;
+    } else if (readLength(in, b, family, length) && family == 's') {
+      if (!readString(in, length, key)) return false;
+    } else {
+      return false;
+    }
+    if (key) {
+      // Add the member before decoding into it: a plain object[key]
+      // converts to a null variant while the key is missing, and
+      // everything set on it is dropped
+      if (!decodeValue(in, object[key].to<JsonVariant>(), isType)) return false;
+    } else {
+      // Unknown key from a newer schema: decode and drop the value
+      JsonVariant discard;
+      if (!decodeValue(in, discard, false)) return false;
+    }
+  }
+  return true;
+}
+
+static bool decodeValue(WireReader &in, JsonVariant target, bool isType) {
+  if (in.pos >= in.end || in.depth > WIRE_MAX_DEPTH) return false;
+  uint8_t b = *in.pos++;
+  uint64_t value;
+
+  // Integers, including type codes
+  if (b < 0x80 || b == 0xCC || b == 0xCD || b == 0xCE || b == 0xCF) {
+    value = b;
+    if (b >= 0xCC) {
+      if (!readBigEndian(in, 1 << (b - 0xCC), value)) return false;
+    }
+    if (isType) {
+      target.set(value < WIRE_TYPE_COUNT ? WIRE_TYPES[value] : "");
+    } else {
+      target.set(value);
+    }
+    return true;
+  }
+  if (b >= 0xE0) {
+    target.set((int8_t)b);
+    return true;
+  }
+  if (b >= 0xD0 && b <= 0xD3) {
+    uint8_t bytes = 1 << (b - 0xD0);
+    if (!readBigEndian(in, bytes, value)) return false;
+    uint8_t shift = 64 - bytes * 8;
+    target.set((int64_t)(value << shift) >> shift);
+    return true;
+  }
+  switch (b) {
+    case 0xC0: target.clear(); return true;
+    case 0xC2: target.set(false); return true;
+    case 0xC3: target.set(true); return true;
+    case 0xCA: {
+      if (!readBigEndian(in, 4, value)) return false;
+      uint32_t bits = (uint32_t)value;
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      target.set(f);
+      return true;
+    }
+    case 0xCB: {
+      if (!readBigEndian(in, 8, value)) return false;
+      double d;
+      memcpy(&d, &value, sizeof(d));
+      target.set(d);
+      return true;
+    }
+  }
+
+  char family;
+  uint32_t length;
+  if (!readLength(in, b, family, length)) return false;
+  if (family == 's') {
+    const char* text;
+    if (!readString(in, length, text)) return false;
+    target.set(text);
+    return true;
+  }
+  if (family == 'm' || family == 'a') {
+    in.depth++;
+    bool ok;
+    if (family == 'm') {
+      ok = decodeMap(in, target, length);
+    } else {
+      JsonArray array = target.to<JsonArray>();
+      ok = true;
+      for (uint32_t i = 0; i < length && ok; i++) {
+        ok = decodeValue(in, array.add<JsonVariant>(), false);
+      }
+    }
+    in.depth--;
+    return ok;
+  }
+  // bin and ext are not part of the protocol
+  return false;
+}
+
+// Decode a binary frame into doc.  The payload is modified in place
+// (strings are NUL-terminated where they lie).  Returns false for
+// malformed input or when the document runs out of memory.
+bool decodeWireMessage(uint8_t *data, size_t length, JsonDocument &doc) {
+  WireReader in = {data, data + length, 0};
+  if (!decodeValue(in, doc.to<JsonVariant>(), false)) return false;
+  return in.pos == in.end && !doc.overflowed();
+}
@@ -1,5 +1,14 @@
 // Session management functions for MakerPass firmware
-// This module handles relay control and session management
+// This module handles relay control and session management for each
+// resource the controller serves.  Every resource has its own session
+// state and deadlines (indicator, door relay, display refresh, card
+// presence); the deadlines are timers on accessTimers, fired by the
+// access task, and carry their resource as context.
+//
+// The display shows one resource at a time: the one with the latest
+// card or decision.  A countdown or runtime is drawn only for that one;
+// when its relay drops, the display moves to another resource whose
+// relay is still energised.
 
 #include "session_manager.h"
 #include "config.h"
@@ -7,74 +16,374 @@
 #include "constants.h"
 #include "ui_manager.h"
 #include "websocket_manager.h"
+#include "task_manager.h"
+#include "grant_cache.h"
+#include "telemetry.h"
+#include "event_journal.h"
+#include "wiegand_reader.h"
+#include "hal.h"
+#include "logger.h"
 
-extern bool relayActive;
-extern unsigned long relayEndTime;
-extern String activeUser;
-extern String currentSessionId;
-extern unsigned long sessionStartTime;
-extern bool runtimeDisplayReset;
-
-// Briefly illuminate the RFID activity LED and reader LED/beeper.  The
-// actual turn‑off happens asynchronously in updateTimers().
-void flashRFIDIndicator(uint16_t durationMs) {
-  extern unsigned long rfidIndicatorEndTime;
-  Serial.print(F("[RFID] Flash indicator for "));
-  Serial.print(durationMs);
-  Serial.println(F(" ms"));
-  digitalWrite(PIN_LED_RFID, HIGH);
-  digitalWrite(PIN_RFID_LED, HIGH);
-  digitalWrite(PIN_RFID_BEEP, HIGH);
-  rfidIndicatorEndTime = millis() + durationMs;
+extern bool linkUp;
+
+// Presence of sessions' cards while require_card_present is set
+static PresenceStats presenceStats = {};
+
+// Resource whose countdown or runtime is on the display
+static uint8_t shownResource = 0;
+
+static void indicatorOff(void *context);
+static void doorRelayExpired(void *context);
+static void relayDisplayTick(void *context);
+static void presenceCheck(void *context);
+static void presenceHeartbeat(void *context);
+
+static void writeOutput(uint8_t pin, uint8_t level) {
+  if (pin != PIN_NONE) halDigitalWrite(pin, level);
+}
+
+static void setupOutput(uint8_t pin) {
+  if (pin == PIN_NONE) return;
+  halPinMode(pin, OUTPUT);
+  halDigitalWrite(pin, LOW);
+}
+
+// The board's relay LED is lit while any relay is energised
+static void updateRelayLed() {
+  bool anyActive = false;
+  for (const ResourceState &res : resources) anyActive = anyActive || res.relayActive;
+  halDigitalWrite(PIN_LED_RELAY, anyActive ? HIGH : LOW);
+}
+
+static void initTimer(Timer &timer, TimerCallback callback, ResourceState &res) {
+  timer.callback = callback;
+  timer.context = &res;
+}
+
+// Configure each resource's reader and relay pins, put its outputs in a
+// safe state and start its Wiegand decoder.  Called first in setup() so
+// that no card is missed while the rest starts.
+void initResources() {
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    ResourceState &res = resources[i];
+    const ResourceConfig &config = RESOURCES[i];
+    res.index = i;
+    res.config = &config;
+    res.door = strcmp(config.type, "door") == 0;
+    res.runtimeDisplayReset = true;
+    initTimer(res.indicatorTimer, indicatorOff, res);
+    initTimer(res.doorTimer, doorRelayExpired, res);
+    initTimer(res.displayTimer, relayDisplayTick, res);
+    initTimer(res.presenceTimer, presenceCheck, res);
+    initTimer(res.heartbeatTimer, presenceHeartbeat, res);
+
+    halPinMode(config.pinD0, INPUT_PULLUP);
+    halPinMode(config.pinD1, INPUT_PULLUP);
+    setupOutput(config.pinRelay);
+    setupOutput(config.pinReaderLed);
+    setupOutput(config.pinReaderBeep);
+    // Edges are captured by interrupts and decoded by the access task
+    initWiegandReader(i, config.pinD0, config.pinD1);
+  }
+}
+
+// Briefly illuminate the RFID activity LED and the resource's reader
+// LED/beeper.  A timer turns them off again.
+void flashRFIDIndicator(ResourceState &res, uint16_t durationMs) {
+  LOG_D(RFID, "Flash indicator %u for %u ms", res.index, durationMs);
+  halDigitalWrite(PIN_LED_RFID, HIGH);
+  writeOutput(res.config->pinReaderLed, HIGH);
+  writeOutput(res.config->pinReaderBeep, HIGH);
+  accessTimers.schedule(res.indicatorTimer, durationMs);
+}
+
+static void indicatorOff(void *context) {
+  ResourceState &res = *(ResourceState *)context;
+  halDigitalWrite(PIN_LED_RFID, LOW);
+  writeOutput(res.config->pinReaderLed, LOW);
+  writeOutput(res.config->pinReaderBeep, LOW);
+}
+
+// Put a resource's countdown or runtime on the display.  Called on
+// every card read and decision, so the display follows the resource
+// being used.
+void showResource(ResourceState &res) {
+  if (res.index == shownResource) return;
+  shownResource = res.index;
+  if (res.relayActive) {
+    res.runtimeDisplayReset = true;
+    accessTimers.schedule(res.displayTimer, 0);
+  }
+}
+
+// A resource's relay has dropped: if it was on the display, show
+// another one that is still running.  Returns false if there is none.
+static bool showOtherResource(const ResourceState &res) {
+  if (res.index != shownResource) return true;
+  for (ResourceState &other : resources) {
+    if (&other != &res && other.relayActive) {
+      showResource(other);
+      return true;
+    }
+  }
+  return false;
 }
 
 // Energise the relay for a door and display a countdown.  The relay
 // remains energised for RELAY_DOOR_DURATION_MS and then turns off.
-void unlockRelay(const String &userName) {
-  relayActive = true;
-  relayEndTime = millis() + RELAY_DOOR_DURATION_MS;
-  digitalWrite(PIN_RELAY, HIGH);
-  digitalWrite(PIN_LED_RELAY, HIGH);
-  activeUser = userName;
+// code is the card the door was opened for.
+void unlockRelay(ResourceState &res, uint32_t code, const char *userName) {
+  res.relayActive = true;
+  res.grantedCode = code;
+  if (res.door) {
+    accessTimers.schedule(res.doorTimer, RELAY_DOOR_DURATION_MS);
+  }
+  writeOutput(res.config->pinRelay, HIGH);
+  latencyRelayOn();
+  updateRelayLed();
+  res.activeUser = userName;
+  showResource(res);
   // Initial UI: Access Granted with starting seconds
-  uint32_t remaining = (relayEndTime - millis() + 999) / 1000;
-  showDoorCountdown("Access Granted", String(remaining) + " s", true);
-  Serial.print(F("[RELAY] Door unlocked for user: "));
-  Serial.println(userName);
+  clearTempMessages();
+  char secondsBuf[12];
+  snprintf(secondsBuf, sizeof(secondsBuf), "%lu s", (unsigned long)((RELAY_DOOR_DURATION_MS + 999) / 1000));
+  showDoorCountdown("Access Granted", secondsBuf, true);
+  res.runtimeDisplayReset = false;
+  accessTimers.schedule(res.displayTimer, 1000);
+  LOG_I(SESSION, "%s unlocked for user: %s", res.config->id, userName);
+}
+
+static void doorRelayExpired(void *context) {
+  ResourceState &res = *(ResourceState *)context;
+  lockRelay(res);
+  if (!showOtherResource(res)) showIdleScreen();
+  LOG_I(SESSION, "%s relay turned off", res.config->id);
 }
 
 // De‑energise the relay and clear related state
-void lockRelay() {
-  relayActive = false;
-  digitalWrite(PIN_RELAY, LOW);
-  digitalWrite(PIN_LED_RELAY, LOW);
-  activeUser = "";
-  relayEndTime = 0;
+void lockRelay(ResourceState &res) {
+  res.relayActive = false;
+  res.grantedCode = 0;
+  writeOutput(res.config->pinRelay, LOW);
+  updateRelayLed();
+  res.activeUser.clear();
+  accessTimers.cancel(res.doorTimer);
+  accessTimers.cancel(res.displayTimer);
+  accessTimers.cancel(res.presenceTimer);
+  accessTimers.cancel(res.heartbeatTimer);
+}
+
+// Redraw the door countdown or the machine runtime while the relay is
+// energised and the resource is on the display.  The countdown ticks
+// on its own second boundaries.
+static void relayDisplayTick(void *context) {
+  ResourceState &res = *(ResourceState *)context;
+  if (!res.relayActive || res.index != shownResource) return;
+  if (res.door) {
+    uint32_t remainingMs = accessTimers.remainingMs(res.doorTimer);
+    char secondsBuf[12];
+    snprintf(secondsBuf, sizeof(secondsBuf), "%lu s", (unsigned long)((remainingMs + 999) / 1000));
+    showDoorCountdown("Access Granted", secondsBuf, res.runtimeDisplayReset);
+    accessTimers.schedule(res.displayTimer, remainingMs % 1000 ? remainingMs % 1000 : 1000);
+  } else {
+    uint32_t seconds = (halMillis() - res.sessionStartTime) / 1000;
+    uint32_t mins    = seconds / 60;
+    uint32_t hours   = mins / 60;
+    seconds %= 60;
+    mins    %= 60;
+    char timeBuf[16];
+    snprintf(timeBuf, sizeof(timeBuf), "%02lu:%02lu:%02lu",
+             (unsigned long)hours, (unsigned long)mins, (unsigned long)seconds);
+    showRuntimeDisplay(res.activeUser.c_str(), timeBuf, res.runtimeDisplayReset);
+    accessTimers.schedule(res.displayTimer, 1000);
+  }
+  res.runtimeDisplayReset = false;
+}
+
+// Grant access to card code according to the device type: doors
+// unlock for a fixed period, machines start a session without an id.
+void grantAccess(ResourceState &res, uint32_t code, const char *userName) {
+  if (res.door) {
+    unlockRelay(res, code, userName);
+  } else {
+    startSession(res, code, "", userName);
+  }
 }
 
 // Start a machine session.  The relay is energised until the
 // session ends.  The sessionId may be empty if the server did not
-// provide one (e.g. access_granted in machine mode).
-void startSession(const String &sessionId, const String &userName) {
-  currentSessionId = sessionId;
-  activeUser       = userName;
-  sessionStartTime = millis();
-  runtimeDisplayReset = true;  // Reset runtime display for new session
-  relayActive      = true;
-  digitalWrite(PIN_RELAY, HIGH);
-  digitalWrite(PIN_LED_RELAY, HIGH);
+// provide one (e.g. access_granted in machine mode).  code is the card
+// the session was granted to.
+void startSession(ResourceState &res, uint32_t code, const char *sessionId, const char *userName) {
+  res.currentSessionId = sessionId;
+  res.grantedCode      = code;
+  res.activeUser       = userName;
+  res.sessionStartTime = halMillis();
+  res.runtimeDisplayReset = true;  // Reset runtime display for new session
+  res.cardDropout = false;
+  res.relayActive      = true;
+  writeOutput(res.config->pinRelay, HIGH);
+  latencyRelayOn();
+  updateRelayLed();
+  showResource(res);
   // Display user and initial elapsed time
+  clearTempMessages();
   showMessage(userName, "Session Started", COLOR_MSG_OK);
-  Serial.print(F("[SESSION] Started for user: "));
-  Serial.println(userName);
+  accessTimers.schedule(res.displayTimer, 0);
+  accessTimers.schedule(res.heartbeatTimer, CARD_PRESENCE_HEARTBEAT_MS);
+  watchCardPresence(res);
+  LOG_I(SESSION, "%s started for user: %s", res.config->id, userName);
 }
 
 // End a machine session.  Turn off the relay and clear session
 // variables.  Display that the session has ended.
-void endSession(const String &userName) {
-  lockRelay();
-  currentSessionId = "";
-  showTempMessage("Session Ended", userName, COLOR_MSG_WARN);
-  Serial.print(F("[SESSION] Ended for user: "));
-  Serial.println(userName);
+void endSession(ResourceState &res, const char *userName) {
+  UserName name = userName;   // may be res.activeUser, which lockRelay() clears
+  lockRelay(res);
+  res.currentSessionId.clear();
+  showOtherResource(res);
+  showTempMessage("Session Ended", name.c_str(), COLOR_MSG_WARN);
+  LOG_I(SESSION, "%s ended for user: %s", res.config->id, name.c_str());
+}
+
+// Apply a decision or state change from the network task.  Runs in the
+// access task, which owns the relays and all session state.
+void processAccessCommand(const AccessCommand &cmd) {
+  if (cmd.type == ACCESS_CACHE_CLEAR) {
+    grantCacheClear();
+    return;
+  }
+  if (cmd.resource >= RESOURCE_COUNT) return;
+  ResourceState &res = resources[cmd.resource];
+  uint32_t code = cmd.codeKnown ? cmd.code : res.lastCardCode;
+  const char *userName = cmd.userName;
+
+  switch (cmd.type) {
+    case ACCESS_LINK_STATE:
+      linkUp = cmd.online;
+      if (cmd.presenceRequired && !res.presenceRequired) watchCardPresence(res);
+      res.presenceRequired = cmd.presenceRequired;
+      break;
+    case ACCESS_GRANT:
+      grantCacheStore(res.index, code, userName, cmd.ttlSeconds);
+      // A cache hit has already opened the door or started the session
+      // for this card; unlocking again would restart the door timer and
+      // count the relay twice
+      if (!res.relayActive || res.grantedCode != code) {
+        grantAccess(res, code, userName);
+      }
+      break;
+    case ACCESS_SESSION_STARTED:
+      grantCacheStore(res.index, code, userName, cmd.ttlSeconds);
+      if (res.door) {
+        // A door has no sessions; starting one would hold the relay
+        // open with no door timer
+        if (!res.relayActive || res.grantedCode != code) grantAccess(res, code, userName);
+      } else if (res.relayActive && res.grantedCode == code && res.currentSessionId.empty()) {
+        // Session already running from a cache hit; adopt the server's id
+        res.currentSessionId = cmd.sessionId;
+      } else {
+        startSession(res, code, cmd.sessionId, userName);
+      }
+      break;
+    case ACCESS_SESSION_ENDED:
+      // Only the session the server names: a late or repeated
+      // session_ended must not end the one that followed it
+      if (!res.relayActive || res.door) break;
+      if (cmd.sessionId[0] != '\0' && !res.currentSessionId.empty() &&
+          res.currentSessionId != cmd.sessionId) {
+        LOG_W(SESSION, "%s ignoring end of session %s", res.config->id, cmd.sessionId);
+        break;
+      }
+      endSession(res, userName[0] != '\0' ? userName : res.activeUser.c_str());
+      break;
+    case ACCESS_DENIED:
+      LOG_I(ACCESS, "%s denied: %s", res.config->id, cmd.text);
+      latencyScanDenied();
+      // The server overrides a stale cached grant: forget it and take
+      // back the access it gave.  Only the card holding the relay: a
+      // denial of another card must not end someone else's session.
+      if (grantCacheRevoke(res.index, code) && res.relayActive && res.grantedCode == code) {
+        LOG_I(CACHE, "Cached grant revoked, locking");
+        lockRelay(res);
+        res.currentSessionId.clear();
+      }
+      showResource(res);
+      showTempMessage("Access Denied", cmd.text, COLOR_MSG_ERR);
+      // brief flash of the RFID LED to indicate denial
+      flashRFIDIndicator(res, 200);
+      break;
+    case ACCESS_CACHE_REVOKE:
+      grantCacheRevoke(res.index, code);
+      break;
+    case ACCESS_CACHE_CLEAR:   // not about one resource, handled above
+      break;
+  }
+}
+
+// A card resting on the reader during a require_card_present session
+// is read continuously.  Repeat reads of the card that holds the
+// session only refresh its presence: no logging, indicator or server
+// round trip.  Returns true when the read was absorbed.
+bool coalescePresenceRead(ResourceState &res, uint32_t code) {
+  if (!res.presenceRequired || !res.relayActive || res.door) return false;
+  if (code != res.grantedCode) return false;
+  res.lastCardTime = halMillis();
+  watchCardPresence(res);
+  presenceStats.suppressed++;
+  if (res.cardDropout) {
+    res.cardDropout = false;
+    presenceStats.dropouts++;
+  }
+  return true;
+}
+
+// Look at card presence again CARD_DROPOUT_MS after the last read.
+// Called whenever lastCardTime moves and when a session starts.
+void watchCardPresence(ResourceState &res) {
+  uint32_t sinceRead = halMillis() - res.lastCardTime;
+  accessTimers.schedule(res.presenceTimer, sinceRead < CARD_DROPOUT_MS ? CARD_DROPOUT_MS - sinceRead : 0);
+}
+
+// No read for CARD_DROPOUT_MS: hold the session through the gap, and
+// end it once the card has been gone for CARD_PRESENT_TIMEOUT_MS
+static void presenceCheck(void *context) {
+  ResourceState &res = *(ResourceState *)context;
+  if (!res.presenceRequired || !res.relayActive || res.door) return;
+  uint32_t sinceRead = halMillis() - res.lastCardTime;
+  if (sinceRead <= CARD_PRESENT_TIMEOUT_MS) {
+    res.cardDropout = true;
+    accessTimers.schedule(res.presenceTimer, CARD_PRESENT_TIMEOUT_MS - sinceRead + 1);
+    return;
+  }
+  // send session_end to server only if we have a session ID
+  LOG_I(SESSION, "%s card removed, ending session", res.config->id);
+  uint32_t seconds = (halMillis() - res.sessionStartTime) / 1000;
+  if (linkUp && !res.currentSessionId.empty()) {
+    requestSessionEnd(res.index, res.currentSessionId.c_str(), res.grantedCode, seconds);
+  } else {
+    // The server cannot be told now; keep it for the audit trail
+    journalEvent(JOURNAL_SESSION_END, res.index, res.grantedCode, seconds,
+                 res.currentSessionId.c_str());
+  }
+  endSession(res, res.activeUser.c_str());
+  res.lastCardCode = 0;
+}
+
+// Periodic card_present while the session's card is on the reader
+static void presenceHeartbeat(void *context) {
+  ResourceState &res = *(ResourceState *)context;
+  if (!res.relayActive) return;
+  accessTimers.schedule(res.heartbeatTimer, CARD_PRESENCE_HEARTBEAT_MS);
+  if (!res.presenceRequired || res.cardDropout || res.door) return;
+  if (linkUp && !res.currentSessionId.empty() &&
+      requestCardPresent(res.index, res.currentSessionId.c_str())) {
+    presenceStats.heartbeats++;
+  }
+}
+
+// Counters are written by the access task only; other tasks may read a
+// torn snapshot, which is harmless for reporting
+const PresenceStats &getPresenceStats() {
+  return presenceStats;
 }
@@ -0,0 +1,225 @@
+// Task management functions for MakerPass firmware
+// This module creates the network and UI tasks and owns the queues
+// that connect them to the access task (the Arduino loop()).
+
+#include "task_manager.h"
+#include "constants.h"
+#include "spsc_queue.h"
+#include "ui_manager.h"
+#include "display_buffer.h"
+#include "telemetry.h"
+#include "event_journal.h"
+#include "boot_manager.h"
+#include "wifi_manager.h"
+#include "websocket_manager.h"
+#include "hal.h"
+#include "logger.h"
+#include <atomic>
+
+// One queue per producer/consumer pair
+static SpscQueue<AccessCommand, ACCESS_QUEUE_DEPTH> netToAccess;
+static SpscQueue<NetRequest, NET_QUEUE_DEPTH> accessToNet;
+static SpscQueue<UiCommand, UI_QUEUE_DEPTH> accessToUi;
+static SpscQueue<UiCommand, UI_QUEUE_DEPTH> netToUi;
+
+static TaskHandle_t accessTaskHandle  = nullptr;
+static TaskHandle_t networkTaskHandle = nullptr;
+static TaskHandle_t uiTaskHandle      = nullptr;
+static TaskHandle_t logTaskHandle     = nullptr;
+static volatile bool started = false;
+
+// UI commands lost to a full queue or posted from an unknown task
+static std::atomic<uint32_t> uiStray{0};
+static uint32_t uiDropWarnMs[TASK_ROLE_COUNT];   // each producer its own
+
+TimerWheel accessTimers;
+TimerWheel networkTimers;
+
+// Network task: boot sequencing, WiFi supervision, WebSocket I/O and
+// protocol handling.  A slow TLS handshake here stalls only this task.
+// The WebSocket library has to be polled, so the task still wakes every
+// NETWORK_TASK_PERIOD_MS; its own deadlines live in networkTimers.
+static void networkTask(void *) {
+  for (;;) {
+    uint32_t startUs = halMicros();
+    networkTimers.run();
+    handleBoot();
+    pollWebSocket();
+    handleWiFiStatus();
+    handleTelemetry();
+    handleJournal();
+
+    NetRequest req;
+    while (accessToNet.pop(req)) {
+      processNetRequest(req);
+    }
+    recordLatency(LAT_NET_LOOP, halMicros() - startUs);
+    uint32_t waitMs = networkTimers.msUntilNext(NETWORK_TASK_PERIOD_MS);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+  }
+}
+
+// UI task: the only place that touches the display once tasks run.
+// Everything drawn in one pass reaches the panel in a single flush.
+static void uiTask(void *) {
+  for (;;) {
+    uint32_t startUs = halMicros();
+    bool drew = false;
+    UiCommand cmd;
+    while (accessToUi.pop(cmd)) {
+      renderUiCommand(cmd);
+      drew = true;
+    }
+    while (netToUi.pop(cmd)) {
+      renderUiCommand(cmd);
+      drew = true;
+    }
+    updateUI();
+    displayFlush();
+    if (drew) recordLatency(LAT_UI, halMicros() - startUs);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UI_TASK_PERIOD_MS));
+  }
+}
+
+// Start the network, UI and log tasks.  Called at the end of setup();
+// from then on loop() is the access task and runs at the highest
+// priority.
+void startTasks() {
+  accessTaskHandle = xTaskGetCurrentTaskHandle();
+  vTaskPrioritySet(nullptr, ACCESS_TASK_PRIORITY);
+  started = true;
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr,
+                          NETWORK_TASK_PRIORITY, &networkTaskHandle, 0);
+  xTaskCreatePinnedToCore(uiTask, "ui", UI_TASK_STACK, nullptr,
+                          UI_TASK_PRIORITY, &uiTaskHandle, 1);
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr,
+                          LOG_TASK_PRIORITY, &logTaskHandle, 0);
+  LOG_I(TASK, "Network and log on core 0, access and UI on core 1");
+}
+
+bool tasksRunning() {
+  return started;
+}
+
+// Which task is calling.  Only the access task (setup() and loop()),
+// the network task and the UI task queue messages; a call from any
+// other task is a bug.  It trips configASSERT and, where asserts are
+// compiled out, gets TASK_ROLE_COUNT so that the caller drops its
+// message instead of pushing onto another producer's queue.
+TaskRole currentTaskRole() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  if (self == accessTaskHandle) return TASK_ACCESS;
+  if (self == networkTaskHandle) return TASK_NETWORK;
+  if (self == uiTaskHandle) return TASK_UI;
+  configASSERT(!"queued message from an unknown task");
+  return TASK_ROLE_COUNT;
+}
+
+// Network task -> access task.  Wakes the access task immediately so
+// that a grant reaches the relay without waiting for the next poll.
+bool postAccessCommand(const AccessCommand &cmd) {
+  bool ok = netToAccess.push(cmd);
+  if (!ok) {
+    LOG_W(TASK, "Access queue full, command dropped");
+  }
+  if (accessTaskHandle) xTaskNotifyGive(accessTaskHandle);
+  return ok;
+}
+
+bool pollAccessCommand(AccessCommand &cmd) {
+  return netToAccess.pop(cmd);
+}
+
+// Block the access task until a command or Wiegand edge arrives or
+// the timeout (its next deadline) elapses
+void waitForAccessEvent(uint32_t timeoutMs) {
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+}
+
+// Wiegand edge interrupt -> access task
+void IRAM_ATTR wakeAccessTaskFromISR() {
+  if (!accessTaskHandle) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(accessTaskHandle, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+static bool postNetRequest(const NetRequest &req) {
+  bool ok = accessToNet.push(req);
+  if (!ok) {
+    LOG_W(TASK, "Network queue full, request dropped");
+  }
+  if (networkTaskHandle) xTaskNotifyGive(networkTaskHandle);
+  return ok;
+}
+
+// Access task -> network task: report a scan
+bool requestRFIDScan(uint8_t resource, uint32_t code, bool cacheGrant) {
+  NetRequest req = {};
+  req.type = NET_RFID_SCAN;
+  req.resource = resource;
+  req.cacheGrant = cacheGrant;
+  req.code = code;
+  req.postedUs = halMicros();
+  return postNetRequest(req);
+}
+
+// Access task -> network task: report the end of a session
+bool requestSessionEnd(uint8_t resource, const char *sessionId, uint32_t code, uint32_t seconds) {
+  NetRequest req = {};
+  req.type = NET_SESSION_END;
+  req.resource = resource;
+  req.code = code;
+  req.data = seconds;
+  copyQueueText(req.sessionId, sizeof(req.sessionId), sessionId);
+  return postNetRequest(req);
+}
+
+// Access task -> network task: the session's card is still on the reader
+bool requestCardPresent(uint8_t resource, const char *sessionId) {
+  NetRequest req = {};
+  req.type = NET_CARD_PRESENT;
+  req.resource = resource;
+  copyQueueText(req.sessionId, sizeof(req.sessionId), sessionId);
+  return postNetRequest(req);
+}
+
+// Queue a draw command on the producer's own queue.  Before the tasks
+// start (during setup()) there is only one task, so draw directly; the
+// UI task itself draws directly too.  A lost command is counted, and
+// warned about at most every UI_DROP_LOG_INTERVAL_MS per producer.
+void postUiCommand(const UiCommand &cmd) {
+  if (!started) {
+    renderUiCommand(cmd);
+    displayFlush();
+    return;
+  }
+  TaskRole role = currentTaskRole();
+  if (role == TASK_UI) {
+    renderUiCommand(cmd);
+    return;
+  }
+  bool queued;
+  if (role == TASK_NETWORK) {
+    queued = netToUi.push(cmd);
+  } else if (role == TASK_ACCESS) {
+    queued = accessToUi.push(cmd);
+  } else {
+    uiStray.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (!queued) {
+    uint32_t now = halMillis();
+    if (uiDropWarnMs[role] == 0 || now - uiDropWarnMs[role] >= UI_DROP_LOG_INTERVAL_MS) {
+      uiDropWarnMs[role] = now;
+      LOG_W(TASK, "UI queue full, %lu draw commands dropped so far",
+            (unsigned long)uiCommandsDropped());
+    }
+  }
+  if (uiTaskHandle) xTaskNotifyGive(uiTaskHandle);
+}
+
+// Draw commands lost since boot, for telemetry
+uint32_t uiCommandsDropped() {
+  return accessToUi.dropped() + netToUi.dropped() + uiStray.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,194 @@
+// Telemetry functions for MakerPass firmware
+// This module keeps fixed-bucket, log-scale latency histograms for each
+// stage between a Wiegand read and the relay switching, plus loop and
+// render times, and counts the WebSocket traffic the device generates.
+// The network task reports them to the server every
+// TELEMETRY_INTERVAL_MS and dumps them on the serial console on
+// request.  Counters are cumulative since boot, so the server can size
+// itself from what devices actually send rather than from a guess.
+// Each report also carries the state of the internal heap: free bytes
+// falling while the largest free block shrinks faster is fragmentation,
+// which shows up weeks later as failed TLS reconnects.
+//
+// Each histogram has a single writer task; readers may see a sample
+// half-recorded, which is harmless for reporting.
+
+#include "telemetry.h"
+#include <esp_heap_caps.h>
+#include "bench.h"
+#include "websocket_manager.h"
+#include "session_manager.h"
+#include "task_manager.h"
+#include "hal.h"
+#include "logger.h"
+
+extern bool wsConnected;
+extern bool authenticated;
+
+static LatencyHistogram histograms[LAT_STAGE_COUNT];
+
+static const char* const STAGE_NAMES[LAT_STAGE_COUNT] = {
+  "loop", "decode", "queue", "build", "send", "rtt", "parse", "ui", "scan_to_relay", "connect", "net_loop", "wifi_reconnect",
+  "tls_full", "tls_resumed"
+};
+
+// Scan in flight on the access task: set on a Wiegand read, consumed
+// when the relay is energised
+static uint32_t scanStartUs = 0;
+static bool scanPending = false;
+
+// Scan in flight on the network task: set when rfid_scan is sent,
+// consumed by the server's answer
+static uint32_t scanSentUs = 0;
+static bool answerPending = false;
+
+static TrafficStats traffic = {};
+
+static unsigned long lastReportTime = 0;
+
+static uint8_t bucketFor(uint32_t us) {
+  uint8_t bucket = us ? 31 - __builtin_clz(us) : 0;
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+void recordLatency(LatencyStage stage, uint32_t us) {
+  LatencyHistogram &h = histograms[stage];
+  h.buckets[bucketFor(us)]++;
+  h.sumUs += us;
+  if (us > h.maxUs) h.maxUs = us;
+  h.count++;
+}
+
+const LatencyHistogram &getLatencyHistogram(LatencyStage stage) {
+  return histograms[stage];
+}
+
+const char* latencyStageName(LatencyStage stage) {
+  return STAGE_NAMES[stage];
+}
+
+// Access task: a card was read at startUs (from halMicros())
+void latencyScanStarted(uint32_t startUs) {
+  scanStartUs = startUs;
+  scanPending = true;
+}
+
+// Access task: the scan will not energise the relay
+void latencyScanDenied() {
+  scanPending = false;
+}
+
+// Access task: the relay has just been energised
+void latencyRelayOn() {
+  if (!scanPending) return;
+  recordLatency(LAT_SCAN_TO_RELAY, halMicros() - scanStartUs);
+  scanPending = false;
+}
+
+// Network task: an rfid_scan frame has been handed to the socket
+void latencyScanSent() {
+  scanSentUs = halMicros();
+  answerPending = true;
+}
+
+// Network task: the answer to the last scan arrived at receivedUs
+void latencyScanAnswered(uint32_t receivedUs) {
+  if (!answerPending) return;
+  recordLatency(LAT_RTT, receivedUs - scanSentUs);
+  answerPending = false;
+}
+
+// Network task: a frame of the given payload size was handed to the
+// socket or arrived from it
+void recordFrameSent(size_t bytes) {
+  traffic.framesOut++;
+  traffic.bytesOut += bytes;
+}
+
+void recordFrameReceived(size_t bytes) {
+  traffic.framesIn++;
+  traffic.bytesIn += bytes;
+}
+
+const TrafficStats &getTrafficStats() {
+  return traffic;
+}
+
+HeapStats getHeapStats() {
+  const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+  HeapStats heap;
+  heap.freeBytes    = heap_caps_get_free_size(caps);
+  heap.largestBlock = heap_caps_get_largest_free_block(caps);
+  heap.minFreeBytes = heap_caps_get_minimum_free_size(caps);
+  return heap;
+}
+
+// Upper bound of the bucket holding the q-th quantile (q in per mille)
+static uint32_t quantileBound(const LatencyHistogram &h, uint16_t q) {
+  uint32_t target = (uint32_t)(((uint64_t)h.count * q + 999) / 1000);
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h.buckets[i];
+    if (seen >= target) return 2UL << i;
+  }
+  return 2UL << (LATENCY_BUCKETS - 1);
+}
+
+// Print every stage with samples on the serial console
+void dumpTelemetry() {
+  LOG_I(TELEM, "stage: count, mean/p50/p99/p99.9/max us");
+  for (uint8_t i = 0; i < LAT_STAGE_COUNT; i++) {
+    const LatencyHistogram &h = histograms[i];
+    if (h.count == 0) continue;
+    LOG_I(TELEM, "%s: %u, %u/<%u/<%u/<%u/%u", STAGE_NAMES[i], (unsigned)h.count,
+          (unsigned)(h.sumUs / h.count), (unsigned)quantileBound(h, 500),
+          (unsigned)quantileBound(h, 990), (unsigned)quantileBound(h, 999), (unsigned)h.maxUs);
+  }
+  // Busy time of the two polling loops, for comparing wake-up policies
+  uint32_t uptimeMs = halMillis();
+  const LatencyStage loops[] = {LAT_LOOP, LAT_NET_LOOP};
+  for (LatencyStage stage : loops) {
+    const LatencyHistogram &h = histograms[stage];
+    if (uptimeMs == 0) break;
+    LOG_I(TELEM, "cpu %s: %.1f wakeups/s, busy %.2f%%", STAGE_NAMES[stage],
+          h.count * 1000.0 / uptimeMs, h.sumUs / (uptimeMs * 10.0));
+  }
+  if (uptimeMs > 0) {
+    LOG_I(TELEM, "traffic: %u frames/%u bytes out, %u frames/%u bytes in, %.2f frames/min",
+          (unsigned)traffic.framesOut, (unsigned)traffic.bytesOut, (unsigned)traffic.framesIn,
+          (unsigned)traffic.bytesIn, (traffic.framesOut + traffic.framesIn) * 60000.0 / uptimeMs);
+  }
+  HeapStats heap = getHeapStats();
+  LOG_I(TELEM, "heap: %u free, largest block %u, minimum free %u", (unsigned)heap.freeBytes,
+        (unsigned)heap.largestBlock, (unsigned)heap.minFreeBytes);
+  const PresenceStats &presence = getPresenceStats();
+  LOG_I(TELEM, "presence: %u reads suppressed, %u dropouts, %u heartbeats",
+        (unsigned)presence.suppressed, (unsigned)presence.dropouts, (unsigned)presence.heartbeats);
+  LogStats logStats = getLogStats();
+  LOG_I(TELEM, "log: %u written, %u dropped, %u truncated", (unsigned)logStats.written,
+        (unsigned)logStats.dropped, (unsigned)logStats.truncated);
+  LOG_I(TELEM, "ui: %u draw commands dropped", (unsigned)uiCommandsDropped());
+}
+
+// Called from the network task: periodic report and console requests
+void handleTelemetry() {
+  while (Serial.available()) {
+    int key = Serial.read();
+    if (key == TELEMETRY_CONSOLE_KEY) {
+      dumpTelemetry();
+    } else if (key == BENCH_CONSOLE_KEY) {
+      printBenchmarks();
+    }
+  }
+  if (!wsConnected || !authenticated) return;
+  unsigned long now = halMillis();
+  if (now - lastReportTime >= TELEMETRY_INTERVAL_MS) {
+    lastReportTime = now;
+    sendTelemetry();
+    HeapStats heap = getHeapStats();
+    if (heap.largestBlock < HEAP_LOW_BLOCK_BYTES) {
+      LOG_W(TELEM, "Heap fragmented: largest block %u of %u free", (unsigned)heap.largestBlock,
+            (unsigned)heap.freeBytes);
+    }
+  }
+}
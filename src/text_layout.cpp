@@ -0,0 +1,137 @@
+// Text layout functions for MakerPass firmware
+// This module measures text for the UI without calling into the display
+// library.  The advance width of every glyph of fonts 2 and 4 is read
+// from TFT_eSPI once at boot into a table; a string's width is then the
+// sum of its glyphs.  The tables are taken from the library rather than
+// copied into the source so they cannot drift from the fonts actually
+// linked.
+//
+// Names from the server can be wider than the screen, so they are
+// fitted: cut at a glyph boundary and ellipsized.  The last few fitted
+// strings are cached with their widths, so redraws of the same name
+// neither re-measure it nor guess how much to clear.  UI task only,
+// apart from initTextMetrics() in setup().
+
+#include "text_layout.h"
+#include "constants.h"
+
+static const uint8_t FIRST_GLYPH = 32;
+static const uint8_t GLYPH_COUNT = 96;
+
+struct FontMetrics {
+  uint8_t font;
+  uint8_t height;
+  uint8_t unknownWidth;    // a non-ASCII character, which the font lacks
+  uint8_t advance[GLYPH_COUNT];
+};
+
+static FontMetrics metrics[] = {{FONT_SMALL}, {FONT_LARGE}};
+
+static const char ELLIPSIS[] = "...";
+
+// Fitted strings, most recently used first
+struct LayoutEntry {
+  char source[QUEUE_TEXT_LEN];
+  uint8_t font;
+  uint16_t maxWidth;
+  FittedText fitted;
+};
+
+static LayoutEntry layoutCache[TEXT_LAYOUT_CACHE_SIZE];
+static uint8_t layoutCount = 0;
+
+static const FontMetrics *metricsFor(uint8_t font) {
+  for (const FontMetrics &m : metrics) {
+    if (m.font == font) return &m;
+  }
+  return nullptr;
+}
+
+// Read the advance widths from the library.  Called from setup() once
+// the display is initialised.
+void initTextMetrics(TFT_eSPI &gfx) {
+  for (FontMetrics &m : metrics) {
+    for (uint8_t i = 0; i < GLYPH_COUNT; i++) {
+      char glyph[2] = {(char)(FIRST_GLYPH + i), '\0'};
+      m.advance[i] = gfx.textWidth(glyph, m.font);
+    }
+    m.unknownWidth = gfx.textWidth("\xC2\xBF", m.font);
+    m.height = gfx.fontHeight(m.font);
+  }
+}
+
+// Width of one character starting at *text, advancing text past it.
+// A UTF-8 sequence is one character.
+static uint8_t nextGlyphWidth(const FontMetrics &m, const char *&text) {
+  uint8_t c = (uint8_t)*text++;
+  if (c < 0x80) {
+    return c >= FIRST_GLYPH ? m.advance[c - FIRST_GLYPH] : 0;
+  }
+  while (((uint8_t)*text & 0xC0) == 0x80) text++;
+  return m.unknownWidth;
+}
+
+uint16_t textPixelWidth(const char *text, uint8_t font) {
+  const FontMetrics *m = metricsFor(font);
+  if (!m) return 0;
+  uint16_t width = 0;
+  while (*text) width += nextGlyphWidth(*m, text);
+  return width;
+}
+
+uint16_t fontPixelHeight(uint8_t font) {
+  const FontMetrics *m = metricsFor(font);
+  return m ? m->height : 0;
+}
+
+static void fit(const char *text, uint8_t font, uint16_t maxWidth, FittedText &out) {
+  const FontMetrics *m = metricsFor(font);
+  out.height = m ? m->height : 0;
+  out.width = textPixelWidth(text, font);
+  if (!m || out.width <= maxWidth) {
+    copyQueueText(out.text, sizeof(out.text), text);
+    return;
+  }
+  // Keep whole characters while they and the ellipsis still fit
+  uint16_t ellipsisWidth = textPixelWidth(ELLIPSIS, font);
+  uint16_t width = 0;
+  const char *pos = text;
+  const char *cut = text;
+  while (*pos) {
+    uint16_t next = width + nextGlyphWidth(*m, pos);
+    if (next + ellipsisWidth > maxWidth) break;
+    width = next;
+    cut = pos;
+  }
+  size_t keep = cut - text;
+  if (keep > sizeof(out.text) - sizeof(ELLIPSIS)) keep = sizeof(out.text) - sizeof(ELLIPSIS);
+  memcpy(out.text, text, keep);
+  memcpy(out.text + keep, ELLIPSIS, sizeof(ELLIPSIS));
+  out.width = width + ellipsisWidth;
+}
+
+// Fit text into maxWidth pixels in the given font.  The result stays
+// valid until TEXT_LAYOUT_CACHE_SIZE other strings have been fitted.
+const FittedText &fitText(const char *text, uint8_t font, uint16_t maxWidth) {
+  uint8_t i = 0;
+  while (i < layoutCount &&
+         !(layoutCache[i].font == font && layoutCache[i].maxWidth == maxWidth &&
+           strcmp(layoutCache[i].source, text) == 0)) {
+    i++;
+  }
+  if (i == layoutCount) {
+    // Miss: reuse the least recently used slot
+    if (layoutCount < TEXT_LAYOUT_CACHE_SIZE) layoutCount++;
+    i = layoutCount - 1;
+    LayoutEntry &entry = layoutCache[i];
+    copyQueueText(entry.source, sizeof(entry.source), text);
+    entry.font = font;
+    entry.maxWidth = maxWidth;
+    fit(entry.source, font, maxWidth, entry.fitted);
+  }
+  // Move to the front
+  LayoutEntry found = layoutCache[i];
+  for (; i > 0; i--) layoutCache[i] = layoutCache[i - 1];
+  layoutCache[0] = found;
+  return layoutCache[0].fitted;
+}
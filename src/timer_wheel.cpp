@@ -0,0 +1,159 @@
+// Timer wheel functions for MakerPass firmware
+// This module replaces the per-feature millis() comparisons with one
+// deadline structure per task.  A timer due within 64 ms sits in a
+// level 0 slot for its exact millisecond; later ones sit in a coarser
+// level and move down a level each time the wheel below wraps round to
+// their slot.  run() fires everything due, and msUntilNext() tells the
+// task how long it may block before the next deadline.
+
+#include "timer_wheel.h"
+#include "hal.h"
+
+// Milliseconds since boot on the 64-bit esp_timer clock
+int64_t timerNowMs() {
+  return halUptimeUs() / 1000;
+}
+
+TimerWheel::TimerWheel() : firing_(nullptr), nextTick_(-1) {
+  memset(slots_, 0, sizeof(slots_));
+  memset(occupied_, 0, sizeof(occupied_));
+}
+
+// Start the wheel at the current time on first use, so that static
+// wheels do not read the clock during static initialisation
+void TimerWheel::sync() {
+  if (nextTick_ < 0) nextTick_ = timerNowMs();
+}
+
+// File an armed timer under the slot that is processed at or just
+// before its deadline
+void TimerWheel::insert(Timer &timer) {
+  int64_t expires = timer.expiresMs < nextTick_ ? nextTick_ : timer.expiresMs;
+  int64_t delta = expires - nextTick_;
+  uint8_t level = 0;
+  while (level < LEVELS - 1 && delta >= (1LL << (SLOT_BITS * (level + 1)))) level++;
+  if (delta >= (1LL << (SLOT_BITS * LEVELS))) {
+    // Beyond the wheel: park in the furthest slot and re-file from there
+    expires = nextTick_ + (1LL << (SLOT_BITS * LEVELS)) - 1;
+  }
+  uint8_t slot = (expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+
+  Timer *&head = slots_[level][slot];
+  timer.level = level;
+  timer.slot = slot;
+  timer.prev = nullptr;
+  timer.next = head;
+  if (head) head->prev = &timer;
+  head = &timer;
+  occupied_[level] |= 1ULL << slot;
+}
+
+// Arm a timer to fire delayMs from now, replacing any earlier deadline
+void TimerWheel::schedule(Timer &timer, uint32_t delayMs) {
+  sync();
+  cancel(timer);
+  timer.expiresMs = timerNowMs() + delayMs;
+  timer.armed = true;
+  insert(timer);
+}
+
+// Disarm a timer.  Harmless when it is not armed.
+void TimerWheel::cancel(Timer &timer) {
+  if (!timer.armed) return;
+  Timer *&head = timer.level == FIRING ? firing_ : slots_[timer.level][timer.slot];
+  if (timer.prev) {
+    timer.prev->next = timer.next;
+  } else {
+    head = timer.next;
+  }
+  if (timer.next) timer.next->prev = timer.prev;
+  if (!head && timer.level != FIRING) {
+    occupied_[timer.level] &= ~(1ULL << timer.slot);
+  }
+  timer.next = timer.prev = nullptr;
+  timer.armed = false;
+}
+
+uint32_t TimerWheel::remainingMs(const Timer &timer) const {
+  if (!timer.armed) return 0;
+  int64_t remaining = timer.expiresMs - timerNowMs();
+  return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+// Move every timer in a slot down to where it now belongs
+void TimerWheel::cascade(uint8_t level, uint8_t slot) {
+  Timer *timer = slots_[level][slot];
+  slots_[level][slot] = nullptr;
+  occupied_[level] &= ~(1ULL << slot);
+  while (timer) {
+    Timer *next = timer->next;
+    insert(*timer);
+    timer = next;
+  }
+}
+
+// Fire every timer whose deadline has passed.  Callbacks may schedule
+// or cancel any timer, including themselves.
+void TimerWheel::run() {
+  sync();
+  int64_t now = timerNowMs();
+  while (nextTick_ <= now) {
+    uint8_t index = nextTick_ & (SLOTS - 1);
+    if (index == 0) {
+      // The level 0 wheel has come round: pull down the next slot of
+      // each level whose own index has just wrapped as well
+      uint8_t top = 1;
+      while (top < LEVELS - 1 && ((nextTick_ >> (SLOT_BITS * top)) & (SLOTS - 1)) == 0) top++;
+      for (uint8_t level = top; level >= 1; level--) {
+        cascade(level, (nextTick_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+      }
+    }
+
+    if (!(occupied_[0] & (1ULL << index))) {
+      // Skip straight to the next occupied slot or the next wrap
+      uint64_t ahead = occupied_[0] & (~0ULL << index);
+      int64_t target = nextTick_ - index + (ahead ? __builtin_ctzll(ahead) : SLOTS);
+      nextTick_ = target < now + 1 ? target : now + 1;
+      continue;
+    }
+
+    // Everything in a level 0 slot is due at this tick
+    firing_ = slots_[0][index];
+    slots_[0][index] = nullptr;
+    occupied_[0] &= ~(1ULL << index);
+    for (Timer *timer = firing_; timer; timer = timer->next) timer->level = FIRING;
+    nextTick_++;
+
+    while (firing_) {
+      Timer *timer = firing_;
+      cancel(*timer);
+      timer->callback(timer->context);
+    }
+  }
+}
+
+// How long the owning task may block before run() has work to do,
+// capped at limitMs
+uint32_t TimerWheel::msUntilNext(uint32_t limitMs) {
+  sync();
+  int64_t now = timerNowMs();
+  uint8_t index = nextTick_ & (SLOTS - 1);
+  int64_t due = INT64_MAX;
+
+  if (occupied_[0]) {
+    uint64_t rotated = index ? (occupied_[0] >> index) | (occupied_[0] << (SLOTS - index))
+                             : occupied_[0];
+    due = nextTick_ + __builtin_ctzll(rotated);
+  }
+  for (uint8_t level = 1; level < LEVELS; level++) {
+    if (occupied_[level]) {
+      // Higher levels only need attention when level 0 wraps
+      int64_t wrap = index ? nextTick_ - index + SLOTS : nextTick_;
+      if (wrap < due) due = wrap;
+      break;
+    }
+  }
+
+  if (due == INT64_MAX || due - now >= limitMs) return limitMs;
+  return due > now ? (uint32_t)(due - now) : 0;
+}
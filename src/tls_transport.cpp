@@ -0,0 +1,268 @@
+// TLS transport for MakerPass firmware
+// The WebSockets library is started without SSL and given this
+// transport as its connection, because its own WiFiClientSecure is
+// made new for every attempt and cannot offer a previous session.
+// Here the session from the last good handshake is kept and offered on
+// the next connect; a server that still holds it (by session id or
+// ticket) answers with an abbreviated handshake that skips the
+// certificate and the key exchange.  A server that declines gets a
+// full handshake, and a resumption that fails drops the session so the
+// next attempt is full.
+//
+// Instead of walking a certificate chain, a full handshake hashes the
+// server certificate's SubjectPublicKeyInfo and compares it with
+// WS_PIN_SPKI.  A session is only kept after that check, so resuming
+// it needs no second one.  The session lives in RAM: the first
+// connection after a reset is a full handshake.
+
+#include "tls_transport.h"
+#include "websocket_manager.h"
+#include "config.h"
+#include "constants.h"
+#include "hal.h"
+#include "logger.h"
+
+static TlsHandshake lastHandshake = {};
+
+#ifndef MAKERPASS_HOST
+
+#include <mbedtls/base64.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/sha256.h>
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static mbedtls_ssl_config tlsConfig;
+static bool configReady = false;
+
+static mbedtls_ssl_session savedSession;
+static bool sessionSaved = false;
+
+static uint8_t pinnedKeyHash[32];
+static bool keyPinned = false;
+
+// Shared by every connection; set up on the first connect
+static bool setUpConfig() {
+  if (configReady) return true;
+  static bool initialised = false;
+  if (!initialised) {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_ssl_config_init(&tlsConfig);
+    mbedtls_ssl_session_init(&savedSession);
+    initialised = true;
+  }
+
+  size_t pinLength = 0;
+  keyPinned = WS_PIN_SPKI[0] != '\0';
+  if (keyPinned &&
+      (mbedtls_base64_decode(pinnedKeyHash, sizeof(pinnedKeyHash), &pinLength,
+                             (const uint8_t *)WS_PIN_SPKI, strlen(WS_PIN_SPKI)) != 0 ||
+       pinLength != sizeof(pinnedKeyHash))) {
+    LOG_E(WS, "WS_PIN_SPKI is not a base64 SHA-256 hash; not connecting");
+    return false;
+  }
+
+  static const char PERSONALISATION[] = "makerpass-tls";
+  if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                            (const uint8_t *)PERSONALISATION, sizeof(PERSONALISATION) - 1) != 0 ||
+      mbedtls_ssl_config_defaults(&tlsConfig, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+    LOG_E(WS, "TLS setup failed");
+    return false;
+  }
+  mbedtls_ssl_conf_rng(&tlsConfig, mbedtls_ctr_drbg_random, &drbg);
+  // The key is checked against the pin after the handshake
+  mbedtls_ssl_conf_authmode(&tlsConfig, MBEDTLS_SSL_VERIFY_NONE);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&tlsConfig, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+  configReady = true;
+  return true;
+}
+
+static void forgetSession() {
+  mbedtls_ssl_session_free(&savedSession);
+  mbedtls_ssl_session_init(&savedSession);
+  sessionSaved = false;
+}
+
+static bool keyMatchesPin(const mbedtls_ssl_context &ssl) {
+  if (!keyPinned) return true;
+  const mbedtls_x509_crt *peer = mbedtls_ssl_get_peer_cert(&ssl);
+  if (!peer) return false;
+  uint8_t hash[32];
+  if (mbedtls_sha256_ret(peer->pk_raw.p, peer->pk_raw.len, hash, 0) != 0) return false;
+  return memcmp(hash, pinnedKeyHash, sizeof(hash)) == 0;
+}
+
+TlsTransport::TlsTransport() : open_(false), peeked_(-1) {
+  mbedtls_ssl_init(&ssl_);
+  mbedtls_net_init(&net_);
+}
+
+TlsTransport::~TlsTransport() {
+  close();
+  mbedtls_ssl_free(&ssl_);
+}
+
+int TlsTransport::connect(const char *host, uint16_t port, int32_t timeoutMs) {
+  if (!setUpConfig()) return 0;
+  if (!WiFiClient::connect(host, port, timeoutMs)) return 0;
+
+  uint32_t startUs = halMicros();
+  // The socket belongs to WiFiClient; mbedTLS only reads and writes it
+  net_.fd = fd();
+  mbedtls_net_set_block(&net_);
+  if (mbedtls_ssl_setup(&ssl_, &tlsConfig) != 0 || mbedtls_ssl_set_hostname(&ssl_, host) != 0) {
+    close();
+    return 0;
+  }
+  mbedtls_ssl_set_bio(&ssl_, &net_, mbedtls_net_send, mbedtls_net_recv, nullptr);
+  bool offered = sessionSaved && mbedtls_ssl_set_session(&ssl_, &savedSession) == 0;
+
+  // A resuming server goes from its hello straight to ChangeCipherSpec
+  // and never sends its certificate
+  bool full = false;
+  int ret = 0;
+  while (ssl_.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    if (ssl_.state == MBEDTLS_SSL_SERVER_CERTIFICATE) full = true;
+    ret = mbedtls_ssl_handshake_step(&ssl_);
+    if (ret != 0) break;
+    if (halMicros() - startUs > (uint32_t)timeoutMs * 1000) {
+      ret = MBEDTLS_ERR_SSL_TIMEOUT;
+      break;
+    }
+  }
+  if (ret != 0) {
+    LOG_W(WS, "TLS handshake failed: -0x%04X", (unsigned)-ret);
+    if (offered) forgetSession();
+    close();
+    return 0;
+  }
+  if (full && !keyMatchesPin(ssl_)) {
+    LOG_E(WS, "Server key does not match WS_PIN_SPKI");
+    forgetSession();
+    close();
+    return 0;
+  }
+  lastHandshake = {!full, halMicros() - startUs};
+
+  // A resumed session may come with a new ticket; keep the latest
+  forgetSession();
+  sessionSaved = mbedtls_ssl_get_session(&ssl_, &savedSession) == 0;
+
+  mbedtls_net_set_nonblock(&net_);
+  open_ = true;
+  return 1;
+}
+
+size_t TlsTransport::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+// Partial writes are retried by the library with the same bytes, as
+// mbedTLS requires after MBEDTLS_ERR_SSL_WANT_WRITE
+size_t TlsTransport::write(const uint8_t *buf, size_t size) {
+  if (!open_) return 0;
+  int ret = mbedtls_ssl_write(&ssl_, buf, size);
+  if (ret > 0) return ret;
+  if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) close();
+  return 0;
+}
+
+// A zero-length read moves any complete record off the socket so that
+// its plaintext can be counted, as ssl_client does
+int TlsTransport::available() {
+  int pending = peeked_ >= 0 ? 1 : 0;
+  if (!open_) return pending;
+  int ret = mbedtls_ssl_read(&ssl_, nullptr, 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    close();
+    return pending;
+  }
+  return pending + mbedtls_ssl_get_bytes_avail(&ssl_);
+}
+
+int TlsTransport::read() {
+  uint8_t data;
+  return read(&data, 1) == 1 ? data : -1;
+}
+
+// -1 when nothing is waiting, like WiFiClientSecure
+int TlsTransport::read(uint8_t *buf, size_t size) {
+  if (size == 0) return 0;
+  int count = 0;
+  if (peeked_ >= 0) {
+    buf[count++] = peeked_;
+    peeked_ = -1;
+  }
+  if (count == (int)size || !open_) return count ? count : -1;
+  int ret = mbedtls_ssl_read(&ssl_, buf + count, size - count);
+  if (ret > 0) return count + ret;
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) close();
+  return count ? count : -1;
+}
+
+int TlsTransport::peek() {
+  if (peeked_ < 0) {
+    uint8_t data;
+    if (read(&data, 1) == 1) peeked_ = data;
+  }
+  return peeked_;
+}
+
+// Writes are not buffered here; unlike WiFiClient::flush() this must
+// not drain the socket, which holds TLS records
+void TlsTransport::flush() {}
+
+void TlsTransport::stop() {
+  close();
+}
+
+uint8_t TlsTransport::connected() {
+  return (open_ && WiFiClient::connected()) || peeked_ >= 0;
+}
+
+void TlsTransport::close() {
+  if (open_) mbedtls_ssl_close_notify(&ssl_);
+  open_ = false;
+  WiFiClient::stop();
+}
+
+// Replaces the library's connection with a new transport and connects
+// it; the library then sends the upgrade request as after its own
+// connect.  A failed transport is deleted here so that disconnect()
+// does not report a connection that never was.
+bool ServerSocket::open() {
+  if (_client.tcp) {
+    delete _client.tcp;
+    _client.tcp = nullptr;
+  }
+  TlsTransport *transport = new TlsTransport();
+  if (!transport->connect(_host.c_str(), _port, WS_CONNECT_TIMEOUT_MS)) {
+    delete transport;
+    return false;
+  }
+  _client.tcp = transport;
+  connectedCb();
+  return true;
+}
+
+#else  // MAKERPASS_HOST
+
+// The WebSockets double models the TCP connect and TLS handshake
+// (HostLink), resumption included
+bool ServerSocket::open() {
+  uint32_t startUs = halMicros();
+  if (!hostOpen()) return false;
+  lastHandshake = {hostTlsResumed(), halMicros() - startUs};
+  return true;
+}
+
+#endif
+
+const TlsHandshake &lastTlsHandshake() {
+  return lastHandshake;
+}
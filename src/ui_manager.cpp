@@ -1,213 +1,475 @@
 // UI management functions for MakerPass firmware
-// This module handles all display and user interface operations
+// This module handles all display and user interface operations.
+//
+// The public show*() functions only queue a UiCommand; the drawing
+// itself happens in the UI task through renderUiCommand(), which is the
+// only code that touches the TFT once the tasks are running.  Drawing
+// goes to the off-screen framebuffer; each draw function marks the
+// area it touches and the UI task flushes the changes to the panel.
 
 #include "ui_manager.h"
 #include "constants.h"
+#include "task_manager.h"
+#include "display_buffer.h"
+#include "text_layout.h"
+#include "hal.h"
 
-extern TFT_eSPI tft;
-extern String resourceName;
-extern bool wifiConnected;
-extern bool wsConnected;
-extern bool authenticated;
+// Link state as last reported by the network task
+static bool uiWifiConnected = false;
+static bool uiAuthenticated = false;
+static char uiResourceName[QUEUE_TEXT_LEN] = "MakerPass";
 
+// A temporary message waiting for, or occupying, the message area
+struct TempMessage {
+  UiCommand cmd;
+  unsigned long postedAt;   // when it was last requested
+};
+
+// Pending messages, highest priority first and FIFO within a priority
+static TempMessage pendingMessages[UI_MESSAGE_QUEUE_SIZE];
+static uint8_t pendingCount = 0;
+
+// Message currently on screen
+static TempMessage currentMessage;
+static bool tempMessageActive = false;
+static unsigned long currentShownAt = 0;
+
+// The persistent screen underneath any temporary message.  It is
+// redrawn in full when the last temporary message clears.
+static UiCommand baseScreen = {UI_IDLE};
+
+// ---------------------------------------------------------------------------
+// Drawing (UI task only)
+// ---------------------------------------------------------------------------
 
 // Draw the top status bar
-void showTopStatusBar() {
+static void drawTopStatusBar() {
+  TFT_eSPI &gfx = displayCanvas();
+  displayMarkDirty(0, 0, SCREEN_WIDTH, TOP_STATUS_BAR_H);
+
   // Clear the top area with dark gray background to match bottom status bar
-  tft.fillRect(0, 0, SCREEN_WIDTH, TOP_STATUS_BAR_H, 0x1082); // Very dark gray, barely lighter than black
-  
+  gfx.fillRect(0, 0, SCREEN_WIDTH, TOP_STATUS_BAR_H, 0x1082); // Very dark gray, barely lighter than black
+
   // Device name in white
-  tft.setTextFont(4);
-  tft.setTextColor(TFT_WHITE, 0x1082);
-  
-  String deviceText;
-  // Use resourceName if available, otherwise default to "MakerPass Device"
-  if (resourceName.length() > 0) {
-    deviceText = resourceName;
-  } else {
-    deviceText = "MakerPass Device";
-  }
+  gfx.setTextFont(FONT_LARGE);
+  gfx.setTextColor(TFT_WHITE, 0x1082);
 
-  tft.setCursor(10, 8); 
-  tft.print(deviceText);
+  // Use the resource name if available, otherwise default to "MakerPass Device"
+  const char* deviceText = uiResourceName[0] ? uiResourceName : "MakerPass Device";
+  const FittedText &name = fitText(deviceText, FONT_LARGE, TEXT_MAX_WIDTH);
+
+  gfx.setCursor(TEXT_MARGIN_X, (TOP_STATUS_BAR_H - name.height) / 2);
+  gfx.print(name.text);
+}
+
+// Label followed by a connection dot; returns the x after the dot
+static int16_t drawIndicator(TFT_eSPI &gfx, int16_t x, int16_t y, const char* label, bool up) {
+  uint16_t labelH = fontPixelHeight(FONT_SMALL);
+  gfx.setCursor(x, y + (BOTTOM_STATUS_BAR_H - labelH) / 2);
+  gfx.print(label);
+  int16_t dotX = x + textPixelWidth(label, FONT_SMALL) + 2 * STATUS_DOT_R;
+  gfx.fillCircle(dotX, y + BOTTOM_STATUS_BAR_H / 2, STATUS_DOT_R, up ? TFT_GREEN : 0xF800);
+  return dotX + STATUS_DOT_R;
 }
 
 // Draw the bottom status bar with connection indicators
-void showBottomStatusBar() {
+static void drawBottomStatusBar() {
+  TFT_eSPI &gfx = displayCanvas();
   int bottomY = SCREEN_HEIGHT - BOTTOM_STATUS_BAR_H;
-  tft.fillRect(0, bottomY, SCREEN_WIDTH, BOTTOM_STATUS_BAR_H, 0x1082);
-  
-  tft.setTextFont(2);
-  tft.setTextColor(COLOR_STATUS_TX, 0x1082);
-  
-  // WiFi status with dot
-  tft.setCursor(10, bottomY + 2);
-  tft.print("WiFi");
-  tft.fillCircle(50, bottomY + 8, 4, wifiConnected ? TFT_GREEN : 0xF800);
-  
-  // Server status with dot
-  tft.setCursor(70, bottomY + 2);
-  tft.print("Server");
-  tft.fillCircle(120, bottomY + 8, 4, authenticated ? TFT_GREEN : 0xF800);
+  displayMarkDirty(0, bottomY, SCREEN_WIDTH, BOTTOM_STATUS_BAR_H);
+  gfx.fillRect(0, bottomY, SCREEN_WIDTH, BOTTOM_STATUS_BAR_H, 0x1082);
+
+  gfx.setTextFont(FONT_SMALL);
+  gfx.setTextColor(COLOR_STATUS_TX, 0x1082);
+
+  // WiFi and server status, each with a dot
+  int16_t x = drawIndicator(gfx, TEXT_MARGIN_X, bottomY, "WiFi", uiWifiConnected);
+  drawIndicator(gfx, x + 4 * STATUS_DOT_R, bottomY, "Server", uiAuthenticated);
 }
 
 // Update both status bars
-void showStatusBar() {
-  showTopStatusBar();
-  showBottomStatusBar();
+static void drawStatusBar() {
+  drawTopStatusBar();
+  drawBottomStatusBar();
+}
+
+// Top of the large first line and the small second line of the message
+// area, with the pair centred vertically
+static int16_t messageLine1Y() {
+  uint16_t blockH = fontPixelHeight(FONT_LARGE) + MESSAGE_LINE_GAP + fontPixelHeight(FONT_SMALL);
+  return MESSAGE_AREA_Y + (MESSAGE_AREA_H - blockH) / 2;
+}
+
+static int16_t messageLine2Y() {
+  return messageLine1Y() + fontPixelHeight(FONT_LARGE) + MESSAGE_LINE_GAP;
 }
 
 // Display a multi‑line message in the main message area between status bars
-void showMessage(const String &line1, const String &line2, uint16_t textColor, uint16_t bgColor) {
+static void drawMessage(const char* line1, const char* line2, uint16_t textColor, uint16_t bgColor) {
+  TFT_eSPI &gfx = displayCanvas();
+  displayMarkDirty(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H);
+
   // Clear the message area (between the two status bars)
-  tft.fillRect(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H, bgColor);
-  tft.setTextColor(textColor, bgColor);
-  
+  gfx.fillRect(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H, bgColor);
+  gfx.setTextColor(textColor, bgColor);
+
   // Use a large font for the first line
-  tft.setTextFont(4);
-  tft.setCursor(10, MESSAGE_AREA_Y + 35);
-  tft.print(line1);
-  
+  gfx.setTextFont(FONT_LARGE);
+  gfx.setCursor(TEXT_MARGIN_X, messageLine1Y());
+  gfx.print(fitText(line1, FONT_LARGE, TEXT_MAX_WIDTH).text);
+
   // Second line in smaller font below first line
-  if (line2.length() > 0) {
-    tft.setTextFont(2);
-    tft.setCursor(10, MESSAGE_AREA_Y + 70);
-    tft.print(line2);
+  if (line2[0] != '\0') {
+    gfx.setTextFont(FONT_SMALL);
+    gfx.setCursor(TEXT_MARGIN_X, messageLine2Y());
+    gfx.print(fitText(line2, FONT_SMALL, TEXT_MAX_WIDTH).text);
   }
-  
-  // Always show status bars
-  showStatusBar();
-}
 
-// Display a temporary message that auto-clears after 3 seconds
-void showTempMessage(const String &line1, const String &line2, uint16_t textColor, uint16_t bgColor) {
-  showMessage(line1, line2, textColor, bgColor);
-  
-  // Wait 3 seconds then show idle screen
-  delay(3000);
-  showIdleScreen();
+  // Always show status bars; unchanged pixels are not pushed again
+  drawStatusBar();
 }
 
 // Show boot-time messages with simpler formatting
-void showBootMessage(const String &message, const String &detail, uint16_t textColor) {
-  tft.fillScreen(COLOR_BG);
-  tft.setCursor(10, SCREEN_HEIGHT / 2 - 20);
-  tft.setTextFont(4);
-  tft.setTextColor(textColor, COLOR_BG);
-  tft.println(message);
-  if (detail.length() > 0) {
-    tft.setTextFont(2);
-    tft.println(detail);
+static void drawBootMessage(const char* message, const char* detail, uint16_t textColor) {
+  TFT_eSPI &gfx = displayCanvas();
+  displayMarkDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  gfx.fillScreen(COLOR_BG);
+  gfx.setCursor(10, SCREEN_HEIGHT / 2 - 20);
+  gfx.setTextFont(4);
+  gfx.setTextColor(textColor, COLOR_BG);
+  gfx.println(message);
+  if (detail[0] != '\0') {
+    gfx.setTextFont(2);
+    gfx.println(detail);
   }
 }
 
 // Show the idle screen when device is ready
-void showIdleScreen() {
-  if (authenticated) {
-    showMessage("Ready", "Scan card", COLOR_MSG_OK);
+static void drawIdleScreen() {
+  if (uiAuthenticated) {
+    drawMessage("Ready", "Scan card", COLOR_MSG_OK, COLOR_BG);
   } else {
-    showMessage("Offline", "Master Key Only", COLOR_MSG_WARN);
+    drawMessage("Offline", "Master Key Only", COLOR_MSG_WARN, COLOR_BG);
   }
 }
 
-// Show runtime display
-void showRuntimeDisplay(const String &userName, const String &runtime, bool initialDraw) {
-  static String lastRuntime = "";
-  
+// A value drawn after a label on the second message line and redrawn
+// in place, clearing exactly the pixels of the previous value
+struct LabelledValue {
+  const char* label;
+  int16_t x;               // -1 until laid out
+  int16_t y;
+  uint16_t width;          // of the value on screen
+  char text[QUEUE_TEXT_LEN];
+};
+
+static void layoutLabelledValue(LabelledValue &v) {
+  v.x = TEXT_MARGIN_X + textPixelWidth(v.label, FONT_SMALL);
+  v.y = messageLine2Y();
+  v.width = 0;
+  v.text[0] = '\0';
+}
+
+static void drawLabelledValueText(LabelledValue &v, const char* value) {
+  TFT_eSPI &gfx = displayCanvas();
+  if (v.x < 0) layoutLabelledValue(v);
+  uint16_t newWidth = textPixelWidth(value, FONT_SMALL);
+  uint16_t clearWidth = v.width > newWidth ? v.width : newWidth;
+  uint16_t height = fontPixelHeight(FONT_SMALL);
+  displayMarkDirty(v.x, v.y, clearWidth, height);
+  gfx.fillRect(v.x, v.y, clearWidth, height, COLOR_BG);
+  gfx.setTextFont(FONT_SMALL);
+  gfx.setTextColor(TFT_WHITE, COLOR_BG);
+  gfx.setCursor(v.x, v.y);
+  gfx.print(value);
+  v.width = newWidth;
+  copyQueueText(v.text, sizeof(v.text), value);
+}
+
+// Full redraw of the message area: a large first line, then the label
+// and its value
+static void drawLabelledScreen(LabelledValue &v, const char* line1, const char* value) {
+  TFT_eSPI &gfx = displayCanvas();
+  displayMarkDirty(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H);
+  gfx.fillRect(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H, COLOR_BG);
+
+  gfx.setTextFont(FONT_LARGE);
+  gfx.setTextColor(COLOR_MSG_OK, COLOR_BG);
+  gfx.setCursor(TEXT_MARGIN_X, messageLine1Y());
+  gfx.print(fitText(line1, FONT_LARGE, TEXT_MAX_WIDTH).text);
+
+  layoutLabelledValue(v);
+  gfx.setTextFont(FONT_SMALL);
+  gfx.setTextColor(TFT_WHITE, COLOR_BG);
+  gfx.setCursor(TEXT_MARGIN_X, v.y);
+  gfx.print(v.label);
+  drawLabelledValueText(v, value);
+
+  drawStatusBar();
+}
+
+static LabelledValue runtimeValue   = {"Runtime: ", -1};
+static LabelledValue countdownValue = {"Locking in: ", -1};
+
+// Show runtime display: user name with the elapsed time below it.
+// Updates only redraw the time.
+static void drawRuntimeDisplay(const char* userName, const char* runtime, bool initialDraw) {
   if (initialDraw) {
-    // Full redraw - clear message area and draw everything
-    tft.fillRect(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H, COLOR_BG);
-    
-    // User name
-    tft.setTextFont(4);
-    tft.setTextColor(COLOR_MSG_OK, COLOR_BG);
-    tft.setCursor(10, MESSAGE_AREA_Y + 35);
-    tft.print(userName);
-    
-    // Runtime label and time in smaller font
-    tft.setTextFont(2);
-    tft.setTextColor(TFT_WHITE, COLOR_BG);
-    tft.setCursor(10, MESSAGE_AREA_Y + 70); // Below user name
-    tft.print("Runtime: ");
-    tft.print(runtime);
-    
-    // Show status bars
-    showStatusBar();
-    lastRuntime = runtime;
-  } else if (runtime != lastRuntime) {
-    // Efficient update - only update the time portion
-    tft.setTextFont(2);
-    tft.setTextColor(COLOR_MSG_OK, COLOR_BG);
-    
-    // Clear just the time area (approximate width for HH:MM:SS)
-    tft.fillRect(65, MESSAGE_AREA_Y + 70, 80, 16, COLOR_BG); // Clear time area
-    
-    // Redraw just the time
-    tft.setCursor(65, MESSAGE_AREA_Y + 70); // After "Runtime: "
-    tft.print(runtime);
-    lastRuntime = runtime;
+    drawLabelledScreen(runtimeValue, userName, runtime);
+  } else if (strcmp(runtimeValue.text, runtime) != 0) {
+    drawLabelledValueText(runtimeValue, runtime);
   }
 }
 
-// Reset runtime display state for new sessions
-void resetRuntimeDisplay() {
-  // This will be used in main.cpp to reset the firstDraw flag
+// Show a door countdown screen with efficient time-only updates
+static void drawDoorCountdown(const char* header, const char* seconds, bool initialDraw) {
+  if (initialDraw) {
+    drawLabelledScreen(countdownValue, header, seconds);
+  } else if (strcmp(countdownValue.text, seconds) != 0) {
+    drawLabelledValueText(countdownValue, seconds);
+  }
 }
 
-// Show a door countdown screen with efficient time-only updates
-void showDoorCountdown(const String &header, const String &seconds, bool initialDraw) {
-  static String lastSeconds = "";
-  static int16_t secondsX = -1;
-  static int16_t secondsY = -1;
+static void drawBaseScreen(const UiCommand &cmd) {
+  switch (cmd.type) {
+    case UI_BOOT:
+      drawBootMessage(cmd.text1, cmd.text2, cmd.textColor);
+      break;
+    case UI_MESSAGE:
+      drawMessage(cmd.text1, cmd.text2, cmd.textColor, cmd.bgColor);
+      break;
+    case UI_DOOR_COUNTDOWN:
+      drawDoorCountdown(cmd.text1, cmd.text2, cmd.initialDraw);
+      break;
+    case UI_RUNTIME:
+      drawRuntimeDisplay(cmd.text1, cmd.text2, cmd.initialDraw);
+      break;
+    case UI_IDLE:
+    default:
+      drawIdleScreen();
+      break;
+  }
+}
 
-  if (initialDraw) {
-    // Full redraw of message area
-    tft.fillRect(0, MESSAGE_AREA_Y, SCREEN_WIDTH, MESSAGE_AREA_H, COLOR_BG);
-
-    // Header (e.g., "Access Granted") in large font, left-justified
-    tft.setTextFont(4);
-    tft.setTextColor(COLOR_MSG_OK, COLOR_BG);
-    tft.setCursor(10, MESSAGE_AREA_Y + 35);
-    tft.print(header);
-
-    // Label + seconds in smaller font; label in white, seconds in white too
-    tft.setTextFont(2);
-    tft.setTextColor(TFT_WHITE, COLOR_BG);
-    secondsY = MESSAGE_AREA_Y + 70;
-
-    // Draw the label and compute where the seconds should start
-    const char* label = "Locking in: ";
-    tft.setCursor(10, secondsY);
-    tft.print(label);
-    int16_t labelWidth = tft.textWidth(label); // current font is 2
-    secondsX = 10 + labelWidth;
-
-    // Draw the initial seconds exactly at computed X
-    tft.setCursor(secondsX, secondsY);
-    tft.print(seconds);
-
-    showStatusBar();
-    lastSeconds = seconds;
-  } else if (seconds != lastSeconds) {
-    // Only update the seconds text at the exact same X position
-    tft.setTextFont(2);
-    tft.setTextColor(TFT_WHITE, COLOR_BG);
-    if (secondsX < 0) {
-      // Fallback: compute based on label width if not initialized
-      const char* label = "Locking in: ";
-      int16_t labelWidth = tft.textWidth(label);
-      secondsX = 10 + labelWidth;
-      secondsY = MESSAGE_AREA_Y + 70;
+// ---------------------------------------------------------------------------
+// Temporary message queue (UI task only)
+// ---------------------------------------------------------------------------
+
+static void displayTempMessage(const TempMessage &msg) {
+  drawMessage(msg.cmd.text1, msg.cmd.text2, msg.cmd.textColor, msg.cmd.bgColor);
+  currentMessage = msg;
+  tempMessageActive = true;
+  currentShownAt = halMillis();
+}
+
+static bool sameText(const UiCommand &a, const UiCommand &b) {
+  return strcmp(a.text1, b.text1) == 0 && strcmp(a.text2, b.text2) == 0;
+}
+
+static void removePending(uint8_t index) {
+  for (uint8_t i = index; i + 1 < pendingCount; i++) {
+    pendingMessages[i] = pendingMessages[i + 1];
+  }
+  pendingCount--;
+}
+
+// Insert behind every message of equal or higher priority.  When the
+// queue is full the lowest priority message gives way.
+static void enqueueTempMessage(const TempMessage &msg) {
+  if (pendingCount == UI_MESSAGE_QUEUE_SIZE) {
+    if (pendingMessages[pendingCount - 1].cmd.priority > msg.cmd.priority) return;
+    pendingCount--;
+  }
+  uint8_t pos = pendingCount;
+  while (pos > 0 && pendingMessages[pos - 1].cmd.priority < msg.cmd.priority) {
+    pendingMessages[pos] = pendingMessages[pos - 1];
+    pos--;
+  }
+  pendingMessages[pos] = msg;
+  pendingCount++;
+}
+
+// A temporary message is shown now if the message area is free or it
+// outranks the one on screen, otherwise it is queued.  A repeat of a
+// message already on screen or queued is coalesced with it instead of
+// being added again.  updateUI() takes care of expiry.
+static void handleTempMessage(const UiCommand &cmd) {
+  unsigned long now = halMillis();
+
+  if (tempMessageActive && sameText(currentMessage.cmd, cmd)) {
+    currentShownAt = now;
+    return;
+  }
+
+  TempMessage msg = {cmd, now};
+  for (uint8_t i = 0; i < pendingCount; i++) {
+    if (sameText(pendingMessages[i].cmd, cmd)) {
+      if (pendingMessages[i].cmd.priority > msg.cmd.priority) {
+        msg.cmd.priority = pendingMessages[i].cmd.priority;
+      }
+      removePending(i);
+      break;
+    }
+  }
+
+  if (!tempMessageActive || msg.cmd.priority > currentMessage.cmd.priority) {
+    displayTempMessage(msg);
+  } else {
+    enqueueTempMessage(msg);
+  }
+}
+
+// Persistent screens replace the base screen and are drawn unless a
+// temporary message currently owns the message area
+static void handleBaseScreen(const UiCommand &cmd) {
+  baseScreen = cmd;
+  if (!tempMessageActive) {
+    drawBaseScreen(cmd);
+  }
+}
+
+// Execute one queued command.  Called by the UI task, or directly by
+// postUiCommand() before the tasks are started.
+void renderUiCommand(const UiCommand &cmd) {
+  switch (cmd.type) {
+    case UI_LINK_STATE:
+      uiWifiConnected = cmd.wifiConnected;
+      uiAuthenticated = cmd.authenticated;
+      copyQueueText(uiResourceName, sizeof(uiResourceName), cmd.text1);
+      drawStatusBar();
+      break;
+    case UI_STATUS_BAR:
+      drawStatusBar();
+      break;
+    case UI_TEMP_MESSAGE:
+      handleTempMessage(cmd);
+      break;
+    case UI_CLEAR_TEMP:
+      pendingCount = 0;
+      tempMessageActive = false;
+      break;
+    default:
+      handleBaseScreen(cmd);
+      break;
+  }
+}
+
+// Advance the temporary message queue.  Called from the UI task; never
+// blocks.
+void updateUI() {
+  if (!tempMessageActive) return;
+  unsigned long now = halMillis();
+
+  unsigned long shown = now - currentShownAt;
+  if (shown < TEMP_MESSAGE_DURATION_MS && !(pendingCount > 0 && shown >= TEMP_MESSAGE_MIN_MS)) {
+    return;
+  }
+
+  // Drop queued messages that are too old to still be relevant
+  for (uint8_t i = 0; i < pendingCount;) {
+    if (now - pendingMessages[i].postedAt > TEMP_MESSAGE_MAX_AGE_MS) {
+      removePending(i);
+    } else {
+      i++;
     }
-    // Clear precisely the previous seconds width (with a small padding)
-    int16_t oldW = tft.textWidth(lastSeconds);
-    int16_t newW = tft.textWidth(seconds);
-    int16_t clearW = (oldW > newW ? oldW : newW) + 6;
-    tft.fillRect(secondsX, secondsY, clearW, 16, COLOR_BG);
+  }
 
-    // Redraw the new seconds string
-    tft.setCursor(secondsX, secondsY);
-    tft.print(seconds);
-    lastSeconds = seconds;
+  if (pendingCount > 0) {
+    TempMessage next = pendingMessages[0];
+    removePending(0);
+    displayTempMessage(next);
+  } else {
+    // Restore the screen underneath in full
+    tempMessageActive = false;
+    UiCommand restore = baseScreen;
+    restore.initialDraw = true;
+    drawBaseScreen(restore);
   }
 }
+
+// ---------------------------------------------------------------------------
+// Public interface (any task)
+// ---------------------------------------------------------------------------
+
+static UiCommand makeUiCommand(UiCommandType type, const char *text1 = "", const char *text2 = "") {
+  UiCommand cmd = {};
+  cmd.type = type;
+  copyQueueText(cmd.text1, sizeof(cmd.text1), text1);
+  copyQueueText(cmd.text2, sizeof(cmd.text2), text2);
+  return cmd;
+}
+
+// Size of text as drawn in one of the UI fonts (2 or 4), from the
+// glyph tables; no display library call
+void getTextDimensions(const char *text, uint8_t font, uint16_t &width, uint16_t &height) {
+  width  = textPixelWidth(text, font);
+  height = fontPixelHeight(font);
+}
+
+// Update the connection indicators and device name
+void setUiLinkState(bool wifiConnected, bool authenticated, const char *resourceName) {
+  UiCommand cmd = makeUiCommand(UI_LINK_STATE, resourceName);
+  cmd.wifiConnected = wifiConnected;
+  cmd.authenticated = authenticated;
+  postUiCommand(cmd);
+}
+
+// Redraw both status bars
+void showStatusBar() {
+  postUiCommand(makeUiCommand(UI_STATUS_BAR));
+}
+
+// Display a multi‑line message in the main message area between status bars
+void showMessage(const char *line1, const char *line2, uint16_t textColor, uint16_t bgColor) {
+  UiCommand cmd = makeUiCommand(UI_MESSAGE, line1, line2);
+  cmd.textColor = textColor;
+  cmd.bgColor   = bgColor;
+  postUiCommand(cmd);
+}
+
+// Display a temporary message without blocking; it clears by itself
+void showTempMessage(const char *line1, const char *line2, uint16_t textColor, uint16_t bgColor, uint8_t priority) {
+  UiCommand cmd = makeUiCommand(UI_TEMP_MESSAGE, line1, line2);
+  cmd.textColor = textColor;
+  cmd.bgColor   = bgColor;
+  cmd.priority  = priority;
+  postUiCommand(cmd);
+}
+
+// Discard the temporary message on screen and everything queued, e.g.
+// when access is granted and the grant display must take over.  The
+// caller is responsible for drawing the new screen.
+void clearTempMessages() {
+  postUiCommand(makeUiCommand(UI_CLEAR_TEMP));
+}
+
+// Show boot-time messages with simpler formatting
+void showBootMessage(const char *message, const char *detail, uint16_t textColor) {
+  UiCommand cmd = makeUiCommand(UI_BOOT, message, detail);
+  cmd.textColor = textColor;
+  postUiCommand(cmd);
+}
+
+// Show the idle screen when device is ready
+void showIdleScreen() {
+  postUiCommand(makeUiCommand(UI_IDLE));
+}
+
+// Show runtime display
+void showRuntimeDisplay(const char *userName, const char *runtime, bool initialDraw) {
+  UiCommand cmd = makeUiCommand(UI_RUNTIME, userName, runtime);
+  cmd.initialDraw = initialDraw;
+  postUiCommand(cmd);
+}
+
+// Reset runtime display state for new sessions
+void resetRuntimeDisplay() {
+  // This will be used in main.cpp to reset the firstDraw flag
+}
+
+// Show a door countdown screen with efficient time-only updates
+void showDoorCountdown(const char *header, const char *seconds, bool initialDraw) {
+  UiCommand cmd = makeUiCommand(UI_DOOR_COUNTDOWN, header, seconds);
+  cmd.initialDraw = initialDraw;
+  postUiCommand(cmd);
+}
@@ -1,225 +1,759 @@
 // WebSocket management functions for MakerPass firmware
-// This module handles WebSocket connection and message processing
+// This module handles WebSocket connection and message processing.
+// One connection carries the traffic of every resource the controller
+// serves: messages about a resource name it by resource_id, and a
+// message without one is about the first resource.
 
 #include "websocket_manager.h"
 #include "config.h"
 #include "constants.h"
 #include "ui_manager.h"
 #include "session_manager.h"
-#include <WiFiClientSecure.h>
+#include "grant_cache.h"
+#include "allowlist.h"
+#include "message_types.h"
+#include "json_arena.h"
+#include "frame_builder.h"
+#include "telemetry.h"
+#include "boot_manager.h"
+#include "msgpack_codec.h"
+#include "wire_schema.h"
+#include "hal.h"
+#include "tls_transport.h"
+#include "logger.h"
 #include <time.h>
 
-extern WebSocketsClient webSocket;
+extern ServerSocket webSocket;
+extern bool wifiConnected;
 extern bool wsConnected;
 extern bool authenticated;
-extern bool resourceEnabled;
-extern bool requireCardPresent;
-extern String resourceName;
-extern unsigned long lastPongTime;
+extern DisplayText resourceName;
+
+// Per-resource settings from auth_success
+static bool resourceEnabled[MAX_RESOURCES];
+static bool requireCardPresent[MAX_RESOURCES];
+
+// Inbound messages are parsed into this document, whose memory comes
+// from a static arena reset for every frame
+static JsonArena inboundArena;
+static JsonDocument inboundDoc(&inboundArena);
+
+// halMicros() when the frame being processed arrived
+static uint32_t inboundReceivedUs = 0;
+
+// Set once initWebSocket() has configured the client
+static bool webSocketStarted = false;
+
+// Fires when the server has been silent for PONG_TIMEOUT_MS; every
+// inbound frame pushes it back (see serverActive())
+static void serverActive();
+static void checkServerSilence(void *);
+static Timer silenceTimer = {checkServerSilence};
+
+// Closes the socket after an error frame, outside the library's
+// receive callback
+static void closeSocket(void *);
+static Timer closeTimer = {closeSocket};
+
+// True once the server has accepted MessagePack for this connection
+static bool binaryProtocol = false;
+
+// Encoding buffer for outbound documents, binary or JSON, with the
+// WebSocket header space in front (see sendFrame())
+static const size_t WIRE_MAX_BINARY = 8192;
+static uint8_t binaryOut[WEBSOCKETS_MAX_HEADER_SIZE + WIRE_MAX_BINARY];
+
+// Reconnect policy.  The library's own reconnect timer is parked and
+// webSocket.loop() is not called while waiting, so the only connect
+// attempts are the ones startConnectAttempt() makes: it connects once
+// (TCP and TLS handshake, synchronously inside ServerSocket::open())
+// and then keeps polling until the upgrade completes or
+// WS_CONNECT_TIMEOUT_MS passes.
+static const unsigned long LIBRARY_RECONNECT_PARKED = 0xFFFFFFFFUL;
+static void startConnectAttempt(void *);
+static void connectAttemptFailed(const char *reason);
+static void connectAttemptTimedOut(void *);
+static Timer reconnectTimer = {startConnectAttempt};
+static Timer attemptTimer   = {connectAttemptTimedOut};
+static bool socketOpen = false;          // upgraded and not yet closed
+static bool attemptInFlight = false;
+static uint8_t connectFailures = 0;      // since the last stable connection
+static unsigned long retryAfterMs = 0;   // server hint for the next wait
+static bool socketAuthenticated = false; // auth_success on this socket
+static unsigned long authenticatedAtMs = 0;
+
+// Connection timing
+static uint32_t attemptStartUs = 0;
+static uint32_t handshakeUs = 0;
+static bool attemptPending = false;
+
+// Index of the resource a message is about: the one its resource_id
+// names, or the first when it names none.  False for an id that is not
+// ours.
+bool resourceIndexFor(JsonDocument &doc, uint8_t &index) {
+  const char* id = doc["resource_id"] | "";
+  if (id[0] == '\0') {
+    index = 0;
+    return true;
+  }
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    if (strcmp(RESOURCES[i].id, id) == 0) {
+      index = i;
+      return true;
+    }
+  }
+  LOG_W(WS, "Message for unknown resource %s", id);
+  return false;
+}
+
+// Start an access command about the card named in the message.
+// Servers that echo rfid_code are taken at their word; otherwise the
+// access task applies it to the last card scanned at the resource.
+// The code is a hex string in JSON and a plain integer in the binary
+// encoding.  False if the message is for a resource we do not serve.
+static bool accessCommandFor(AccessCommandType type, JsonDocument &doc, AccessCommand &cmd) {
+  cmd = {};
+  cmd.type = type;
+  if (!resourceIndexFor(doc, cmd.resource)) return false;
+  JsonVariant code = doc["rfid_code"];
+  if (code.is<uint32_t>()) {
+    cmd.codeKnown = true;
+    cmd.code = code.as<uint32_t>();
+  } else {
+    const char* hex = code | "";
+    if (hex[0] != '\0') {
+      cmd.codeKnown = true;
+      cmd.code = strtoul(hex, nullptr, 16);
+    }
+  }
+  return true;
+}
+
+// A name or reason from the message: the first of key and alt that is
+// a non-empty string, else fallback.  A field that is missing, null,
+// empty or not a string never reaches the access task as a blank.
+static const char *textField(JsonDocument &doc, const char *key, const char *alt, const char *fallback) {
+  const char *text = doc[key] | "";
+  if (text[0] == '\0') text = doc[alt] | "";
+  return text[0] != '\0' ? text : fallback;
+}
+
+// Time to wait before the next connect attempt: a server retry_after
+// hint spread over [hint, 1.5 * hint], otherwise full jitter over the
+// exponential backoff window.  draw is a uniform random number; it
+// spreads devices that failed together so that they do not retry
+// together.
+unsigned long reconnectBackoffMs(uint8_t failures, unsigned long hintMs, uint32_t draw) {
+  if (hintMs > 0) return hintMs + draw % (hintMs / 2 + 1);
+  unsigned long windowMs = WS_BACKOFF_MAX_MS;
+  if (failures < 16 && (WS_BACKOFF_BASE_MS << failures) < WS_BACKOFF_MAX_MS) {
+    windowMs = WS_BACKOFF_BASE_MS << failures;
+  }
+  return draw % (windowMs + 1);
+}
+
+// The next wait, drawn from the hardware RNG.  A retry_after hint
+// applies to one attempt only.
+static unsigned long reconnectDelayMs() {
+  unsigned long delayMs = reconnectBackoffMs(connectFailures, retryAfterMs, halRandom());
+  retryAfterMs = 0;
+  return delayMs;
+}
+
+static void scheduleReconnect() {
+  unsigned long delayMs = reconnectDelayMs();
+  LOG_I(WS, "Reconnecting in %lu ms after %u failures", delayMs, connectFailures);
+  networkTimers.schedule(reconnectTimer, delayMs);
+}
+
+static void startConnectAttempt(void *) {
+  // Draw a new wait without counting a failure; after an outage the
+  // fleet's attempts stay spread over the window
+  if (!wifiConnected) {
+    networkTimers.schedule(reconnectTimer, reconnectDelayMs());
+    return;
+  }
+  attemptInFlight = true;
+  attemptPending  = true;
+  attemptStartUs  = halMicros();
+  handshakeUs     = 0;
+  networkTimers.schedule(attemptTimer, WS_CONNECT_TIMEOUT_MS);
+  bool open = webSocket.open();
+  handshakeUs = halMicros() - attemptStartUs;
+  // Fail a refused or failed TCP/TLS connect now rather than wait out
+  // WS_CONNECT_TIMEOUT_MS
+  if (!open) {
+    networkTimers.cancel(attemptTimer);
+    connectAttemptFailed("TCP/TLS connect failed");
+    return;
+  }
+  const TlsHandshake &tls = lastTlsHandshake();
+  recordLatency(tls.resumed ? LAT_TLS_RESUMED : LAT_TLS_FULL, tls.us);
+}
+
+static void connectAttemptFailed(const char *reason) {
+  attemptInFlight = false;
+  attemptPending  = false;
+  webSocket.disconnect();
+  if (connectFailures < UINT8_MAX) connectFailures++;
+  LOG_W(WS, "Connect attempt failed: %s", reason);
+  scheduleReconnect();
+}
+
+// The server never completed the upgrade (e.g. it answered 503 while
+// restarting)
+static void connectAttemptTimedOut(void *) {
+  if (socketOpen) return;
+  connectAttemptFailed("no upgrade");
+}
+
+// Switch outbound frames between JSON and MessagePack
+static void setBinaryProtocol(bool binary) {
+  binaryProtocol = binary;
+  setFrameEncoding(binary);
+}
+
+// Tell the access and UI tasks about a change in connectivity or in
+// the settings received with auth_success
+void publishLinkState() {
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    AccessCommand cmd = {};
+    cmd.type = ACCESS_LINK_STATE;
+    cmd.resource = i;
+    cmd.online = wifiConnected && authenticated;
+    cmd.presenceRequired = requireCardPresent[i];
+    postAccessCommand(cmd);
+  }
+  setUiLinkState(wifiConnected, authenticated, resourceName.c_str());
+}
+
+// auth_success: enabled and require_card_present at the top level
+// apply to every resource; a "resources" array of objects with
+// resource_id overrides them per resource.  Returns the number of
+// resources that are disabled.
+static uint8_t applyResourceSettings(JsonDocument &doc) {
+  bool enabled = doc["enabled"] | false;
+  bool presence = doc["require_card_present"] | false;
+  for (uint8_t i = 0; i < MAX_RESOURCES; i++) {
+    resourceEnabled[i] = enabled;
+    requireCardPresent[i] = presence;
+  }
+  for (JsonVariant entry : doc["resources"].as<JsonArray>()) {
+    const char* id = entry["resource_id"] | "";
+    for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+      if (strcmp(RESOURCES[i].id, id) != 0) continue;
+      resourceEnabled[i] = entry["enabled"] | enabled;
+      requireCardPresent[i] = entry["require_card_present"] | presence;
+    }
+  }
+  uint8_t disabled = 0;
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    if (!resourceEnabled[i]) disabled++;
+  }
+  return disabled;
+}
 
 // Initialise the WebSocket client, specify the server and path and
-// register the event callback.  A reconnect interval ensures that
-// lost connections are re‑established automatically.
+// register the event callback.  Connecting, and reconnecting after a
+// drop, follows the backoff policy above; even the first attempt waits
+// a random part of WS_BACKOFF_BASE_MS so that devices powered up
+// together do not connect together.  Called once WiFi is up so the
+// first attempt does not fail; the server is checked by its key pin,
+// not against the clock, so the handshake does not wait for SNTP.  The
+// library is begun without SSL: TLS, with session resumption, is done
+// by the transport ServerSocket::open() hands it (see tls_transport.cpp).
 void initWebSocket() {
-  // Synchronize time for SSL certificate validation
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-  Serial.print("[SSL] Synchronizing time");
-  time_t now = time(nullptr);
-  int attempts = 0;
-  while (now < 8 * 3600 * 2 && attempts < 15) {
-    delay(500);
-    Serial.print(".");
-    now = time(nullptr);
-    attempts++;
-  }
-  Serial.println("");
-  Serial.print("[SSL] Time synchronized: ");
-  Serial.println(ctime(&now));
-  
-  // Use SSL connection with proper certificate handling
-  webSocket.beginSSL(WS_HOST, WS_PORT, WS_PATH);
+  webSocket.begin(WS_HOST, WS_PORT, WS_PATH);
+  if (WS_PIN_SPKI[0] != '\0') LOG_I(WS, "Server key pinned");
+  webSocketStarted = true;
   
   webSocket.onEvent([](WStype_t type, uint8_t * payload, size_t length) {
     switch (type) {
-      case WStype_DISCONNECTED:
-        Serial.println(F("[WS] Disconnected"));
+      case WStype_DISCONNECTED: {
+        LOG_W(WS, "Disconnected");
+        // Not `authenticated`: a WiFi drop or an error frame clears that
+        // before the library reports the disconnect
+        bool stable = socketAuthenticated && halMillis() - authenticatedAtMs >= WS_BACKOFF_RESET_MS;
+        socketAuthenticated = false;
+        if (stable) {
+          connectFailures = 0;
+        } else if (connectFailures < UINT8_MAX) {
+          connectFailures++;
+        }
+        socketOpen = false;
+        attemptInFlight = false;
+        networkTimers.cancel(attemptTimer);
+        scheduleReconnect();
         wsConnected = false;
         authenticated = false;
-        resourceEnabled = false;
+        memset(resourceEnabled, 0, sizeof(resourceEnabled));
+        setBinaryProtocol(false);
+        publishLinkState();
         showMessage("Offline", "Master Key Only", COLOR_MSG_WARN);
         break;
+      }
       case WStype_CONNECTED: {
-        Serial.print(F("[WS] Connected to: "));
-        Serial.println((const char *)payload);
+        LOG_I(WS, "Connected to: %.*s", (int)length, (const char *)payload);
+        socketOpen = true;
+        attemptInFlight = false;
+        networkTimers.cancel(attemptTimer);
         wsConnected = true;
-        // Initialize activity timing (server sends pings, we track last activity)
-        extern unsigned long lastPongTime;
-        lastPongTime = millis();
+        markBootMilestone(BOOT_SERVER_CONNECTED);
+        if (attemptPending) {
+          uint32_t totalUs = halMicros() - attemptStartUs;
+          recordLatency(LAT_CONNECT, totalUs);
+          attemptPending = false;
+          LOG_I(WS, "Connected in %u ms, TCP+TLS %u ms (%s handshake)",
+                (unsigned)(totalUs / 1000), (unsigned)(handshakeUs / 1000),
+                lastTlsHandshake().resumed ? "resumed" : "full");
+        }
         // immediately send device_auth
         sendDeviceAuth();
         break;
       }
-      case WStype_TEXT: {
-        String msg = String((const char *)payload);
-        Serial.print(F("[WS] Text: "));
-        Serial.println(msg);
-        handleIncomingMessage(msg);
+      case WStype_TEXT:
+        recordFrameReceived(length);
+        handleIncomingMessage(payload, length);
         break;
-      }
       case WStype_BIN:
-        Serial.println(F("[WS] Binary message received, ignoring"));
+        recordFrameReceived(length);
+        handleIncomingBinary(payload, length);
         break;
       case WStype_PING:
         // reply with pong is handled automatically by the library
         break;
       case WStype_PONG:
-        // update last pong time for keep‑alive monitoring
-        Serial.println(F("[WS] Received WebSocket pong"));
-        lastPongTime = millis();
+        LOG_D(WS, "Received WebSocket pong");
+        serverActive();
         break;
       case WStype_ERROR:
-        Serial.println(F("[WS] Error"));
+        LOG_E(WS, "Error");
         break;
       default:
         break;
     }
   });
-  // Reconnect every 5 seconds if the connection drops
-  webSocket.setReconnectInterval(5000);
+  webSocket.setReconnectInterval(LIBRARY_RECONNECT_PARKED);
+  scheduleReconnect();
+}
+
+// Run the client while it is connected or connecting.  Between
+// attempts it is left alone so the library cannot reconnect on its
+// own.  Called from the network task.
+void pollWebSocket() {
+  if (!webSocketStarted) return;
+  if (socketOpen || attemptInFlight) {
+    webSocket.loop();
+  }
 }
 
 // Send a device_auth message when the WebSocket is connected.  The
 // server uses the resource_id and API key to authenticate the device
 // before allowing any RFID events to be processed.
 void sendDeviceAuth() {
-  JsonDocument doc;
-  doc["type"]        = "device_auth";
-  doc["resource_id"] = RESOURCE_ID;
-  doc["api_key"]     = API_KEY;
-  String json;
-  serializeJson(doc, json);
-  webSocket.sendTXT(json);
+  OutboundFrame frame;
+  if (buildDeviceAuthFrame(frame)) {
+    sendFrame(frame);
+  }
+}
+
+// Send a frame built by one of the frame builders.  The header space in
+// front of the payload lets the library frame and mask it in place.
+bool sendFrame(OutboundFrame &frame) {
+  recordFrameSent(frame.length);
+  if (frame.binary) {
+    return webSocket.sendBIN(frame.data, frame.length, true);
+  }
+  return webSocket.sendTXT(frame.data, frame.length, true);
+}
+
+// Send a message built as a JsonDocument in the negotiated encoding
+bool sendDocument(JsonDocument &doc) {
+  if (binaryProtocol) {
+    size_t length = encodeWireMessage(doc, binaryOut + WEBSOCKETS_MAX_HEADER_SIZE, WIRE_MAX_BINARY);
+    if (length > 0) {
+      recordFrameSent(length);
+      return webSocket.sendBIN(binaryOut, length, true);
+    }
+    LOG_W(WIRE, "Message too large for binary encoding, sending JSON");
+  }
+  size_t length = measureJson(doc);
+  if (length >= WIRE_MAX_BINARY) {
+    LOG_E(WIRE, "Message too large to send, %u bytes", (unsigned)length);
+    return false;
+  }
+  serializeJson(doc, (char *)binaryOut + WEBSOCKETS_MAX_HEADER_SIZE, WIRE_MAX_BINARY);
+  recordFrameSent(length);
+  return webSocket.sendTXT(binaryOut, length, true);
 }
 
 // Dispatch a raw JSON message received over the WebSocket.  The
-// payload is parsed into a JsonDocument and passed to
-// processJsonMessage() for further handling.  If parsing fails
-// the message is ignored.
-void handleIncomingMessage(const String &message) {
-  // Any message from server counts as activity
-  extern unsigned long lastPongTime;
-  lastPongTime = millis();
-  
-  JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, message);
+// payload is parsed into the reusable inbound document, which copies
+// its strings into the static arena rather than the heap, and passed
+// to processJsonMessage() for further handling.  If parsing fails,
+// including a frame too large for the arena (NoMemory), the message is
+// ignored.
+void handleIncomingMessage(uint8_t *payload, size_t length) {
+  serverActive();
+  inboundReceivedUs = halMicros();
+
+  inboundDoc.clear();
+  inboundArena.reset();
+  DeserializationError err = deserializeJson(inboundDoc, (char *)payload, length);
   if (err) {
-    Serial.print(F("[JSON] Deserialization failed: "));
-    Serial.println(err.c_str());
+    LOG_W(WIRE, "JSON deserialization failed: %s, %u bytes", err.c_str(), (unsigned)length);
     return;
   }
-  processJsonMessage(doc);
+  processJsonMessage(inboundDoc);
+  recordLatency(LAT_PARSE, halMicros() - inboundReceivedUs);
+}
+
+// Dispatch a MessagePack message.  It is decoded into the same document
+// with keys and types restored to their names, so processJsonMessage()
+// needs no binary-specific handling.
+void handleIncomingBinary(uint8_t *payload, size_t length) {
+  serverActive();
+  inboundReceivedUs = halMicros();
+
+  inboundDoc.clear();
+  inboundArena.reset();
+  if (!decodeWireMessage(payload, length, inboundDoc)) {
+    LOG_W(WIRE, "Malformed binary message, %u bytes", (unsigned)length);
+    return;
+  }
+  processJsonMessage(inboundDoc);
+  recordLatency(LAT_PARSE, halMicros() - inboundReceivedUs);
+}
+
+// The most of the inbound arena any message has needed, in bytes
+size_t inboundArenaPeak() {
+  return inboundArena.peak();
 }
 
 // Interpret and act upon a JSON message from the server.
 void processJsonMessage(JsonDocument &doc) {
   const char* type = doc["type"] | "";
-  if (strcmp(type, "auth_success") == 0) {
-    authenticated      = true;
-    resourceEnabled    = doc["enabled"] | false;
-    requireCardPresent = doc["require_card_present"] | false;
-    resourceName       = doc["resource_name"] | String(RESOURCE_ID);
-    Serial.println(F("[AUTH] Success"));
-    if (!resourceEnabled) {
-      showTempMessage("Resource Disabled", "", COLOR_MSG_WARN);
-    } else {
-      showIdleScreen(); // Show the new idle screen layout
+  // Any message may tell the device how long to stay away next time it
+  // loses the connection, e.g. ahead of a deploy or with an error
+  JsonVariant retryAfter = doc["retry_after"];
+  if (retryAfter.is<uint32_t>()) {
+    uint32_t seconds = retryAfter.as<uint32_t>();
+    retryAfterMs = seconds < WS_RETRY_AFTER_MAX_MS / 1000 ? seconds * 1000 : WS_RETRY_AFTER_MAX_MS;
+    LOG_I(WS, "Server asks for retry after %u s", (unsigned)seconds);
+  }
+  switch (lookupMessageType(type)) {
+    case MSG_AUTH_SUCCESS: {
+      authenticated      = true;
+      authenticatedAtMs  = halMillis();
+      socketAuthenticated = true;
+      uint8_t disabled   = applyResourceSettings(doc);
+      resourceName       = doc["resource_name"] | RESOURCES[0].id;
+      setBinaryProtocol(strcmp(doc["encoding"] | "", WIRE_ENCODING_MSGPACK) == 0);
+      LOG_I(WS, "Authenticated, encoding %s", binaryProtocol ? "msgpack" : "json");
+      markBootMilestone(BOOT_AUTHENTICATED);
+      publishLinkState();
+      networkTimers.schedule(silenceTimer, PONG_TIMEOUT_MS);
+      // Fetch allowlist changes since the version we last acknowledged
+      requestAllowlistSync();
+      // Replay events recorded while we were not connected
+      resetJournalUpload();
+      if (disabled == RESOURCE_COUNT) {
+        showTempMessage("Resource Disabled", "", COLOR_MSG_WARN, COLOR_BG, UI_PRIORITY_HIGH);
+      } else {
+        showIdleScreen(); // Show the new idle screen layout
+        if (disabled > 0) {
+          LOG_W(WS, "%u of %u resources disabled", disabled, RESOURCE_COUNT);
+        }
+      }
+      break;
     }
-  } else if (strcmp(type, "ping") == 0) {
-    // Server sent us a ping, respond with pong
-    Serial.println(F("[WS] Received ping from server, sending pong"));
-    JsonDocument pongDoc;
-    pongDoc["type"] = "pong";
-    String json;
-    serializeJson(pongDoc, json);
-    webSocket.sendTXT(json);
-    // Update our last activity time
-    lastPongTime = millis();
-  } else if (strcmp(type, "pong") == 0) {
-    // Server responded to our ping (though we don't send them anymore)
-    Serial.println(F("[WS] Received pong from server"));
-    lastPongTime = millis();
-  } else if (strcmp(type, "access_granted") == 0) {
-    String userName = doc["user_name"] | doc["user"] | "User";
-    if (strcmp(DEVICE_TYPE, "door") == 0) {
-      unlockRelay(userName);
-    } else {
-      // For machines, start a session without id
-      startSession("", userName);
+    case MSG_PING: {
+      // Server sent us a ping, respond with pong
+      LOG_D(WS, "Received ping from server, sending pong");
+      OutboundFrame frame;
+      buildPongFrame(frame);
+      sendFrame(frame);
+      break;
     }
-  } else if (strcmp(type, "access_denied") == 0) {
-    String reason = doc["reason"] | doc["message"] | "Denied";
-    Serial.print(F("[ACCESS] Denied: "));
-    Serial.println(reason);
-    showTempMessage("Access Denied", reason, COLOR_MSG_ERR);
-    // brief flash of the RFID LED to indicate denial
-    flashRFIDIndicator(200);
-  } else if (strcmp(type, "session_started") == 0) {
-    const char* sid = doc["session_id"] | "";
-    String userName = doc["user_name"] | doc["user"] | "User";
-    startSession(String(sid), userName);
-  } else if (strcmp(type, "session_ended") == 0) {
-    String userName = doc["user_name"] | doc["user"] | "";
-    endSession(userName);
-  } else if (strcmp(type, "error") == 0 || strcmp(type, "auth_error") == 0) {
-    String errorMsg = doc["message"] | "Unknown error";
-    Serial.print(F("[ERROR] "));
-    Serial.println(errorMsg);
-    authenticated = false;
-    wsConnected   = false;
-    showTempMessage("Error", errorMsg, COLOR_MSG_ERR);
-  } else {
-    Serial.print(F("[WARN] Unrecognised message type: "));
-    Serial.println(type);
+    case MSG_PONG:
+      // Server responded to our ping (though we don't send them anymore)
+      LOG_D(WS, "Received pong from server");
+      break;
+    case MSG_ACCESS_GRANTED: {
+      latencyScanAnswered(inboundReceivedUs);
+      AccessCommand cmd;
+      if (!accessCommandFor(ACCESS_GRANT, doc, cmd)) break;
+      copyQueueText(cmd.userName, sizeof(cmd.userName), textField(doc, "user_name", "user", "User"));
+      cmd.ttlSeconds = doc["cache_ttl"] | 0U;
+      postAccessCommand(cmd);
+      break;
+    }
+    case MSG_ACCESS_DENIED: {
+      latencyScanAnswered(inboundReceivedUs);
+      AccessCommand cmd;
+      if (!accessCommandFor(ACCESS_DENIED, doc, cmd)) break;
+      copyQueueText(cmd.text, sizeof(cmd.text), textField(doc, "reason", "message", "Denied"));
+      postAccessCommand(cmd);
+      break;
+    }
+    case MSG_SESSION_STARTED: {
+      latencyScanAnswered(inboundReceivedUs);
+      AccessCommand cmd;
+      if (!accessCommandFor(ACCESS_SESSION_STARTED, doc, cmd)) break;
+      copyQueueText(cmd.sessionId, sizeof(cmd.sessionId), doc["session_id"] | "");
+      copyQueueText(cmd.userName, sizeof(cmd.userName), textField(doc, "user_name", "user", "User"));
+      cmd.ttlSeconds = doc["cache_ttl"] | 0U;
+      postAccessCommand(cmd);
+      break;
+    }
+    case MSG_SESSION_ENDED: {
+      AccessCommand cmd;
+      if (!accessCommandFor(ACCESS_SESSION_ENDED, doc, cmd)) break;
+      copyQueueText(cmd.sessionId, sizeof(cmd.sessionId), doc["session_id"] | "");
+      copyQueueText(cmd.userName, sizeof(cmd.userName), textField(doc, "user_name", "user", ""));
+      postAccessCommand(cmd);
+      break;
+    }
+    case MSG_CACHE_REVOKE: {
+      AccessCommand cmd = {};
+      if (doc["all"] | false) {
+        cmd.type = ACCESS_CACHE_CLEAR;
+        postAccessCommand(cmd);
+        LOG_I(CACHE, "All grants revoked");
+      } else if (accessCommandFor(ACCESS_CACHE_REVOKE, doc, cmd)) {
+        if (cmd.codeKnown) postAccessCommand(cmd);
+        char codeStr[9] = {};
+        encodeHex32(cmd.code, codeStr);
+        LOG_I(CACHE, "Revoked: %s", codeStr);
+      }
+      break;
+    }
+    case MSG_ALLOWLIST_FULL:
+      handleAllowlistFull(doc);
+      break;
+    case MSG_ALLOWLIST_DELTA:
+      handleAllowlistDelta(doc);
+      break;
+    case MSG_EVENT_ACK:
+      handleEventAck(doc);
+      break;
+    case MSG_CACHE_STATS:
+      sendCacheStats();
+      break;
+    case MSG_ERROR:
+    case MSG_AUTH_ERROR: {
+      // Close the connection rather than only marking it down: an open
+      // socket with wsConnected cleared is never timed out or retried.
+      // The disconnect handler publishes the link state and reconnects
+      // with backoff (or after retry_after).
+      const char* errorMsg = textField(doc, "message", "error", "Unknown error");
+      LOG_E(WS, "Server error: %s", errorMsg);
+      networkTimers.schedule(closeTimer, 0);
+      showTempMessage("Error", errorMsg, COLOR_MSG_ERR, COLOR_BG, UI_PRIORITY_HIGH);
+      break;
+    }
+    case MSG_UNKNOWN:
+    default:
+      LOG_W(WS, "Unrecognised message type: %s", type);
+      break;
   }
 }
 
-// Handle WebSocket keep-alive - Server initiates pings, we just monitor timeout
-void handleWebSocketKeepAlive() {
-  extern bool wsConnected, authenticated;
-  extern unsigned long lastPongTime;
-  
-  if (wsConnected && authenticated) {
-    unsigned long now = millis();
-    // Server sends pings every 5 minutes, we have 15-minute timeout
-    // We only need to check if we haven't heard from server in too long
-    if (now - lastPongTime > PONG_TIMEOUT_MS) {
-      Serial.print(F("[WS] Server timeout, closing socket. Last activity was "));
-      Serial.print((now - lastPongTime) / 1000);
-      Serial.println(F(" seconds ago"));
-      webSocket.disconnect();
+// Any frame from the server, or a pong, counts as activity and
+// restarts the silence timer.  Before auth_success there is nothing to
+// watch: the connect attempt has its own timeout.
+static void serverActive() {
+  if (authenticated) networkTimers.schedule(silenceTimer, PONG_TIMEOUT_MS);
+}
+
+// Handle WebSocket keep-alive - Server initiates pings every 5 minutes,
+// we close the socket after PONG_TIMEOUT_MS without a frame
+static void checkServerSilence(void *) {
+  if (!wsConnected || !authenticated) return;
+  LOG_W(WS, "Server timeout, closing socket. No activity for %lu seconds", PONG_TIMEOUT_MS / 1000);
+  webSocket.disconnect();
+}
+
+static void closeSocket(void *) {
+  if (socketOpen) webSocket.disconnect();
+}
+
+// Carry out a request queued by the access task.  The access task
+// journals what it decides while offline, but a request posted just
+// before the link fell arrives here with nowhere to go: scans and
+// session ends are journaled in its place, and presence heartbeats,
+// which mean nothing once the link is down, are dropped.
+void processNetRequest(const NetRequest &req) {
+  if (!wsConnected || !authenticated) {
+    if (req.type == NET_RFID_SCAN) {
+      // Unanswered, the scan was refused unless the cache admitted it
+      journalUnsentEvent(req.cacheGrant ? JOURNAL_CACHE_GRANT : JOURNAL_OFFLINE_DENY,
+                         req.resource, req.code);
+    } else if (req.type == NET_SESSION_END) {
+      journalUnsentEvent(JOURNAL_SESSION_END, req.resource, req.code, req.data, req.sessionId);
     }
+    return;
+  }
+  switch (req.type) {
+    case NET_RFID_SCAN:
+      recordLatency(LAT_QUEUE, halMicros() - req.postedUs);
+      sendRFIDScan(req.resource, req.code);
+      break;
+    case NET_SESSION_END:
+      if (req.sessionId[0] != '\0') {
+        sendSessionEnd(req.resource, req.sessionId);
+        LOG_I(SESSION, "Sent session end");
+      }
+      break;
+    case NET_CARD_PRESENT:
+      if (req.sessionId[0] != '\0') {
+        sendCardPresent(req.resource, req.sessionId);
+      }
+      break;
   }
 }
 
 // Send RFID scan to server
-void sendRFIDScan(const String &codeStr) {
-  JsonDocument doc;
-  doc["type"]        = "rfid_scan";
-  doc["resource_id"] = RESOURCE_ID;
-  doc["rfid_code"]   = codeStr;
-  String json;
-  serializeJson(doc, json);
-  webSocket.sendTXT(json);
-  Serial.println(F("[RFID] Sent scan to server"));
+void sendRFIDScan(uint8_t resource, uint32_t code) {
+  OutboundFrame frame;
+  uint32_t startUs = halMicros();
+  if (!buildRFIDScanFrame(frame, resource, code)) return;
+  uint32_t builtUs = halMicros();
+  recordLatency(LAT_BUILD, builtUs - startUs);
+  bool sent = sendFrame(frame);
+  recordLatency(LAT_SEND, halMicros() - builtUs);
+  if (sent) {
+    latencyScanSent();
+    LOG_D(RFID, "Sent scan to server");
+  }
 }
 
 // Send session end to server
-void sendSessionEnd(const String &sessionId) {
+void sendSessionEnd(uint8_t resource, const char* sessionId) {
+  OutboundFrame frame;
+  if (buildSessionEndFrame(frame, resource, sessionId)) {
+    sendFrame(frame);
+  } else {
+    LOG_E(SESSION, "Session id too long for frame");
+  }
+}
+
+// Presence heartbeat for a require_card_present session
+void sendCardPresent(uint8_t resource, const char* sessionId) {
+  OutboundFrame frame;
+  if (buildCardPresentFrame(frame, resource, sessionId)) {
+    sendFrame(frame);
+  }
+}
+
+// Report grant cache counters in response to a cache_stats request
+void sendCacheStats() {
+  const GrantCacheStats &stats = getGrantCacheStats();
   JsonDocument doc;
-  doc["type"]        = "session_end";
-  doc["resource_id"] = RESOURCE_ID;
-  doc["session_id"]  = sessionId;
-  String json;
-  serializeJson(doc, json);
-  webSocket.sendTXT(json);
+  doc["type"]        = "cache_stats";
+  doc["resource_id"] = RESOURCES[0].id;
+  doc["entries"]     = grantCacheCount();
+  doc["hits"]        = stats.hits;
+  doc["misses"]      = stats.misses;
+  doc["evictions"]   = stats.evictions;
+  doc["expirations"] = stats.expirations;
+  doc["revocations"] = stats.revocations;
+  sendDocument(doc);
+}
+
+// Ask the server for a resource's allowlist changes since sinceVersion
+// (0 requests the full list).  Full lists are sent in chunks of at most
+// `chunk` codes.
+void sendAllowlistSync(uint8_t resource, uint32_t sinceVersion) {
+  JsonDocument doc;
+  doc["type"]        = "allowlist_sync";
+  doc["resource_id"] = RESOURCES[resource].id;
+  doc["version"]     = sinceVersion;
+  doc["chunk"]       = ALLOWLIST_SYNC_CHUNK;
+  sendDocument(doc);
+}
+
+// Confirm that an allowlist version has been applied and persisted
+void sendAllowlistAck(uint8_t resource, uint32_t version) {
+  JsonDocument doc;
+  doc["type"]        = "allowlist_ack";
+  doc["resource_id"] = RESOURCES[resource].id;
+  doc["version"]     = version;
+  sendDocument(doc);
+}
+
+// Report the latency histograms.  Each stage with samples is sent as
+// [count, sum_us, max_us, bucket0, bucket1, ...] with trailing empty
+// buckets left out; bucket i counts samples in [2^i, 2^(i+1)) us.
+void sendTelemetry() {
+  JsonDocument doc;
+  doc["type"]        = "telemetry";
+  doc["resource_id"] = RESOURCES[0].id;
+  doc["uptime_s"]    = halMillis() / 1000;
+  const PresenceStats &presence = getPresenceStats();
+  JsonArray presenceCounts = doc["presence"].to<JsonArray>();
+  presenceCounts.add(presence.suppressed);
+  presenceCounts.add(presence.dropouts);
+  presenceCounts.add(presence.heartbeats);
+  LogStats logStats = getLogStats();
+  JsonArray logCounts = doc["log"].to<JsonArray>();
+  logCounts.add(logStats.written);
+  logCounts.add(logStats.dropped);
+  logCounts.add(logStats.truncated);
+  HeapStats heap = getHeapStats();
+  JsonArray heapState = doc["heap"].to<JsonArray>();
+  heapState.add(heap.freeBytes);
+  heapState.add(heap.largestBlock);
+  heapState.add(heap.minFreeBytes);
+  doc["json_arena"] = inboundArenaPeak();
+  const TrafficStats &traffic = getTrafficStats();
+  JsonArray trafficCounts = doc["traffic"].to<JsonArray>();
+  trafficCounts.add(traffic.framesOut);
+  trafficCounts.add(traffic.bytesOut);
+  trafficCounts.add(traffic.framesIn);
+  trafficCounts.add(traffic.bytesIn);
+  JsonObject stages  = doc["stages"].to<JsonObject>();
+  for (uint8_t i = 0; i < LAT_STAGE_COUNT; i++) {
+    LatencyStage stage = (LatencyStage)i;
+    const LatencyHistogram &h = getLatencyHistogram(stage);
+    if (h.count == 0) continue;
+    JsonArray values = stages[latencyStageName(stage)].to<JsonArray>();
+    values.add(h.count);
+    values.add(h.sumUs);
+    values.add(h.maxUs);
+    uint8_t used = LATENCY_BUCKETS;
+    while (used > 0 && h.buckets[used - 1] == 0) used--;
+    for (uint8_t b = 0; b < used; b++) {
+      values.add(h.buckets[b]);
+    }
+  }
+  sendDocument(doc);
+}
+
+// Upload journal records, all of one resource.  Each event is [seq,
+// type, time, rfid_code, data], with the session id appended when there
+// is one.  The server answers with event_ack carrying the highest seq
+// it has stored.
+bool sendEventBatch(uint32_t journalId, const JournalRecord *records, uint8_t count) {
+  uint8_t resource = records[0].resource < RESOURCE_COUNT ? records[0].resource : 0;
+  JsonDocument doc;
+  doc["type"]        = "event_batch";
+  doc["resource_id"] = RESOURCES[resource].id;
+  doc["journal"]     = journalId;
+  JsonArray events   = doc["events"].to<JsonArray>();
+  for (uint8_t i = 0; i < count; i++) {
+    const JournalRecord &rec = records[i];
+    char code[9];
+    encodeHex32(rec.code, code);
+    code[8] = '\0';
+    JsonArray event = events.add<JsonArray>();
+    event.add(rec.seq);
+    event.add(journalEventName(rec.type));
+    event.add(rec.time);
+    event.add(code);
+    event.add(rec.data);
+    if (rec.sessionId[0] != '\0') event.add(rec.sessionId);
+  }
+  LOG_I(JOURNAL, "Uploading %u events", count);
+  return sendDocument(doc);
 }
@@ -0,0 +1,230 @@
+// Wiegand reader functions for MakerPass firmware
+// This module replaces the polled Wiegand library.  Falling edges on D0
+// and D1 are timestamped in the interrupt handlers and pushed onto a
+// lock-free queue; the access task drains it in pollWiegand(), frames
+// the bits by the silence after the last one, and checks the length
+// and parity of the result before anything acts on it.  A read damaged
+// by noise or a missed edge is rejected here instead of reaching the
+// server as a wrong card number.
+//
+// The framing code only sees (bit, timestamp) pairs, so it does not
+// depend on the pins and can be driven with synthetic pulse trains.
+// Each reader (one per resource) has its own queue and frame state.
+
+#include "wiegand_reader.h"
+#include "constants.h"
+#include "hal.h"
+#include "spsc_queue.h"
+#include "task_manager.h"
+#include "logger.h"
+
+struct WiegandEdge {
+  uint32_t us;
+  uint8_t bit;
+};
+
+struct WiegandReader {
+  // All handlers are attached from setup() and therefore run on the
+  // same core at the same interrupt level; they never nest, so the two
+  // of a reader are together its queue's single producer.  Each edge
+  // wakes the access task, which otherwise sleeps until its next
+  // deadline.
+  SpscQueue<WiegandEdge, WIEGAND_EDGE_QUEUE_DEPTH> edges;
+
+  // Frame being collected (access task)
+  uint64_t frame;
+  uint8_t frameBits;
+  uint32_t firstEdgeUs;
+  uint32_t lastEdgeUs;
+
+  // An edge that arrived after a gap long enough to end the previous
+  // frame; it starts the next one
+  WiegandEdge carried;
+  bool hasCarried;
+
+  WiegandStats stats;
+};
+
+static WiegandReader readers[MAX_RESOURCES];
+static uint8_t readerCount = 0;
+
+// Parity layout of each format.  Bit 0 (the first sent) is even parity
+// over bits 0..evenLast; the last bit is odd parity over oddFirst..end.
+struct WiegandLayout {
+  WiegandFormat format;
+  uint8_t bits;
+  uint8_t evenLast;
+  uint8_t oddFirst;
+  const char* name;
+};
+
+static const WiegandLayout LAYOUTS[] = {
+  {WIEGAND_H10301, 26, 12, 13, "H10301"},
+  {WIEGAND_H10306, 34, 16, 17, "H10306"},
+  {WIEGAND_H10304, 37, 18, 18, "H10304"},
+};
+
+static void IRAM_ATTR onData0(void *arg) {
+  WiegandEdge edge = {(uint32_t)halMicros(), 0};
+  ((WiegandReader *)arg)->edges.push(edge);
+  wakeAccessTaskFromISR();
+}
+
+static void IRAM_ATTR onData1(void *arg) {
+  WiegandEdge edge = {(uint32_t)halMicros(), 1};
+  ((WiegandReader *)arg)->edges.push(edge);
+  wakeAccessTaskFromISR();
+}
+
+// Attach the edge handlers of reader `index`.  The pins must already be
+// inputs with pull-ups; the lines idle high and each bit is a short low
+// pulse.
+void initWiegandReader(uint8_t index, uint8_t pinD0, uint8_t pinD1) {
+  if (index >= MAX_RESOURCES) return;
+  WiegandReader *reader = &readers[index];
+  halAttachFallingEdge(pinD0, onData0, reader);
+  halAttachFallingEdge(pinD1, onData1, reader);
+  if (index >= readerCount) readerCount = index + 1;
+}
+
+static const WiegandLayout *layoutFor(uint8_t bits) {
+  for (const WiegandLayout &layout : LAYOUTS) {
+    if (layout.bits == bits) return &layout;
+  }
+  return nullptr;
+}
+
+// Number of set bits among frame bits first..last, counted from the
+// first bit received
+static uint8_t onesIn(const WiegandReader &r, uint8_t first, uint8_t last) {
+  uint64_t mask = ((1ULL << (last - first + 1)) - 1) << (r.frameBits - 1 - last);
+  return __builtin_popcountll(r.frame & mask);
+}
+
+static bool parityValid(const WiegandReader &r, const WiegandLayout &layout) {
+  return (onesIn(r, 0, layout.evenLast) & 1) == 0 &&
+         (onesIn(r, layout.oddFirst, layout.bits - 1) & 1) == 1;
+}
+
+// Silence that ends the current frame.  A frame that is already a
+// complete, valid read ends after a few bit intervals; anything else
+// waits the full gap in case more bits are coming.
+static uint32_t frameGapUs(const WiegandReader &r) {
+  const WiegandLayout *layout = layoutFor(r.frameBits);
+  if (!layout || !parityValid(r, *layout)) return WIEGAND_MAX_GAP_US;
+  uint32_t gap = 4 * (r.lastEdgeUs - r.firstEdgeUs) / (r.frameBits - 1);
+  if (gap < WIEGAND_MIN_GAP_US) gap = WIEGAND_MIN_GAP_US;
+  if (gap > WIEGAND_MAX_GAP_US) gap = WIEGAND_MAX_GAP_US;
+  return gap;
+}
+
+static void addEdge(WiegandReader &r, const WiegandEdge &edge) {
+  if (r.frameBits == 0) r.firstEdgeUs = edge.us;
+  if (r.frameBits <= WIEGAND_MAX_BITS) {
+    r.frame = (r.frame << 1) | edge.bit;
+    r.frameBits++;
+  }
+  r.lastEdgeUs = edge.us;
+}
+
+// Validate the collected frame and clear it for the next one
+static bool closeFrame(WiegandReader &r, WiegandRead &read) {
+  const WiegandLayout *layout = layoutFor(r.frameBits);
+  bool ok = false;
+  if (!layout) {
+    r.stats.badLength++;
+    LOG_W(RFID, "Rejected read of %u bits: unknown format", r.frameBits);
+  } else if (!parityValid(r, *layout)) {
+    r.stats.parityErrors++;
+    LOG_W(RFID, "Rejected %u-bit read: parity error", r.frameBits);
+  } else {
+    uint64_t code = (r.frame >> 1) & ((1ULL << (r.frameBits - 2)) - 1);
+    if (code > UINT32_MAX) {
+      // Cutting it to 32 bits would give it another card's identity
+      r.stats.tooWide++;
+      LOG_E(RFID, "Rejected %u-bit read: card number wider than 32 bits", r.frameBits);
+    } else {
+      read.format = layout->format;
+      read.bits = r.frameBits;
+      read.code = code;
+      read.lastEdgeUs = r.lastEdgeUs;
+      r.stats.reads++;
+      ok = true;
+    }
+  }
+  r.frame = 0;
+  r.frameBits = 0;
+  return ok;
+}
+
+// Collect reader `index`'s queued edges and return its next complete
+// read, if any.  Called by the access task every iteration.
+bool pollWiegand(uint8_t index, WiegandRead &read) {
+  if (index >= readerCount) return false;
+  WiegandReader &r = readers[index];
+  WiegandEdge edge;
+  while (r.hasCarried || r.edges.pop(edge)) {
+    if (r.hasCarried) {
+      edge = r.carried;
+      r.hasCarried = false;
+    }
+    if (r.frameBits > 0) {
+      uint32_t sinceLast = edge.us - r.lastEdgeUs;
+      if (sinceLast < WIEGAND_GLITCH_US) {
+        r.stats.glitches++;
+        continue;
+      }
+      if (sinceLast >= frameGapUs(r)) {
+        r.carried = edge;
+        r.hasCarried = true;
+        if (closeFrame(r, read)) return true;
+        continue;
+      }
+    }
+    addEdge(r, edge);
+  }
+
+  // Read the clock only after draining, so no queued edge is newer
+  if (r.frameBits > 0 && halMicros() - r.lastEdgeUs >= frameGapUs(r)) {
+    return closeFrame(r, read);
+  }
+  return false;
+}
+
+// How long the access task may sleep before pollWiegand() has a frame
+// to close on any reader, capped at limitMs
+uint32_t wiegandMsUntilFrameEnd(uint32_t limitMs) {
+  uint32_t waitMs = limitMs;
+  for (uint8_t i = 0; i < readerCount; i++) {
+    const WiegandReader &r = readers[i];
+    if (r.hasCarried || r.edges.size() > 0) return 0;
+    if (r.frameBits == 0) continue;
+    uint32_t elapsedUs = (uint32_t)halMicros() - r.lastEdgeUs;
+    uint32_t gapUs = frameGapUs(r);
+    if (elapsedUs >= gapUs) return 0;
+    uint32_t untilEndMs = (gapUs - elapsedUs + 999) / 1000;
+    if (untilEndMs < waitMs) waitMs = untilEndMs;
+  }
+  return waitMs;
+}
+
+// The 32-bit card number used by the access path, the cache, the
+// allowlist, the journal and the server.  It is always the whole code:
+// 37-bit reads that do not fit are rejected when the frame closes.
+uint32_t wiegandCardNumber(const WiegandRead &read) {
+  return (uint32_t)read.code;
+}
+
+const char* wiegandFormatName(WiegandFormat format) {
+  for (const WiegandLayout &layout : LAYOUTS) {
+    if (layout.format == format) return layout.name;
+  }
+  return "unknown";
+}
+
+WiegandStats getWiegandStats(uint8_t index) {
+  if (index >= readerCount) return WiegandStats{};
+  WiegandStats snapshot = readers[index].stats;
+  snapshot.overruns = readers[index].edges.dropped();
+  return snapshot;
+}
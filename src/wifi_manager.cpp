@@ -1,73 +1,309 @@
 // WiFi management functions for MakerPass firmware
-// This module handles WiFi connection and reconnection logic
+// This module handles WiFi connection and reconnection logic.  The
+// access point last associated with (BSSID, channel, network) is kept
+// in NVS so that a reconnect, or the first connect after boot, can
+// skip the scan.  The address always comes from DHCP.
+// While connected on a weak signal the module scans in the background
+// and moves to a clearly stronger access point before the link drops.
+// Everything here runs in the network task.
 
 #include "wifi_manager.h"
 #include "pins.h"
 #include "constants.h"
 #include "config.h"
 #include "ui_manager.h"
+#include "websocket_manager.h"
+#include "task_manager.h"
+#include "telemetry.h"
+#include "hal.h"
+#include "logger.h"
+#include <Preferences.h>
 
 extern bool wifiConnected;
 extern bool authenticated;
 extern bool wsConnected;
-extern TFT_eSPI tft;
 
-// Attempt to connect to the configured WiFi network.  While connecting
-// the WiFi status LED blinks at ~1 Hz.  On success the LED remains
-// lit; on failure it is turned off.
-void connectToWiFi() {
+enum WiFiState : uint8_t {
+  WIFI_STATE_OFF,          // startWiFi() not called yet
+  WIFI_STATE_UP,
+  WIFI_STATE_CONNECTING,   // association attempt running
+  WIFI_STATE_SCANNING      // scanning for a network to reconnect to
+};
+
+// An access point to associate with
+struct WiFiTarget {
+  uint8_t network;         // index into WIFI_NETWORKS
+  uint8_t bssid[6];
+  int32_t channel;
+  int32_t rssi;
+};
+
+static WiFiState wifiState = WIFI_STATE_OFF;
+static WiFiTarget lastAp;
+static bool lastApValid = false;
+static uint8_t attempt = 0;           // attempts since the link was lost
+static uint8_t nextNetwork = 0;       // rotation when a scan finds nothing
+static bool roamScanning = false;
+static uint32_t reconnectStartUs = 0;
+static bool reconnectTimed = false;
+
+static Preferences wifiPrefs;
+
+static void attemptTimedOut(void *);
+static void roamCheck(void *);
+static Timer attemptTimer = {attemptTimedOut};
+static Timer roamTimer    = {roamCheck};
+
+static void loadLastAp() {
+  wifiPrefs.begin("wifi", true);
+  lastApValid = wifiPrefs.getBytes("bssid", lastAp.bssid, sizeof(lastAp.bssid)) == sizeof(lastAp.bssid);
+  lastAp.channel = wifiPrefs.getUInt("channel", 0);
+  lastAp.network = wifiPrefs.getUInt("network", 0);
+  wifiPrefs.end();
+  if (lastAp.channel == 0 || lastAp.network >= WIFI_NETWORK_COUNT) lastApValid = false;
+}
+
+// Remember the access point now in use; NVS is written only when it
+// changes
+static void saveLastAp(const WiFiTarget &ap) {
+  if (lastApValid && ap.network == lastAp.network && ap.channel == lastAp.channel &&
+      memcmp(ap.bssid, lastAp.bssid, sizeof(ap.bssid)) == 0) {
+    return;
+  }
+  lastAp = ap;
+  lastApValid = true;
+  wifiPrefs.begin("wifi", false);
+  wifiPrefs.putBytes("bssid", ap.bssid, sizeof(ap.bssid));
+  wifiPrefs.putUInt("channel", ap.channel);
+  wifiPrefs.putUInt("network", ap.network);
+  wifiPrefs.end();
+}
+
+static int8_t networkIndex(const String &ssid) {
+  for (uint8_t i = 0; i < WIFI_NETWORK_COUNT; i++) {
+    if (ssid == WIFI_NETWORKS[i].ssid) return i;
+  }
+  return -1;
+}
+
+// "AA:BB:CC:DD:EE:FF" into text[18]
+static const char *formatBssid(const uint8_t *bssid, char *text) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  for (uint8_t i = 0; i < 6; i++) {
+    text[i * 3]     = HEX_DIGITS[bssid[i] >> 4];
+    text[i * 3 + 1] = HEX_DIGITS[bssid[i] & 0xF];
+    text[i * 3 + 2] = i < 5 ? ':' : '\0';
+  }
+  return text;
+}
+
+static void connectTo(const WiFiTarget &ap, unsigned long timeoutMs) {
+  const WiFiNetwork &net = WIFI_NETWORKS[ap.network];
+  char bssid[18];
+  LOG_I(WIFI, "Joining %s via %s on channel %d", net.ssid, formatBssid(ap.bssid, bssid),
+        (int)ap.channel);
+  WiFi.begin(net.ssid, net.password, ap.channel, ap.bssid);
+  wifiState = WIFI_STATE_CONNECTING;
+  networkTimers.schedule(attemptTimer, timeoutMs);
+}
+
+// Let the driver find the network itself (full scan, any BSSID)
+static void connectToNetwork(uint8_t network) {
+  const WiFiNetwork &net = WIFI_NETWORKS[network];
+  LOG_I(WIFI, "Joining %s", net.ssid);
+  WiFi.begin(net.ssid, net.password);
+  wifiState = WIFI_STATE_CONNECTING;
+  networkTimers.schedule(attemptTimer, WIFI_ATTEMPT_TIMEOUT_MS);
+}
+
+// Rank scan results: usable signal first, then network preference,
+// then signal strength.  Returns false when no configured network was
+// seen.  minRssi and exclude narrow the choice for roaming.
+static bool bestTarget(int16_t found, WiFiTarget &best, int32_t minRssi, const uint8_t *exclude) {
+  bool have = false;
+  for (int16_t i = 0; i < found; i++) {
+    int8_t network = networkIndex(WiFi.SSID(i));
+    int32_t rssi = WiFi.RSSI(i);
+    const uint8_t *bssid = WiFi.BSSID(i);
+    if (network < 0 || rssi < minRssi || !bssid) continue;
+    if (exclude && memcmp(bssid, exclude, 6) == 0) continue;
+    if (have) {
+      bool usable = rssi >= WIFI_ROAM_RSSI_DBM;
+      bool bestUsable = best.rssi >= WIFI_ROAM_RSSI_DBM;
+      if (usable != bestUsable) {
+        if (!usable) continue;
+      } else if (network != best.network) {
+        if (network > best.network) continue;
+      } else if (rssi <= best.rssi) {
+        continue;
+      }
+    }
+    best.network = network;
+    memcpy(best.bssid, bssid, 6);
+    best.channel = WiFi.channel(i);
+    best.rssi = rssi;
+    have = true;
+  }
+  return have;
+}
+
+// Next step after the link is lost or an attempt fails: the cached
+// access point first, then scans
+static void nextAttempt() {
+  roamScanning = false;
+  if (attempt++ == 0 && lastApValid) {
+    connectTo(lastAp, WIFI_FAST_ATTEMPT_MS);
+    return;
+  }
+  WiFi.disconnect();
+  WiFi.scanNetworks(true);
+  wifiState = WIFI_STATE_SCANNING;
+  networkTimers.schedule(attemptTimer, WIFI_ATTEMPT_TIMEOUT_MS);
+}
+
+static void attemptTimedOut(void *) {
+  if (wifiState == WIFI_STATE_UP) return;
+  LOG_W(WIFI, "Attempt timed out");
+  if (wifiState == WIFI_STATE_SCANNING) WiFi.scanDelete();
+  nextAttempt();
+}
+
+// Start associating with the configured WiFi network.  Returns at
+// once; the WiFi driver connects in the background and
+// handleWiFiStatus() picks up the result.
+void startWiFi() {
+  WiFi.persistent(false);       // credentials live in config.h, not driver flash
   WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  WiFi.setAutoReconnect(false); // reconnects are driven from here
+  loadLastAp();
+  attempt = 0;
+  reconnectTimed = false;
+  if (lastApValid) {
+    nextAttempt();
+  } else {
+    attempt = 1;
+    connectToNetwork(0);
+  }
+}
 
-  showBootMessage("Connecting WiFi");
+static void onLinkUp() {
+  wifiConnected = true;
+  wifiState = WIFI_STATE_UP;
+  attempt = 0;
+  networkTimers.cancel(attemptTimer);
+  halDigitalWrite(PIN_LED_WIFI, HIGH);
 
-  unsigned long start = millis();
-  bool ledState = false;
-  while (WiFi.status() != WL_CONNECTED && (millis() - start < 20000)) {
-    // blink WiFi LED while trying to connect
-    digitalWrite(PIN_LED_WIFI, ledState);
-    ledState = !ledState;
-    delay(500);
+  WiFiTarget ap;
+  int8_t network = networkIndex(WiFi.SSID());
+  ap.network = network < 0 ? 0 : network;
+  memcpy(ap.bssid, WiFi.BSSID(), sizeof(ap.bssid));
+  ap.channel = WiFi.channel();
+  ap.rssi = WiFi.RSSI();
+  saveLastAp(ap);
+  networkTimers.schedule(roamTimer, WIFI_ROAM_CHECK_MS);
+
+  char bssid[18];
+  formatBssid(ap.bssid, bssid);
+  if (reconnectTimed) {
+    uint32_t elapsedUs = halMicros() - reconnectStartUs;
+    recordLatency(LAT_WIFI_RECONNECT, elapsedUs);
+    LOG_I(WIFI, "Connected to %s, channel %d, %d dBm, reconnected in %u ms", bssid,
+          (int)ap.channel, (int)ap.rssi, (unsigned)(elapsedUs / 1000));
+    reconnectTimed = false;
+  } else {
+    LOG_I(WIFI, "Connected to %s, channel %d, %d dBm", bssid, (int)ap.channel,
+          (int)ap.rssi);
   }
-  // ensure LED off during update
-  digitalWrite(PIN_LED_WIFI, LOW);
+  publishLinkState();
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    wifiConnected = true;
-    digitalWrite(PIN_LED_WIFI, HIGH);
-    showBootMessage("WiFi Connected", WiFi.localIP().toString());
+static void onLinkDown() {
+  wifiConnected = false;
+  authenticated = false;
+  wsConnected = false;
+  halDigitalWrite(PIN_LED_WIFI, LOW);
+  networkTimers.cancel(roamTimer);
+  publishLinkState();
+  showMessage("Offline", "Master Key Only", COLOR_MSG_WARN);
+  if (!reconnectTimed) {
+    reconnectStartUs = halMicros();
+    reconnectTimed = true;
+  }
+  // A roam already has its attempt running
+  if (wifiState == WIFI_STATE_UP) {
+    attempt = 0;
+    nextAttempt();
+  }
+}
+
+// Periodic signal check while connected
+static void roamCheck(void *) {
+  if (wifiState != WIFI_STATE_UP) return;
+  networkTimers.schedule(roamTimer, WIFI_ROAM_CHECK_MS);
+  if (!roamScanning && WiFi.RSSI() < WIFI_ROAM_RSSI_DBM) {
+    WiFi.scanNetworks(true);
+    roamScanning = true;
+  }
+}
+
+// Move to a clearly stronger access point found by a roaming scan
+static void finishRoamScan(int16_t found) {
+  roamScanning = false;
+  int32_t current = WiFi.RSSI();
+  WiFiTarget target;
+  bool move = found > 0 &&
+              bestTarget(found, target, current + WIFI_ROAM_HYSTERESIS_DB, WiFi.BSSID());
+  WiFi.scanDelete();
+  if (!move) return;
+  LOG_I(WIFI, "Roaming from %d dBm to %d dBm", (int)current, (int)target.rssi);
+  reconnectStartUs = halMicros();
+  reconnectTimed = true;
+  attempt = 1;
+  connectTo(target, WIFI_FAST_ATTEMPT_MS);
+}
+
+// Pick a network from a reconnect scan, or fall back to letting the
+// driver search for the configured networks in turn
+static void finishReconnectScan(int16_t found) {
+  WiFiTarget target;
+  bool have = found > 0 && bestTarget(found, target, INT32_MIN, nullptr);
+  WiFi.scanDelete();
+  if (have) {
+    connectTo(target, WIFI_ATTEMPT_TIMEOUT_MS);
   } else {
-    wifiConnected = false;
-    showBootMessage("WiFi Failed", "", COLOR_MSG_ERR);
+    connectToNetwork(nextNetwork);
+    nextNetwork = (nextNetwork + 1) % WIFI_NETWORK_COUNT;
   }
-  delay(1000);
 }
 
-// Check WiFi status and handle reconnection
+// Check WiFi status and drive reconnects and roaming
 void handleWiFiStatus() {
+  if (wifiState == WIFI_STATE_OFF) return;
+
+  if (wifiState == WIFI_STATE_SCANNING || roamScanning) {
+    int16_t found = WiFi.scanComplete();
+    if (found != WIFI_SCAN_RUNNING) {
+      if (wifiState == WIFI_STATE_SCANNING) {
+        finishReconnectScan(found);
+      } else {
+        finishRoamScan(found);
+      }
+    }
+    if (wifiState == WIFI_STATE_SCANNING) return;
+  }
+
   wl_status_t wifiStatus = WiFi.status();
   if (wifiStatus == WL_CONNECTED) {
-    if (!wifiConnected) {
-      wifiConnected = true;
-      digitalWrite(PIN_LED_WIFI, HIGH);
-      showStatusBar();
-    }
+    // A roam can complete between two polls without the drop being seen
+    if (!wifiConnected || wifiState != WIFI_STATE_UP) onLinkUp();
   } else {
     if (wifiConnected) {
-      wifiConnected = false;
-      authenticated = false;
-      wsConnected = false;
-      digitalWrite(PIN_LED_WIFI, LOW);
-      showStatusBar();
-      showMessage("Offline", "Master Key Only", COLOR_MSG_WARN);
-    }
-    // Attempt to reconnect WiFi periodically
-    static unsigned long lastWifiRetry = 0;
-    if (millis() - lastWifiRetry > 10000) {
-      Serial.println(F("[WiFi] Attempting reconnect"));
-      WiFi.disconnect();
-      WiFi.reconnect();
-      lastWifiRetry = millis();
+      onLinkDown();
+    } else if (wifiState == WIFI_STATE_CONNECTING &&
+               (wifiStatus == WL_CONNECT_FAILED || wifiStatus == WL_NO_SSID_AVAIL)) {
+      // The attempt has ended; no need to wait for its timeout
+      LOG_W(WIFI, "Attempt failed");
+      nextAttempt();
     }
   }
 }
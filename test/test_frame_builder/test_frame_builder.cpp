@@ -0,0 +1,154 @@
+// Frame builder tests for MakerPass host builds
+// These tests check that the template-built outbound frames are the
+// messages the JsonDocument code used to send: exact JSON text for the
+// fixed frames, escaping of session ids, the overflow guard, and in
+// the binary encoding the same fields once decoded.
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "constants.h"
+#include "frame_builder.h"
+#include "msgpack_codec.h"
+#include <string>
+
+// A JSON frame's payload as a C string
+static const char *text(OutboundFrame &frame) {
+  static char buffer[FRAME_MAX_PAYLOAD + 1];
+  memcpy(buffer, frame.payload(), frame.length);
+  buffer[frame.length] = '\0';
+  return buffer;
+}
+
+// Parse a built frame in either encoding
+static bool parse(OutboundFrame &frame, JsonDocument &doc) {
+  if (frame.binary) return decodeWireMessage((uint8_t *)frame.payload(), frame.length, doc);
+  return !deserializeJson(doc, frame.payload(), frame.length);
+}
+
+void setUp() {
+  setFrameEncoding(false);
+}
+
+void tearDown() {}
+
+static void test_hex_is_eight_upper_case_digits() {
+  char hex[9] = {};
+  encodeHex32(0x00C0FFEE, hex);
+  TEST_ASSERT_EQUAL_STRING("00C0FFEE", hex);
+  encodeHex32(0xFFFFFFFF, hex);
+  TEST_ASSERT_EQUAL_STRING("FFFFFFFF", hex);
+  encodeHex32(0, hex);
+  TEST_ASSERT_EQUAL_STRING("00000000", hex);
+}
+
+static void test_rfid_scan_json() {
+  OutboundFrame frame;
+  TEST_ASSERT_TRUE(buildRFIDScanFrame(frame, 0, 0x00C0FFEE));
+  TEST_ASSERT_FALSE(frame.binary);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"type\":\"rfid_scan\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\"}",
+      text(frame));
+  TEST_ASSERT_TRUE(buildRFIDScanFrame(frame, 1, 1));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"type\":\"rfid_scan\",\"resource_id\":\"EFGH5678\",\"rfid_code\":\"00000001\"}",
+      text(frame));
+  TEST_ASSERT_FALSE(buildRFIDScanFrame(frame, MAX_RESOURCES, 1));
+}
+
+static void test_session_frames_escape_the_id() {
+  const char *id = "a\"b\\c\x01" "d";
+  OutboundFrame frame;
+  TEST_ASSERT_TRUE(buildSessionEndFrame(frame, 0, id));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"type\":\"session_end\",\"resource_id\":\"ABCD1234\",\"session_id\":\"a\\\"b\\\\c\\u0001d\"}",
+      text(frame));
+  JsonDocument doc;
+  TEST_ASSERT_TRUE(parse(frame, doc));
+  TEST_ASSERT_EQUAL_STRING(id, doc["session_id"] | "");
+
+  TEST_ASSERT_TRUE(buildCardPresentFrame(frame, 1, "5f1c2a7e"));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"type\":\"card_present\",\"resource_id\":\"EFGH5678\",\"session_id\":\"5f1c2a7e\"}",
+      text(frame));
+}
+
+static void test_oversized_session_id_is_refused() {
+  std::string id(FRAME_MAX_PAYLOAD, 'x');
+  OutboundFrame frame;
+  TEST_ASSERT_FALSE(buildSessionEndFrame(frame, 0, id.c_str()));
+  setFrameEncoding(true);
+  TEST_ASSERT_FALSE(buildSessionEndFrame(frame, 0, id.c_str()));
+}
+
+static void test_device_auth_offers_msgpack_for_every_resource() {
+  setFrameEncoding(true);
+  OutboundFrame frame;
+  TEST_ASSERT_TRUE(buildDeviceAuthFrame(frame));
+  TEST_ASSERT_FALSE(frame.binary);
+  JsonDocument doc;
+  TEST_ASSERT_TRUE(parse(frame, doc));
+  TEST_ASSERT_EQUAL_STRING("device_auth", doc["type"] | "");
+  TEST_ASSERT_EQUAL_STRING(RESOURCES[0].id, doc["resource_id"] | "");
+  TEST_ASSERT_EQUAL_STRING(API_KEY, doc["api_key"] | "");
+  TEST_ASSERT_EQUAL_STRING("msgpack", doc["encodings"][0] | "");
+  TEST_ASSERT_EQUAL(RESOURCE_COUNT, doc["resources"].size());
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    TEST_ASSERT_EQUAL_STRING(RESOURCES[i].id, doc["resources"][i] | "");
+  }
+}
+
+static void test_pong() {
+  OutboundFrame frame;
+  TEST_ASSERT_TRUE(buildPongFrame(frame));
+  TEST_ASSERT_EQUAL_STRING("{\"type\":\"pong\"}", text(frame));
+  setFrameEncoding(true);
+  TEST_ASSERT_TRUE(buildPongFrame(frame));
+  JsonDocument doc;
+  TEST_ASSERT_TRUE(parse(frame, doc));
+  TEST_ASSERT_EQUAL_STRING("pong", doc["type"] | "");
+}
+
+// The binary frames carry the fields of the JSON ones, rfid_code as a
+// number
+static void test_binary_frames_match_json() {
+  OutboundFrame json, binary;
+  JsonDocument fromJson, fromBinary;
+
+  buildRFIDScanFrame(json, 1, 0x0012AB34);
+  setFrameEncoding(true);
+  TEST_ASSERT_TRUE(buildRFIDScanFrame(binary, 1, 0x0012AB34));
+  TEST_ASSERT_TRUE(binary.binary);
+  TEST_ASSERT_LESS_THAN(json.length, binary.length);
+  TEST_ASSERT_TRUE(parse(json, fromJson));
+  TEST_ASSERT_TRUE(parse(binary, fromBinary));
+  TEST_ASSERT_EQUAL_STRING(fromJson["type"] | "", fromBinary["type"] | "?");
+  TEST_ASSERT_EQUAL_STRING(fromJson["resource_id"] | "", fromBinary["resource_id"] | "?");
+  TEST_ASSERT_EQUAL_HEX32(strtoul(fromJson["rfid_code"] | "", nullptr, 16),
+                          fromBinary["rfid_code"] | 0u);
+
+  setFrameEncoding(false);
+  buildSessionEndFrame(json, 0, "5f1c2a7e-9b0d");
+  setFrameEncoding(true);
+  TEST_ASSERT_TRUE(buildSessionEndFrame(binary, 0, "5f1c2a7e-9b0d"));
+  fromJson.clear();
+  fromBinary.clear();
+  TEST_ASSERT_TRUE(parse(json, fromJson));
+  TEST_ASSERT_TRUE(parse(binary, fromBinary));
+  TEST_ASSERT_EQUAL_STRING("session_end", fromBinary["type"] | "");
+  TEST_ASSERT_EQUAL_STRING(fromJson["resource_id"] | "", fromBinary["resource_id"] | "?");
+  TEST_ASSERT_EQUAL_STRING(fromJson["session_id"] | "", fromBinary["session_id"] | "?");
+}
+
+int main() {
+  initFrameTemplates();
+  UNITY_BEGIN();
+  RUN_TEST(test_hex_is_eight_upper_case_digits);
+  RUN_TEST(test_rfid_scan_json);
+  RUN_TEST(test_session_frames_escape_the_id);
+  RUN_TEST(test_oversized_session_id_is_refused);
+  RUN_TEST(test_device_auth_offers_msgpack_for_every_resource);
+  RUN_TEST(test_pong);
+  RUN_TEST(test_binary_frames_match_json);
+  return UNITY_END();
+}
@@ -0,0 +1,152 @@
+// Grant cache tests for MakerPass host builds
+// These tests drive grant_cache.cpp on the virtual clock: hits and
+// misses per resource, TTL expiry including across the millis()
+// rollover, least-recently-used eviction when the table is full, and
+// revocation.
+
+#include <unity.h>
+#include "constants.h"
+#include "grant_cache.h"
+#include "hal.h"
+
+static const uint32_t CODE_A = 0x00C0FFEE;
+static const uint32_t CODE_B = 0x0012AB34;
+
+void setUp() {
+  grantCacheClear();
+}
+
+void tearDown() {}
+
+static void advanceMs(uint32_t ms) {
+  halAdvanceUs((int64_t)ms * 1000);
+}
+
+static void test_hit_returns_the_cached_name() {
+  UserName name;
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_EQUAL_STRING("Ada Lovelace", name.c_str());
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_B, name));
+}
+
+static void test_grants_are_per_resource() {
+  UserName name;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+  TEST_ASSERT_FALSE(grantCacheLookup(1, CODE_A, name));
+  grantCacheStore(1, CODE_A, "Ada at the door", 60);
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_EQUAL_STRING("Ada Lovelace", name.c_str());
+  TEST_ASSERT_EQUAL(2, grantCacheCount());
+}
+
+static void test_entry_expires_after_its_ttl() {
+  UserName name;
+  uint32_t expirations = getGrantCacheStats().expirations;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 10);
+  advanceMs(9999);
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+  advanceMs(1);
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_EQUAL(expirations + 1, getGrantCacheStats().expirations);
+  TEST_ASSERT_EQUAL(0, grantCacheCount());
+}
+
+static void test_ttl_is_capped() {
+  UserName name;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", GRANT_CACHE_MAX_TTL_S * 2);
+  advanceMs(GRANT_CACHE_MAX_TTL_S * 1000);
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+}
+
+static void test_zero_ttl_drops_the_entry() {
+  UserName name;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 0);
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_EQUAL(0, grantCacheCount());
+}
+
+static void test_full_table_evicts_least_recently_used() {
+  UserName name;
+  uint32_t evictions = getGrantCacheStats().evictions;
+  for (uint32_t i = 0; i < GRANT_CACHE_SIZE; i++) {
+    grantCacheStore(0, 0x1000 + i, "Member", 60);
+  }
+  // The first entry becomes the most recent; the second is now oldest
+  TEST_ASSERT_TRUE(grantCacheLookup(0, 0x1000, name));
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+
+  TEST_ASSERT_EQUAL(evictions + 1, getGrantCacheStats().evictions);
+  TEST_ASSERT_EQUAL(GRANT_CACHE_SIZE, grantCacheCount());
+  TEST_ASSERT_TRUE(grantCacheLookup(0, 0x1000, name));
+  TEST_ASSERT_FALSE(grantCacheLookup(0, 0x1001, name));
+  TEST_ASSERT_TRUE(grantCacheLookup(0, 0x1002, name));
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+}
+
+static void test_expired_entry_is_reused_before_eviction() {
+  UserName name;
+  uint32_t evictions = getGrantCacheStats().evictions;
+  grantCacheStore(0, 0x1000, "Short", 1);
+  for (uint32_t i = 1; i < GRANT_CACHE_SIZE; i++) {
+    grantCacheStore(0, 0x1000 + i, "Member", 60);
+  }
+  advanceMs(1000);
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+  TEST_ASSERT_EQUAL(evictions, getGrantCacheStats().evictions);
+  for (uint32_t i = 1; i < GRANT_CACHE_SIZE; i++) {
+    TEST_ASSERT_TRUE(grantCacheLookup(0, 0x1000 + i, name));
+  }
+}
+
+static void test_restore_refreshes_the_ttl() {
+  UserName name;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 10);
+  advanceMs(8000);
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 10);
+  advanceMs(8000);
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_EQUAL(1, grantCacheCount());
+}
+
+static void test_revoke_and_clear() {
+  UserName name;
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 60);
+  grantCacheStore(0, CODE_B, "Grace Hopper", 60);
+  TEST_ASSERT_TRUE(grantCacheRevoke(0, CODE_A));
+  TEST_ASSERT_FALSE(grantCacheRevoke(0, CODE_A));
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_B, name));
+  grantCacheClear();
+  TEST_ASSERT_EQUAL(0, grantCacheCount());
+}
+
+// Last test: the clock only moves forward
+static void test_ttl_holds_across_millis_rollover() {
+  UserName name;
+  int64_t wrapUs = (int64_t)UINT32_MAX * 1000 + 1000;
+  halSetUptimeUs(wrapUs - 5000000);
+  grantCacheStore(0, CODE_A, "Ada Lovelace", 10);
+  halSetUptimeUs(wrapUs + 4000000);
+  TEST_ASSERT_TRUE(halMillis() < 10000);
+  TEST_ASSERT_TRUE(grantCacheLookup(0, CODE_A, name));
+  advanceMs(1000);
+  TEST_ASSERT_FALSE(grantCacheLookup(0, CODE_A, name));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_hit_returns_the_cached_name);
+  RUN_TEST(test_grants_are_per_resource);
+  RUN_TEST(test_entry_expires_after_its_ttl);
+  RUN_TEST(test_ttl_is_capped);
+  RUN_TEST(test_zero_ttl_drops_the_entry);
+  RUN_TEST(test_full_table_evicts_least_recently_used);
+  RUN_TEST(test_expired_entry_is_reused_before_eviction);
+  RUN_TEST(test_restore_refreshes_the_ttl);
+  RUN_TEST(test_revoke_and_clear);
+  RUN_TEST(test_ttl_holds_across_millis_rollover);
+  return UNITY_END();
+}
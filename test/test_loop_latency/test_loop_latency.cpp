@@ -0,0 +1,134 @@
+// Loop latency tests for MakerPass host builds
+// These tests boot the firmware on the virtual clock against the mock
+// server, as the scenario runner does, and check that temporary
+// messages never hold up the access task: a member's card energises
+// the relay within a few milliseconds of its last bit while denials
+// queue up on the display, and every scan in a burst of strangers
+// reaches the server although the message queue overflows.
+
+#include <unity.h>
+#include "config.h"
+#include "constants.h"
+#include "telemetry.h"
+#include "wiegand_reader.h"
+#include "../../src/host/mock_server.h"
+#include "host_sim.h"
+#include "hal.h"
+
+static const uint32_t MEMBER = 0xA1B2C3;
+static const uint32_t STRANGER = 0x0BAD01;
+static const uint8_t MACHINE = 0;
+static const uint8_t DOOR = 1;
+
+// Frame end detection, the server round trip and some slack; a blocking
+// message display would add whole seconds
+static const int64_t LINK_LATENCY_US = 2000;
+static const int64_t RELAY_BOUND_US = 50000;
+
+static const uint32_t BIT_INTERVAL_US = 2000;
+
+class TestServer : public HostServer, public MockConnection {
+ public:
+  MockServer brain;
+
+  bool accept() override { return true; }
+  void receive(const uint8_t *payload, size_t length, bool binary) override {
+    brain.receive(*this, payload, length, binary);
+  }
+  void closed() override { reset(); }
+  void sendFrame(const uint8_t *payload, size_t length, bool binary) override {
+    hostServerSend(payload, length, binary);
+  }
+};
+
+static TestServer server;
+static int64_t relayOnUs[RESOURCE_COUNT];
+
+// After every task switch: when each relay was last energised
+static void watchRelays() {
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    if (halPinLevel(RESOURCES[i].pinRelay) == HIGH) {
+      if (relayOnUs[i] < 0) relayOnUs[i] = halUptimeUs();
+    } else {
+      relayOnUs[i] = -1;
+    }
+  }
+}
+
+// A 26-bit H10301 read: even parity over the first twelve data bits in
+// front, odd parity over the last twelve behind.  Returns the time of
+// the last bit.
+static int64_t presentCard(uint8_t resource, uint32_t code, int64_t atUs) {
+  uint64_t even = __builtin_popcount(code >> 12) & 1;
+  uint64_t odd = (__builtin_popcount(code & 0xFFF) & 1) ^ 1;
+  uint64_t frame = (even << 25) | ((uint64_t)code << 1) | odd;
+  const ResourceConfig &config = RESOURCES[resource];
+  halWiegandFrame(config.pinD0, config.pinD1, frame, 26, atUs, BIT_INTERVAL_US);
+  return atUs + 25 * BIT_INTERVAL_US;
+}
+
+static void boot() {
+  hostSerialEcho(false);
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    server.brain.setResourceType(RESOURCES[i].id, strcmp(RESOURCES[i].type, "door") == 0);
+    relayOnUs[i] = -1;
+  }
+  server.brain.addMember(MEMBER, "Ada Lovelace");
+  const uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  hostWiFiAddAccessPoint(WIFI_NETWORKS[0].ssid, bssid, 6, -55);
+  hostSetServer(&server);
+  hostSetLink({true, 600, LINK_LATENCY_US});
+  hostSetProbe(watchRelays);
+  hostStart();
+  hostRunUntil(30000000);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_device_comes_online() {
+  TEST_ASSERT_TRUE(hostServerConnected());
+  TEST_ASSERT_EQUAL(1, server.brain.stats().auths);
+}
+
+static void test_grant_is_fast_while_denials_show() {
+  int64_t t0 = halUptimeUs() + 1000000;
+  uint32_t denials = server.brain.stats().denials;
+  for (int i = 0; i < 3; i++) presentCard(DOOR, STRANGER + i, t0 + i * 300000);
+  int64_t lastBitUs = presentCard(MACHINE, MEMBER, t0 + 1000000);
+
+  hostRunUntil(t0 + 1000000 - 1000);
+  TEST_ASSERT_EQUAL(denials + 3, server.brain.stats().denials);
+  TEST_ASSERT_TRUE(relayOnUs[MACHINE] < 0);
+
+  hostRunUntil(t0 + 2000000);
+  TEST_ASSERT_TRUE(relayOnUs[MACHINE] >= lastBitUs);
+  TEST_ASSERT_LESS_OR_EQUAL(RELAY_BOUND_US, relayOnUs[MACHINE] - lastBitUs);
+  TEST_ASSERT_LESS_OR_EQUAL(RELAY_BOUND_US, getLatencyHistogram(LAT_SCAN_TO_RELAY).maxUs);
+}
+
+static void test_every_scan_reaches_the_server_in_a_burst() {
+  // Twice as many denials as the message queue holds, one every 100 ms
+  const uint8_t burst = UI_MESSAGE_QUEUE_SIZE * 2;
+  int64_t t0 = halUptimeUs() + 1000000;
+  uint32_t scans = server.brain.stats().scans;
+  uint32_t denials = server.brain.stats().denials;
+  int64_t lastBitUs = 0;
+  for (uint8_t i = 0; i < burst; i++) {
+    lastBitUs = presentCard(DOOR, STRANGER + 0x100 + i, t0 + i * 100000);
+  }
+  hostRunUntil(lastBitUs + RELAY_BOUND_US);
+  TEST_ASSERT_EQUAL(scans + burst, server.brain.stats().scans);
+  TEST_ASSERT_EQUAL(denials + burst, server.brain.stats().denials);
+  TEST_ASSERT_EQUAL(0, getWiegandStats(DOOR).overruns);
+}
+
+int main() {
+  boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_device_comes_online);
+  RUN_TEST(test_grant_is_fast_while_denials_show);
+  RUN_TEST(test_every_scan_reaches_the_server_in_a_burst);
+  return UNITY_END();
+}
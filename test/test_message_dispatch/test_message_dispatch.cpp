@@ -0,0 +1,170 @@
+// Message dispatch tests for MakerPass host builds
+// These tests cover the inbound path: the perfect hash from type names
+// to MessageType, the arena that keeps parsing off the heap, the
+// largest frame fitting in it, and handleIncomingMessage() turning
+// server frames into the access commands the access task applies.  The firmware is brought up by
+// the replay harness, so replies go to a sink that counts them.
+
+#include <unity.h>
+#include "config.h"
+#include "constants.h"
+#include "allowlist.h"
+#include "json_arena.h"
+#include "message_types.h"
+#include "task_manager.h"
+#include "websocket_manager.h"
+#include "../../src/host/replay.h"
+#include "host_sim.h"
+
+void setUp() {
+  AccessCommand cmd;
+  while (pollAccessCommand(cmd)) continue;
+}
+
+void tearDown() {}
+
+// Hand a frame to the parser as the WebSocket callback does
+static void deliver(const char *json) {
+  static char buffer[ALLOWLIST_SYNC_CHUNK * 11 + 256];
+  size_t length = strlen(json);
+  memcpy(buffer, json, length + 1);
+  handleIncomingMessage((uint8_t *)buffer, length);
+}
+
+static void test_every_type_name_maps_to_its_type() {
+  for (size_t i = 0; i < MESSAGE_TYPE_COUNT; i++) {
+    TEST_ASSERT_EQUAL(MESSAGE_TYPES[i].type, lookupMessageType(MESSAGE_TYPES[i].name));
+  }
+}
+
+static void test_unknown_names_map_to_unknown() {
+  const char *const names[] = {"", "pin", "pingg", "Ping", "access", "access_granted ",
+                               "session_start", "allowlist", "event_ack_"};
+  for (const char *name : names) {
+    TEST_ASSERT_EQUAL(MSG_UNKNOWN, lookupMessageType(name));
+  }
+}
+
+static void test_arena_allocates_from_its_buffer_only() {
+  static JsonArena arena;
+  arena.reset();
+  void *a = arena.allocate(100);
+  void *b = arena.allocate(100);
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_TRUE((uint8_t *)b >= (uint8_t *)a + 100);
+  TEST_ASSERT_GREATER_OR_EQUAL(200, arena.used());
+  TEST_ASSERT_NULL(arena.allocate(JSON_ARENA_SIZE));
+
+  // The most recent block grows where it is, and can be given back
+  TEST_ASSERT_EQUAL_PTR(b, arena.reallocate(b, 300));
+  size_t used = arena.used();
+  void *c = arena.allocate(16);
+  arena.deallocate(c);
+  TEST_ASSERT_EQUAL(used, arena.used());
+  arena.reset();
+  TEST_ASSERT_EQUAL(0, arena.used());
+  TEST_ASSERT_GREATER_OR_EQUAL(400, arena.peak());
+}
+
+static void test_access_granted_becomes_a_grant() {
+  deliver("{\"type\":\"access_granted\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\","
+          "\"user_name\":\"Ada Lovelace\",\"cache_ttl\":3600}");
+  AccessCommand cmd;
+  TEST_ASSERT_TRUE(pollAccessCommand(cmd));
+  TEST_ASSERT_EQUAL(ACCESS_GRANT, cmd.type);
+  TEST_ASSERT_EQUAL(0, cmd.resource);
+  TEST_ASSERT_TRUE(cmd.codeKnown);
+  TEST_ASSERT_EQUAL_HEX32(0x00C0FFEE, cmd.code);
+  TEST_ASSERT_EQUAL_STRING("Ada Lovelace", cmd.userName);
+  TEST_ASSERT_EQUAL(3600, cmd.ttlSeconds);
+  TEST_ASSERT_FALSE(pollAccessCommand(cmd));
+}
+
+static void test_session_started_carries_its_id() {
+  deliver("{\"type\":\"session_started\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\","
+          "\"session_id\":\"5f1c2a7e\",\"user\":\"Grace Hopper\"}");
+  AccessCommand cmd;
+  TEST_ASSERT_TRUE(pollAccessCommand(cmd));
+  TEST_ASSERT_EQUAL(ACCESS_SESSION_STARTED, cmd.type);
+  TEST_ASSERT_EQUAL_STRING("5f1c2a7e", cmd.sessionId);
+  TEST_ASSERT_EQUAL_STRING("Grace Hopper", cmd.userName);
+}
+
+static void test_denial_without_code_refers_to_last_scan() {
+  deliver("{\"type\":\"access_denied\",\"reason\":\"Not trained\"}");
+  AccessCommand cmd;
+  TEST_ASSERT_TRUE(pollAccessCommand(cmd));
+  TEST_ASSERT_EQUAL(ACCESS_DENIED, cmd.type);
+  TEST_ASSERT_EQUAL(0, cmd.resource);
+  TEST_ASSERT_FALSE(cmd.codeKnown);
+  TEST_ASSERT_EQUAL_STRING("Not trained", cmd.text);
+}
+
+static void test_second_resource_is_addressed_by_id() {
+  deliver("{\"type\":\"access_granted\",\"resource_id\":\"EFGH5678\",\"rfid_code\":\"00000001\"}");
+  AccessCommand cmd;
+  TEST_ASSERT_TRUE(pollAccessCommand(cmd));
+  TEST_ASSERT_EQUAL(1, cmd.resource);
+  TEST_ASSERT_EQUAL_STRING("User", cmd.userName);
+}
+
+static void test_frames_that_act_on_nothing_post_nothing() {
+  const char *const frames[] = {
+    "{\"type\":\"access_granted\",\"resource_id\":\"ZZZZ9999\",\"rfid_code\":\"00C0FFEE\"}",
+    "{\"type\":\"no_such_type\"}",
+    "{\"type\":\"access_granted\",\"rfid_code\":",
+    "[1,2,3]",
+    "",
+  };
+  for (const char *frame : frames) {
+    deliver(frame);
+    AccessCommand cmd;
+    TEST_ASSERT_FALSE(pollAccessCommand(cmd));
+  }
+}
+
+static void test_ping_is_answered() {
+  uint64_t sent = replayStats().framesSent;
+  deliver("{\"type\":\"ping\"}");
+  TEST_ASSERT_EQUAL(sent + 1, replayStats().framesSent);
+}
+
+// The largest message the device asks for: a JSON allowlist chunk of
+// ALLOWLIST_SYNC_CHUNK hex codes, each copied into the inbound arena
+static void test_full_allowlist_chunk_fits_the_arena() {
+  static char frame[ALLOWLIST_SYNC_CHUNK * 11 + 256];
+  uint32_t version = allowlistVersion(0) + 1;
+  int length = snprintf(frame, sizeof(frame),
+                        "{\"type\":\"allowlist_full\",\"resource_id\":\"ABCD1234\",\"offset\":0,\"codes\":[");
+  for (uint16_t i = 0; i < ALLOWLIST_SYNC_CHUNK; i++) {
+    length += snprintf(frame + length, sizeof(frame) - length, "%s\"%08X\"", i ? "," : "",
+                       (unsigned)(0x00C00000 + i * 7919));
+  }
+  snprintf(frame + length, sizeof(frame) - length, "],\"more\":false,\"version\":%u}",
+           (unsigned)version);
+
+  deliver(frame);
+  TEST_ASSERT_EQUAL(version, allowlistVersion(0));
+  TEST_ASSERT_EQUAL(ALLOWLIST_SYNC_CHUNK, allowlistCount(0));
+  TEST_ASSERT_TRUE(allowlistContains(0, 0x00C00000 + 5 * 7919));
+  // A quarter of the arena to spare for other library versions
+  TEST_ASSERT_LESS_OR_EQUAL(JSON_ARENA_SIZE * 3 / 4, inboundArenaPeak());
+}
+
+int main() {
+  hostSerialEcho(false);
+  replayInit();
+  UNITY_BEGIN();
+  RUN_TEST(test_every_type_name_maps_to_its_type);
+  RUN_TEST(test_unknown_names_map_to_unknown);
+  RUN_TEST(test_arena_allocates_from_its_buffer_only);
+  RUN_TEST(test_access_granted_becomes_a_grant);
+  RUN_TEST(test_session_started_carries_its_id);
+  RUN_TEST(test_denial_without_code_refers_to_last_scan);
+  RUN_TEST(test_second_resource_is_addressed_by_id);
+  RUN_TEST(test_frames_that_act_on_nothing_post_nothing);
+  RUN_TEST(test_ping_is_answered);
+  RUN_TEST(test_full_allowlist_chunk_fits_the_arena);
+  return UNITY_END();
+}
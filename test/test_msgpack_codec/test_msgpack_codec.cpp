@@ -0,0 +1,193 @@
+// MessagePack codec tests for MakerPass host builds
+// These tests check the writer's choice of format at every size
+// boundary, that protocol messages survive JSON -> MessagePack -> JSON
+// unchanged with keys and type names replaced by their codes on the
+// wire, and that the decoder rejects truncated, trailing and over-deep
+// input.
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "msgpack_codec.h"
+#include "wire_schema.h"
+#include <string>
+
+static uint8_t wire[1024];
+
+void setUp() {}
+
+void tearDown() {}
+
+// The bytes one writer call produces
+template <typename Write>
+static std::string written(Write write) {
+  MsgPackWriter out(wire, sizeof(wire));
+  write(out);
+  TEST_ASSERT_TRUE(out.ok());
+  return std::string((const char *)wire, out.length());
+}
+
+static std::string bytes(std::initializer_list<uint8_t> list) {
+  return std::string(list.begin(), list.end());
+}
+
+static void test_unsigned_boundaries() {
+  TEST_ASSERT_TRUE(bytes({0x7F}) == written([](MsgPackWriter &w) { w.unsignedInt(127); }));
+  TEST_ASSERT_TRUE(bytes({0xCC, 0x80}) == written([](MsgPackWriter &w) { w.unsignedInt(128); }));
+  TEST_ASSERT_TRUE(bytes({0xCD, 0x01, 0x00}) == written([](MsgPackWriter &w) { w.unsignedInt(256); }));
+  TEST_ASSERT_TRUE(bytes({0xCE, 0x00, 0x01, 0x00, 0x00}) ==
+                   written([](MsgPackWriter &w) { w.unsignedInt(65536); }));
+  TEST_ASSERT_TRUE(bytes({0xCF, 0, 0, 0, 1, 0, 0, 0, 0}) ==
+                   written([](MsgPackWriter &w) { w.unsignedInt(1ULL << 32); }));
+  TEST_ASSERT_TRUE(bytes({0xCE, 0, 0, 0, 5}) == written([](MsgPackWriter &w) { w.uint32Fixed(5); }));
+}
+
+static void test_signed_boundaries() {
+  TEST_ASSERT_TRUE(bytes({0xE0}) == written([](MsgPackWriter &w) { w.signedInt(-32); }));
+  TEST_ASSERT_TRUE(bytes({0xD0, 0xDF}) == written([](MsgPackWriter &w) { w.signedInt(-33); }));
+  TEST_ASSERT_TRUE(bytes({0xD1, 0xFF, 0x7F}) == written([](MsgPackWriter &w) { w.signedInt(-129); }));
+  TEST_ASSERT_TRUE(bytes({0xD2, 0xFF, 0xFF, 0x7F, 0xFF}) ==
+                   written([](MsgPackWriter &w) { w.signedInt(-32769); }));
+  TEST_ASSERT_TRUE(bytes({0x05}) == written([](MsgPackWriter &w) { w.signedInt(5); }));
+}
+
+static void test_string_and_container_headers() {
+  std::string s31(31, 'a'), s32(32, 'a'), s256(256, 'a');
+  TEST_ASSERT_EQUAL(0xBF, (uint8_t)written([&](MsgPackWriter &w) { w.string(s31.c_str()); })[0]);
+  std::string str8 = written([&](MsgPackWriter &w) { w.string(s32.c_str()); });
+  TEST_ASSERT_EQUAL(0xD9, (uint8_t)str8[0]);
+  TEST_ASSERT_EQUAL(32, (uint8_t)str8[1]);
+  std::string str16 = written([&](MsgPackWriter &w) { w.string(s256.c_str()); });
+  TEST_ASSERT_TRUE(bytes({0xDA, 0x01, 0x00}) == str16.substr(0, 3));
+  TEST_ASSERT_EQUAL(259, str16.size());
+
+  TEST_ASSERT_TRUE(bytes({0x8F}) == written([](MsgPackWriter &w) { w.mapHeader(15); }));
+  TEST_ASSERT_TRUE(bytes({0xDE, 0x00, 0x10}) == written([](MsgPackWriter &w) { w.mapHeader(16); }));
+  TEST_ASSERT_TRUE(bytes({0x9F}) == written([](MsgPackWriter &w) { w.arrayHeader(15); }));
+  TEST_ASSERT_TRUE(bytes({0xDC, 0x00, 0x10}) == written([](MsgPackWriter &w) { w.arrayHeader(16); }));
+  TEST_ASSERT_TRUE(bytes({0xC0, 0xC2, 0xC3}) == written([](MsgPackWriter &w) {
+    w.nil();
+    w.boolean(false);
+    w.boolean(true);
+  }));
+}
+
+static void test_writer_stops_at_the_end_of_its_buffer() {
+  uint8_t small[4];
+  MsgPackWriter out(small, sizeof(small));
+  out.string("too long for four bytes");
+  TEST_ASSERT_FALSE(out.ok());
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(small), out.length());
+
+  MsgPackWriter exact(small, sizeof(small));
+  exact.string("abc");
+  TEST_ASSERT_TRUE(exact.ok());
+  exact.nil();
+  TEST_ASSERT_FALSE(exact.ok());
+}
+
+// JSON text -> document -> MessagePack -> document -> JSON text
+static std::string roundTrip(const char *json, size_t *wireLength = nullptr) {
+  JsonDocument in;
+  TEST_ASSERT_FALSE(deserializeJson(in, json));
+  size_t length = encodeWireMessage(in.as<JsonVariantConst>(), wire, sizeof(wire));
+  TEST_ASSERT_GREATER_THAN(0, length);
+  if (wireLength) *wireLength = length;
+  JsonDocument out;
+  TEST_ASSERT_TRUE(decodeWireMessage(wire, length, out));
+  char text[1024];
+  serializeJson(out, text, sizeof(text));
+  return text;
+}
+
+static void test_protocol_messages_round_trip() {
+  const char *const messages[] = {
+    "{\"type\":\"access_granted\",\"resource_id\":\"ABCD1234\",\"rfid_code\":\"00C0FFEE\","
+    "\"user_name\":\"Ada Lovelace\",\"cache_ttl\":3600}",
+    "{\"type\":\"session_started\",\"resource_id\":\"ABCD1234\",\"rfid_code\":12648430,"
+    "\"session_id\":\"5f1c2a7e-9b0d-4e11-a3c2-7d41f0e8b6a9\",\"user\":\"Grace Hopper\"}",
+    "{\"type\":\"auth_success\",\"resource_name\":\"Laser cutter\",\"encoding\":\"msgpack\","
+    "\"require_card_present\":true,\"enabled\":false,\"retry_after\":null}",
+    "{\"type\":\"allowlist_delta\",\"resource_id\":\"ABCD1234\",\"base_version\":41,"
+    "\"version\":42,\"add\":[12648430,1223476,16435934],\"remove\":[48879]}",
+    "{\"type\":\"telemetry\",\"stages\":{\"scan_to_relay\":{\"p50\":1.5,\"max\":-12}},"
+    "\"uptime_s\":4294967296}",
+    "{\"type\":\"error\",\"message\":\"caf\\u00e9 \\\"quoted\\\"\"}",
+  };
+  for (const char *message : messages) {
+    JsonDocument original;
+    deserializeJson(original, message);
+    char expected[1024];
+    serializeJson(original, expected, sizeof(expected));
+    std::string decoded = roundTrip(message);
+    TEST_ASSERT_EQUAL_STRING(expected, decoded.c_str());
+  }
+}
+
+static void test_keys_and_types_travel_as_codes() {
+  size_t length;
+  roundTrip("{\"type\":\"ping\"}", &length);
+  TEST_ASSERT_EQUAL(3, length);
+  TEST_ASSERT_EQUAL(0x81, wire[0]);
+  TEST_ASSERT_EQUAL(WIRE_KEY_TYPE, wire[1]);
+  TEST_ASSERT_EQUAL_STRING("ping", WIRE_TYPES[wire[2]]);
+
+  // A key from outside the schema stays a string
+  std::string custom = roundTrip("{\"custom\":1}", &length);
+  TEST_ASSERT_EQUAL_STRING("{\"custom\":1}", custom.c_str());
+  TEST_ASSERT_EQUAL(9, length);
+}
+
+static void test_unknown_key_codes_are_dropped() {
+  // {200: "x", type: ping}
+  uint8_t frame[] = {0x82, 0xCC, 200, 0xA1, 'x', 0x00, 0x04};
+  JsonDocument doc;
+  TEST_ASSERT_TRUE(decodeWireMessage(frame, sizeof(frame), doc));
+  TEST_ASSERT_EQUAL(1, doc.as<JsonObject>().size());
+  TEST_ASSERT_EQUAL_STRING("ping", doc["type"] | "");
+}
+
+static void test_truncated_frames_are_rejected() {
+  JsonDocument in;
+  deserializeJson(in, "{\"type\":\"access_granted\",\"rfid_code\":12648430,"
+                      "\"user_name\":\"Ada Lovelace\",\"add\":[1,-2,3.5]}");
+  size_t length = encodeWireMessage(in.as<JsonVariantConst>(), wire, sizeof(wire));
+  for (size_t cut = 0; cut < length; cut++) {
+    uint8_t copy[256];
+    memcpy(copy, wire, cut);
+    JsonDocument out;
+    TEST_ASSERT_FALSE(decodeWireMessage(copy, cut, out));
+  }
+}
+
+static void test_trailing_bytes_are_rejected() {
+  uint8_t frame[] = {0x81, 0x00, 0x04, 0xC0};
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(decodeWireMessage(frame, sizeof(frame), doc));
+}
+
+static void test_nesting_is_limited() {
+  uint8_t deep[32];
+  memset(deep, 0x91, sizeof(deep));   // arrays of one array of ...
+  deep[sizeof(deep) - 1] = 0x01;
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(decodeWireMessage(deep, sizeof(deep), doc));
+
+  uint8_t shallow[] = {0x91, 0x91, 0x91, 0x01};
+  TEST_ASSERT_TRUE(decodeWireMessage(shallow, sizeof(shallow), doc));
+  TEST_ASSERT_EQUAL(1, doc[0][0][0] | 0);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unsigned_boundaries);
+  RUN_TEST(test_signed_boundaries);
+  RUN_TEST(test_string_and_container_headers);
+  RUN_TEST(test_writer_stops_at_the_end_of_its_buffer);
+  RUN_TEST(test_protocol_messages_round_trip);
+  RUN_TEST(test_keys_and_types_travel_as_codes);
+  RUN_TEST(test_unknown_key_codes_are_dropped);
+  RUN_TEST(test_truncated_frames_are_rejected);
+  RUN_TEST(test_trailing_bytes_are_rejected);
+  RUN_TEST(test_nesting_is_limited);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+// Offline journal tests for MakerPass host builds
+// These tests boot the firmware on the virtual clock against the mock
+// server and take the server away between the access task posting a
+// request and the network task carrying it out, as happens when the
+// link falls while the request is queued.  The scan and the session
+// end must reach the server later as journal events rather than
+// vanish; a presence heartbeat is simply dropped.
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "constants.h"
+#include "task_manager.h"
+#include "websocket_manager.h"
+#include "../../src/host/mock_server.h"
+#include "host_sim.h"
+#include "hal.h"
+
+extern bool wsConnected;
+
+static const uint32_t STRANGER = 0x0BAD01;
+static const uint32_t CACHED = 0x00A1B2;
+static const uint32_t MEMBER = 0xA1B2C3;
+static const HostLink LINK = {true, 600, 2000, 150};
+
+// Past the longest reconnect wait and a journal upload
+static const int64_t RECOVERY_US = (int64_t)(WS_BACKOFF_MAX_MS + 10000) * 1000;
+
+// One event from an event_batch
+struct UploadedEvent {
+  std::string type;
+  uint32_t code;
+  uint32_t data;
+  std::string sessionId;
+};
+
+class TestServer : public HostServer, public MockConnection {
+ public:
+  MockServer brain;
+  std::vector<UploadedEvent> events;
+
+  bool accept() override { return true; }
+  void receive(const uint8_t *payload, size_t length, bool binary) override {
+    if (!binary) record(payload, length);
+    brain.receive(*this, payload, length, binary);
+  }
+  void closed() override { reset(); }
+  void sendFrame(const uint8_t *payload, size_t length, bool binary) override {
+    hostServerSend(payload, length, binary);
+  }
+
+ private:
+  void record(const uint8_t *payload, size_t length) {
+    JsonDocument doc;
+    if (deserializeJson(doc, payload, length) || strcmp(doc["type"] | "", "event_batch") != 0) {
+      return;
+    }
+    for (JsonVariant item : doc["events"].as<JsonArray>()) {
+      JsonArray event = item.as<JsonArray>();
+      events.push_back({event[1] | "", (uint32_t)strtoul(event[3] | "0", nullptr, 16),
+                        event[4] | 0U, event[5] | ""});
+    }
+  }
+};
+
+static TestServer server;
+
+static void boot() {
+  hostSerialEcho(false);
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    server.brain.setResourceType(RESOURCES[i].id, strcmp(RESOURCES[i].type, "door") == 0);
+  }
+  // JSON, so that the test can read the uploaded events
+  server.brain.setEncoding(false);
+  const uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  hostWiFiAddAccessPoint(WIFI_NETWORKS[0].ssid, bssid, 6, -55);
+  hostSetServer(&server);
+  hostSetLink(LINK);
+  hostStart();
+  hostRunUntil(30000000);
+}
+
+// The server goes away and the device notices, with nothing queued
+static void dropLink() {
+  HostLink down = LINK;
+  down.reachable = false;
+  hostSetLink(down);
+  hostServerClose();
+  hostRunUntil(halUptimeUs() + 100000);
+  TEST_ASSERT_FALSE(wsConnected);
+}
+
+static void restoreLink() {
+  hostSetLink(LINK);
+  hostRunUntil(halUptimeUs() + RECOVERY_US);
+  TEST_ASSERT_TRUE(hostServerConnected());
+}
+
+static NetRequest requestFor(NetRequestType type, uint32_t code) {
+  NetRequest req = {};
+  req.type = type;
+  req.code = code;
+  req.postedUs = halMicros();
+  return req;
+}
+
+static const UploadedEvent *findEvent(const char *type, uint32_t code) {
+  for (const UploadedEvent &event : server.events) {
+    if (event.type == type && event.code == code) return &event;
+  }
+  return nullptr;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_requests_the_link_fell_under_are_journaled() {
+  TEST_ASSERT_TRUE(hostServerConnected());
+  uint32_t scans = server.brain.stats().scans;
+  uint32_t sessionEnds = server.brain.stats().sessionEnds;
+  dropLink();
+
+  // Posted while the access task still saw the link up
+  processNetRequest(requestFor(NET_RFID_SCAN, STRANGER));
+  NetRequest cached = requestFor(NET_RFID_SCAN, CACHED);
+  cached.cacheGrant = true;
+  processNetRequest(cached);
+  NetRequest end = requestFor(NET_SESSION_END, MEMBER);
+  end.data = 754;
+  strcpy(end.sessionId, "session-42");
+  processNetRequest(end);
+  NetRequest heartbeat = requestFor(NET_CARD_PRESENT, MEMBER);
+  strcpy(heartbeat.sessionId, "session-42");
+  processNetRequest(heartbeat);
+
+  restoreLink();
+  TEST_ASSERT_EQUAL(scans, server.brain.stats().scans);
+  TEST_ASSERT_EQUAL(sessionEnds, server.brain.stats().sessionEnds);
+  TEST_ASSERT_EQUAL(3, server.events.size());
+  TEST_ASSERT_NOT_NULL(findEvent("offline_deny", STRANGER));
+  TEST_ASSERT_NOT_NULL(findEvent("cache_grant", CACHED));
+  const UploadedEvent *ended = findEvent("session_end", MEMBER);
+  TEST_ASSERT_NOT_NULL(ended);
+  TEST_ASSERT_EQUAL(754, ended->data);
+  TEST_ASSERT_EQUAL_STRING("session-42", ended->sessionId.c_str());
+}
+
+int main() {
+  boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_requests_the_link_fell_under_are_journaled);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+// Reconnect backoff tests for MakerPass host builds
+// These tests check reconnectBackoffMs(): the window doubling from
+// WS_BACKOFF_BASE_MS up to WS_BACKOFF_MAX_MS, full jitter over it, and
+// a server retry_after hint spread over [hint, 1.5 * hint].  A fleet
+// simulation then takes a thousand devices through a server outage
+// with a seeded generator in place of the hardware RNG, and checks
+// that their reconnects come back spread out rather than as one burst.
+
+#include <unity.h>
+#include "constants.h"
+#include "websocket_manager.h"
+
+static const uint16_t FLEET_SIZE = 1000;
+
+// xorshift32: repeatable stand-in for halRandom()
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static unsigned long windowFor(uint8_t failures) {
+  unsigned long windowMs = (unsigned long)WS_BACKOFF_BASE_MS << failures;
+  return windowMs < WS_BACKOFF_MAX_MS ? windowMs : WS_BACKOFF_MAX_MS;
+}
+
+void setUp() {
+  rngState = 0x2545F491;
+}
+
+void tearDown() {}
+
+// A draw of window gives the longest wait and window + 1 the shortest
+static void test_window_doubles_up_to_the_cap() {
+  for (uint8_t failures = 0; failures < 8; failures++) {
+    unsigned long windowMs = windowFor(failures);
+    TEST_ASSERT_EQUAL_UINT32(windowMs, reconnectBackoffMs(failures, 0, windowMs));
+    TEST_ASSERT_EQUAL_UINT32(0, reconnectBackoffMs(failures, 0, windowMs + 1));
+  }
+  TEST_ASSERT_EQUAL_UINT32(4000, windowFor(2));
+  TEST_ASSERT_EQUAL_UINT32(WS_BACKOFF_MAX_MS, windowFor(7));
+
+  // Counts past the width of the shift stay at the cap
+  const uint8_t many[] = {16, 31, 32, 200, UINT8_MAX};
+  for (uint8_t failures : many) {
+    TEST_ASSERT_EQUAL_UINT32(WS_BACKOFF_MAX_MS, reconnectBackoffMs(failures, 0, WS_BACKOFF_MAX_MS));
+    TEST_ASSERT_EQUAL_UINT32(0, reconnectBackoffMs(failures, 0, WS_BACKOFF_MAX_MS + 1));
+  }
+}
+
+// Waits cover the whole window, not just its upper half
+static void test_full_jitter_covers_the_window() {
+  const uint8_t failures = 3;
+  const unsigned long windowMs = windowFor(failures);
+  unsigned long shortest = windowMs, longest = 0;
+  uint64_t total = 0;
+  for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+    unsigned long delayMs = reconnectBackoffMs(failures, 0, nextRandom());
+    TEST_ASSERT_LESS_OR_EQUAL(windowMs, delayMs);
+    if (delayMs < shortest) shortest = delayMs;
+    if (delayMs > longest) longest = delayMs;
+    total += delayMs;
+  }
+  TEST_ASSERT_LESS_THAN(windowMs / 20, shortest);
+  TEST_ASSERT_GREATER_THAN(windowMs - windowMs / 20, longest);
+  unsigned long meanMs = total / FLEET_SIZE;
+  TEST_ASSERT_UINT32_WITHIN(windowMs / 10, windowMs / 2, meanMs);
+}
+
+static void test_retry_after_is_spread_over_half_the_hint() {
+  const unsigned long hintMs = 30000;
+  TEST_ASSERT_EQUAL_UINT32(hintMs, reconnectBackoffMs(0, hintMs, 0));
+  TEST_ASSERT_EQUAL_UINT32(hintMs + hintMs / 2, reconnectBackoffMs(0, hintMs, hintMs / 2));
+  TEST_ASSERT_EQUAL_UINT32(hintMs, reconnectBackoffMs(0, hintMs, hintMs / 2 + 1));
+
+  // The hint replaces the backoff window whatever the failure count
+  for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+    unsigned long delayMs = reconnectBackoffMs(i % 10, hintMs, nextRandom());
+    TEST_ASSERT_GREATER_OR_EQUAL(hintMs, delayMs);
+    TEST_ASSERT_LESS_OR_EQUAL(hintMs + hintMs / 2, delayMs);
+  }
+  TEST_ASSERT_EQUAL_UINT32(WS_RETRY_AFTER_MAX_MS + WS_RETRY_AFTER_MAX_MS / 2,
+                           reconnectBackoffMs(0, WS_RETRY_AFTER_MAX_MS, WS_RETRY_AFTER_MAX_MS / 2));
+}
+
+// One device from the moment its stable connection drops: the first
+// wait is drawn with no failures counted, and every refused attempt
+// counts one more.  Returns when it gets through.
+static unsigned long reconnectsAtMs(unsigned long serverBackMs) {
+  uint8_t failures = 0;
+  unsigned long atMs = reconnectBackoffMs(failures, 0, nextRandom());
+  while (atMs < serverBackMs) {
+    if (failures < UINT8_MAX) failures++;
+    atMs += reconnectBackoffMs(failures, 0, nextRandom());
+  }
+  return atMs;
+}
+
+// Largest number of arrivals in any one second from startMs
+static uint16_t busiestSecond(const unsigned long *arrivalsMs, uint16_t count, unsigned long startMs,
+                              unsigned long spanMs) {
+  static uint16_t buckets[WS_BACKOFF_MAX_MS / 1000 + 1];
+  memset(buckets, 0, sizeof(buckets));
+  uint16_t busiest = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    unsigned long second = (arrivalsMs[i] - startMs) / 1000;
+    TEST_ASSERT_LESS_OR_EQUAL(spanMs / 1000, second);
+    if (++buckets[second] > busiest) busiest = buckets[second];
+  }
+  return busiest;
+}
+
+// The whole fleet loses the server for ten minutes.  Once it is back
+// every device gets through within one capped window, at a rate near
+// the fleet size over WS_BACKOFF_MAX_MS rather than all at once.
+static void test_fleet_reconnects_spread_after_an_outage() {
+  const unsigned long serverBackMs = 10 * 60 * 1000UL;
+  static unsigned long arrivalsMs[FLEET_SIZE];
+  for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+    arrivalsMs[i] = reconnectsAtMs(serverBackMs);
+    TEST_ASSERT_GREATER_OR_EQUAL(serverBackMs, arrivalsMs[i]);
+    TEST_ASSERT_LESS_OR_EQUAL(serverBackMs + WS_BACKOFF_MAX_MS, arrivalsMs[i]);
+  }
+
+  // About 8 a second on average; allow for clustering
+  uint16_t busiest = busiestSecond(arrivalsMs, FLEET_SIZE, serverBackMs, WS_BACKOFF_MAX_MS);
+  TEST_ASSERT_LESS_OR_EQUAL(FLEET_SIZE * 3 / 100, busiest);
+}
+
+// The server comes back but answers everyone with retry_after: 20 s at
+// the same moment.  The fleet returns over the following ten seconds.
+static void test_fleet_honours_retry_after_without_a_burst() {
+  const unsigned long hintMs = 20000;
+  static unsigned long arrivalsMs[FLEET_SIZE];
+  for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+    arrivalsMs[i] = reconnectBackoffMs(4, hintMs, nextRandom());
+    TEST_ASSERT_GREATER_OR_EQUAL(hintMs, arrivalsMs[i]);
+  }
+
+  // About 100 a second on average
+  uint16_t busiest = busiestSecond(arrivalsMs, FLEET_SIZE, hintMs, hintMs / 2);
+  TEST_ASSERT_LESS_OR_EQUAL(FLEET_SIZE * 15 / 100, busiest);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_window_doubles_up_to_the_cap);
+  RUN_TEST(test_full_jitter_covers_the_window);
+  RUN_TEST(test_retry_after_is_spread_over_half_the_hint);
+  RUN_TEST(test_fleet_reconnects_spread_after_an_outage);
+  RUN_TEST(test_fleet_honours_retry_after_without_a_burst);
+  return UNITY_END();
+}
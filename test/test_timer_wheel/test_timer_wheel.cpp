@@ -0,0 +1,251 @@
+// Timer wheel tests for MakerPass host builds
+// These tests drive timer_wheel.cpp on the virtual clock the way a task
+// does, sleeping for msUntilNext() and then calling run(): deadlines
+// fire at their exact millisecond on every level of the wheel and
+// beyond it, cancelled and rescheduled timers fire once or not at all,
+// and callbacks may re-arm themselves or cancel other timers.
+
+#include <unity.h>
+#include "timer_wheel.h"
+#include "hal.h"
+
+static const uint8_t LOG_SIZE = 32;
+
+// Which timers fired, in order, and when
+struct Firing {
+  int id;
+  int64_t atMs;
+};
+
+static Firing fired[LOG_SIZE];
+static uint8_t firedCount;
+
+static void record(void *context) {
+  if (firedCount < LOG_SIZE) fired[firedCount++] = {(int)(intptr_t)context, timerNowMs()};
+}
+
+static Timer timerFor(int id) {
+  Timer timer = {};
+  timer.callback = record;
+  timer.context = (void *)(intptr_t)id;
+  return timer;
+}
+
+static void advanceMs(int64_t ms) {
+  halAdvanceUs(ms * 1000);
+}
+
+// Sleep and run as the owning task would, until untilMs
+static void runUntil(TimerWheel &wheel, int64_t untilMs) {
+  wheel.run();
+  while (timerNowMs() < untilMs) {
+    uint32_t sleepMs = wheel.msUntilNext(UINT32_MAX);
+    int64_t left = untilMs - timerNowMs();
+    advanceMs(sleepMs == 0 ? 0 : (sleepMs < left ? sleepMs : left));
+    wheel.run();
+  }
+}
+
+void setUp() {
+  firedCount = 0;
+}
+
+void tearDown() {}
+
+static void test_timer_fires_at_its_millisecond() {
+  TimerWheel wheel;
+  Timer timer = timerFor(1);
+  int64_t start = timerNowMs();
+  wheel.schedule(timer, 10);
+  TEST_ASSERT_TRUE(wheel.armed(timer));
+
+  advanceMs(9);
+  wheel.run();
+  TEST_ASSERT_EQUAL(0, firedCount);
+  advanceMs(1);
+  wheel.run();
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(start + 10, fired[0].atMs);
+  TEST_ASSERT_FALSE(wheel.armed(timer));
+
+  advanceMs(100);
+  wheel.run();
+  TEST_ASSERT_EQUAL(1, firedCount);
+}
+
+static void test_zero_delay_fires_on_the_next_run() {
+  TimerWheel wheel;
+  Timer timer = timerFor(1);
+  wheel.schedule(timer, 0);
+  TEST_ASSERT_EQUAL(0, wheel.msUntilNext(1000));
+  wheel.run();
+  TEST_ASSERT_EQUAL(1, firedCount);
+}
+
+static void test_cancelled_timer_does_not_fire() {
+  TimerWheel wheel;
+  Timer timer = timerFor(1);
+  Timer other = timerFor(2);
+  wheel.schedule(timer, 10);
+  wheel.schedule(other, 10);
+  wheel.cancel(timer);
+  TEST_ASSERT_FALSE(wheel.armed(timer));
+  TEST_ASSERT_EQUAL(0, wheel.remainingMs(timer));
+  wheel.cancel(timer);
+
+  advanceMs(20);
+  wheel.run();
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(2, fired[0].id);
+
+  // Cancelling the last timer empties the wheel
+  wheel.schedule(timer, 500);
+  wheel.cancel(timer);
+  TEST_ASSERT_EQUAL(1000, wheel.msUntilNext(1000));
+}
+
+static void test_remaining_and_next_deadline() {
+  TimerWheel wheel;
+  Timer near = timerFor(1);
+  Timer far = timerFor(2);
+  TEST_ASSERT_EQUAL(1000, wheel.msUntilNext(1000));
+
+  wheel.schedule(near, 20);
+  wheel.schedule(far, 250);
+  TEST_ASSERT_EQUAL(20, wheel.remainingMs(near));
+  TEST_ASSERT_EQUAL(250, wheel.remainingMs(far));
+  TEST_ASSERT_EQUAL(20, wheel.msUntilNext(1000));
+  TEST_ASSERT_EQUAL(5, wheel.msUntilNext(5));
+
+  advanceMs(20);
+  wheel.run();
+  TEST_ASSERT_EQUAL(230, wheel.remainingMs(far));
+
+  // A deadline on a higher level is only a hint: the task may wake
+  // early to move it down, but never late
+  uint32_t sleepMs = wheel.msUntilNext(1000);
+  TEST_ASSERT_GREATER_THAN(0, sleepMs);
+  TEST_ASSERT_LESS_OR_EQUAL(230, sleepMs);
+
+  advanceMs(1000);
+  TEST_ASSERT_EQUAL(0, wheel.remainingMs(far));
+  TEST_ASSERT_EQUAL(0, wheel.msUntilNext(1000));
+}
+
+// Either side of each level boundary, and past the end of the wheel
+static void test_deadlines_on_every_level_fire_exactly() {
+  const uint32_t delays[] = {1,        63,       64,       65,       4095,     4096,
+                             4097,     262143,   262144,   262145,   16777215, 16777216,
+                             16777217, 20000000, 36000000};
+  const uint8_t count = sizeof(delays) / sizeof(delays[0]);
+  TimerWheel wheel;
+  Timer timers[count];
+  int64_t start = timerNowMs();
+  for (uint8_t i = 0; i < count; i++) {
+    timers[i] = timerFor(i);
+    wheel.schedule(timers[i], delays[i]);
+  }
+
+  runUntil(wheel, start + delays[count - 1]);
+  TEST_ASSERT_EQUAL(count, firedCount);
+  for (uint8_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL(i, fired[i].id);
+    TEST_ASSERT_EQUAL(start + delays[i], fired[i].atMs);
+  }
+}
+
+static void test_rescheduling_replaces_the_deadline() {
+  TimerWheel wheel;
+  Timer timer = timerFor(1);
+  int64_t start = timerNowMs();
+  wheel.schedule(timer, 100000);
+  wheel.schedule(timer, 10);
+  TEST_ASSERT_EQUAL(10, wheel.remainingMs(timer));
+
+  runUntil(wheel, start + 200000);
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(start + 10, fired[0].atMs);
+
+  // And later than first set
+  wheel.schedule(timer, 10);
+  wheel.schedule(timer, 5000);
+  start = timerNowMs();
+  runUntil(wheel, start + 10000);
+  TEST_ASSERT_EQUAL(2, firedCount);
+  TEST_ASSERT_EQUAL(start + 5000, fired[1].atMs);
+}
+
+static TimerWheel periodicWheel;
+static Timer periodic;
+
+static void tick(void *context) {
+  record(context);
+  if (firedCount < 20) periodicWheel.schedule(periodic, 5);
+}
+
+static void test_callback_can_rearm_itself() {
+  periodic.callback = tick;
+  periodic.context = (void *)(intptr_t)7;
+  int64_t start = timerNowMs();
+  periodicWheel.schedule(periodic, 5);
+
+  runUntil(periodicWheel, start + 1000);
+  TEST_ASSERT_EQUAL(20, firedCount);
+  for (uint8_t i = 0; i < firedCount; i++) {
+    TEST_ASSERT_EQUAL(start + 5 * (i + 1), fired[i].atMs);
+  }
+  TEST_ASSERT_FALSE(periodicWheel.armed(periodic));
+}
+
+static TimerWheel sharedWheel;
+static Timer victim;
+
+static void cancelVictim(void *context) {
+  record(context);
+  sharedWheel.cancel(victim);
+}
+
+// Timers due in the same millisecond are fired together, and one of
+// them may cancel another that has not fired yet
+static void test_callback_can_cancel_a_timer_due_with_it() {
+  Timer killer = timerFor(1);
+  killer.callback = cancelVictim;
+  victim = timerFor(2);
+  sharedWheel.schedule(victim, 30);
+  sharedWheel.schedule(killer, 30);
+
+  advanceMs(30);
+  sharedWheel.run();
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(1, fired[0].id);
+  TEST_ASSERT_FALSE(sharedWheel.armed(victim));
+}
+
+// A task that wakes late fires everything overdue in deadline order
+static void test_late_run_fires_in_deadline_order() {
+  TimerWheel wheel;
+  Timer timers[4] = {timerFor(0), timerFor(1), timerFor(2), timerFor(3)};
+  wheel.schedule(timers[2], 3000);
+  wheel.schedule(timers[0], 5);
+  wheel.schedule(timers[3], 70000);
+  wheel.schedule(timers[1], 100);
+
+  advanceMs(100000);
+  wheel.run();
+  TEST_ASSERT_EQUAL(4, firedCount);
+  for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL(i, fired[i].id);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_timer_fires_at_its_millisecond);
+  RUN_TEST(test_zero_delay_fires_on_the_next_run);
+  RUN_TEST(test_cancelled_timer_does_not_fire);
+  RUN_TEST(test_remaining_and_next_deadline);
+  RUN_TEST(test_deadlines_on_every_level_fire_exactly);
+  RUN_TEST(test_rescheduling_replaces_the_deadline);
+  RUN_TEST(test_callback_can_rearm_itself);
+  RUN_TEST(test_callback_can_cancel_a_timer_due_with_it);
+  RUN_TEST(test_late_run_fires_in_deadline_order);
+  return UNITY_END();
+}
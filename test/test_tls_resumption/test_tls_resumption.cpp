@@ -0,0 +1,105 @@
+// TLS resumption tests for MakerPass host builds
+// These tests boot the firmware on the virtual clock against the mock
+// server and drop the connection under it: the first connection after
+// boot is a full TLS handshake, reconnects resume the session it left
+// unless the server declines, and each kind of handshake is timed in
+// its own telemetry stage.
+
+#include <unity.h>
+#include "config.h"
+#include "constants.h"
+#include "telemetry.h"
+#include "tls_transport.h"
+#include "../../src/host/mock_server.h"
+#include "host_sim.h"
+#include "hal.h"
+
+static const uint32_t FULL_MS = 600;
+static const uint32_t RESUMED_MS = 150;
+static const uint32_t LINK_LATENCY_US = 2000;
+
+// Past the longest reconnect wait after a single drop
+static const int64_t RECONNECT_US = (int64_t)WS_BACKOFF_MAX_MS * 1000;
+
+class TestServer : public HostServer, public MockConnection {
+ public:
+  MockServer brain;
+
+  bool accept() override { return true; }
+  void receive(const uint8_t *payload, size_t length, bool binary) override {
+    brain.receive(*this, payload, length, binary);
+  }
+  void closed() override { reset(); }
+  void sendFrame(const uint8_t *payload, size_t length, bool binary) override {
+    hostServerSend(payload, length, binary);
+  }
+};
+
+static TestServer server;
+
+static void boot() {
+  hostSerialEcho(false);
+  for (uint8_t i = 0; i < RESOURCE_COUNT; i++) {
+    server.brain.setResourceType(RESOURCES[i].id, strcmp(RESOURCES[i].type, "door") == 0);
+  }
+  const uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  hostWiFiAddAccessPoint(WIFI_NETWORKS[0].ssid, bssid, 6, -55);
+  hostSetServer(&server);
+  hostSetLink({true, FULL_MS, LINK_LATENCY_US, RESUMED_MS});
+  hostStart();
+  hostRunUntil(30000000);
+}
+
+// The server drops the connection; run until the device is back
+static void dropAndReconnect() {
+  hostServerClose();
+  hostRunUntil(halUptimeUs() + RECONNECT_US);
+  TEST_ASSERT_TRUE(hostServerConnected());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_first_connection_is_a_full_handshake() {
+  TEST_ASSERT_TRUE(hostServerConnected());
+  TEST_ASSERT_FALSE(lastTlsHandshake().resumed);
+  const LatencyHistogram &full = getLatencyHistogram(LAT_TLS_FULL);
+  TEST_ASSERT_EQUAL(1, full.count);
+  TEST_ASSERT_UINT32_WITHIN(1000, FULL_MS * 1000, full.maxUs);
+  TEST_ASSERT_EQUAL(0, getLatencyHistogram(LAT_TLS_RESUMED).count);
+}
+
+static void test_reconnect_resumes_the_session() {
+  uint32_t auths = server.brain.stats().auths;
+  dropAndReconnect();
+  TEST_ASSERT_EQUAL(auths + 1, server.brain.stats().auths);
+  TEST_ASSERT_TRUE(lastTlsHandshake().resumed);
+  const LatencyHistogram &resumed = getLatencyHistogram(LAT_TLS_RESUMED);
+  TEST_ASSERT_EQUAL(1, resumed.count);
+  TEST_ASSERT_UINT32_WITHIN(1000, RESUMED_MS * 1000, resumed.maxUs);
+  TEST_ASSERT_EQUAL(1, getLatencyHistogram(LAT_TLS_FULL).count);
+
+  // And again from the session the resumed connection left
+  dropAndReconnect();
+  TEST_ASSERT_EQUAL(2, getLatencyHistogram(LAT_TLS_RESUMED).count);
+}
+
+// A server that no longer holds the session answers with a full
+// handshake, which is timed as one
+static void test_declined_resumption_is_a_full_handshake() {
+  hostSetLink({true, FULL_MS, LINK_LATENCY_US, 0});
+  dropAndReconnect();
+  TEST_ASSERT_FALSE(lastTlsHandshake().resumed);
+  TEST_ASSERT_EQUAL(2, getLatencyHistogram(LAT_TLS_FULL).count);
+  TEST_ASSERT_EQUAL(2, getLatencyHistogram(LAT_TLS_RESUMED).count);
+}
+
+int main() {
+  boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_first_connection_is_a_full_handshake);
+  RUN_TEST(test_reconnect_resumes_the_session);
+  RUN_TEST(test_declined_resumption_is_a_full_handshake);
+  return UNITY_END();
+}
@@ -0,0 +1,224 @@
+// Wiegand decoder tests for MakerPass host builds
+// These tests feed synthetic pulse trains to the decoder's edge
+// handlers through the virtual clock, as a reader would drive the
+// pins, and check framing by silence, the 26-, 34- and 37-bit parity
+// layouts, rejection of damaged frames and of 37-bit codes too wide
+// for a card number, glitch filtering, and the time at which a frame is
+// closed.
+
+#include <unity.h>
+#include "config.h"
+#include "constants.h"
+#include "wiegand_reader.h"
+#include "host_sim.h"
+#include "hal.h"
+
+static const uint8_t READER = 0;
+static const uint32_t BIT_INTERVAL_US = 2000;
+
+struct Layout {
+  uint8_t bits;
+  uint8_t evenLast;
+  uint8_t oddFirst;
+  WiegandFormat format;
+};
+
+static const Layout H10301 = {26, 12, 13, WIEGAND_H10301};
+static const Layout H10306 = {34, 16, 17, WIEGAND_H10306};
+static const Layout H10304 = {37, 18, 18, WIEGAND_H10304};
+
+// Number of set bits among frame positions first..last, counted from
+// the first bit sent
+static uint8_t onesAt(uint64_t frame, uint8_t bits, uint8_t first, uint8_t last) {
+  uint8_t ones = 0;
+  for (uint8_t p = first; p <= last; p++) ones += (frame >> (bits - 1 - p)) & 1;
+  return ones;
+}
+
+// The frame a card sends: the code between an even parity bit in front
+// and an odd parity bit behind
+static uint64_t encode(const Layout &layout, uint64_t code) {
+  uint64_t frame = code << 1;
+  if (onesAt(frame, layout.bits, 1, layout.evenLast) & 1) frame |= 1ULL << (layout.bits - 1);
+  if (!(onesAt(frame, layout.bits, layout.oddFirst, layout.bits - 2) & 1)) frame |= 1;
+  return frame;
+}
+
+// Send a frame starting a little after the present; returns the time
+// of its last bit
+static int64_t send(uint64_t frame, uint8_t bits, uint32_t intervalUs = BIT_INTERVAL_US) {
+  int64_t startUs = halUptimeUs() + 1000;
+  halWiegandFrame(RESOURCES[READER].pinD0, RESOURCES[READER].pinD1, frame, bits, startUs,
+                  intervalUs);
+  return startUs + (int64_t)(bits - 1) * intervalUs;
+}
+
+static bool pollAt(int64_t us, WiegandRead &read) {
+  halSetUptimeUs(us);
+  return pollWiegand(READER, read);
+}
+
+// Poll once the longest frame gap has passed
+static bool settle(int64_t lastBitUs, WiegandRead &read) {
+  return pollAt(lastBitUs + WIEGAND_MAX_GAP_US, read);
+}
+
+void setUp() {
+  // Let anything left by the previous test close
+  WiegandRead read;
+  pollAt(halUptimeUs() + WIEGAND_MAX_GAP_US * 2, read);
+}
+
+void tearDown() {}
+
+static void checkRead(const Layout &layout, uint64_t code) {
+  WiegandRead read;
+  int64_t lastUs = send(encode(layout, code), layout.bits);
+  TEST_ASSERT_TRUE(settle(lastUs, read));
+  TEST_ASSERT_EQUAL(layout.format, read.format);
+  TEST_ASSERT_EQUAL(layout.bits, read.bits);
+  TEST_ASSERT_EQUAL_UINT64(code, read.code);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)lastUs, read.lastEdgeUs);
+}
+
+static void test_26_bit_reads() {
+  checkRead(H10301, 0xA1B2C3);
+  checkRead(H10301, 0x000000);
+  checkRead(H10301, 0xFFFFFF);
+  checkRead(H10301, 0x001000);
+}
+
+static void test_34_bit_reads() {
+  checkRead(H10306, 0x00C0FFEE);
+  checkRead(H10306, 0xFFFFFFFF);
+  checkRead(H10306, 0x80000001);
+}
+
+static void test_37_bit_reads() {
+  checkRead(H10304, 0x12345678);
+  checkRead(H10304, 0xFFFFFFFF);
+
+  WiegandRead read;
+  TEST_ASSERT_TRUE(settle(send(encode(H10304, 0xDEADBEEF), 37), read));
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, wiegandCardNumber(read));
+  TEST_ASSERT_EQUAL_STRING("H10304", wiegandFormatName(read.format));
+}
+
+// A 37-bit code above 32 bits would alias the card with the same low
+// bits, so it is refused rather than cut down
+static void test_37_bit_codes_wider_than_32_bits_are_rejected() {
+  const uint64_t codes[] = {0x7DEADBEEFULL, 1ULL << 32, (1ULL << 35) - 1};
+  for (uint64_t code : codes) {
+    uint32_t tooWide = getWiegandStats(READER).tooWide;
+    uint32_t reads = getWiegandStats(READER).reads;
+    WiegandRead read;
+    TEST_ASSERT_FALSE(settle(send(encode(H10304, code), 37), read));
+    TEST_ASSERT_EQUAL(tooWide + 1, getWiegandStats(READER).tooWide);
+    TEST_ASSERT_EQUAL(reads, getWiegandStats(READER).reads);
+  }
+}
+
+// Every single-bit error, parity bits included, is caught
+static void checkParity(const Layout &layout, uint64_t code) {
+  uint64_t frame = encode(layout, code);
+  for (uint8_t bit = 0; bit < layout.bits; bit++) {
+    uint32_t errors = getWiegandStats(READER).parityErrors;
+    WiegandRead read;
+    TEST_ASSERT_FALSE(settle(send(frame ^ (1ULL << bit), layout.bits), read));
+    TEST_ASSERT_EQUAL(errors + 1, getWiegandStats(READER).parityErrors);
+  }
+}
+
+static void test_26_bit_parity() {
+  checkParity(H10301, 0xA1B2C3);
+}
+
+static void test_34_bit_parity() {
+  checkParity(H10306, 0x00C0FFEE);
+}
+
+static void test_37_bit_parity() {
+  checkParity(H10304, 0x1A2B3C4D5ULL);
+}
+
+static void test_unknown_length_is_rejected() {
+  uint32_t badLength = getWiegandStats(READER).badLength;
+  WiegandRead read;
+  TEST_ASSERT_FALSE(settle(send(0x2AAAAAAAULL, 30), read));
+  TEST_ASSERT_FALSE(settle(send(encode(H10301, 0xA1B2C3) >> 1, 25), read));
+  TEST_ASSERT_EQUAL(badLength + 2, getWiegandStats(READER).badLength);
+}
+
+static void test_ringing_edges_are_dropped() {
+  uint32_t glitches = getWiegandStats(READER).glitches;
+  int64_t lastUs = send(encode(H10301, 0xA1B2C3), 26);
+  // A second pulse 50 us after the tenth bit
+  halScheduleFallingEdge(RESOURCES[READER].pinD1, lastUs - 16 * BIT_INTERVAL_US + 50);
+  WiegandRead read;
+  TEST_ASSERT_TRUE(settle(lastUs, read));
+  TEST_ASSERT_EQUAL_UINT64(0xA1B2C3, read.code);
+  TEST_ASSERT_EQUAL(glitches + 1, getWiegandStats(READER).glitches);
+}
+
+static void test_frames_back_to_back() {
+  // The second card starts 10 ms after the first ends, before the
+  // first has been polled
+  int64_t firstUs = send(encode(H10301, 0x111111), 26);
+  int64_t secondStartUs = firstUs + 10000;
+  halWiegandFrame(RESOURCES[READER].pinD0, RESOURCES[READER].pinD1, encode(H10306, 0x22222222),
+                  34, secondStartUs, BIT_INTERVAL_US);
+  int64_t secondUs = secondStartUs + 33 * BIT_INTERVAL_US;
+
+  WiegandRead read;
+  TEST_ASSERT_TRUE(pollAt(secondUs + WIEGAND_MAX_GAP_US, read));
+  TEST_ASSERT_EQUAL_UINT64(0x111111, read.code);
+  TEST_ASSERT_TRUE(pollWiegand(READER, read));
+  TEST_ASSERT_EQUAL_UINT64(0x22222222, read.code);
+  TEST_ASSERT_FALSE(pollWiegand(READER, read));
+}
+
+// A valid frame closes four bit intervals after its last bit; one that
+// is not valid yet waits the full gap for more bits
+static void test_frame_end_timing() {
+  WiegandRead read;
+  int64_t lastUs = send(encode(H10301, 0xA1B2C3), 26);
+  TEST_ASSERT_FALSE(pollAt(lastUs + 4 * BIT_INTERVAL_US - 1, read));
+  TEST_ASSERT_EQUAL(1, wiegandMsUntilFrameEnd(1000));
+  TEST_ASSERT_TRUE(pollAt(lastUs + 4 * BIT_INTERVAL_US, read));
+
+  lastUs = send(encode(H10301, 0xA1B2C3) ^ 1, 26);
+  TEST_ASSERT_FALSE(pollAt(lastUs + 4 * BIT_INTERVAL_US, read));
+  TEST_ASSERT_FALSE(pollAt(lastUs + WIEGAND_MAX_GAP_US - 1, read));
+  TEST_ASSERT_FALSE(pollAt(lastUs + WIEGAND_MAX_GAP_US, read));
+  TEST_ASSERT_EQUAL(1000, wiegandMsUntilFrameEnd(1000));
+}
+
+// Readers pulse anywhere from every 250 us to every few ms
+static void test_bit_rates() {
+  const uint32_t intervals[] = {250, 1000, 5000};
+  for (uint32_t interval : intervals) {
+    WiegandRead read;
+    int64_t lastUs = send(encode(H10306, 0x00C0FFEE), 34, interval);
+    TEST_ASSERT_TRUE(settle(lastUs, read));
+    TEST_ASSERT_EQUAL_UINT64(0x00C0FFEE, read.code);
+  }
+}
+
+int main() {
+  hostSerialEcho(false);
+  initWiegandReader(READER, RESOURCES[READER].pinD0, RESOURCES[READER].pinD1);
+  UNITY_BEGIN();
+  RUN_TEST(test_26_bit_reads);
+  RUN_TEST(test_34_bit_reads);
+  RUN_TEST(test_37_bit_reads);
+  RUN_TEST(test_37_bit_codes_wider_than_32_bits_are_rejected);
+  RUN_TEST(test_26_bit_parity);
+  RUN_TEST(test_34_bit_parity);
+  RUN_TEST(test_37_bit_parity);
+  RUN_TEST(test_unknown_length_is_rejected);
+  RUN_TEST(test_ringing_edges_are_dropped);
+  RUN_TEST(test_frames_back_to_back);
+  RUN_TEST(test_frame_end_timing);
+  RUN_TEST(test_bit_rates);
+  return UNITY_END();
+}